@@ -21,7 +21,7 @@
 #ifndef VSCONSTANTS4_H
 #define VSCONSTANTS4_H
 
-#if defined(VS_USE_LATEST_API) || defined(VS_USE_API_42)
+#if defined(VS_USE_LATEST_API) || defined(VS_USE_API_43) || defined(VS_USE_API_42)
 
 typedef enum VSRange {
 	VSC_RANGE_FULL = 1,
@@ -26,7 +26,9 @@
 
 #define VS_MAKE_VERSION(major, minor) (((major) << 16) | (minor))
 #define VAPOURSYNTH_API_MAJOR 4
-#if defined(VS_USE_LATEST_API) || defined(VS_USE_API_42)
+#if defined(VS_USE_LATEST_API) || defined(VS_USE_API_43)
+#define VAPOURSYNTH_API_MINOR 3
+#elif defined(VS_USE_API_42)
 #define VAPOURSYNTH_API_MINOR 2
 #elif defined(VS_USE_API_41)
 #define VAPOURSYNTH_API_MINOR 1
@@ -275,6 +277,20 @@ typedef struct VSCoreInfo2 {
     int64_t usedFramebufferSize;
 } VSCoreInfo2;
 
+typedef struct VSCoreMemoryStats {
+    int64_t allocatedBytes; /* same as usedFramebufferSize */
+    int64_t peakAllocatedBytes;
+    int64_t freelistBytes; /* released frame buffers kept around for reuse */
+    int64_t freelistBlocks;
+    int64_t poolHits; /* large allocations served from the freelist */
+    int64_t poolMisses; /* large allocations that had to go to the system allocator */
+    int64_t smallAllocations; /* allocations too small to be pooled */
+    int64_t gcEvictions; /* buffers dropped from the freelist to stay below the max cache size */
+    int64_t gcEvictedBytes;
+    int64_t trimmedBytes; /* memory handed back to the os by trimCoreMemory, idle trimming and the release of buffers that haven't been reused for a long time */
+    int64_t sizeClasses[16]; /* number of allocations by size, the first class is up to 64kB and each following one doubles the bound, the last class counts everything above 1GB */
+} VSCoreMemoryStats;
+
 typedef struct VSVideoInfo {
     VSVideoFormat format;
     int64_t fpsNum;
@@ -535,6 +551,19 @@ struct VSAPI {
     const char *(VS_CC *getNodeCreationPluginID)(VSNode *node, int level) VS_NOEXCEPT; /* level=0 returns the name of the function that created the filter, specifying a higher level will retrieve the function above that invoked it or NULL if a non-existent level is requested */
     const char *(VS_CC *getNodeCreationPluginNS)(VSNode *node, int level) VS_NOEXCEPT; /* level=0 returns the name of the function that created the filter, specifying a higher level will retrieve the function above that invoked it or NULL if a non-existent level is requested */
     const VSMap *(VS_CC *getNodeCreationFunctionArguments)(VSNode *node, int level) VS_NOEXCEPT; /* level=0 returns a copy of the arguments passed to the function that created the filter, returns NULL if a non-existent level is requested */
+#elif VAPOURSYNTH_API_MINOR >= 3
+    void *reservedGraphAPI[4]; /* the graph functions above, keeps the members added in 4.3 at the same offsets without VS_GRAPH_API */
+#endif
+
+    /* Added in API 4.3 */
+#if VAPOURSYNTH_API_MINOR >= 3
+    /* Scratch memory, only usable inside a filter's getframe function and automatically released once it returns */
+    void *(VS_CC *allocScratch)(size_t size, VSFrameContext *frameCtx) VS_NOEXCEPT; /* returns 64 byte aligned memory or NULL if the allocation failed */
+    void (VS_CC *freeScratch)(void *ptr, VSFrameContext *frameCtx) VS_NOEXCEPT; /* optional, only the most recently allocated block can actually be reused */
+
+    void (VS_CC *getCoreMemoryStats)(VSCore *core, VSCoreMemoryStats *stats, int reset) VS_NOEXCEPT; /* non-zero reset clears all counters after reading them and restarts the peak from the current allocation */
+    int64_t (VS_CC *trimCoreMemory)(VSCore *core, int64_t retainBytes) VS_NOEXCEPT; /* frees unused frame buffers kept for reuse until at most retainBytes remain, returns the number of bytes freed */
+    void (VS_CC *prewarmCoreMemory)(VSNode *node, VSCore *core) VS_NOEXCEPT; /* estimates the frame buffers needed to process node and allocates them in the background, call after the output node is known and before requesting frames, a new call cancels prewarming still in progress from the previous one */
 #endif
 #endif
 #endif
@@ -19,207 +19,40 @@
 */
 
 #include <algorithm>
+#include <atomic>
 #include <cstdint>
 #include <cstdlib>
 #include <cmath>
 #include <cfloat>
 #include <cstddef>
+#include <functional>
 #include <limits>
 #include <memory>
+#include <mutex>
 #include <stdexcept>
 #include <vector>
 #include <VapourSynth4.h>
 #include <VSHelper4.h>
+#include "cpufeatures.h"
 #include "filtershared.h"
-#include "float16_helper.h"
 #include "version.h"
+#include "kernel/average.h"
+#include "kernel/cpulevel.h"
 
 namespace {
 
-// ---- plane averaging kernels (AverageFrames) -------------------------------
-// Pure scalar C, written to auto-vectorise: the source count is a compile-time
-// template parameter (AverageFrames caps it at 31) so the reduction unrolls, and
-// __restrict on the row pointers lets the store be proven not to alias the
-// sources. Build this file with -fno-math-errno so lrintf lowers to a vector
-// convert instead of a libcall.
-
-// Round to nearest, ties to even (matches SSE cvtps_epi32).
-static inline int32_t round_nearest_i32(float x)
-{
-#if defined(__aarch64__)
-    // lrintf returns long, so the vectorizer widens through f64 (frintx + fcvtl +
-    // fcvtzs.2d + repack per half). roundevenf keeps 32-bit lanes (frintn + fcvtzs)
-    // and gives the same ties-to-even result independent of the rounding mode.
-    return static_cast<int32_t>(__builtin_roundevenf(x));
-#else
-    return static_cast<int32_t>(std::lrintf(x));
-#endif
-}
-
-template <class T, unsigned N>
-static void average_int_n(const int *weights, const void * const *srcs, void *dst_, int scale, int32_t maxval, int32_t bias, unsigned w, unsigned h, ptrdiff_t stride)
-{
-    float rscale = 1.0f / static_cast<float>(scale);
-
-    for (unsigned i = 0; i < h; ++i) {
-        T *__restrict dst = reinterpret_cast<T *>(static_cast<uint8_t *>(dst_) + static_cast<ptrdiff_t>(i) * stride);
-        const T * __restrict rows[N];
-        for (unsigned k = 0; k < N; ++k)
-            rows[k] = reinterpret_cast<const T *>(static_cast<const uint8_t *>(srcs[k]) + static_cast<ptrdiff_t>(i) * stride);
-
-        for (unsigned j = 0; j < w; ++j) {
-            int32_t accum = 0;
-            for (unsigned k = 0; k < N; ++k)
-                accum += (static_cast<int32_t>(rows[k][j]) - bias) * weights[k];
-
-            int32_t r = round_nearest_i32(static_cast<float>(accum) * rscale) + bias;
-            dst[j] = static_cast<T>(std::min(std::max(r, 0), maxval));
-        }
-    }
-}
-
-template <class T>
-static void average_int_runtime(const int *weights, const void * const *srcs, unsigned num_srcs, void *dst_, int scale, int32_t maxval, int32_t bias, unsigned w, unsigned h, ptrdiff_t stride)
-{
-    float rscale = 1.0f / static_cast<float>(scale);
-
-    for (unsigned i = 0; i < h; ++i) {
-        T *__restrict dst = reinterpret_cast<T *>(static_cast<uint8_t *>(dst_) + static_cast<ptrdiff_t>(i) * stride);
-
-        for (unsigned j = 0; j < w; ++j) {
-            int32_t accum = 0;
-            for (unsigned k = 0; k < num_srcs; ++k) {
-                const T *src = reinterpret_cast<const T *>(static_cast<const uint8_t *>(srcs[k]) + static_cast<ptrdiff_t>(i) * stride);
-                accum += (static_cast<int32_t>(src[j]) - bias) * weights[k];
-            }
-
-            int32_t r = round_nearest_i32(static_cast<float>(accum) * rscale) + bias;
-            dst[j] = static_cast<T>(std::min(std::max(r, 0), maxval));
-        }
-    }
-}
-
-template <unsigned N>
-static void average_float_n(const float *weights, const void * const *srcs, void *dst_, float rscale, unsigned w, unsigned h, ptrdiff_t stride)
-{
-    for (unsigned i = 0; i < h; ++i) {
-        float *__restrict dst = reinterpret_cast<float *>(static_cast<uint8_t *>(dst_) + static_cast<ptrdiff_t>(i) * stride);
-        const float * __restrict rows[N];
-        for (unsigned k = 0; k < N; ++k)
-            rows[k] = reinterpret_cast<const float *>(static_cast<const uint8_t *>(srcs[k]) + static_cast<ptrdiff_t>(i) * stride);
-
-        for (unsigned j = 0; j < w; ++j) {
-            float accum = 0.0f;
-            for (unsigned k = 0; k < N; ++k)
-                accum += rows[k][j] * weights[k];
-            dst[j] = accum * rscale;
-        }
-    }
-}
-
-static void average_float_runtime(const float *weights, const void * const *srcs, unsigned num_srcs, void *dst_, float rscale, unsigned w, unsigned h, ptrdiff_t stride)
-{
-    for (unsigned i = 0; i < h; ++i) {
-        float *__restrict dst = reinterpret_cast<float *>(static_cast<uint8_t *>(dst_) + static_cast<ptrdiff_t>(i) * stride);
-
-        for (unsigned j = 0; j < w; ++j) {
-            float accum = 0.0f;
-            for (unsigned k = 0; k < num_srcs; ++k) {
-                const float *src = reinterpret_cast<const float *>(static_cast<const uint8_t *>(srcs[k]) + static_cast<ptrdiff_t>(i) * stride);
-                accum += src[j] * weights[k];
-            }
-            dst[j] = accum * rscale;
-        }
-    }
-}
-
-template <unsigned N>
-static void average_half_n(const float *weights, const void * const *srcs, void *dst_, float rscale, unsigned w, unsigned h, ptrdiff_t stride)
-{
-    for (unsigned i = 0; i < h; ++i) {
-        uint16_t *__restrict dst = reinterpret_cast<uint16_t *>(static_cast<uint8_t *>(dst_) + static_cast<ptrdiff_t>(i) * stride);
-        const uint16_t * __restrict rows[N];
-        for (unsigned k = 0; k < N; ++k)
-            rows[k] = reinterpret_cast<const uint16_t *>(static_cast<const uint8_t *>(srcs[k]) + static_cast<ptrdiff_t>(i) * stride);
-
-        for (unsigned j = 0; j < w; ++j) {
-            float accum = 0.0f;
-            for (unsigned k = 0; k < N; ++k)
-                accum += halfToFloat(rows[k][j]) * weights[k];
-            dst[j] = floatToHalf(accum * rscale);
-        }
-    }
-}
-
-static void average_half_runtime(const float *weights, const void * const *srcs, unsigned num_srcs, void *dst_, float rscale, unsigned w, unsigned h, ptrdiff_t stride)
-{
-    for (unsigned i = 0; i < h; ++i) {
-        uint16_t *__restrict dst = reinterpret_cast<uint16_t *>(static_cast<uint8_t *>(dst_) + static_cast<ptrdiff_t>(i) * stride);
-
-        for (unsigned j = 0; j < w; ++j) {
-            float accum = 0.0f;
-            for (unsigned k = 0; k < num_srcs; ++k) {
-                const uint16_t *src = reinterpret_cast<const uint16_t *>(static_cast<const uint8_t *>(srcs[k]) + static_cast<ptrdiff_t>(i) * stride);
-                accum += halfToFloat(src[j]) * weights[k];
-            }
-            dst[j] = floatToHalf(accum * rscale);
-        }
-    }
-}
-
-template <class T>
-static void average_int(const int *weights, const void * const *srcs, unsigned num_srcs, void *dst, int scale, unsigned depth, unsigned w, unsigned h, ptrdiff_t stride, bool chroma)
-{
-    int32_t maxval = (1L << depth) - 1;
-    int32_t bias = chroma ? (1L << (depth - 1)) : 0;
-
-#define AVG_CASE(k) case k: average_int_n<T, k>(weights, srcs, dst, scale, maxval, bias, w, h, stride); return;
-    switch (num_srcs) {
-    AVG_CASE(1)  AVG_CASE(2)  AVG_CASE(3)  AVG_CASE(4)  AVG_CASE(5)  AVG_CASE(6)  AVG_CASE(7)  AVG_CASE(8)
-    AVG_CASE(9)  AVG_CASE(10) AVG_CASE(11) AVG_CASE(12) AVG_CASE(13) AVG_CASE(14) AVG_CASE(15) AVG_CASE(16)
-    AVG_CASE(17) AVG_CASE(18) AVG_CASE(19) AVG_CASE(20) AVG_CASE(21) AVG_CASE(22) AVG_CASE(23) AVG_CASE(24)
-    AVG_CASE(25) AVG_CASE(26) AVG_CASE(27) AVG_CASE(28) AVG_CASE(29) AVG_CASE(30) AVG_CASE(31)
-    default: average_int_runtime<T>(weights, srcs, num_srcs, dst, scale, maxval, bias, w, h, stride); return;
-    }
-#undef AVG_CASE
-}
-
-static void average_float(const float *weights, const void * const *srcs, unsigned num_srcs, void *dst, float scale, unsigned w, unsigned h, ptrdiff_t stride)
-{
-    float rscale = 1.0f / scale;
-
-#define AVG_CASE(k) case k: average_float_n<k>(weights, srcs, dst, rscale, w, h, stride); return;
-    switch (num_srcs) {
-    AVG_CASE(1)  AVG_CASE(2)  AVG_CASE(3)  AVG_CASE(4)  AVG_CASE(5)  AVG_CASE(6)  AVG_CASE(7)  AVG_CASE(8)
-    AVG_CASE(9)  AVG_CASE(10) AVG_CASE(11) AVG_CASE(12) AVG_CASE(13) AVG_CASE(14) AVG_CASE(15) AVG_CASE(16)
-    AVG_CASE(17) AVG_CASE(18) AVG_CASE(19) AVG_CASE(20) AVG_CASE(21) AVG_CASE(22) AVG_CASE(23) AVG_CASE(24)
-    AVG_CASE(25) AVG_CASE(26) AVG_CASE(27) AVG_CASE(28) AVG_CASE(29) AVG_CASE(30) AVG_CASE(31)
-    default: average_float_runtime(weights, srcs, num_srcs, dst, rscale, w, h, stride); return;
-    }
-#undef AVG_CASE
-}
-
-static void average_half(const float *weights, const void * const *srcs, unsigned num_srcs, void *dst, float scale, unsigned w, unsigned h, ptrdiff_t stride)
-{
-    float rscale = 1.0f / scale;
-
-#define AVG_CASE(k) case k: average_half_n<k>(weights, srcs, dst, rscale, w, h, stride); return;
-    switch (num_srcs) {
-    AVG_CASE(1)  AVG_CASE(2)  AVG_CASE(3)  AVG_CASE(4)  AVG_CASE(5)  AVG_CASE(6)  AVG_CASE(7)  AVG_CASE(8)
-    AVG_CASE(9)  AVG_CASE(10) AVG_CASE(11) AVG_CASE(12) AVG_CASE(13) AVG_CASE(14) AVG_CASE(15) AVG_CASE(16)
-    AVG_CASE(17) AVG_CASE(18) AVG_CASE(19) AVG_CASE(20) AVG_CASE(21) AVG_CASE(22) AVG_CASE(23) AVG_CASE(24)
-    AVG_CASE(25) AVG_CASE(26) AVG_CASE(27) AVG_CASE(28) AVG_CASE(29) AVG_CASE(30) AVG_CASE(31)
-    default: average_half_runtime(weights, srcs, num_srcs, dst, rscale, w, h, stride); return;
-    }
-#undef AVG_CASE
-}
-
 using namespace std::string_literals;
 using namespace vsh;
 
 ///////////////////////////////////////
 // AverageFrames
 
+struct RunningAccumulator {
+    VSFrame *acc;
+    int n;
+    bool busy;
+};
+
 typedef struct {
     std::vector<int> weights;
     std::vector<float> fweights;
@@ -228,6 +61,14 @@ typedef struct {
     float fscale;
     bool useSceneChange;
     bool process[3];
+    decltype(&vs_average_byte_c) func;
+    // Running sum mode. Every accumulator holds the sum of the window around frame n, or nothing when n is -1.
+    // There's one per frame being processed so each thread can continue the sum of the frame it did last.
+    decltype(&vs_average_running_byte_c) runningFunc;
+    VSVideoFormat accFormat;
+    std::mutex accLock;
+    std::vector<RunningAccumulator> accs;
+    std::atomic<bool> runningWarned;
 } AverageFrameDataExtra;
 
 typedef VariableNodeData<AverageFrameDataExtra> AverageFrameData;
@@ -240,6 +81,23 @@ static const VSFrame *VS_CC averageFramesGetFrame(int n, int activationReason, v
 
     if (activationReason == arInitial) {
         if (singleClipMode) {
+            // The frames leaving the window are needed to continue a running sum from a frame up to maxSteps
+            // before n. With every thread working on the next frame in line, the previous frame of a thread
+            // is about the number of threads back. Moving its sum there costs twice that many frames whatever
+            // the window size, which only beats summing the window while it's less than the window.
+            if (d->runningFunc) {
+                VSCoreInfo ci;
+                vsapi->getCoreInfo(core, &ci);
+                int maxSteps = std::min(static_cast<int>(d->weights.size() - 1) / 2, 2 * ci.numThreads);
+                if (ci.numThreads > maxSteps) {
+                    maxSteps = 0;
+                    if (!d->runningWarned.exchange(true))
+                        vsapi->logMessage(mtWarning, ("AverageFrames: running has no effect with more than " + std::to_string((d->weights.size() - 1) / 2) + " threads, every frame sums the whole window").c_str(), core);
+                }
+                *frameData = reinterpret_cast<void *>(static_cast<intptr_t>(maxSteps));
+                for (int i = std::max(0, n - (int)(d->weights.size() / 2) - maxSteps); i < n - (int)(d->weights.size() / 2); i++)
+                    vsapi->requestFrameFilter(i, d->nodes[0], frameCtx);
+            }
             for (int i = std::max(0, n - (int)(d->weights.size() / 2)); i <= lastframe; i++)
                 vsapi->requestFrameFilter(i, d->nodes[0], frameCtx);
         } else {
@@ -247,21 +105,26 @@ static const VSFrame *VS_CC averageFramesGetFrame(int n, int activationReason, v
                 vsapi->requestFrameFilter(n, iter, frameCtx);
         }
     } else if (activationReason == arAllFramesReady) {
-        std::vector<const VSFrame *> frames(d->weights.size());
+        const size_t numFrames = d->weights.size();
+        const VSFrame **frames = static_cast<const VSFrame **>(vsapi->allocScratch(numFrames * sizeof(const VSFrame *), frameCtx));
+        if (!frames) {
+            vsapi->setFilterError("AverageFrames: failed to allocate scratch memory", frameCtx);
+            return nullptr;
+        }
 
         if (singleClipMode) {
             int fn = n - (int)(d->weights.size() / 2);
-            for (size_t i = 0; i < d->weights.size(); i++) {
+            for (size_t i = 0; i < numFrames; i++) {
                 frames[i] = vsapi->getFrameFilter(std::max(0, fn), d->nodes[0], frameCtx);
                 if (fn < INT_MAX - 1)
                     fn++;
             }
         } else {
-            for (size_t i = 0; i < d->weights.size(); i++)
+            for (size_t i = 0; i < numFrames; i++)
                 frames[i] = vsapi->getFrameFilter(n, d->nodes[i], frameCtx);
         }
 
-        const VSFrame *center = (singleClipMode ? frames[frames.size() / 2] : frames[0]);
+        const VSFrame *center = (singleClipMode ? frames[numFrames / 2] : frames[0]);
         const VSVideoFormat *fi = vsapi->getVideoFrameFormat(center);
 
         const int pl[] = { 0, 1, 2 };
@@ -273,14 +136,22 @@ static const VSFrame *VS_CC averageFramesGetFrame(int n, int activationReason, v
 
         VSFrame *dst = vsapi->newVideoFrame2(fi, vsapi->getFrameWidth(center, 0), vsapi->getFrameHeight(center, 0), fr, pl, center, core);
 
-        std::vector<int> weights(d->weights);
-        std::vector<float> fweights(d->fweights);
+        vs_average_params params = {};
+        params.num_srcs = static_cast<unsigned>(numFrames);
+        std::copy(d->weights.begin(), d->weights.end(), params.weights);
+        std::copy(d->fweights.begin(), d->fweights.end(), params.fweights);
+        params.rscale = (fi->sampleType == stInteger) ? 1.0f / static_cast<float>(d->scale) : 1.0f / d->fscale;
+        params.maxval = (1 << fi->bitsPerSample) - 1;
+
+        int *weights = params.weights;
+        float *fweights = params.fweights;
+        bool weightsModified = false;
 
         if (d->useSceneChange) {
             int fromFrame = 0;
-            int toFrame = static_cast<int>(weights.size());
+            int toFrame = static_cast<int>(numFrames);
 
-            for (int i = static_cast<int>(weights.size()) / 2; i > 0; i--) {
+            for (int i = static_cast<int>(numFrames) / 2; i > 0; i--) {
                 const VSMap *props = vsapi->getFramePropertiesRO(frames[i]);
                 int err;
                 if (vsapi->mapGetInt(props, "_SceneChangePrev", 0, &err)) {
@@ -289,7 +160,7 @@ static const VSFrame *VS_CC averageFramesGetFrame(int n, int activationReason, v
                 }
             }
 
-            for (int i = static_cast<int>(weights.size()) / 2; i < static_cast<int>(weights.size()) - 1; i++) {
+            for (int i = static_cast<int>(numFrames) / 2; i < static_cast<int>(numFrames) - 1; i++) {
                 const VSMap *props = vsapi->getFramePropertiesRO(frames[i]);
                 int err;
                 if (vsapi->mapGetInt(props, "_SceneChangeNext", 0, &err)) {
@@ -298,10 +169,12 @@ static const VSFrame *VS_CC averageFramesGetFrame(int n, int activationReason, v
                 }
             }
 
+            weightsModified = (fromFrame > 0 || toFrame < static_cast<int>(numFrames) - 1);
+
             if (fi->sampleType == stInteger) {
                 int acc = 0;
 
-                for (int i = toFrame + 1; i < static_cast<int>(weights.size()); i++) {
+                for (int i = toFrame + 1; i < static_cast<int>(numFrames); i++) {
                     acc += weights[i];
                     weights[i] = 0;
                 }
@@ -311,11 +184,11 @@ static const VSFrame *VS_CC averageFramesGetFrame(int n, int activationReason, v
                     weights[i] = 0;
                 }
 
-                weights[weights.size() / 2] += acc;
+                weights[numFrames / 2] += acc;
             } else {
                 float acc = 0;
 
-                for (int i = toFrame + 1; i < static_cast<int>(fweights.size()); i++) {
+                for (int i = toFrame + 1; i < static_cast<int>(numFrames); i++) {
                     acc += fweights[i];
                     fweights[i] = 0;
                 }
@@ -325,38 +198,96 @@ static const VSFrame *VS_CC averageFramesGetFrame(int n, int activationReason, v
                     fweights[i] = 0;
                 }
 
-                fweights[fweights.size() / 2] += acc;
+                fweights[numFrames / 2] += acc;
             }
         }
 
+        // The running sum can only be used while the window has its uniform weights
+        int maxSteps = static_cast<int>(reinterpret_cast<intptr_t>(*frameData));
+        bool running = maxSteps > 0 && !clamp && !weightsModified;
+        RunningAccumulator slot = {};
+        size_t accIndex = 0;
+        int steps = 0;
+
+        if (running) {
+            std::lock_guard<std::mutex> lock(d->accLock);
+
+            // Continue the closest sum before n, otherwise start over in the least recently used accumulator
+            bool found = false;
+            for (size_t i = 0; i < d->accs.size(); i++) {
+                const RunningAccumulator &a = d->accs[i];
+                if (!a.busy && a.n >= 0 && a.n < n && a.n >= n - maxSteps && (!found || a.n > d->accs[accIndex].n)) {
+                    accIndex = i;
+                    found = true;
+                }
+            }
+
+            if (found) {
+                steps = n - d->accs[accIndex].n;
+            } else if (d->accs.size() <= static_cast<size_t>(maxSteps)) {
+                accIndex = d->accs.size();
+                d->accs.push_back({ nullptr, -1, false });
+                found = true;
+            } else {
+                for (size_t i = 0; i < d->accs.size(); i++) {
+                    if (!d->accs[i].busy && (!found || d->accs[i].n < d->accs[accIndex].n)) {
+                        accIndex = i;
+                        found = true;
+                    }
+                }
+            }
+
+            if (found) {
+                d->accs[accIndex].busy = true;
+                slot = d->accs[accIndex];
+            } else {
+                running = false;
+            }
+        }
+
+        if (running && !slot.acc) {
+            // Padded so the kernels can process whole vectors of every plane
+            int accWidth = ((d->vi.width + (32 << d->accFormat.subSamplingW) - 1) / (32 << d->accFormat.subSamplingW)) * (32 << d->accFormat.subSamplingW);
+            slot.acc = vsapi->newVideoFrame(&d->accFormat, accWidth, d->vi.height, nullptr, core);
+        }
+
+        // Going from the window of frame n - steps to that of frame n removes its first steps frames
+        const VSFrame *leaving[VS_AVERAGE_MAX_SRCS / 2] = {};
+        for (int i = 0; i < steps; i++)
+            leaving[i] = vsapi->getFrameFilter(std::max(0, n - (int)(numFrames / 2) - steps + i), d->nodes[0], frameCtx);
+
         for (int plane = 0; plane < fi->numPlanes; plane++) {
             if (!d->process[plane])
                 continue;
 
             bool chroma = (plane == 1 || plane == 2) && fi->colorFamily == cfYUV;
+            params.bias = (chroma && fi->sampleType == stInteger) ? (1 << (fi->bitsPerSample - 1)) : 0;
 
-            const void *src_ptrs[32];
-            for (unsigned n = 0; n < frames.size(); ++n)
+            const void *src_ptrs[VS_AVERAGE_MAX_SRCS];
+            for (unsigned n = 0; n < numFrames; ++n)
                 src_ptrs[n] = vsapi->getReadPtr(frames[n], plane);
 
-            unsigned num = static_cast<unsigned>(frames.size());
-            void *dstp = vsapi->getWritePtr(dst, plane);
-            unsigned pw = vsapi->getFrameWidth(dst, plane);
-            unsigned ph = vsapi->getFrameHeight(dst, plane);
-            ptrdiff_t pstride = vsapi->getStride(dst, plane);
-
-            if (fi->bytesPerSample == 1)
-                average_int<uint8_t>(weights.data(), src_ptrs, num, dstp, static_cast<int>(d->scale), fi->bitsPerSample, pw, ph, pstride, chroma);
-            else if (fi->sampleType == stInteger && fi->bytesPerSample == 2)
-                average_int<uint16_t>(weights.data(), src_ptrs, num, dstp, static_cast<int>(d->scale), fi->bitsPerSample, pw, ph, pstride, chroma);
-            else if (fi->bytesPerSample == 2)
-                average_half(fweights.data(), src_ptrs, num, dstp, d->fscale, pw, ph, pstride);
+            const void *sub_ptrs[VS_AVERAGE_MAX_SRCS / 2];
+            for (int i = 0; i < steps; i++)
+                sub_ptrs[i] = vsapi->getReadPtr(leaving[i], plane);
+
+            if (steps)
+                d->runningFunc(src_ptrs + numFrames - steps, static_cast<unsigned>(steps), sub_ptrs, static_cast<unsigned>(steps), vsapi->getWritePtr(slot.acc, plane), vsapi->getStride(slot.acc, plane), vsapi->getWritePtr(dst, plane), vsapi->getStride(dst, plane), &params, vsapi->getFrameWidth(dst, plane), vsapi->getFrameHeight(dst, plane));
+            else if (running)
+                d->runningFunc(src_ptrs, static_cast<unsigned>(numFrames), nullptr, 0, vsapi->getWritePtr(slot.acc, plane), vsapi->getStride(slot.acc, plane), vsapi->getWritePtr(dst, plane), vsapi->getStride(dst, plane), &params, vsapi->getFrameWidth(dst, plane), vsapi->getFrameHeight(dst, plane));
             else
-                average_float(fweights.data(), src_ptrs, num, dstp, d->fscale, pw, ph, pstride);
+                d->func(src_ptrs, vsapi->getWritePtr(dst, plane), vsapi->getStride(dst, plane), &params, vsapi->getFrameWidth(dst, plane), vsapi->getFrameHeight(dst, plane));
+        }
+
+        if (running) {
+            std::lock_guard<std::mutex> lock(d->accLock);
+            d->accs[accIndex] = { slot.acc, n, false };
         }
 
-        for (auto iter : frames)
-            vsapi->freeFrame(iter);
+        for (int i = 0; i < steps; i++)
+            vsapi->freeFrame(leaving[i]);
+        for (size_t i = 0; i < numFrames; i++)
+            vsapi->freeFrame(frames[i]);
 
         return dst;
     }
@@ -364,6 +295,13 @@ static const VSFrame *VS_CC averageFramesGetFrame(int n, int activationReason, v
     return nullptr;
 }
 
+static void VS_CC averageFramesFree(void *instanceData, VSCore *core, const VSAPI *vsapi) {
+    AverageFrameData *d = static_cast<AverageFrameData *>(instanceData);
+    for (const auto &iter : d->accs)
+        vsapi->freeFrame(iter.acc);
+    delete d;
+}
+
 static void VS_CC averageFramesCreate(const VSMap *in, VSMap *out, void *userData, VSCore *core, const VSAPI *vsapi) {
     std::unique_ptr<AverageFrameData> d(new AverageFrameData(vsapi));
     int numNodes = vsapi->mapNumElements(in, "clips");
@@ -378,7 +316,7 @@ static void VS_CC averageFramesCreate(const VSMap *in, VSMap *out, void *userDat
             throw std::runtime_error("Number of weights must match number of clips supplied");
         }
 
-        if (numWeights > 31 || numNodes > 31) {
+        if (numWeights > VS_AVERAGE_MAX_SRCS || numNodes > VS_AVERAGE_MAX_SRCS) {
             throw std::runtime_error("Must use between 1 and 31 weights and input clips");
         }
 
@@ -452,6 +390,69 @@ static void VS_CC averageFramesCreate(const VSMap *in, VSMap *out, void *userDat
 
         getPlanesArg(in, d->process, vsapi);
 
+        bool running = !!vsapi->mapGetInt(in, "running", 0, &err);
+        if (running && numNodes != 1)
+            throw std::runtime_error("Running can only be used in single clip mode");
+        if (running && std::adjacent_find(d->fweights.begin(), d->fweights.end(), std::not_equal_to<float>()) != d->fweights.end())
+            throw std::runtime_error("Running requires all weights to be equal");
+
+        const VSVideoFormat &f = d->vi.format;
+        int cpulevel = vs_get_cpulevel(core);
+        d->func = nullptr;
+#ifdef VS_TARGET_CPU_X86
+        if (getCPUFeatures()->avx512 && cpulevel >= VS_CPU_LEVEL_AVX512) {
+            if (f.sampleType == stInteger && f.bytesPerSample == 1)
+                d->func = vs_average_byte_avx512;
+            else if (f.sampleType == stInteger && f.bytesPerSample == 2)
+                d->func = vs_average_word_avx512;
+            else if (f.sampleType == stFloat && f.bytesPerSample == 4)
+                d->func = vs_average_float_avx512;
+            else if (f.sampleType == stFloat && f.bytesPerSample == 2)
+                d->func = vs_average_half_avx512;
+        }
+        if (!d->func && getCPUFeatures()->avx2 && cpulevel >= VS_CPU_LEVEL_AVX2) {
+            if (f.sampleType == stInteger && f.bytesPerSample == 1)
+                d->func = vs_average_byte_avx2;
+            else if (f.sampleType == stInteger && f.bytesPerSample == 2)
+                d->func = vs_average_word_avx2;
+            else if (f.sampleType == stFloat && f.bytesPerSample == 4)
+                d->func = vs_average_float_avx2;
+            else if (f.sampleType == stFloat && f.bytesPerSample == 2)
+                d->func = vs_average_half_avx2;
+        }
+        if (!d->func && cpulevel >= VS_CPU_LEVEL_SSE2) {
+            if (f.sampleType == stInteger && f.bytesPerSample == 1)
+                d->func = vs_average_byte_sse2;
+            else if (f.sampleType == stInteger && f.bytesPerSample == 2)
+                d->func = vs_average_word_sse2;
+            else if (f.sampleType == stFloat && f.bytesPerSample == 4)
+                d->func = vs_average_float_sse2;
+        }
+#endif
+        if (!d->func) {
+            if (f.sampleType == stInteger && f.bytesPerSample == 1)
+                d->func = vs_average_byte_c;
+            else if (f.sampleType == stInteger && f.bytesPerSample == 2)
+                d->func = vs_average_word_c;
+            else if (f.sampleType == stFloat && f.bytesPerSample == 4)
+                d->func = vs_average_float_c;
+            else
+                d->func = vs_average_half_c;
+        }
+
+        // Float sums can't be updated without accumulating rounding errors so they're always recomputed
+        d->runningFunc = nullptr;
+        if (running && f.sampleType == stInteger) {
+#ifdef VS_TARGET_CPU_X86
+            if (getCPUFeatures()->avx2 && cpulevel >= VS_CPU_LEVEL_AVX2)
+                d->runningFunc = (f.bytesPerSample == 1) ? vs_average_running_byte_avx2 : vs_average_running_word_avx2;
+            else if (cpulevel >= VS_CPU_LEVEL_SSE2)
+                d->runningFunc = (f.bytesPerSample == 1) ? vs_average_running_byte_sse2 : vs_average_running_word_sse2;
+#endif
+            if (!d->runningFunc)
+                d->runningFunc = (f.bytesPerSample == 1) ? vs_average_running_byte_c : vs_average_running_word_c;
+            vsapi->queryVideoFormat(&d->accFormat, f.colorFamily, stInteger, 32, f.subSamplingW, f.subSamplingH, core);
+        }
     } catch (const std::runtime_error &e) {
         vsapi->mapSetError(out, ("AverageFrames: "s + e.what()).c_str());
         return;
@@ -464,7 +465,7 @@ static void VS_CC averageFramesCreate(const VSMap *in, VSMap *out, void *userDat
         for (int i = 0; i < numNodes; i++)
             deps.push_back({d->nodes[i], (vsapi->getVideoInfo(d->nodes[i])->numFrames >= d->vi.numFrames) ? rpStrictSpatial : rpFrameReuseLastOnly });
     }
-    vsapi->createVideoFilter(out, "AverageFrames", &d->vi, averageFramesGetFrame, filterFree<AverageFrameData>, fmParallel, deps.data(), numNodes, d.get(), core);
+    vsapi->createVideoFilter(out, "AverageFrames", &d->vi, averageFramesGetFrame, averageFramesFree, fmParallel, deps.data(), numNodes, d.get(), core);
     d.release();
 }
 
@@ -474,5 +475,5 @@ static void VS_CC averageFramesCreate(const VSMap *in, VSMap *out, void *userDat
 // Init
 
 void averageFramesInitialize(VSPlugin *plugin, const VSPLUGINAPI *vspapi) {
-    vspapi->registerFunction("AverageFrames", "clips:vnode[];weights:float[];scale:float:opt;scenechange:int:opt;planes:int[]:opt;", "clip:vnode;", averageFramesCreate, 0, plugin);
+    vspapi->registerFunction("AverageFrames", "clips:vnode[];weights:float[];scale:float:opt;scenechange:int:opt;planes:int[]:opt;running:int:opt;", "clip:vnode;", averageFramesCreate, 0, plugin);
 }
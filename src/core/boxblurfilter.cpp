@@ -18,6 +18,7 @@
 * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
 */
 
+#include <cassert>
 #include <memory>
 #include <algorithm>
 #include <stdexcept>
@@ -25,8 +26,12 @@
 #include <vector>
 #include "internalfilters.h"
 #include "VSHelper4.h"
+#include "cpufeatures.h"
 #include "filtershared.h"
 #include "float16_helper.h"
+#include "kernel/boxblur.h"
+#include "kernel/cpulevel.h"
+#include "kernel/transpose.h"
 
 using namespace std::string_literals;
 
@@ -35,7 +40,10 @@ using namespace std::string_literals;
 
 struct BoxBlurData {
     VSNode *node;
-    int radius, passes;
+    int hradius, hpasses, vradius, vpasses;
+    decltype(&vs_boxblur_v_byte_c) blurV;
+    // Set when blurV is a SIMD kernel, the horizontal passes then run it on transposed bands of rows
+    decltype(&vs_transpose_plane_byte_c) transpose;
 };
 
 /*
@@ -493,6 +501,79 @@ static void processPlaneR1F_half(const uint8_t *src, uint8_t *dst, ptrdiff_t str
     }
 }
 
+static vs_boxblur_params boxBlurParams(int radius, int pass) {
+    const unsigned div = radius * 2 + 1;
+    const FastDivU32 fd = makeFastDivU32(div);
+    vs_boxblur_params params = {};
+    params.radius = radius;
+    params.round = (pass & 1) ? 0 : div - 1;
+    params.div_magic = fd.magic;
+    params.div_shift = fd.shift;
+    params.div_add = fd.add;
+    params.div = 1.0f / div;
+    return params;
+}
+
+static bool blurPlaneH(const BoxBlurData *d, const VSVideoFormat *fi, const uint8_t *srcp, uint8_t *dstp, ptrdiff_t stride, int w, int h, VSFrameContext *frameCtx, const VSAPI *vsapi) {
+    int bytesPerSample = fi->bytesPerSample;
+    int radius = d->hradius;
+    int passes = d->hpasses;
+
+    if (d->transpose) {
+        // Bands of 64 bytes worth of rows are transposed into a buffer that stays in cache, so the
+        // running sums of all rows in the band are computed at once by the vertical kernel
+        const int band = 64 / bytesPerSample;
+        uint8_t *buf[2] = {
+            static_cast<uint8_t *>(vsapi->allocScratch(64 * w, frameCtx)),
+            static_cast<uint8_t *>(vsapi->allocScratch(64 * w, frameCtx))
+        };
+        uint8_t *acc = static_cast<uint8_t *>(vsapi->allocScratch(band * 4, frameCtx));
+        if (!buf[0] || !buf[1] || !acc)
+            return false;
+
+        for (int y = 0; y < h; y += band) {
+            int rows = std::min(band, h - y);
+            d->transpose(srcp + y * stride, stride, buf[0], 64, w, rows);
+            int cur = 0;
+            for (int p = 0; p < passes; p++) {
+                vs_boxblur_params params = boxBlurParams(radius, p);
+                d->blurV(buf[cur], 64, buf[cur ^ 1], 64, acc, &params, rows, w);
+                cur ^= 1;
+            }
+            d->transpose(buf[cur], 64, dstp + y * stride, stride, rows, w);
+        }
+        return true;
+    }
+
+    // the radius 1 fast path reads three pixels unconditionally so narrower planes are
+    // routed through the general clamped path instead
+    bool useR1 = radius == 1 && w >= 3;
+    uint8_t *ring = (!useR1 && passes > 1) ? static_cast<uint8_t *>(vsapi->allocScratch(bytesPerSample * std::min(radius + 1, w), frameCtx)) : nullptr;
+    if (!useR1 && passes > 1 && !ring)
+        return false;
+
+    if (useR1) {
+        if (bytesPerSample == 1)
+            processPlaneR1<uint8_t>(srcp, dstp, stride, w, h, passes);
+        else if (fi->sampleType == stInteger && bytesPerSample == 2)
+            processPlaneR1<uint16_t>(srcp, dstp, stride, w, h, passes);
+        else if (bytesPerSample == 2)
+            processPlaneR1F_half(srcp, dstp, stride, w, h, passes);
+        else
+            processPlaneR1F<float>(srcp, dstp, stride, w, h, passes);
+    } else {
+        if (bytesPerSample == 1)
+            processPlane<uint8_t>(srcp, dstp, stride, w, h, passes, radius, ring);
+        else if (fi->sampleType == stInteger && bytesPerSample == 2)
+            processPlane<uint16_t>(srcp, dstp, stride, w, h, passes, radius, ring);
+        else if (bytesPerSample == 2)
+            processPlaneF_half(srcp, dstp, stride, w, h, passes, radius, ring);
+        else
+            processPlaneF<float>(srcp, dstp, stride, w, h, passes, radius, ring);
+    }
+    return true;
+}
+
 static const VSFrame *VS_CC boxBlurGetframe(int n, int activationReason, void *instanceData, void **frameData, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi) {
     BoxBlurData *d = reinterpret_cast<BoxBlurData *>(instanceData);
 
@@ -502,8 +583,6 @@ static const VSFrame *VS_CC boxBlurGetframe(int n, int activationReason, void *i
         const VSFrame *src = vsapi->getFrameFilter(n, d->node, frameCtx);
         const VSVideoFormat *fi = vsapi->getVideoFrameFormat(src);
         VSFrame *dst = vsapi->newVideoFrame(fi, vsapi->getFrameWidth(src, 0), vsapi->getFrameHeight(src, 0), src, core);
-        int bytesPerSample = fi->bytesPerSample;
-        int radius = d->radius;
 
         const uint8_t *srcp = vsapi->getReadPtr(src, 0);
         ptrdiff_t stride = vsapi->getStride(src, 0);
@@ -511,32 +590,46 @@ static const VSFrame *VS_CC boxBlurGetframe(int n, int activationReason, void *i
         int h = vsapi->getFrameHeight(src, 0);
         int w = vsapi->getFrameWidth(src, 0);
 
-        // the radius 1 fast path reads three pixels unconditionally so narrower planes are
-        // routed through the general clamped path instead
-        bool useR1 = radius == 1 && w >= 3;
-        uint8_t *ring = (!useR1 && d->passes > 1) ? new uint8_t[bytesPerSample * std::min(radius + 1, w)] : nullptr;
-
-        if (useR1) {
-            if (bytesPerSample == 1)
-                processPlaneR1<uint8_t>(srcp, dstp, stride, w, h, d->passes);
-            else if (fi->sampleType == stInteger && bytesPerSample == 2)
-                processPlaneR1<uint16_t>(srcp, dstp, stride, w, h, d->passes);
-            else if (bytesPerSample == 2)
-                processPlaneR1F_half(srcp, dstp, stride, w, h, d->passes);
-            else
-                processPlaneR1F<float>(srcp, dstp, stride, w, h, d->passes);
+        VSFrame *tmp = nullptr;
+        bool ok = true;
+        if (!d->vpasses) {
+            ok = blurPlaneH(d, fi, srcp, dstp, stride, w, h, frameCtx, vsapi);
         } else {
-            if (bytesPerSample == 1)
-                processPlane<uint8_t>(srcp, dstp, stride, w, h, d->passes, radius, ring);
-            else if (fi->sampleType == stInteger && bytesPerSample == 2)
-                processPlane<uint16_t>(srcp, dstp, stride, w, h, d->passes, radius, ring);
-            else if (bytesPerSample == 2)
-                processPlaneF_half(srcp, dstp, stride, w, h, d->passes, radius, ring);
-            else
-                processPlaneF<float>(srcp, dstp, stride, w, h, d->passes, radius, ring);
+            // The vertical passes can't work in place so they alternate between dst and a
+            // temporary plane, starting with whichever one makes the last pass end in dst.
+            // The temporary plane is a frame of the same single plane format so it has the same
+            // stride and comes from the frame buffer pool instead of the scratch arena.
+            int passes = d->vpasses;
+            bool needTmp = (d->hpasses && (passes & 1)) || passes > 1;
+            tmp = needTmp ? vsapi->newVideoFrame(fi, w, h, nullptr, core) : nullptr;
+            uint8_t *tmpp = tmp ? vsapi->getWritePtr(tmp, 0) : nullptr;
+            assert(!tmp || vsapi->getStride(tmp, 0) == stride);
+            void *acc = vsapi->allocScratch(((w + 63) & ~63) * 4, frameCtx);
+            ok = !!acc;
+            const uint8_t *vsrcp = srcp;
+
+            if (ok && d->hpasses) {
+                uint8_t *hdstp = (passes & 1) ? tmpp : dstp;
+                ok = blurPlaneH(d, fi, srcp, hdstp, stride, w, h, frameCtx, vsapi);
+                vsrcp = hdstp;
+            }
+
+            for (int p = 0; ok && p < passes; p++) {
+                vs_boxblur_params params = boxBlurParams(d->vradius, p);
+                uint8_t *vdstp = ((passes - 1 - p) & 1) ? tmpp : dstp;
+                d->blurV(vsrcp, stride, vdstp, stride, acc, &params, w, h);
+                vsrcp = vdstp;
+            }
         }
 
-        delete[] ring;
+        vsapi->freeFrame(tmp);
+
+        if (!ok) {
+            vsapi->setFilterError("BoxBlur: failed to allocate scratch memory", frameCtx);
+            vsapi->freeFrame(src);
+            vsapi->freeFrame(dst);
+            return nullptr;
+        }
 
         vsapi->freeFrame(src);
         return dst;
@@ -551,32 +644,56 @@ static void VS_CC boxBlurFree(void *instanceData, VSCore *core, const VSAPI *vsa
     delete d;
 }
 
-static VSNode *applyBoxBlurPlaneFiltering(VSPlugin *stdplugin, VSNode *node, int hradius, int hpasses, int vradius, int vpasses, VSCore *core, const VSAPI *vsapi) {
+static VSNode *applyBoxBlurPlaneFiltering(VSNode *node, int hradius, int hpasses, int vradius, int vpasses, VSCore *core, const VSAPI *vsapi) {
     bool hblur = (hradius > 0) && (hpasses > 0);
     bool vblur = (vradius > 0) && (vpasses > 0);
 
-    if (hblur) {
-        VSFilterDependency deps[] = {{node, rpStrictSpatial}};
-        node = vsapi->createVideoFilter2("BoxBlur", vsapi->getVideoInfo(node), boxBlurGetframe, boxBlurFree, fmParallel, deps, 1, new BoxBlurData{node, hradius, hpasses}, core);
-    }
-
-    if (vblur) {
-        VSMap *vtmp1 = vsapi->createMap();
-        vsapi->mapConsumeNode(vtmp1, "clip", node, maAppend);
-        VSMap *vtmp2 = vsapi->invoke(stdplugin, "Transpose", vtmp1);
-        vsapi->clearMap(vtmp1);
-        node = vsapi->mapGetNode(vtmp2, "clip", 0, nullptr);
-        vsapi->clearMap(vtmp2);
-        VSFilterDependency deps[] = {{node, rpStrictSpatial}};
-        vsapi->createVideoFilter(vtmp2, "BoxBlur", vsapi->getVideoInfo(node), boxBlurGetframe, boxBlurFree, fmParallel, deps, 1, new BoxBlurData{ node, vradius, vpasses }, core);
-        vsapi->freeMap(vtmp1);
-        vtmp1 = vsapi->invoke(stdplugin, "Transpose", vtmp2);
-        vsapi->freeMap(vtmp2);
-        node = vsapi->mapGetNode(vtmp1, "clip", 0, nullptr);
-        vsapi->freeMap(vtmp1);
-    }
-
-    return node;
+    const VSVideoFormat &f = vsapi->getVideoInfo(node)->format;
+    int cpulevel = vs_get_cpulevel(core);
+    decltype(&vs_boxblur_v_byte_c) blurV = nullptr;
+    decltype(&vs_transpose_plane_byte_c) transpose = nullptr;
+#ifdef VS_TARGET_CPU_X86
+    if (getCPUFeatures()->avx2 && cpulevel >= VS_CPU_LEVEL_AVX2) {
+        if (f.sampleType == stInteger && f.bytesPerSample == 1)
+            blurV = vs_boxblur_v_byte_avx2;
+        else if (f.sampleType == stInteger && f.bytesPerSample == 2)
+            blurV = vs_boxblur_v_word_avx2;
+        else if (f.sampleType == stFloat && f.bytesPerSample == 4)
+            blurV = vs_boxblur_v_float_avx2;
+        else if (f.sampleType == stFloat && f.bytesPerSample == 2)
+            blurV = vs_boxblur_v_half_avx2;
+    }
+    if (!blurV && cpulevel >= VS_CPU_LEVEL_SSE2) {
+        if (f.sampleType == stInteger && f.bytesPerSample == 1)
+            blurV = vs_boxblur_v_byte_sse2;
+        else if (f.sampleType == stInteger && f.bytesPerSample == 2)
+            blurV = vs_boxblur_v_word_sse2;
+        else if (f.sampleType == stFloat && f.bytesPerSample == 4)
+            blurV = vs_boxblur_v_float_sse2;
+    }
+    if (blurV) {
+        if (f.bytesPerSample == 1)
+            transpose = vs_transpose_plane_byte_sse2;
+        else if (f.bytesPerSample == 2)
+            transpose = vs_transpose_plane_word_sse2;
+        else
+            transpose = vs_transpose_plane_dword_sse2;
+    }
+#endif
+    if (!blurV) {
+        if (f.sampleType == stInteger && f.bytesPerSample == 1)
+            blurV = vs_boxblur_v_byte_c;
+        else if (f.sampleType == stInteger && f.bytesPerSample == 2)
+            blurV = vs_boxblur_v_word_c;
+        else if (f.sampleType == stFloat && f.bytesPerSample == 4)
+            blurV = vs_boxblur_v_float_c;
+        else
+            blurV = vs_boxblur_v_half_c;
+    }
+
+    BoxBlurData *d = new BoxBlurData{ node, hblur ? hradius : 0, hblur ? hpasses : 0, vblur ? vradius : 0, vblur ? vpasses : 0, blurV, transpose };
+    VSFilterDependency deps[] = {{node, rpStrictSpatial}};
+    return vsapi->createVideoFilter2("BoxBlur", vsapi->getVideoInfo(node), boxBlurGetframe, boxBlurFree, fmParallel, deps, 1, d, core);
 }
 
 static void VS_CC boxBlurCreate(const VSMap *in, VSMap *out, void *userData, VSCore *core, const VSAPI *vsapi) {
@@ -626,7 +743,7 @@ static void VS_CC boxBlurCreate(const VSMap *in, VSMap *out, void *userData, VSC
         VSPlugin *stdplugin = vsapi->getPluginByID(VSH_STD_PLUGIN_ID, core);
 
         if (vi->format.numPlanes == 1) {
-            VSNode *tmpnode = applyBoxBlurPlaneFiltering(stdplugin, node, hradius, hpasses, vradius, vpasses, core, vsapi);
+            VSNode *tmpnode = applyBoxBlurPlaneFiltering(node, hradius, hpasses, vradius, vpasses, core, vsapi);
             node = nullptr;
             vsapi->mapSetNode(out, "clip", tmpnode, maAppend);
             vsapi->freeNode(tmpnode);
@@ -646,7 +763,7 @@ static void VS_CC boxBlurCreate(const VSMap *in, VSMap *out, void *userData, VSC
                     vsapi->freeMap(vtmp1);
                     VSNode *tmpnode = vsapi->mapGetNode(vtmp2, "clip", 0, nullptr);
                     vsapi->freeMap(vtmp2);
-                    tmpnode = applyBoxBlurPlaneFiltering(stdplugin, tmpnode, hradius, hpasses, vradius, vpasses, core, vsapi);
+                    tmpnode = applyBoxBlurPlaneFiltering(tmpnode, hradius, hpasses, vradius, vpasses, core, vsapi);
                     vsapi->mapConsumeNode(mergeargs, "clips", tmpnode, maAppend);
                 } else {
                     vsapi->mapSetNode(mergeargs, "clips", node, maAppend);
@@ -160,6 +160,36 @@ std::vector<std::string_view> tokenize(const std::string &expr)
     return tokens;
 }
 
+// x[dx,dy] with an optional :c (clamp, the default) or :m (mirror) edge mode suffix.
+ExprOp decodeNeighbourLoad(std::string_view token)
+{
+    const char *end = token.data() + token.size();
+    int dx = 0;
+    int dy = 0;
+    EdgeMode mode = EdgeMode::CLAMP;
+
+    auto result = std::from_chars(token.data() + 2, end, dx);
+    if (result.ec != std::errc() || result.ptr == end || *result.ptr != ',')
+        throw std::runtime_error("illegal token: " + std::string{ token });
+    result = std::from_chars(result.ptr + 1, end, dy);
+    if (result.ec != std::errc() || result.ptr == end || *result.ptr != ']')
+        throw std::runtime_error("illegal token: " + std::string{ token });
+
+    std::string_view suffix{ result.ptr + 1, static_cast<size_t>(end - result.ptr - 1) };
+    if (suffix == ":m")
+        mode = EdgeMode::MIRROR;
+    else if (!suffix.empty() && suffix != ":c")
+        throw std::runtime_error("illegal token: " + std::string{ token });
+
+    if (dx < -127 || dx > 127 || dy < -127 || dy > 127)
+        throw std::runtime_error("pixel offsets must be between -127 and 127: " + std::string{ token });
+    if (dx == 0 && dy == 0)
+        mode = EdgeMode::CLAMP;
+
+    int input = token[0] >= 'x' ? token[0] - 'x' : token[0] - 'a' + 3;
+    return{ ExprOpType::MEM_LOAD_U8, makeLoadImm(input, dx, dy, mode) };
+}
+
 ExprOp decodeToken(std::string_view token)
 {
     static const std::unordered_map<std::string_view, ExprOp> simple{
@@ -188,6 +218,11 @@ ExprOp decodeToken(std::string_view token)
         { "cos",  { ExprOpType::COS } },
         { "dup",  { ExprOpType::DUP, 0 } },
         { "swap", { ExprOpType::SWAP, 1 } },
+        { "X",      { ExprOpType::COORD_X } },
+        { "Y",      { ExprOpType::RUNTIME_CONST, static_cast<int>(RC_Y) } },
+        { "N",      { ExprOpType::RUNTIME_CONST, static_cast<int>(RC_N) } },
+        { "width",  { ExprOpType::RUNTIME_CONST, static_cast<int>(RC_WIDTH) } },
+        { "height", { ExprOpType::RUNTIME_CONST, static_cast<int>(RC_HEIGHT) } },
     };
 
     auto it = simple.find(token);
@@ -195,6 +230,8 @@ ExprOp decodeToken(std::string_view token)
         return it->second;
     } else if (token.size() == 1 && token[0] >= 'a' && token[0] <= 'z') {
         return{ ExprOpType::MEM_LOAD_U8, token[0] >= 'x' ? token[0] - 'x' : token[0] - 'a' + 3 };
+    } else if (token.size() > 2 && token[0] >= 'a' && token[0] <= 'z' && token[1] == '[') {
+        return decodeNeighbourLoad(token);
     } else if (token.substr(0, 3) == "dup" || token.substr(0, 4) == "swap") {
         size_t prefix = token[0] == 'd' ? 3 : 4;
         int idx = -1;
@@ -217,7 +254,14 @@ ExprOp decodeToken(std::string_view token)
     }
 }
 
-ExpressionTree parseExpr(const std::string &expr, const VSVideoInfo * const srcFormats[], int numInputs)
+bool isVariableName(std::string_view name)
+{
+    if (name.empty() || !(std::isalpha(static_cast<unsigned char>(name[0])) || name[0] == '_'))
+        return false;
+    return std::all_of(name.begin(), name.end(), [](char c) { return std::isalnum(static_cast<unsigned char>(c)) || c == '_'; });
+}
+
+ExpressionTree parseExpr(const std::string &expr, const VSVideoInfo * const srcFormats[], int numInputs, std::vector<PropertyAccess> &props)
 {
     static constexpr unsigned char numOperands[] = {
         0, // MEM_LOAD_U8
@@ -225,6 +269,8 @@ ExpressionTree parseExpr(const std::string &expr, const VSVideoInfo * const srcF
         0, // MEM_LOAD_F16
         0, // MEM_LOAD_F32
         0, // CONSTANT
+        0, // RUNTIME_CONST
+        0, // COORD_X
         0, // MEM_STORE_U8
         0, // MEM_STORE_U16
         0, // MEM_STORE_F16
@@ -260,12 +306,47 @@ ExpressionTree parseExpr(const std::string &expr, const VSVideoInfo * const srcF
 
     ExpressionTree tree;
     std::vector<ExpressionTreeNode *> stack;
+    std::unordered_map<std::string_view, ExpressionTreeNode *> variables;
 
     for (std::string_view tok : tokens) {
-        ExprOp op = decodeToken(tok);
+        ExprOp op{ ExprOpType::RUNTIME_CONST };
+
+        // Variables only name a subtree, name! pops the top of the stack and name@ pushes a
+        // copy of it. Value numbering later merges the copies so each is computed once.
+        if (tok.size() > 1 && (tok.back() == '!' || tok.back() == '@') && isVariableName(tok.substr(0, tok.size() - 1))) {
+            std::string_view name = tok.substr(0, tok.size() - 1);
+
+            if (tok.back() == '!') {
+                if (stack.empty())
+                    throw std::runtime_error("insufficient values on stack: " + std::string{ tok });
+                variables[name] = stack.back();
+                stack.pop_back();
+            } else {
+                auto it = variables.find(name);
+                if (it == variables.end())
+                    throw std::runtime_error("undefined variable: " + std::string{ tok });
+                stack.push_back(tree.clone(it->second));
+            }
+            continue;
+        }
+
+        // Frame properties are numbered in order of first use.
+        if (tok.size() > 2 && tok[0] >= 'a' && tok[0] <= 'z' && tok[1] == '.') {
+            int input = tok[0] >= 'x' ? tok[0] - 'x' : tok[0] - 'a' + 3;
+            if (input >= numInputs)
+                throw std::runtime_error("reference to undefined clip: " + std::string{ tok });
+
+            std::string_view name = tok.substr(2);
+            auto it = std::find_if(props.begin(), props.end(), [&](const PropertyAccess &prop) { return prop.input == input && prop.name == name; });
+            if (it == props.end())
+                it = props.insert(props.end(), { input, std::string{ name } });
+            op.imm.u = RC_FIRST_PROP + static_cast<unsigned>(it - props.begin());
+        } else {
+            op = decodeToken(tok);
+        }
 
         // Check validity.
-        if (op.type == ExprOpType::MEM_LOAD_U8 && op.imm.i >= numInputs)
+        if (op.type == ExprOpType::MEM_LOAD_U8 && loadInput(op.imm) >= numInputs)
             throw std::runtime_error("reference to undefined clip: " + std::string{ tok });
         if ((op.type == ExprOpType::DUP || op.type == ExprOpType::SWAP) && op.imm.u >= stack.size())
             throw std::runtime_error("insufficient values on stack: " + std::string{ tok });
@@ -274,7 +355,7 @@ ExpressionTree parseExpr(const std::string &expr, const VSVideoInfo * const srcF
 
         // Rename load operations with the correct data type.
         if (op.type == ExprOpType::MEM_LOAD_U8) {
-            const VSVideoFormat &format = srcFormats[op.imm.i]->format;
+            const VSVideoFormat &format = srcFormats[loadInput(op.imm)]->format;
 
             if (format.sampleType == stInteger && format.bytesPerSample == 1)
                 op.type = ExprOpType::MEM_LOAD_U8;
@@ -346,6 +427,8 @@ bool isConstantExpr(const ExpressionTreeNode &node)
     case ExprOpType::MEM_LOAD_U16:
     case ExprOpType::MEM_LOAD_F16:
     case ExprOpType::MEM_LOAD_F32:
+    case ExprOpType::RUNTIME_CONST:
+    case ExprOpType::COORD_X:
         return false;
     case ExprOpType::CONSTANT:
         return true;
@@ -447,31 +530,42 @@ void swapNodeContents(ExpressionTreeNode &lhs, ExpressionTreeNode &rhs)
     std::swap(lhs.parent, rhs.parent);
 }
 
-void applyValueNumbering(ExpressionTree &tree)
+// Numbers the nodes of several trees together so equal subtrees get the same number
+// even when they belong to different trees.
+void applyValueNumbering(const std::vector<ExpressionTreeNode *> &roots)
 {
     std::vector<ExpressionTreeNode *> numbered;
     int valueNum = 0;
 
-    tree.getRoot()->postorder([&](ExpressionTreeNode &node)
-    {
-        node.valueNum = -1;
-    });
-
-    tree.getRoot()->postorder([&](ExpressionTreeNode &node)
-    {
-        if (node.op.type == ExprOpType::MUX)
-            return;
+    for (ExpressionTreeNode *root : roots) {
+        root->postorder([&](ExpressionTreeNode &node)
+        {
+            node.valueNum = -1;
+        });
+    }
 
-        for (ExpressionTreeNode *testnode : numbered) {
-            if (equalSubTree(&node, testnode)) {
-                node.valueNum = testnode->valueNum;
+    for (ExpressionTreeNode *root : roots) {
+        root->postorder([&](ExpressionTreeNode &node)
+        {
+            if (node.op.type == ExprOpType::MUX)
                 return;
+
+            for (ExpressionTreeNode *testnode : numbered) {
+                if (equalSubTree(&node, testnode)) {
+                    node.valueNum = testnode->valueNum;
+                    return;
+                }
             }
-        }
 
-        node.valueNum = valueNum++;
-        numbered.push_back(&node);
-    });
+            node.valueNum = valueNum++;
+            numbered.push_back(&node);
+        });
+    }
+}
+
+void applyValueNumbering(ExpressionTree &tree)
+{
+    applyValueNumbering(std::vector<ExpressionTreeNode *>{ tree.getRoot() });
 }
 
 ExpressionTreeNode *emitIntegerPow(ExpressionTree &tree, const ExpressionTreeNode &node, int exponent)
@@ -493,7 +587,7 @@ class ExponentMap {
 
         bool operator()(const std::pair<int, float> &lhs, const std::pair<int, float> &rhs) const
         {
-            const std::initializer_list<ExprOpType> memOpCodes = { ExprOpType::MEM_LOAD_U8, ExprOpType::MEM_LOAD_U16, ExprOpType::MEM_LOAD_F16, ExprOpType::MEM_LOAD_F32 };
+            const std::initializer_list<ExprOpType> memOpCodes = { ExprOpType::MEM_LOAD_U8, ExprOpType::MEM_LOAD_U16, ExprOpType::MEM_LOAD_F16, ExprOpType::MEM_LOAD_F32, ExprOpType::RUNTIME_CONST, ExprOpType::COORD_X };
 
             // Order equivalent terms by exponent.
             if (lhs.first == rhs.first)
@@ -517,7 +611,7 @@ class ExponentMap {
             if (lhsCategory == 2)
                 return lhsNode->op.imm.f < rhsNode->op.imm.f;
             else if (lhsCategory == 1)
-                return lhsNode->op.imm.u < rhsNode->op.imm.u;
+                return std::make_pair(lhsNode->op.type, lhsNode->op.imm.u) < std::make_pair(rhsNode->op.type, rhsNode->op.imm.u);
             else
                 return lhs.first < rhs.first;
         };
@@ -1449,61 +1543,24 @@ void renameRegisters(std::vector<ExprInstruction> &code)
     }
 }
 
-std::vector<ExprInstruction> compile(ExpressionTree &tree, const VSVideoInfo &vi, bool optimize = true)
+void optimizeTree(ExpressionTree &tree)
 {
-    std::vector<ExprInstruction> code;
-    std::unordered_set<int> found;
-
-    if (!tree.getRoot())
-        return code;
-
-    if (optimize) {
-        constexpr unsigned max_passes = 1000;
-        unsigned num_passes = 0;
+    constexpr unsigned max_passes = 1000;
+    unsigned num_passes = 0;
 
-        while (applyLocalOptimizations(tree) || combinePowerTerms(tree) || applyAlgebraicOptimizations(tree) || applyComparisonOptimizations(tree)) {
-            if (++num_passes > max_passes)
-                throw std::runtime_error{ "expression compilation did not complete" };
-        }
-
-        while (applyLocalOptimizations(tree) || applyStrengthReduction(tree) || applyOpFusion(tree)) {
-            if (++num_passes > max_passes)
-                throw std::runtime_error{ "expression compilation did not complete" };
-        }
+    while (applyLocalOptimizations(tree) || combinePowerTerms(tree) || applyAlgebraicOptimizations(tree) || applyComparisonOptimizations(tree)) {
+        if (++num_passes > max_passes)
+            throw std::runtime_error{ "expression compilation did not complete" };
     }
 
-    applyValueNumbering(tree);
-
-    tree.getRoot()->postorder([&](ExpressionTreeNode &node)
-    {
-        if (node.op.type == ExprOpType::MUX)
-            return;
-        if (found.find(node.valueNum) != found.end())
-            return;
-
-        ExprInstruction opcode(node.op);
-        opcode.dst = node.valueNum;
-
-        if (node.left) {
-            assert(node.left->valueNum >= 0);
-            opcode.src1 = node.left->valueNum;
-        }
-        if (node.right) {
-            if (node.right->op.type == ExprOpType::MUX) {
-                assert(node.right->left->valueNum >= 0);
-                assert(node.right->right->valueNum >= 0);
-                opcode.src2 = node.right->left->valueNum;
-                opcode.src3 = node.right->right->valueNum;
-            } else {
-                assert(node.right->valueNum >= 0);
-                opcode.src2 = node.right->valueNum;
-            }
-        }
-
-        code.push_back(opcode);
-        found.insert(node.valueNum);
-    });
+    while (applyLocalOptimizations(tree) || applyStrengthReduction(tree) || applyOpFusion(tree)) {
+        if (++num_passes > max_passes)
+            throw std::runtime_error{ "expression compilation did not complete" };
+    }
+}
 
+ExprInstruction makeStore(const VSVideoInfo &vi, int slot)
+{
     ExprInstruction store(ExprOpType::MEM_STORE_U8);
     const VSVideoFormat &format = vi.format;
 
@@ -1516,23 +1573,233 @@ std::vector<ExprInstruction> compile(ExpressionTree &tree, const VSVideoInfo &vi
     else if (format.sampleType == stFloat && format.bytesPerSample == 4)
         store.op.type = ExprOpType::MEM_STORE_F32;
 
-    if (store.op.type == ExprOpType::MEM_STORE_U16)
-        store.op.imm.u = format.bitsPerSample;
+    store.op.imm = makeStoreImm(store.op.type == ExprOpType::MEM_STORE_U16 ? format.bitsPerSample : 0, slot);
+    return store;
+}
+
+// Emits the trees in order with shared value numbering, so a value computed for an
+// earlier tree is reused by the later ones instead of being evaluated again.
+std::vector<ExprInstruction> compile(std::vector<ExpressionTree> &trees, const VSVideoInfo * const dstFormats[], bool optimize = true)
+{
+    std::vector<ExprInstruction> code;
+    std::unordered_set<int> found;
+    std::vector<ExpressionTreeNode *> roots;
+
+    for (ExpressionTree &tree : trees) {
+        if (!tree.getRoot())
+            return code;
+        if (optimize)
+            optimizeTree(tree);
+        roots.push_back(tree.getRoot());
+    }
+
+    applyValueNumbering(roots);
 
-    store.src1 = code.back().dst;
-    code.push_back(store);
+    for (size_t i = 0; i < roots.size(); ++i) {
+        roots[i]->postorder([&](ExpressionTreeNode &node)
+        {
+            if (node.op.type == ExprOpType::MUX)
+                return;
+            if (found.find(node.valueNum) != found.end())
+                return;
+
+            ExprInstruction opcode(node.op);
+            opcode.dst = node.valueNum;
+
+            if (node.left) {
+                assert(node.left->valueNum >= 0);
+                opcode.src1 = node.left->valueNum;
+            }
+            if (node.right) {
+                if (node.right->op.type == ExprOpType::MUX) {
+                    assert(node.right->left->valueNum >= 0);
+                    assert(node.right->right->valueNum >= 0);
+                    opcode.src2 = node.right->left->valueNum;
+                    opcode.src3 = node.right->right->valueNum;
+                } else {
+                    assert(node.right->valueNum >= 0);
+                    opcode.src2 = node.right->valueNum;
+                }
+            }
+
+            code.push_back(opcode);
+            found.insert(node.valueNum);
+        });
+
+        ExprInstruction store = makeStore(*dstFormats[i], static_cast<int>(i));
+        store.src1 = roots[i]->valueNum;
+        code.push_back(store);
+    }
 
     renameRegisters(code);
     return code;
 }
 
+// Range of a register in integer code. The lanes hold value * 2^frac.
+struct IntRange {
+    int64_t lo;
+    int64_t hi;
+    int frac;
+};
+
+constexpr int MAX_INT_FRAC_BITS = 14;
+
+bool fitsInt16(const IntRange &r)
+{
+    return r.lo >= INT16_MIN && r.hi <= INT16_MAX;
+}
+
+bool intConstant(float x, IntRange &r)
+{
+    for (int frac = 0; frac <= MAX_INT_FRAC_BITS; ++frac) {
+        float n = std::ldexp(x, frac);
+        if (isInteger(n) && std::fabs(n) <= INT16_MAX) {
+            r = { static_cast<int64_t>(n), static_cast<int64_t>(n), frac };
+            return true;
+        }
+    }
+    return false;
+}
+
+IntRange alignRange(const IntRange &r, int frac)
+{
+    int64_t scale = int64_t{ 1 } << (frac - r.frac);
+    return { r.lo * scale, r.hi * scale, frac };
+}
+
+IntRange mulRange(const IntRange &a, const IntRange &b)
+{
+    int64_t p[4] = { a.lo * b.lo, a.lo * b.hi, a.hi * b.lo, a.hi * b.hi };
+    return { *std::min_element(p, p + 4), *std::max_element(p, p + 4), a.frac + b.frac };
+}
+
 } // namespace
 
 
-std::vector<ExprInstruction> compile(const std::string &expr, const VSVideoInfo * const srcFormats[], int numInputs, const VSVideoInfo &dstFormat, bool optimize)
+std::vector<int> analyzeInt16(const std::vector<ExprInstruction> &code, const VSVideoInfo * const srcFormats[])
+{
+    std::unordered_map<int, IntRange> regs;
+    std::vector<int> fracBits;
+    fracBits.reserve(code.size());
+
+    auto aligned = [&](int a, int b, IntRange &ra, IntRange &rb) {
+        int frac = std::max(regs[a].frac, regs[b].frac);
+        ra = alignRange(regs[a], frac);
+        rb = alignRange(regs[b], frac);
+        return fitsInt16(ra) && fitsInt16(rb);
+    };
+
+    for (const ExprInstruction &insn : code) {
+        IntRange r{};
+        IntRange a, b;
+
+        switch (insn.op.type) {
+        case ExprOpType::MEM_LOAD_U8:
+            r = { 0, 255, 0 };
+            break;
+        case ExprOpType::MEM_LOAD_U16:
+            r = { 0, (int64_t{ 1 } << srcFormats[loadInput(insn.op.imm)]->format.bitsPerSample) - 1, 0 };
+            break;
+        case ExprOpType::CONSTANT:
+            if (!intConstant(insn.op.imm.f, r))
+                return {};
+            break;
+        case ExprOpType::ADD:
+        case ExprOpType::SUB:
+        case ExprOpType::MAX:
+        case ExprOpType::MIN:
+            if (!aligned(insn.src1, insn.src2, a, b))
+                return {};
+            if (insn.op.type == ExprOpType::ADD)
+                r = { a.lo + b.lo, a.hi + b.hi, a.frac };
+            else if (insn.op.type == ExprOpType::SUB)
+                r = { a.lo - b.hi, a.hi - b.lo, a.frac };
+            else if (insn.op.type == ExprOpType::MAX)
+                r = { std::max(a.lo, b.lo), std::max(a.hi, b.hi), a.frac };
+            else
+                r = { std::min(a.lo, b.lo), std::min(a.hi, b.hi), a.frac };
+            break;
+        case ExprOpType::MUL:
+            r = mulRange(regs[insn.src1], regs[insn.src2]);
+            break;
+        case ExprOpType::FMA: {
+            // The product is evaluated on its own and then aligned with the addend.
+            IntRange prod = mulRange(regs[insn.src2], regs[insn.src3]);
+            if (!fitsInt16(prod) || prod.frac > MAX_INT_FRAC_BITS)
+                return {};
+            int frac = std::max(prod.frac, regs[insn.src1].frac);
+            a = alignRange(regs[insn.src1], frac);
+            b = alignRange(prod, frac);
+            if (!fitsInt16(a) || !fitsInt16(b))
+                return {};
+
+            switch (static_cast<FMAType>(insn.op.imm.u)) {
+            case FMAType::FMADD: r = { b.lo + a.lo, b.hi + a.hi, frac }; break;
+            case FMAType::FMSUB: r = { b.lo - a.hi, b.hi - a.lo, frac }; break;
+            case FMAType::FNMADD: r = { a.lo - b.hi, a.hi - b.lo, frac }; break;
+            case FMAType::FNMSUB: r = { -b.hi - a.hi, -b.lo - a.lo, frac }; break;
+            }
+            break;
+        }
+        case ExprOpType::ABS:
+            a = regs[insn.src1];
+            r = { a.lo >= 0 ? a.lo : (a.hi <= 0 ? -a.hi : 0), std::max(std::abs(a.lo), std::abs(a.hi)), a.frac };
+            break;
+        case ExprOpType::NEG:
+            a = regs[insn.src1];
+            r = { -a.hi, -a.lo, a.frac };
+            break;
+        case ExprOpType::CMP:
+            if (!aligned(insn.src1, insn.src2, a, b))
+                return {};
+            r = { 0, 1, 0 };
+            break;
+        case ExprOpType::AND:
+        case ExprOpType::OR:
+        case ExprOpType::XOR:
+        case ExprOpType::NOT:
+            r = { 0, 1, 0 };
+            break;
+        case ExprOpType::TERNARY:
+            if (!aligned(insn.src2, insn.src3, a, b))
+                return {};
+            r = { std::min(a.lo, b.lo), std::max(a.hi, b.hi), a.frac };
+            break;
+        case ExprOpType::MEM_STORE_U8:
+        case ExprOpType::MEM_STORE_U16:
+            // Rounding adds up to half an output step before shifting out the fraction.
+            r = regs[insn.src1];
+            if (r.frac && r.hi + (int64_t{ 1 } << (r.frac - 1)) > INT16_MAX)
+                return {};
+            break;
+        default:
+            return {};
+        }
+
+        if (!fitsInt16(r) || r.frac > MAX_INT_FRAC_BITS)
+            return {};
+
+        if (insn.dst >= 0)
+            regs[insn.dst] = r;
+        fracBits.push_back(r.frac);
+    }
+
+    return fracBits;
+}
+
+std::vector<ExprInstruction> compile(const std::string &expr, const VSVideoInfo * const srcFormats[], int numInputs, const VSVideoInfo &dstFormat, std::vector<PropertyAccess> &props, bool optimize)
+{
+    const VSVideoInfo *dstFormats[] = { &dstFormat };
+    return compile(std::vector<std::string>{ expr }, srcFormats, numInputs, dstFormats, props, optimize);
+}
+
+std::vector<ExprInstruction> compile(const std::vector<std::string> &exprs, const VSVideoInfo * const srcFormats[], int numInputs, const VSVideoInfo * const dstFormats[], std::vector<PropertyAccess> &props, bool optimize)
 {
-    ExpressionTree tree = parseExpr(expr, srcFormats, numInputs);
-    return compile(tree, dstFormat, optimize);
+    props.clear();
+    std::vector<ExpressionTree> trees;
+    for (const std::string &expr : exprs)
+        trees.push_back(parseExpr(expr, srcFormats, numInputs, props));
+    return compile(trees, dstFormats, optimize);
 }
 
 } // namespace expr
@@ -30,10 +30,17 @@ struct VSVideoInfo;
 namespace expr {
 
 #define MAX_EXPR_INPUTS 26
+// Distinct (input, dy, edge mode) rows read by neighbourhood loads, each one gets its own
+// source pointer after the regular inputs.
+#define MAX_EXPR_NEIGHBOUR_ROWS 32
+#define MAX_EXPR_SOURCES (MAX_EXPR_INPUTS + MAX_EXPR_NEIGHBOUR_ROWS)
+// Clips written by one program. Stores to outputs after the first get pointers after
+// the sources.
+#define MAX_EXPR_OUTPUTS 8
 
 enum class ExprOpType {
     // Terminals.
-    MEM_LOAD_U8, MEM_LOAD_U16, MEM_LOAD_F16, MEM_LOAD_F32, CONSTANT,
+    MEM_LOAD_U8, MEM_LOAD_U16, MEM_LOAD_F16, MEM_LOAD_F32, CONSTANT, RUNTIME_CONST, COORD_X,
     MEM_STORE_U8, MEM_STORE_U16, MEM_STORE_F16, MEM_STORE_F32,
 
     // Arithmetic primitives.
@@ -71,6 +78,11 @@ enum class ComparisonType {
     NLE = 6,
 };
 
+enum class EdgeMode {
+    CLAMP = 0,  // repeat the edge pixel
+    MIRROR = 1, // half-sample symmetric, -1 -> 0
+};
+
 union ExprUnion {
     int32_t i;
     uint32_t u;
@@ -90,9 +102,49 @@ struct ExprOp {
     ExprOp(ExprOpType type, ExprUnion param = {}) : type(type), imm(param) {}
 };
 
+// The immediate of a MEM_LOAD_* op holds the input index in the low byte. Neighbourhood
+// loads (x[dx,dy]) additionally store the signed offsets and the edge mode in the upper
+// bytes, so a plain load is just the input index.
+inline ExprUnion makeLoadImm(int input, int dx = 0, int dy = 0, EdgeMode mode = EdgeMode::CLAMP)
+{
+    return static_cast<uint32_t>((input & 0xFF) | ((dx & 0xFF) << 8) | ((dy & 0xFF) << 16) | (static_cast<int>(mode) << 24));
+}
+
+inline int loadInput(ExprUnion imm) { return imm.u & 0xFF; }
+inline int loadOffsetX(ExprUnion imm) { return static_cast<int8_t>((imm.u >> 8) & 0xFF); }
+inline int loadOffsetY(ExprUnion imm) { return static_cast<int8_t>((imm.u >> 16) & 0xFF); }
+inline EdgeMode loadEdgeMode(ExprUnion imm) { return static_cast<EdgeMode>(imm.u >> 24); }
+
+// The immediate of a MEM_STORE_* op holds the output bit depth in the low byte and the
+// index of the pointer written in the next byte. A single-output program always writes
+// pointer 0.
+inline ExprUnion makeStoreImm(int depth, int slot = 0)
+{
+    return static_cast<uint32_t>((depth & 0xFF) | ((slot & 0xFF) << 8));
+}
+
+inline int storeDepth(ExprUnion imm) { return imm.u & 0xFF; }
+inline int storeSlot(ExprUnion imm) { return (imm.u >> 8) & 0xFF; }
+
 inline bool operator==(const ExprOp &lhs, const ExprOp &rhs) { return lhs.type == rhs.type && lhs.imm.u == rhs.imm.u; }
 inline bool operator!=(const ExprOp &lhs, const ExprOp &rhs) { return !(lhs == rhs); }
 
+// Slots of the constant array passed to the compiled code. Y is updated for every row, the
+// rest once per frame. Frame properties follow the fixed slots in the order compile()
+// lists them.
+enum RuntimeConstant {
+    RC_Y,
+    RC_N,
+    RC_WIDTH,
+    RC_HEIGHT,
+    RC_FIRST_PROP,
+};
+
+struct PropertyAccess {
+    int input;
+    std::string name;
+};
+
 struct ExprInstruction {
     ExprOp op;
     int dst;
@@ -103,7 +155,24 @@ struct ExprInstruction {
     ExprInstruction(ExprOp op) : op(op), dst(-1), src1(-1), src2(-1), src3(-1) {}
 };
 
-std::vector<ExprInstruction> compile(const std::string &expr, const VSVideoInfo * const srcFormats[], int numInputs, const VSVideoInfo &dstFormat, bool optimize = true);
+std::vector<ExprInstruction> compile(const std::string &expr, const VSVideoInfo * const srcFormats[], int numInputs, const VSVideoInfo &dstFormat, std::vector<PropertyAccess> &props, bool optimize = true);
+
+// Compiles several expressions into one program. Subexpressions common to more than one
+// expression, loads included, are evaluated once. The store of expression i is emitted
+// right after its last use and writes pointer slot i.
+std::vector<ExprInstruction> compile(const std::vector<std::string> &exprs, const VSVideoInfo * const srcFormats[], int numInputs, const VSVideoInfo * const dstFormats[], std::vector<PropertyAccess> &props, bool optimize = true);
+
+// Range analysis for integer code generation. If every value the program computes is a
+// multiple of a power of two that fits in int16 lanes, the integer code is exact and
+// matches the float path bit for bit. Returns the number of fractional bits held by each
+// instruction's result (or stored value), or an empty vector if the program needs float.
+// Load inputs must still refer to srcFormats, so call it before renumbering them.
+std::vector<int> analyzeInt16(const std::vector<ExprInstruction> &code, const VSVideoInfo * const srcFormats[]);
+
+// Fills the table of Lut (one input) or Lut2 (two inputs) by evaluating expr for every value
+// of the integer inputs, the entry for x and y is table[(y << bits of x) + x]. Only the
+// input values and constants can be used. Defined in exprfilter.cpp.
+void evaluateTable(const std::string &expr, const VSVideoInfo * const srcFormats[], int numInputs, const VSVideoInfo &dstFormat, void *table, int cpulevel);
 
 } // namespace expr
 
@@ -5013,6 +5013,8 @@ struct Frontend
 	void vmovaps(const ZmmReg& dst, const ZmmReg& src, KReg k = k0)	{AppendInstr(I_MOVAPS, 0x28, E_VEX_512_0F_WIG | evexK(k), W(dst), R(src));}
 	void vmovaps(const ZmmReg& dst, const Mem512& src, KReg k = k0)	{AppendInstr(I_MOVAPS, 0x28, E_VEX_512_0F_WIG | evexK(k), W(dst), R(src));}
 	void vmovaps(const Mem512& dst, const ZmmReg& src, KReg k = k0)	{AppendInstr(I_MOVAPS, 0x29, E_VEX_512_0F_WIG | evexK(k), R(src), W(dst));}
+	void vmovups(const ZmmReg& dst, const Mem512& src, KReg k = k0)	{AppendInstr(I_MOVUPS, 0x10, E_VEX_512_0F_WIG | evexK(k), W(dst), R(src));}
+	void vmovups(const Mem512& dst, const ZmmReg& src, KReg k = k0)	{AppendInstr(I_MOVUPS, 0x11, E_VEX_512_0F_WIG | evexK(k), R(src), W(dst));}
 	void vaddps(const ZmmReg& dst, const ZmmReg& src1, const ZmmReg& src2, KReg k = k0, RoundCtl rc = RC_MXCSR)	{AppendInstr(I_ADDPS, 0x58, E_VEX_512_0F_WIG | evexK(k, rc), W(dst), R(src2), R(src1));}
 	void vaddps(const ZmmReg& dst, const ZmmReg& src1, const Mem512& src2, KReg k = k0)	{AppendInstr(I_ADDPS, 0x58, E_VEX_512_0F_WIG | evexK(k), W(dst), R(src2), R(src1));}
 	void vsubps(const ZmmReg& dst, const ZmmReg& src1, const ZmmReg& src2, KReg k = k0, RoundCtl rc = RC_MXCSR)	{AppendInstr(I_SUBPS, 0x5C, E_VEX_512_0F_WIG | evexK(k, rc), W(dst), R(src2), R(src1));}
@@ -5070,6 +5072,7 @@ struct Frontend
 	// Blend: dst = k ? src2 : src1. The mask is the selector, so it is required (no k0 default).
 	void vblendmps(const ZmmReg& dst, const ZmmReg& src1, const ZmmReg& src2, KReg k)	{AppendInstr(I_VBLENDMPS, 0x65, E_VEX_512 | E_VEX_66_0F38 | E_VEX_W0 | evexK(k), W(dst), R(src2), R(src1));}
 	// Embedded-broadcast ({1to16}) source forms: the r/m is a single dword the hardware broadcasts to all 16 lanes.
+	void vaddps(const ZmmReg& dst, const ZmmReg& src1, const Mem32& src2, KReg k = k0)	{AppendInstr(I_ADDPS, 0x58, E_VEX_512_0F_WIG | E_EVEX_BCAST32 | evexK(k), W(dst), R(src2), R(src1));}
 	void vminps(const ZmmReg& dst, const ZmmReg& src1, const Mem32& src2, KReg k = k0)	{AppendInstr(I_MINPS, 0x5D, E_VEX_512_0F_WIG | E_EVEX_BCAST32 | evexK(k), W(dst), R(src2), R(src1));}
 	void vmaxps(const ZmmReg& dst, const ZmmReg& src1, const Mem32& src2, KReg k = k0)	{AppendInstr(I_MAXPS, 0x5F, E_VEX_512_0F_WIG | E_EVEX_BCAST32 | evexK(k), W(dst), R(src2), R(src1));}
 	void vmulps(const ZmmReg& dst, const ZmmReg& src1, const Mem32& src2, KReg k = k0)	{AppendInstr(I_MULPS, 0x59, E_VEX_512_0F_WIG | E_EVEX_BCAST32 | evexK(k), W(dst), R(src2), R(src1));}
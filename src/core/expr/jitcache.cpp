@@ -0,0 +1,293 @@
+/*
+* Copyright (c) 2013-2020 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "../cpufeatures.h"
+#include "../version.h"
+#include "jitcompiler.h"
+
+namespace expr {
+namespace {
+
+// Bump whenever the generated code or the file layout changes so stale cache
+// files from development builds of the same release are ignored.
+constexpr uint32_t CACHE_FORMAT_VERSION = 2;
+constexpr char CACHE_MAGIC[8] = { 'V', 'S', 'E', 'X', 'P', 'R', 'J', 'T' };
+
+std::mutex cacheMutex;
+std::unordered_map<std::string, std::weak_ptr<const JitCode>> cache;
+
+template <class T>
+void append(std::string &s, T v)
+{
+    s.append(reinterpret_cast<const char *>(&v), sizeof(v));
+}
+
+// The x86 generators pick instructions by the features of the CPU they run on and not
+// only by the target, the SSE2 target for example uses FMA, SSE4.1 and VEX encodings when
+// they're available. Code compiled on one machine must not be loaded on another without
+// them, so the features that select instructions or targets are part of the key.
+uint32_t cpuFeatureMask()
+{
+    uint32_t mask = 0;
+#ifdef VS_TARGET_CPU_X86
+    const CPUFeatures *f = getCPUFeatures();
+    const char features[] = { f->sse4_1, f->fma3, f->avx, f->avx2, f->f16c, f->avx512 };
+    for (size_t i = 0; i < sizeof(features); ++i)
+        mask |= (features[i] ? 1U : 0U) << i;
+#endif
+    return mask;
+}
+
+// The bytecode already encodes the input and output formats in its load and store
+// ops, so together with the target, the CPU features and the number of source pointers
+// it determines the generated code.
+std::string makeKey(const ExprInstruction *bytecode, size_t numInsns, int numInputs, JitTarget target, const std::vector<int> &intFracBits)
+{
+    std::string key;
+    key.reserve(20 + numInsns * 24);
+    append(key, static_cast<int32_t>(target));
+    append(key, cpuFeatureMask());
+    append(key, static_cast<int32_t>(numInputs));
+    append(key, static_cast<uint64_t>(numInsns));
+
+    for (size_t i = 0; i < numInsns; ++i) {
+        const ExprInstruction &insn = bytecode[i];
+        append(key, static_cast<int32_t>(insn.op.type));
+        append(key, insn.op.imm.u);
+        append(key, static_cast<int32_t>(insn.dst));
+        append(key, static_cast<int32_t>(insn.src1));
+        append(key, static_cast<int32_t>(insn.src2));
+        append(key, static_cast<int32_t>(insn.src3));
+    }
+
+    if (target == JitTarget::YMM_INT16) {
+        for (int frac : intFracBits)
+            append(key, static_cast<int32_t>(frac));
+    }
+    return key;
+}
+
+uint64_t hashKey(const std::string &key)
+{
+    uint64_t h = 14695981039346656037ULL;
+    for (unsigned char c : key) {
+        h ^= c;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+std::filesystem::path getCacheDir()
+{
+#ifdef VS_TARGET_OS_WINDOWS
+    const wchar_t *dir = _wgetenv(L"VAPOURSYNTH_EXPR_CACHE_DIR");
+    if (dir && wcslen(dir) > 0)
+        return dir;
+#else
+    const char *dir = std::getenv("VAPOURSYNTH_EXPR_CACHE_DIR");
+    if (dir && strlen(dir) > 0)
+        return dir;
+#endif
+    return {};
+}
+
+std::filesystem::path getCachePath(const std::filesystem::path &dir, const std::string &key)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.vsjit", static_cast<unsigned long long>(hashKey(key)));
+    return dir / name;
+}
+
+// File layout: magic, core version, format version, key size, key, pixels per
+// iteration, relocation count, relocations, code size, code. Symbol addresses in
+// the stored code are zeroed and filled in again when loading.
+std::shared_ptr<const JitCode> loadCode(const std::filesystem::path &path, const std::string &key, const ExprCompiler &compiler)
+{
+    std::ifstream f(path, std::ios::binary);
+    if (!f)
+        return nullptr;
+
+    auto read = [&f](auto &v) { return !!f.read(reinterpret_cast<char *>(&v), sizeof(v)); };
+
+    char magic[sizeof(CACHE_MAGIC)];
+    uint32_t coreVersion, formatVersion;
+    uint64_t keySize;
+    if (!f.read(magic, sizeof(magic)) || memcmp(magic, CACHE_MAGIC, sizeof(magic)) || !read(coreVersion) || !read(formatVersion) || !read(keySize))
+        return nullptr;
+    if (coreVersion != VAPOURSYNTH_CORE_VERSION || formatVersion != CACHE_FORMAT_VERSION || keySize != key.size())
+        return nullptr;
+
+    std::string storedKey(keySize, '\0');
+    if (!f.read(storedKey.data(), keySize) || storedKey != key)
+        return nullptr;
+
+    int32_t pixelsPerIteration;
+    uint32_t numRelocs;
+    if (!read(pixelsPerIteration) || !read(numRelocs) || pixelsPerIteration != compiler.pixelsPerIteration())
+        return nullptr;
+
+    std::vector<Relocation> relocs;
+    for (uint32_t i = 0; i < numRelocs; ++i) {
+        uint64_t offset;
+        uint32_t symbol;
+        if (!read(offset) || !read(symbol))
+            return nullptr;
+        relocs.push_back({ static_cast<size_t>(offset), symbol });
+    }
+
+    uint64_t codeSize;
+    if (!read(codeSize) || codeSize == 0 || codeSize > (64 << 20))
+        return nullptr;
+    std::vector<uint8_t> code(codeSize);
+    if (!f.read(reinterpret_cast<char *>(code.data()), codeSize))
+        return nullptr;
+
+    // 16 bytes covers the largest relocation, four AArch64 instructions.
+    std::vector<const void *> symbols = compiler.getSymbols();
+    for (const Relocation &r : relocs) {
+        if (r.symbol >= symbols.size() || r.offset > codeSize || codeSize - r.offset < 16)
+            return nullptr;
+        compiler.applyRelocation(code.data(), r, symbols[r.symbol]);
+    }
+
+    void *ptr = alloc_jit_code(code.data(), code.size());
+    if (!ptr)
+        return nullptr;
+    return std::make_shared<const JitCode>(reinterpret_cast<ExprCompiler::ProcessLineProc>(ptr), code.size(), pixelsPerIteration);
+}
+
+void storeCode(const std::filesystem::path &path, const std::string &key, const ExprCompiler &compiler, const JitCode &jit)
+{
+    std::vector<Relocation> relocs;
+    if (!compiler.getRelocations(reinterpret_cast<const void *>(jit.proc), jit.size, relocs))
+        return;
+
+    std::vector<uint8_t> code(jit.size);
+    memcpy(code.data(), reinterpret_cast<const void *>(jit.proc), jit.size);
+    for (const Relocation &r : relocs)
+        compiler.applyRelocation(code.data(), r, nullptr);
+
+    std::string data(CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    append(data, static_cast<uint32_t>(VAPOURSYNTH_CORE_VERSION));
+    append(data, CACHE_FORMAT_VERSION);
+    append(data, static_cast<uint64_t>(key.size()));
+    data += key;
+    append(data, static_cast<int32_t>(jit.pixelsPerIteration));
+    append(data, static_cast<uint32_t>(relocs.size()));
+    for (const Relocation &r : relocs) {
+        append(data, static_cast<uint64_t>(r.offset));
+        append(data, static_cast<uint32_t>(r.symbol));
+    }
+    append(data, static_cast<uint64_t>(code.size()));
+    data.append(reinterpret_cast<const char *>(code.data()), code.size());
+
+    // Write to a temporary name and rename it so other processes never see
+    // a partial file. Failures only mean the code isn't persisted.
+    std::error_code ec;
+    std::filesystem::create_directories(path.parent_path(), ec);
+    std::filesystem::path tmp = path;
+    tmp += "." + std::to_string(reinterpret_cast<uintptr_t>(&jit)) + ".tmp";
+    {
+        std::ofstream f(tmp, std::ios::binary | std::ios::trunc);
+        if (!f || !f.write(data.data(), data.size()))
+            return;
+    }
+    std::filesystem::rename(tmp, path, ec);
+    if (ec)
+        std::filesystem::remove(tmp, ec);
+}
+
+} // namespace
+
+std::shared_ptr<const JitCode> compile_jit_cached(const ExprInstruction *bytecode, size_t numInsns, int numInputs, int cpulevel, const std::vector<int> &intFracBits)
+{
+    JitTarget target = select_jit_target(cpulevel, intFracBits);
+    std::unique_ptr<ExprCompiler> compiler = make_compiler(target, numInputs, intFracBits);
+    if (!compiler)
+        return nullptr;
+
+    std::string key = makeKey(bytecode, numInsns, numInputs, target, intFracBits);
+
+    {
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        auto it = cache.find(key);
+        if (it != cache.end()) {
+            if (std::shared_ptr<const JitCode> jit = it->second.lock())
+                return jit;
+        }
+    }
+
+    // Compile without holding the lock, if another thread finishes the same
+    // expression first its copy is used and this one is discarded.
+    std::filesystem::path dir = getCacheDir();
+    std::filesystem::path path;
+    std::shared_ptr<const JitCode> jit;
+
+    if (!dir.empty()) {
+        path = getCachePath(dir, key);
+        try {
+            jit = loadCode(path, key, *compiler);
+        } catch (...) {
+        }
+    }
+
+    if (!jit) {
+        for (size_t i = 0; i < numInsns; ++i)
+            compiler->addInstruction(bytecode[i]);
+
+        auto code = compiler->getCode();
+        if (!code.first)
+            return nullptr;
+        jit = std::make_shared<const JitCode>(code.first, code.second, compiler->pixelsPerIteration());
+
+        if (!path.empty()) {
+            try {
+                storeCode(path, key, *compiler, *jit);
+            } catch (...) {
+            }
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    std::weak_ptr<const JitCode> &entry = cache[key];
+    if (std::shared_ptr<const JitCode> existing = entry.lock())
+        return existing;
+    entry = jit;
+
+    // Drop the entries of expressions whose filters have all been freed.
+    for (auto iter = cache.begin(); iter != cache.end();) {
+        if (iter->second.expired())
+            iter = cache.erase(iter);
+        else
+            ++iter;
+    }
+    return jit;
+}
+
+} // namespace expr
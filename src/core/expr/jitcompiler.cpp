@@ -19,10 +19,20 @@
 */
 
 #include <cassert>
+#include <cstring>
 #include "../cpufeatures.h"
 #include "../kernel/cpulevel.h"
 #include "jitcompiler.h"
 
+#ifdef VS_TARGET_OS_WINDOWS
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#ifdef __APPLE__
+#include <pthread.h>
+#endif
+#endif
+
 namespace expr {
 
 void ExprCompiler::addInstruction(const ExprInstruction &insn)
@@ -33,6 +43,8 @@ void ExprCompiler::addInstruction(const ExprInstruction &insn)
     case ExprOpType::MEM_LOAD_F16: loadF16(insn); break;
     case ExprOpType::MEM_LOAD_F32: loadF32(insn); break;
     case ExprOpType::CONSTANT: loadConst(insn); break;
+    case ExprOpType::RUNTIME_CONST: loadRuntimeConst(insn); break;
+    case ExprOpType::COORD_X: loadCoordX(insn); break;
     case ExprOpType::MEM_STORE_U8: store8(insn); break;
     case ExprOpType::MEM_STORE_U16: store16(insn); break;
     case ExprOpType::MEM_STORE_F16: storeF16(insn); break;
@@ -62,29 +74,108 @@ void ExprCompiler::addInstruction(const ExprInstruction &insn)
     }
 }
 
-std::pair<ExprCompiler::ProcessLineProc, size_t> compile_jit(const ExprInstruction *bytecode, size_t numInsns, int numInputs, int cpulevel, int *pixelsPerIterationOut)
+bool ExprCompiler::getRelocations(const void *code, size_t size, std::vector<Relocation> &relocs) const
+{
+    const uint8_t *p = static_cast<const uint8_t *>(code);
+    std::vector<const void *> symbols = getSymbols();
+
+    for (unsigned i = 0; i < symbols.size(); ++i) {
+        uint64_t addr = reinterpret_cast<uintptr_t>(symbols[i]);
+
+        // Addresses that fit in 32 bits may have been encoded with a shorter
+        // immediate that can't be found reliably.
+        if (addr <= UINT32_MAX)
+            return false;
+
+        for (size_t off = 0; off + sizeof(addr) <= size; ++off) {
+            if (!memcmp(p + off, &addr, sizeof(addr)))
+                relocs.push_back({ off, i });
+        }
+    }
+    return true;
+}
+
+void ExprCompiler::applyRelocation(uint8_t *code, const Relocation &reloc, const void *addr) const
+{
+    uint64_t imm = reinterpret_cast<uintptr_t>(addr);
+    memcpy(code + reloc.offset, &imm, sizeof(imm));
+}
+
+JitCode::~JitCode()
+{
+    free_jit_code(reinterpret_cast<void *>(proc), size);
+}
+
+void *alloc_jit_code(const void *code, size_t size)
 {
-	std::unique_ptr<ExprCompiler> compiler;
+#ifdef VS_TARGET_OS_WINDOWS
+    void *ptr = VirtualAlloc(nullptr, size, MEM_COMMIT, PAGE_EXECUTE_READWRITE);
+    if (!ptr)
+        return nullptr;
+    memcpy(ptr, code, size);
+    FlushInstructionCache(GetCurrentProcess(), ptr, size);
+#else
+#ifdef __APPLE__
+    void *ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_ANON | MAP_PRIVATE | MAP_JIT, -1, 0);
+#else
+    void *ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_ANON | MAP_PRIVATE, -1, 0);
+#endif
+    if (ptr == MAP_FAILED)
+        return nullptr;
+#ifdef __APPLE__
+    pthread_jit_write_protect_np(0);
+#endif
+    memcpy(ptr, code, size);
+#ifdef __APPLE__
+    pthread_jit_write_protect_np(1);
+#endif
+    __builtin___clear_cache(static_cast<char *>(ptr), static_cast<char *>(ptr) + size);
+#endif
+    return ptr;
+}
+
+void free_jit_code(void *ptr, size_t size)
+{
+    if (!ptr)
+        return;
+#ifdef VS_TARGET_OS_WINDOWS
+    VirtualFree(ptr, 0, MEM_RELEASE);
+#else
+    munmap(ptr, size);
+#endif
+}
 
+JitTarget select_jit_target(int cpulevel, const std::vector<int> &intFracBits)
+{
 #ifdef VS_TARGET_CPU_X86
-	if (getCPUFeatures()->avx512 && cpulevel >= VS_CPU_LEVEL_AVX512)
-		compiler = make_zmm_compiler(numInputs);
+	if (!intFracBits.empty() && getCPUFeatures()->avx2 && cpulevel >= VS_CPU_LEVEL_AVX2)
+		return JitTarget::YMM_INT16;
+	else if (getCPUFeatures()->avx512 && cpulevel >= VS_CPU_LEVEL_AVX512)
+		return JitTarget::ZMM;
 	else if (getCPUFeatures()->avx2 && cpulevel >= VS_CPU_LEVEL_AVX2)
-		compiler = make_ymm_compiler(numInputs);
+		return JitTarget::YMM;
 	else
-		compiler = make_xmm_compiler(numInputs);
+		return JitTarget::XMM;
+#elif defined(VS_TARGET_CPU_ARM64)
+	if (cpulevel >= VS_CPU_LEVEL_NEON)
+		return JitTarget::NEON;
 #endif
+	return JitTarget::NONE;
+}
 
-	if (!compiler)
-		return{};
-
-	if (pixelsPerIterationOut)
-		*pixelsPerIterationOut = compiler->pixelsPerIteration();
-
-	for (size_t i = 0; i < numInsns; ++i) {
-		compiler->addInstruction(bytecode[i]);
+std::unique_ptr<ExprCompiler> make_compiler(JitTarget target, int numInputs, const std::vector<int> &intFracBits)
+{
+	switch (target) {
+#ifdef VS_TARGET_CPU_X86
+	case JitTarget::XMM: return make_xmm_compiler(numInputs);
+	case JitTarget::YMM: return make_ymm_compiler(numInputs);
+	case JitTarget::ZMM: return make_zmm_compiler(numInputs);
+	case JitTarget::YMM_INT16: return make_int16_compiler(numInputs, intFracBits);
+#elif defined(VS_TARGET_CPU_ARM64)
+	case JitTarget::NEON: return make_neon_compiler(numInputs);
+#endif
+	default: return nullptr;
 	}
-	return compiler->getCode();
 }
 
 } // namespace expr
@@ -22,20 +22,37 @@
 #define JITCOMPILER_H
 
 #include <cstddef>
+#include <cstdint>
 #include <memory>
+#include <vector>
 #include "expr.h"
 
 namespace expr {
 
+// The code generator compile_jit_cached picks for a cpulevel. Cached code is only reused
+// for the same target.
+enum class JitTarget {
+    NONE, XMM, YMM, ZMM, NEON, YMM_INT16
+};
+
+// An absolute address of symbols[symbol] embedded in generated code at offset.
+struct Relocation {
+    size_t offset;
+    unsigned symbol;
+};
+
 class ExprCompiler {
 public:
-    typedef void (*ProcessLineProc)(void *rwptrs, intptr_t ptroff[MAX_EXPR_INPUTS + 1], intptr_t niter);
+    // consts holds the RuntimeConstant values, x coordinates always start at 0.
+    typedef void (*ProcessLineProc)(void *rwptrs, intptr_t ptroff[MAX_EXPR_SOURCES + 1], intptr_t niter, const float *consts);
 private:
     virtual void load8(const ExprInstruction &insn) = 0;
     virtual void load16(const ExprInstruction &insn) = 0;
     virtual void loadF16(const ExprInstruction &insn) = 0;
     virtual void loadF32(const ExprInstruction &insn) = 0;
     virtual void loadConst(const ExprInstruction &insn) = 0;
+    virtual void loadRuntimeConst(const ExprInstruction &insn) = 0;
+    virtual void loadCoordX(const ExprInstruction &insn) = 0;
     virtual void store8(const ExprInstruction &insn) = 0;
     virtual void store16(const ExprInstruction &insn) = 0;
     virtual void storeF16(const ExprInstruction &insn) = 0;
@@ -70,17 +87,58 @@ public:
 
     // Number of pixels the generated proc consumes per loop iteration. The caller
     // uses this for the pointer advance (ptroffsets) and iteration count. XMM/YMM
-    // process 8, the ZMM (AVX-512) path processes 16.
+    // process 8, the ZMM (AVX-512) path processes 16. NEON processes 8.
     virtual int pixelsPerIteration() const = 0;
+
+    // Static data the generated code refers to by absolute address, always in the
+    // same order so relocations stay valid between processes.
+    virtual std::vector<const void *> getSymbols() const = 0;
+
+    // Locates the symbol addresses in code previously returned by getCode(). The
+    // default looks for them as 64 bit immediates. Returns false if the code can't
+    // be relocated.
+    virtual bool getRelocations(const void *code, size_t size, std::vector<Relocation> &relocs) const;
+
+    // Writes addr over the symbol address at reloc in a copy of the code.
+    virtual void applyRelocation(uint8_t *code, const Relocation &reloc, const void *addr) const;
+};
+
+// Executable code shared by every Expr instance compiling the same bytecode for the
+// same target. The memory is released together with the last reference.
+struct JitCode {
+    ExprCompiler::ProcessLineProc proc;
+    size_t size;
+    int pixelsPerIteration;
+
+    JitCode(ExprCompiler::ProcessLineProc proc, size_t size, int pixelsPerIteration) : proc(proc), size(size), pixelsPerIteration(pixelsPerIteration) {}
+    JitCode(const JitCode &) = delete;
+    JitCode &operator=(const JitCode &) = delete;
+    ~JitCode();
 };
 
 #ifdef VS_TARGET_CPU_X86
 std::unique_ptr<ExprCompiler> make_xmm_compiler(int numInputs);
 std::unique_ptr<ExprCompiler> make_ymm_compiler(int numInputs);
 std::unique_ptr<ExprCompiler> make_zmm_compiler(int numInputs);
+std::unique_ptr<ExprCompiler> make_int16_compiler(int numInputs, const std::vector<int> &fracBits);
+#elif defined(VS_TARGET_CPU_ARM64)
+std::unique_ptr<ExprCompiler> make_neon_compiler(int numInputs);
 #endif
 
-std::pair<ExprCompiler::ProcessLineProc, size_t> compile_jit(const ExprInstruction *bytecode, size_t numInsns, int numInputs, int cpulevel, int *pixelsPerIterationOut = nullptr);
+// Copies code into newly allocated executable memory, returns nullptr on failure.
+void *alloc_jit_code(const void *code, size_t size);
+void free_jit_code(void *ptr, size_t size);
+
+// intFracBits is the result of analyzeInt16, integer code is used when it isn't empty
+// and the cpu supports it.
+JitTarget select_jit_target(int cpulevel, const std::vector<int> &intFracBits = {});
+std::unique_ptr<ExprCompiler> make_compiler(JitTarget target, int numInputs, const std::vector<int> &intFracBits = {});
+
+// Compiles bytecode for the target select_jit_target picks and returns code shared
+// with all other callers that compiled identical bytecode for the same target. When
+// the VAPOURSYNTH_EXPR_CACHE_DIR environment variable is set the code is also stored
+// there and reused by later processes. Returns nullptr when no JIT is available.
+std::shared_ptr<const JitCode> compile_jit_cached(const ExprInstruction *bytecode, size_t numInsns, int numInputs, int cpulevel, const std::vector<int> &intFracBits = {});
 
 } // namespace expr
 
@@ -0,0 +1,1057 @@
+/*
+* Copyright (c) 2013-2020 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifdef VS_TARGET_CPU_ARM64
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+#include "jitcompiler.h"
+
+namespace expr {
+namespace {
+
+struct XReg { unsigned n; };
+struct VReg { unsigned n; };
+
+constexpr XReg SP{ 31 };
+
+// Just enough of an AArch64 encoder for the expression compiler. Vector arithmetic is
+// always on all four float lanes (.4s), loads and stores take an unsigned immediate.
+// An operand that doesn't fit its field marks the code as unencodable instead of
+// emitting a different instruction, the compiler then returns no code.
+class Arm64Assembler {
+    std::vector<uint32_t> code;
+    bool unencodable = false;
+
+    void emit(uint32_t insn) { code.push_back(insn); }
+    bool fits(bool cond) { unencodable = unencodable || !cond; return cond; }
+
+    void three(uint32_t op, VReg d, VReg n, VReg m) { emit(op | (m.n << 16) | (n.n << 5) | d.n); }
+    void two(uint32_t op, VReg d, VReg n) { emit(op | (n.n << 5) | d.n); }
+    void ldst(uint32_t op, unsigned rt, XReg n, unsigned offset, unsigned scale)
+    {
+        if (fits(offset % scale == 0 && offset / scale < 4096))
+            emit(op | ((offset / scale) << 10) | (n.n << 5) | rt);
+    }
+    void pair(uint32_t op, unsigned rt1, unsigned rt2, XReg n, int offset)
+    {
+        if (fits(offset % 8 == 0 && offset >= -512 && offset < 512))
+            emit(op | ((static_cast<uint32_t>(offset / 8) & 0x7F) << 15) | (rt2 << 10) | (n.n << 5) | rt1);
+    }
+protected:
+    size_t label() const { return code.size(); }
+    bool isUnencodable() const { return unencodable; }
+    const std::vector<uint32_t> &getInstructions() const { return code; }
+
+    // Integer.
+    void movz(XReg d, uint16_t imm, unsigned shift) { emit(0xD2800000 | ((shift / 16) << 21) | (imm << 5) | d.n); }
+    void movk(XReg d, uint16_t imm, unsigned shift) { emit(0xF2800000 | ((shift / 16) << 21) | (imm << 5) | d.n); }
+    void movw(XReg d, uint32_t imm)
+    {
+        emit(0x52800000 | ((imm & 0xFFFF) << 5) | d.n);
+        if (imm >> 16)
+            emit(0x72A00000 | ((imm >> 16) << 5) | d.n);
+    }
+    void mov(XReg d, uint64_t imm)
+    {
+        movz(d, imm & 0xFFFF, 0);
+        for (unsigned shift = 16; shift < 64; shift += 16) {
+            if ((imm >> shift) & 0xFFFF)
+                movk(d, (imm >> shift) & 0xFFFF, shift);
+        }
+    }
+    // Always four instructions so the address can be patched when relocating.
+    void movAbs(XReg d, uint64_t imm)
+    {
+        movz(d, imm & 0xFFFF, 0);
+        for (unsigned shift = 16; shift < 64; shift += 16)
+            movk(d, (imm >> shift) & 0xFFFF, shift);
+    }
+    void add(XReg d, XReg n, unsigned imm)
+    {
+        if (!fits(imm < (1 << 24)))
+            return;
+        if (imm >> 12)
+            emit(0x91400000 | ((imm >> 12) << 10) | (n.n << 5) | d.n);
+        if ((imm & 0xFFF) || !(imm >> 12))
+            emit(0x91000000 | ((imm & 0xFFF) << 10) | ((imm >> 12 ? d.n : n.n) << 5) | d.n);
+    }
+    void sub(XReg d, XReg n, unsigned imm)
+    {
+        if (!fits(imm < (1 << 24)))
+            return;
+        if (imm >> 12)
+            emit(0xD1400000 | ((imm >> 12) << 10) | (n.n << 5) | d.n);
+        if ((imm & 0xFFF) || !(imm >> 12))
+            emit(0xD1000000 | ((imm & 0xFFF) << 10) | ((imm >> 12 ? d.n : n.n) << 5) | d.n);
+    }
+    void add(XReg d, XReg n, XReg m) { emit(0x8B000000 | (m.n << 16) | (n.n << 5) | d.n); }
+    void subs(XReg d, XReg n, unsigned imm) { if (fits(imm < 4096)) emit(0xF1000000 | (imm << 10) | (n.n << 5) | d.n); }
+    void ldr(XReg t, XReg n, unsigned offset) { ldst(0xF9400000, t.n, n, offset, 8); }
+    void str(XReg t, XReg n, unsigned offset) { ldst(0xF9000000, t.n, n, offset, 8); }
+    void ldrw(XReg t, XReg n, unsigned offset) { ldst(0xB9400000, t.n, n, offset, 4); }
+    void ldp(XReg t1, XReg t2, XReg n, int offset) { pair(0xA9400000, t1.n, t2.n, n, offset); }
+    void stp(XReg t1, XReg t2, XReg n, int offset) { pair(0xA9000000, t1.n, t2.n, n, offset); }
+    void bne(size_t target)
+    {
+        ptrdiff_t offset = static_cast<ptrdiff_t>(target) - static_cast<ptrdiff_t>(code.size());
+        if (fits(offset >= -(1 << 18) && offset < (1 << 18)))
+            emit(0x54000001 | ((static_cast<uint32_t>(offset) & 0x7FFFF) << 5));
+    }
+    void ret() { emit(0xD65F03C0); }
+
+    // Vector loads and stores.
+    void ldrq(VReg t, XReg n, unsigned offset) { ldst(0x3DC00000, t.n, n, offset, 16); }
+    void strq(VReg t, XReg n, unsigned offset) { ldst(0x3D800000, t.n, n, offset, 16); }
+    void ldrd(VReg t, XReg n, unsigned offset) { ldst(0xFD400000, t.n, n, offset, 8); }
+    void strd(VReg t, XReg n, unsigned offset) { ldst(0xFD000000, t.n, n, offset, 8); }
+    void ldpd(VReg t1, VReg t2, XReg n, int offset) { pair(0x6D400000, t1.n, t2.n, n, offset); }
+    void stpd(VReg t1, VReg t2, XReg n, int offset) { pair(0x6D000000, t1.n, t2.n, n, offset); }
+
+    // Vector data movement.
+    void dup(VReg d, XReg n) { emit(0x4E040C00 | (n.n << 5) | d.n); }
+    void movi0(VReg d) { emit(0x6F00E400 | d.n); }
+    void mov(VReg d, VReg n) { if (d.n != n.n) three(0x4EA01C00, d, n, n); }
+
+    // Float arithmetic.
+    void fadd(VReg d, VReg n, VReg m) { three(0x4E20D400, d, n, m); }
+    void fsub(VReg d, VReg n, VReg m) { three(0x4EA0D400, d, n, m); }
+    void fmul(VReg d, VReg n, VReg m) { three(0x6E20DC00, d, n, m); }
+    void fdiv(VReg d, VReg n, VReg m) { three(0x6E20FC00, d, n, m); }
+    void fmla(VReg d, VReg n, VReg m) { three(0x4E20CC00, d, n, m); }
+    void fmls(VReg d, VReg n, VReg m) { three(0x4EA0CC00, d, n, m); }
+    void fmaxnm(VReg d, VReg n, VReg m) { three(0x4E20C400, d, n, m); }
+    void fminnm(VReg d, VReg n, VReg m) { three(0x4EA0C400, d, n, m); }
+    void fabs(VReg d, VReg n) { two(0x4EA0F800, d, n); }
+    void fneg(VReg d, VReg n) { two(0x6EA0F800, d, n); }
+    void fsqrt(VReg d, VReg n) { two(0x6EA1F800, d, n); }
+
+    // Float comparisons, all lanes set on true.
+    void fcmeq(VReg d, VReg n, VReg m) { three(0x4E20E400, d, n, m); }
+    void fcmge(VReg d, VReg n, VReg m) { three(0x6E20E400, d, n, m); }
+    void fcmgt(VReg d, VReg n, VReg m) { three(0x6EA0E400, d, n, m); }
+    void fcmgtz(VReg d, VReg n) { two(0x4EA0C800, d, n); }
+    void fcmlez(VReg d, VReg n) { two(0x6EA0D800, d, n); }
+
+    // Bitwise.
+    void and_(VReg d, VReg n, VReg m) { three(0x4E201C00, d, n, m); }
+    void orr(VReg d, VReg n, VReg m) { three(0x4EA01C00, d, n, m); }
+    void eor(VReg d, VReg n, VReg m) { three(0x6E201C00, d, n, m); }
+    void bic(VReg d, VReg n, VReg m) { three(0x4E601C00, d, n, m); }
+    void bsl(VReg d, VReg n, VReg m) { three(0x6E601C00, d, n, m); }
+
+    // Integer lanes.
+    void addi(VReg d, VReg n, VReg m) { three(0x4EA08400, d, n, m); }
+    void subi(VReg d, VReg n, VReg m) { three(0x6EA08400, d, n, m); }
+    void shl(VReg d, VReg n, unsigned shift) { if (fits(shift < 32)) two(0x4F205400 | (shift << 16), d, n); }
+    void ushr(VReg d, VReg n, unsigned shift) { if (fits(shift >= 1 && shift <= 32)) two(0x6F200400 | ((32 - shift) << 16), d, n); }
+
+    // Conversions. The narrowing and widening forms name the wide arrangement.
+    void scvtf(VReg d, VReg n) { two(0x4E21D800, d, n); }
+    void ucvtf(VReg d, VReg n) { two(0x6E21D800, d, n); }
+    void fcvtzs(VReg d, VReg n) { two(0x4EA1B800, d, n); }
+    void fcvtns(VReg d, VReg n) { two(0x4E21A800, d, n); }
+    void uxtl8h(VReg d, VReg n) { two(0x2F08A400, d, n); }
+    void uxtl4s(VReg d, VReg n) { two(0x2F10A400, d, n); }
+    void uxtl24s(VReg d, VReg n) { two(0x6F10A400, d, n); }
+    void fcvtl(VReg d, VReg n) { two(0x0E217800, d, n); }
+    void fcvtl2(VReg d, VReg n) { two(0x4E217800, d, n); }
+    void fcvtn(VReg d, VReg n) { two(0x0E216800, d, n); }
+    void fcvtn2(VReg d, VReg n) { two(0x4E216800, d, n); }
+    void sqxtun4h(VReg d, VReg n) { two(0x2E612800, d, n); }
+    void sqxtun28h(VReg d, VReg n) { two(0x6E612800, d, n); }
+    void uqxtn8b(VReg d, VReg n) { two(0x2E214800, d, n); }
+};
+
+// Register usage of the generated code:
+//   x0-x3   arguments (rwptrs, ptroff, niter, consts)
+//   x9      load/store address
+//   x10     constData
+//   x11-x14 pointer advance
+//   v0-v7   scratch for the operations and transcendental functions
+//   v8-v23  bytecode registers, two per register (pixels 0-3 and 4-7)
+//   v24-v27 bytecode registers reloaded from or going to the stack
+//   v28-v29 x coordinate
+//   v30     1.0f
+//   v31     0.0f
+class ExprCompilerNeon : public ExprCompiler, private Arm64Assembler {
+    typedef Arm64Assembler jit;
+
+#define SPLAT(x) { (x), (x), (x), (x) }
+    static constexpr ExprUnion constData alignas(16)[56][4] = {
+        SPLAT(0x7FFFFFFF), // absmask
+        SPLAT(0x80000000), // negmask
+        SPLAT(0x7F), // x7F
+        SPLAT(0x00800000), // min_norm_pos
+        SPLAT(~0x7F800000), // inv_mant_mask
+        SPLAT(1.0f), // float_one
+        SPLAT(0.5f), // float_half
+        SPLAT(255.0f), // float_255
+        SPLAT(511.0f), // float_511
+        SPLAT(1023.0f), // float_1023
+        SPLAT(2047.0f), // float_2047
+        SPLAT(4095.0f), // float_4095
+        SPLAT(8191.0f), // float_8191
+        SPLAT(16383.0f), // float_16383
+        SPLAT(32767.0f), // float_32767
+        SPLAT(65535.0f), // float_65535
+        SPLAT(static_cast<int32_t>(0x80008000)), // i16min_epi16
+        SPLAT(static_cast<int32_t>(0xFFFF8000)), // i16min_epi32
+        SPLAT(88.3762626647949f), // exp_hi
+        SPLAT(-88.3762626647949f), // exp_lo
+        SPLAT(1.44269504088896341f), // log2e
+        SPLAT(0.693359375f), // exp_c1
+        SPLAT(-2.12194440e-4f), // exp_c2
+        SPLAT(1.9875691500E-4f), // exp_p0
+        SPLAT(1.3981999507E-3f), // exp_p1
+        SPLAT(8.3334519073E-3f), // exp_p2
+        SPLAT(4.1665795894E-2f), // exp_p3
+        SPLAT(1.6666665459E-1f), // exp_p4
+        SPLAT(5.0000001201E-1f), // exp_p5
+        SPLAT(0.707106781186547524f), // sqrt_1_2
+        SPLAT(7.0376836292E-2f), // log_p0
+        SPLAT(-1.1514610310E-1f), // log_p1
+        SPLAT(1.1676998740E-1f), // log_p2
+        SPLAT(-1.2420140846E-1f), // log_p3
+        SPLAT(+1.4249322787E-1f), // log_p4
+        SPLAT(-1.6668057665E-1f), // log_p5
+        SPLAT(+2.0000714765E-1f), // log_p6
+        SPLAT(-2.4999993993E-1f), // log_p7
+        SPLAT(+3.3333331174E-1f), // log_p8
+        SPLAT(0x3ea2f983), // float_invpi, 1/pi
+        SPLAT(0x4b400000), // float_rintf
+        SPLAT(0x40490000), // float_pi1
+        SPLAT(0x3a7da000), // float_pi2
+        SPLAT(0x34222000), // float_pi3
+        SPLAT(0x2cb4611a), // float_pi4
+        SPLAT(0xbe2aaaa6), // float_sinC3
+        SPLAT(0x3c08876a), // float_sinC5
+        SPLAT(0xb94fb7ff), // float_sinC7
+        SPLAT(0x362edef8), // float_sinC9
+        SPLAT(static_cast<int32_t>(0xBEFFFFE2)), // float_cosC2
+        SPLAT(0x3D2AA73C), // float_cosC4
+        SPLAT(static_cast<int32_t>(0XBAB58D50)), // float_cosC6
+        SPLAT(0x37C1AD76), // float_cosC8
+        { 0.0f, 1.0f, 2.0f, 3.0f }, // lane_index_lo
+        { 4.0f, 5.0f, 6.0f, 7.0f }, // lane_index_hi
+        SPLAT(8.0f), // float_8
+    };
+
+    struct ConstantIndex {
+        static constexpr int absmask = 0;
+        static constexpr int negmask = 1;
+        static constexpr int x7F = 2;
+        static constexpr int min_norm_pos = 3;
+        static constexpr int inv_mant_mask = 4;
+        static constexpr int float_one = 5;
+        static constexpr int float_half = 6;
+        static constexpr int float_255 = 7;
+        static constexpr int exp_hi = 18;
+        static constexpr int exp_lo = 19;
+        static constexpr int log2e = 20;
+        static constexpr int exp_c1 = 21;
+        static constexpr int exp_c2 = 22;
+        static constexpr int exp_p0 = 23;
+        static constexpr int sqrt_1_2 = 29;
+        static constexpr int log_p0 = 30;
+        static constexpr int log_q1 = exp_c2;
+        static constexpr int log_q2 = exp_c1;
+        static constexpr int float_invpi = 39;
+        static constexpr int float_rintf = 40;
+        static constexpr int float_pi1 = 41;
+        static constexpr int float_sinC3 = 45;
+        static constexpr int float_sinC5 = float_sinC3 + 1;
+        static constexpr int float_sinC7 = float_sinC3 + 2;
+        static constexpr int float_sinC9 = float_sinC3 + 3;
+        static constexpr int float_cosC2 = 49;
+        static constexpr int float_cosC4 = float_cosC2 + 1;
+        static constexpr int float_cosC6 = float_cosC2 + 2;
+        static constexpr int float_cosC8 = float_cosC2 + 3;
+        static constexpr int lane_index_lo = 53;
+        static constexpr int lane_index_hi = 54;
+        static constexpr int float_8 = 55;
+    };
+#undef SPLAT
+
+    static constexpr XReg regptrs{ 0 };
+    static constexpr XReg regoffs{ 1 };
+    static constexpr XReg niter{ 2 };
+    static constexpr XReg runtimeConsts{ 3 };
+    static constexpr XReg addr{ 9 };
+    static constexpr XReg constants{ 10 };
+    static constexpr VReg spillSrc[3] = { { 24 }, { 25 }, { 26 } };
+    static constexpr VReg spillDst{ 27 };
+    static constexpr VReg coordX[2] = { { 28 }, { 29 } };
+    static constexpr VReg one{ 30 };
+    static constexpr VReg zero{ 31 };
+    static constexpr unsigned firstBytecodeReg = 8;
+    static constexpr unsigned numBytecodeRegPairs = 8;
+    static constexpr unsigned savedRegsSize = 64;
+
+    // A bytecode register lives in v[reg], v[reg + 1] or, when slot >= 0, in 32 bytes
+    // of stack above the saved registers.
+    struct Location {
+        unsigned reg;
+        int slot;
+    };
+
+    // Operations are recorded until all bytecode registers are known.
+    std::vector<std::function<void()>> deferred;
+    std::unordered_map<int, unsigned> useCount;
+    std::unordered_map<int, Location> bytecodeRegs;
+
+    int numInputs;
+    int numSlots;
+    bool usesCoordX;
+    size_t constantsReloc = 0;
+
+#define EMIT() [this, insn]()
+
+    void use(int reg)
+    {
+        if (reg >= 0)
+            ++useCount[reg];
+    }
+
+    void record(const ExprInstruction &insn, std::function<void()> f)
+    {
+        use(insn.dst);
+        use(insn.src1);
+        use(insn.src2);
+        use(insn.src3);
+        deferred.push_back(std::move(f));
+    }
+
+    unsigned slotOffset(const Location &loc, int half) const { return savedRegsSize + loc.slot * 32 + half * 16; }
+
+    VReg src(int reg, int half, int n)
+    {
+        const Location &loc = bytecodeRegs.at(reg);
+        if (loc.slot < 0)
+            return VReg{ loc.reg + half };
+        ldrq(spillSrc[n], SP, slotOffset(loc, half));
+        return spillSrc[n];
+    }
+
+    VReg dst(int reg, int half)
+    {
+        const Location &loc = bytecodeRegs.at(reg);
+        return loc.slot < 0 ? VReg{ loc.reg + half } : spillDst;
+    }
+
+    void commit(int reg, int half)
+    {
+        const Location &loc = bytecodeRegs.at(reg);
+        if (loc.slot >= 0)
+            strq(spillDst, SP, slotOffset(loc, half));
+    }
+
+    void loadConstant(VReg r, int index)
+    {
+        ldrq(r, constants, index * 16);
+    }
+
+    void loadSourcePointer(const ExprInstruction &insn, int bytes)
+    {
+        int offset = loadOffsetX(insn.op.imm) * bytes;
+        ldr(addr, regptrs, sizeof(void *) * (loadInput(insn.op.imm) + 1));
+        if (offset > 0)
+            jit::add(addr, addr, offset);
+        else if (offset < 0)
+            jit::sub(addr, addr, -offset);
+    }
+
+    void load8(const ExprInstruction &insn) override
+    {
+        record(insn, EMIT()
+        {
+            loadSourcePointer(insn, 1);
+            ldrd(VReg{ 0 }, addr, 0);
+            uxtl8h(VReg{ 0 }, VReg{ 0 });
+            for (int h = 0; h < 2; ++h) {
+                VReg d = dst(insn.dst, h);
+                if (h)
+                    uxtl24s(d, VReg{ 0 });
+                else
+                    uxtl4s(d, VReg{ 0 });
+                ucvtf(d, d);
+                commit(insn.dst, h);
+            }
+        });
+    }
+
+    void load16(const ExprInstruction &insn) override
+    {
+        record(insn, EMIT()
+        {
+            loadSourcePointer(insn, 2);
+            ldrq(VReg{ 0 }, addr, 0);
+            for (int h = 0; h < 2; ++h) {
+                VReg d = dst(insn.dst, h);
+                if (h)
+                    uxtl24s(d, VReg{ 0 });
+                else
+                    uxtl4s(d, VReg{ 0 });
+                ucvtf(d, d);
+                commit(insn.dst, h);
+            }
+        });
+    }
+
+    void loadF16(const ExprInstruction &insn) override
+    {
+        record(insn, EMIT()
+        {
+            loadSourcePointer(insn, 2);
+            ldrq(VReg{ 0 }, addr, 0);
+            for (int h = 0; h < 2; ++h) {
+                VReg d = dst(insn.dst, h);
+                if (h)
+                    fcvtl2(d, VReg{ 0 });
+                else
+                    fcvtl(d, VReg{ 0 });
+                commit(insn.dst, h);
+            }
+        });
+    }
+
+    void loadF32(const ExprInstruction &insn) override
+    {
+        record(insn, EMIT()
+        {
+            loadSourcePointer(insn, 4);
+            for (int h = 0; h < 2; ++h) {
+                ldrq(dst(insn.dst, h), addr, h * 16);
+                commit(insn.dst, h);
+            }
+        });
+    }
+
+    void loadConst(const ExprInstruction &insn) override
+    {
+        record(insn, EMIT()
+        {
+            if (insn.op.imm.f != 0.0f)
+                movw(addr, insn.op.imm.u);
+            for (int h = 0; h < 2; ++h) {
+                VReg d = dst(insn.dst, h);
+                if (insn.op.imm.f == 0.0f)
+                    movi0(d);
+                else
+                    dup(d, addr);
+                commit(insn.dst, h);
+            }
+        });
+    }
+
+    void loadRuntimeConst(const ExprInstruction &insn) override
+    {
+        record(insn, EMIT()
+        {
+            ldrw(addr, runtimeConsts, insn.op.imm.u * 4);
+            for (int h = 0; h < 2; ++h) {
+                dup(dst(insn.dst, h), addr);
+                commit(insn.dst, h);
+            }
+        });
+    }
+
+    void loadCoordX(const ExprInstruction &insn) override
+    {
+        usesCoordX = true;
+        record(insn, EMIT()
+        {
+            for (int h = 0; h < 2; ++h) {
+                mov(dst(insn.dst, h), coordX[h]);
+                commit(insn.dst, h);
+            }
+        });
+    }
+
+    // Round to nearest and saturate both halves into v0.8h, negative values become 0.
+    void packUnsigned16(const ExprInstruction &insn, int limitIndex)
+    {
+        loadConstant(VReg{ 1 }, limitIndex);
+        for (int h = 0; h < 2; ++h) {
+            VReg t = VReg{ 2 + static_cast<unsigned>(h) };
+            fminnm(t, src(insn.src1, h, 0), VReg{ 1 });
+            fcvtns(t, t);
+        }
+        sqxtun4h(VReg{ 0 }, VReg{ 2 });
+        sqxtun28h(VReg{ 0 }, VReg{ 3 });
+    }
+
+    void store8(const ExprInstruction &insn) override
+    {
+        record(insn, EMIT()
+        {
+            packUnsigned16(insn, ConstantIndex::float_255);
+            uqxtn8b(VReg{ 0 }, VReg{ 0 });
+            ldr(addr, regptrs, sizeof(void *) * storeSlot(insn.op.imm));
+            strd(VReg{ 0 }, addr, 0);
+        });
+    }
+
+    void store16(const ExprInstruction &insn) override
+    {
+        record(insn, EMIT()
+        {
+            int depth = storeDepth(insn.op.imm);
+            packUnsigned16(insn, ConstantIndex::float_255 + depth - 8);
+            ldr(addr, regptrs, sizeof(void *) * storeSlot(insn.op.imm));
+            strq(VReg{ 0 }, addr, 0);
+        });
+    }
+
+    void storeF16(const ExprInstruction &insn) override
+    {
+        record(insn, EMIT()
+        {
+            fcvtn(VReg{ 0 }, src(insn.src1, 0, 0));
+            fcvtn2(VReg{ 0 }, src(insn.src1, 1, 0));
+            ldr(addr, regptrs, sizeof(void *) * storeSlot(insn.op.imm));
+            strq(VReg{ 0 }, addr, 0);
+        });
+    }
+
+    void storeF32(const ExprInstruction &insn) override
+    {
+        record(insn, EMIT()
+        {
+            ldr(addr, regptrs, sizeof(void *) * storeSlot(insn.op.imm));
+            for (int h = 0; h < 2; ++h)
+                strq(src(insn.src1, h, 0), addr, h * 16);
+        });
+    }
+
+#define UNARYOP(...) \
+do { \
+  for (int h = 0; h < 2; ++h) { \
+    VReg a = src(insn.src1, h, 0); \
+    VReg d = dst(insn.dst, h); \
+    __VA_ARGS__; \
+    commit(insn.dst, h); \
+  } \
+} while (0)
+#define BINARYOP(...) \
+do { \
+  for (int h = 0; h < 2; ++h) { \
+    VReg a = src(insn.src1, h, 0); \
+    VReg b = src(insn.src2, h, 1); \
+    VReg d = dst(insn.dst, h); \
+    __VA_ARGS__; \
+    commit(insn.dst, h); \
+  } \
+} while (0)
+    void add(const ExprInstruction &insn) override
+    {
+        record(insn, EMIT()
+        {
+            BINARYOP(fadd(d, a, b));
+        });
+    }
+
+    void sub(const ExprInstruction &insn) override
+    {
+        record(insn, EMIT()
+        {
+            BINARYOP(fsub(d, a, b));
+        });
+    }
+
+    void mul(const ExprInstruction &insn) override
+    {
+        record(insn, EMIT()
+        {
+            BINARYOP(fmul(d, a, b));
+        });
+    }
+
+    void div(const ExprInstruction &insn) override
+    {
+        record(insn, EMIT()
+        {
+            BINARYOP(fdiv(d, a, b));
+        });
+    }
+
+    void fma(const ExprInstruction &insn) override
+    {
+        record(insn, EMIT()
+        {
+            FMAType type = static_cast<FMAType>(insn.op.imm.u);
+
+            // t1 + t2 * t3, accumulated in v0 since the destination may alias t2 or t3
+            for (int h = 0; h < 2; ++h) {
+                VReg t1 = src(insn.src1, h, 0);
+                VReg t2 = src(insn.src2, h, 1);
+                VReg t3 = src(insn.src3, h, 2);
+                VReg d = dst(insn.dst, h);
+
+                if (type == FMAType::FMSUB || type == FMAType::FNMSUB)
+                    fneg(VReg{ 0 }, t1);
+                else
+                    mov(VReg{ 0 }, t1);
+
+                if (type == FMAType::FMADD || type == FMAType::FMSUB)
+                    fmla(VReg{ 0 }, t2, t3);
+                else
+                    fmls(VReg{ 0 }, t2, t3);
+
+                mov(d, VReg{ 0 });
+                commit(insn.dst, h);
+            }
+        });
+    }
+
+    void max(const ExprInstruction &insn) override
+    {
+        record(insn, EMIT()
+        {
+            BINARYOP(fmaxnm(d, a, b));
+        });
+    }
+
+    void min(const ExprInstruction &insn) override
+    {
+        record(insn, EMIT()
+        {
+            BINARYOP(fminnm(d, a, b));
+        });
+    }
+
+    void sqrt(const ExprInstruction &insn) override
+    {
+        record(insn, EMIT()
+        {
+            UNARYOP(fmaxnm(d, a, zero); fsqrt(d, d));
+        });
+    }
+
+    void abs(const ExprInstruction &insn) override
+    {
+        record(insn, EMIT()
+        {
+            UNARYOP(fabs(d, a));
+        });
+    }
+
+    void neg(const ExprInstruction &insn) override
+    {
+        record(insn, EMIT()
+        {
+            UNARYOP(fneg(d, a));
+        });
+    }
+
+    void not_(const ExprInstruction &insn) override
+    {
+        record(insn, EMIT()
+        {
+            UNARYOP(fcmlez(d, a); jit::and_(d, d, one));
+        });
+    }
+
+    void and_(const ExprInstruction &insn) override
+    {
+        record(insn, EMIT()
+        {
+            BINARYOP(fcmgtz(VReg{ 0 }, a); fcmgtz(d, b); jit::and_(d, d, VReg{ 0 }); jit::and_(d, d, one));
+        });
+    }
+
+    void or_(const ExprInstruction &insn) override
+    {
+        record(insn, EMIT()
+        {
+            BINARYOP(fcmgtz(VReg{ 0 }, a); fcmgtz(d, b); orr(d, d, VReg{ 0 }); jit::and_(d, d, one));
+        });
+    }
+
+    void xor_(const ExprInstruction &insn) override
+    {
+        record(insn, EMIT()
+        {
+            BINARYOP(fcmgtz(VReg{ 0 }, a); fcmgtz(d, b); eor(d, d, VReg{ 0 }); jit::and_(d, d, one));
+        });
+    }
+
+    void cmp(const ExprInstruction &insn) override
+    {
+        record(insn, EMIT()
+        {
+            switch (static_cast<ComparisonType>(insn.op.imm.u)) {
+            case ComparisonType::EQ: BINARYOP(fcmeq(d, a, b); jit::and_(d, d, one)); break;
+            case ComparisonType::LT: BINARYOP(fcmgt(d, b, a); jit::and_(d, d, one)); break;
+            case ComparisonType::LE: BINARYOP(fcmge(d, b, a); jit::and_(d, d, one)); break;
+            case ComparisonType::NEQ: BINARYOP(fcmeq(d, a, b); bic(d, one, d)); break;
+            case ComparisonType::NLT: BINARYOP(fcmge(d, a, b); jit::and_(d, d, one)); break;
+            case ComparisonType::NLE: BINARYOP(fcmgt(d, a, b); jit::and_(d, d, one)); break;
+            }
+        });
+    }
+#undef BINARYOP
+#undef UNARYOP
+
+    void ternary(const ExprInstruction &insn) override
+    {
+        record(insn, EMIT()
+        {
+            for (int h = 0; h < 2; ++h) {
+                VReg t1 = src(insn.src1, h, 0);
+                VReg t2 = src(insn.src2, h, 1);
+                VReg t3 = src(insn.src3, h, 2);
+                VReg d = dst(insn.dst, h);
+                fcmgtz(VReg{ 0 }, t1);
+                bsl(VReg{ 0 }, t2, t3);
+                mov(d, VReg{ 0 });
+                commit(insn.dst, h);
+            }
+        });
+    }
+
+    // The transcendental functions are the same approximations as the x86 compilers, with
+    // the same operation order. They work on v0 and clobber v1-v7.
+    void exp_()
+    {
+        VReg x{ 0 }, fx{ 1 }, emm0{ 2 }, etmp{ 3 }, y{ 4 }, mask{ 5 }, z{ 6 }, c{ 7 };
+        loadConstant(c, ConstantIndex::exp_hi);
+        fminnm(x, x, c);
+        loadConstant(c, ConstantIndex::exp_lo);
+        fmaxnm(x, x, c);
+        loadConstant(c, ConstantIndex::log2e);
+        fmul(fx, x, c);
+        loadConstant(c, ConstantIndex::float_half);
+        fadd(fx, fx, c);
+        fcvtzs(emm0, fx);
+        scvtf(etmp, emm0);
+        fcmgt(mask, etmp, fx);
+        jit::and_(mask, mask, one);
+        fsub(fx, etmp, mask);
+        loadConstant(c, ConstantIndex::exp_c1);
+        fmul(etmp, fx, c);
+        loadConstant(c, ConstantIndex::exp_c2);
+        fmul(z, fx, c);
+        fsub(x, x, etmp);
+        fsub(x, x, z);
+        fmul(z, x, x);
+        loadConstant(c, ConstantIndex::exp_p0);
+        fmul(y, x, c);
+        for (int i = 1; i <= 5; ++i) {
+            loadConstant(c, ConstantIndex::exp_p0 + i);
+            fadd(y, y, c);
+            fmul(y, y, i < 5 ? x : z);
+        }
+        fadd(y, y, x);
+        fadd(y, y, one);
+        fcvtzs(emm0, fx);
+        loadConstant(c, ConstantIndex::x7F);
+        addi(emm0, emm0, c);
+        shl(emm0, emm0, 23);
+        fmul(x, y, emm0);
+    }
+
+    void log_()
+    {
+        VReg x{ 0 }, emm0{ 1 }, mask{ 2 }, y{ 3 }, etmp{ 4 }, z{ 5 }, c{ 7 };
+        loadConstant(c, ConstantIndex::min_norm_pos);
+        fmaxnm(x, x, c);
+        ushr(emm0, x, 23);
+        loadConstant(c, ConstantIndex::inv_mant_mask);
+        jit::and_(x, x, c);
+        loadConstant(c, ConstantIndex::float_half);
+        orr(x, x, c);
+        loadConstant(c, ConstantIndex::x7F);
+        subi(emm0, emm0, c);
+        scvtf(emm0, emm0);
+        fadd(emm0, emm0, one);
+        loadConstant(c, ConstantIndex::sqrt_1_2);
+        fcmgt(mask, c, x);
+        jit::and_(etmp, x, mask);
+        fsub(x, x, one);
+        jit::and_(mask, mask, one);
+        fsub(emm0, emm0, mask);
+        fadd(x, x, etmp);
+        fmul(z, x, x);
+        loadConstant(c, ConstantIndex::log_p0);
+        fmul(y, x, c);
+        for (int i = 1; i <= 8; ++i) {
+            loadConstant(c, ConstantIndex::log_p0 + i);
+            fadd(y, y, c);
+            fmul(y, y, x);
+        }
+        fmul(y, y, z);
+        loadConstant(c, ConstantIndex::log_q1);
+        fmul(etmp, emm0, c);
+        fadd(y, y, etmp);
+        loadConstant(c, ConstantIndex::float_half);
+        fmul(z, z, c);
+        fsub(y, y, z);
+        loadConstant(c, ConstantIndex::log_q2);
+        fmul(emm0, emm0, c);
+        fadd(x, x, y);
+        fadd(x, x, emm0);
+    }
+
+    void sincos_(bool issin)
+    {
+        VReg x{ 0 }, t1{ 1 }, sign{ 2 }, t2{ 3 }, t3{ 4 }, t4{ 5 }, c{ 7 };
+        // Remove sign
+        loadConstant(c, ConstantIndex::absmask);
+        if (issin)
+            bic(sign, x, c);
+        else
+            movi0(sign);
+        jit::and_(t1, x, c);
+        // Range reduction
+        loadConstant(t3, ConstantIndex::float_rintf);
+        loadConstant(c, ConstantIndex::float_invpi);
+        fmul(t2, t1, c);
+        fadd(t2, t2, t3);
+        shl(t4, t2, 31);
+        eor(sign, sign, t4);
+        fsub(t2, t2, t3);
+        for (int i = 0; i < 4; ++i) {
+            loadConstant(c, ConstantIndex::float_pi1 + i);
+            fmls(t1, t2, c);
+        }
+        fmul(t2, t1, t1);
+        if (issin) {
+            // Evaluate minimax polynomial for sin(x) in [-pi/2, pi/2] interval
+            // Y <- X + X * X^2 * (C3 + X^2 * (C5 + X^2 * (C7 + X^2 * C9)))
+            loadConstant(t3, ConstantIndex::float_sinC7);
+            loadConstant(c, ConstantIndex::float_sinC9);
+            fmla(t3, t2, c);
+            loadConstant(t4, ConstantIndex::float_sinC5);
+            fmla(t4, t3, t2);
+            loadConstant(t3, ConstantIndex::float_sinC3);
+            fmla(t3, t4, t2);
+            fmul(t3, t3, t2);
+            fmla(t1, t1, t3);
+        } else {
+            // Evaluate minimax polynomial for cos(x) in [-pi/2, pi/2] interval
+            // Y <- 1 + X^2 * (C2 + X^2 * (C4 + X^2 * (C6 + X^2 * C8)))
+            loadConstant(t3, ConstantIndex::float_cosC6);
+            loadConstant(c, ConstantIndex::float_cosC8);
+            fmla(t3, t2, c);
+            loadConstant(t4, ConstantIndex::float_cosC4);
+            fmla(t4, t3, t2);
+            loadConstant(t3, ConstantIndex::float_cosC2);
+            fmla(t3, t4, t2);
+            mov(t1, one);
+            fmla(t1, t3, t2);
+        }
+        // Apply sign
+        eor(x, t1, sign);
+    }
+
+    void exp(const ExprInstruction &insn) override
+    {
+        record(insn, EMIT()
+        {
+            for (int h = 0; h < 2; ++h) {
+                mov(VReg{ 0 }, src(insn.src1, h, 0));
+                exp_();
+                mov(dst(insn.dst, h), VReg{ 0 });
+                commit(insn.dst, h);
+            }
+        });
+    }
+
+    void log(const ExprInstruction &insn) override
+    {
+        record(insn, EMIT()
+        {
+            for (int h = 0; h < 2; ++h) {
+                mov(VReg{ 0 }, src(insn.src1, h, 0));
+                log_();
+                mov(dst(insn.dst, h), VReg{ 0 });
+                commit(insn.dst, h);
+            }
+        });
+    }
+
+    void pow(const ExprInstruction &insn) override
+    {
+        record(insn, EMIT()
+        {
+            // log_() leaves v6 alone, so the exponent waits there
+            for (int h = 0; h < 2; ++h) {
+                mov(VReg{ 6 }, src(insn.src2, h, 1));
+                mov(VReg{ 0 }, src(insn.src1, h, 0));
+                log_();
+                fmul(VReg{ 0 }, VReg{ 0 }, VReg{ 6 });
+                exp_();
+                mov(dst(insn.dst, h), VReg{ 0 });
+                commit(insn.dst, h);
+            }
+        });
+    }
+
+    void sincos(bool issin, const ExprInstruction &insn)
+    {
+        record(insn, [this, issin, insn]()
+        {
+            for (int h = 0; h < 2; ++h) {
+                mov(VReg{ 0 }, src(insn.src1, h, 0));
+                sincos_(issin);
+                mov(dst(insn.dst, h), VReg{ 0 });
+                commit(insn.dst, h);
+            }
+        });
+    }
+
+    void sin(const ExprInstruction &insn) override
+    {
+        sincos(true, insn);
+    }
+
+    void cos(const ExprInstruction &insn) override
+    {
+        sincos(false, insn);
+    }
+
+    // The most used bytecode registers get vector registers, the rest go to the stack.
+    void assignRegisters()
+    {
+        std::vector<std::pair<int, unsigned>> regs(useCount.begin(), useCount.end());
+        std::stable_sort(regs.begin(), regs.end(), [](const auto &lhs, const auto &rhs) { return lhs.second > rhs.second || (lhs.second == rhs.second && lhs.first < rhs.first); });
+
+        numSlots = 0;
+        for (size_t i = 0; i < regs.size(); ++i) {
+            if (i < numBytecodeRegPairs)
+                bytecodeRegs[regs[i].first] = { firstBytecodeReg + static_cast<unsigned>(i) * 2, -1 };
+            else
+                bytecodeRegs[regs[i].first] = { 0, numSlots++ };
+        }
+    }
+
+    void main()
+    {
+        assignRegisters();
+
+        unsigned frameSize = (savedRegsSize + numSlots * 32 + 15) & ~15;
+        jit::sub(SP, SP, frameSize);
+        for (unsigned i = 0; i < 8; i += 2)
+            stpd(VReg{ 8 + i }, VReg{ 9 + i }, SP, i * 8);
+
+        constantsReloc = label() * sizeof(uint32_t);
+        movAbs(constants, reinterpret_cast<uintptr_t>(constData));
+        loadConstant(one, ConstantIndex::float_one);
+        movi0(zero);
+
+        if (usesCoordX) {
+            loadConstant(coordX[0], ConstantIndex::lane_index_lo);
+            loadConstant(coordX[1], ConstantIndex::lane_index_hi);
+        }
+
+        size_t wloop = label();
+
+        for (const auto &f : deferred) {
+            f();
+        }
+
+        int numPointers = numInputs + 1;
+        for (int i = 0; i < numPointers; i += 2) {
+            XReg p1{ 11 }, p2{ 12 }, o1{ 13 }, o2{ 14 };
+            if (i + 1 < numPointers) {
+                ldp(p1, p2, regptrs, i * 8);
+                ldp(o1, o2, regoffs, i * 8);
+                jit::add(p1, p1, o1);
+                jit::add(p2, p2, o2);
+                stp(p1, p2, regptrs, i * 8);
+            } else {
+                ldr(p1, regptrs, i * 8);
+                ldr(o1, regoffs, i * 8);
+                jit::add(p1, p1, o1);
+                str(p1, regptrs, i * 8);
+            }
+        }
+
+        if (usesCoordX) {
+            loadConstant(VReg{ 0 }, ConstantIndex::float_8);
+            fadd(coordX[0], coordX[0], VReg{ 0 });
+            fadd(coordX[1], coordX[1], VReg{ 0 });
+        }
+
+        subs(niter, niter, 1);
+        bne(wloop);
+
+        for (unsigned i = 0; i < 8; i += 2)
+            ldpd(VReg{ 8 + i }, VReg{ 9 + i }, SP, i * 8);
+        jit::add(SP, SP, frameSize);
+        ret();
+    }
+
+public:
+    explicit ExprCompilerNeon(int numInputs) : numInputs(numInputs), numSlots(), usesCoordX() {}
+
+    int pixelsPerIteration() const override { return 8; }
+
+    std::pair<ProcessLineProc, size_t> getCode() override
+    {
+        main();
+
+        // For example too many spill slots for the 12 bit scaled offsets, Expr runs the interpreter instead
+        if (isUnencodable())
+            return { nullptr, 0 };
+
+        const std::vector<uint32_t> &code = getInstructions();
+        size_t size = code.size() * sizeof(uint32_t);
+        void *ptr = alloc_jit_code(code.data(), size);
+        return { reinterpret_cast<ProcessLineProc>(ptr), ptr ? size : 0 };
+    }
+
+    std::vector<const void *> getSymbols() const override { return { constData }; }
+
+    bool getRelocations(const void *code, size_t size, std::vector<Relocation> &relocs) const override
+    {
+        relocs.push_back({ constantsReloc, 0 });
+        return true;
+    }
+
+    void applyRelocation(uint8_t *code, const Relocation &reloc, const void *addr) const override
+    {
+        uint64_t imm = reinterpret_cast<uintptr_t>(addr);
+        for (unsigned i = 0; i < 4; ++i) {
+            uint32_t insn;
+            memcpy(&insn, code + reloc.offset + i * sizeof(insn), sizeof(insn));
+            insn = (insn & ~(0xFFFFU << 5)) | static_cast<uint32_t>(((imm >> (i * 16)) & 0xFFFF) << 5);
+            memcpy(code + reloc.offset + i * sizeof(insn), &insn, sizeof(insn));
+        }
+    }
+#undef EMIT
+};
+
+constexpr ExprUnion ExprCompilerNeon::constData alignas(16)[56][4];
+
+} // namespace
+
+std::unique_ptr<ExprCompiler> make_neon_compiler(int numInputs)
+{
+    return std::make_unique<ExprCompilerNeon>(numInputs);
+}
+
+} // namespace expr
+
+#endif // VS_TARGET_CPU_ARM64
@@ -20,6 +20,8 @@
 
 #ifdef VS_TARGET_CPU_X86
 
+#include <algorithm>
+#include <cmath>
 #include <functional>
 #include <unordered_map>
 #include <vector>
@@ -41,13 +43,13 @@ static_assert(static_cast<int>(ComparisonType::NLT) == _CMP_NLT_US, "");
 static_assert(static_cast<int>(ComparisonType::NLE) == _CMP_NLE_US, "");
 #endif
 
-class ExprCompiler128 : public ExprCompiler, private jitasm::function<void, ExprCompiler128, uint8_t *, const intptr_t *, intptr_t> {
-    typedef jitasm::function<void, ExprCompiler128, uint8_t *, const intptr_t *, intptr_t> jit;
-    friend struct jitasm::function<void, ExprCompiler128, uint8_t *, const intptr_t *, intptr_t>;
-    friend struct jitasm::function_cdecl<void, ExprCompiler128, uint8_t *, const intptr_t *, intptr_t>;
+class ExprCompiler128 : public ExprCompiler, private jitasm::function<void, ExprCompiler128, uint8_t *, const intptr_t *, intptr_t, const float *> {
+    typedef jitasm::function<void, ExprCompiler128, uint8_t *, const intptr_t *, intptr_t, const float *> jit;
+    friend struct jitasm::function<void, ExprCompiler128, uint8_t *, const intptr_t *, intptr_t, const float *>;
+    friend struct jitasm::function_cdecl<void, ExprCompiler128, uint8_t *, const intptr_t *, intptr_t, const float *>;
 
 #define SPLAT(x) { (x), (x), (x), (x) }
-    static constexpr ExprUnion constData alignas(16)[53][4] = {
+    static constexpr ExprUnion constData alignas(16)[56][4] = {
         SPLAT(0x7FFFFFFF), // absmask
         SPLAT(0x80000000), // negmask
         SPLAT(0x7F), // x7F
@@ -101,6 +103,9 @@ class ExprCompiler128 : public ExprCompiler, private jitasm::function<void, Expr
         SPLAT(0x3D2AA73C), // float_cosC4
         SPLAT(static_cast<int32_t>(0XBAB58D50)), // float_cosC6
         SPLAT(0x37C1AD76), // float_cosC8
+        { 0.0f, 1.0f, 2.0f, 3.0f }, // lane_index_lo
+        { 4.0f, 5.0f, 6.0f, 7.0f }, // lane_index_hi
+        SPLAT(8.0f), // float_8
     };
 
     struct ConstantIndex {
@@ -159,6 +164,9 @@ class ExprCompiler128 : public ExprCompiler, private jitasm::function<void, Expr
         static constexpr int float_cosC4 = float_cosC2 + 1;
         static constexpr int float_cosC6 = float_cosC2 + 2;
         static constexpr int float_cosC8 = float_cosC2 + 3;
+        static constexpr int lane_index_lo = 53;
+        static constexpr int lane_index_hi = 54;
+        static constexpr int float_8 = 55;
     };
 #undef SPLAT
 
@@ -168,6 +176,11 @@ class ExprCompiler128 : public ExprCompiler, private jitasm::function<void, Expr
     CPUFeatures cpuFeatures;
     int numInputs;
     int curLabel;
+    bool usesCoordX;
+
+    // Assigned in main(), read by the runtime constant and x coordinate loads.
+    Reg runtimeConsts;
+    XmmReg coordX[2];
 
 #define EMIT() [this, insn](Reg regptrs, XmmReg zero, Reg constants, std::unordered_map<int, std::pair<XmmReg, XmmReg>> &bytecodeRegs)
 #define VEX1(op, arg1, arg2) \
@@ -226,9 +239,10 @@ do { \
         deferred.push_back(EMIT()
         {
             auto t1 = bytecodeRegs[insn.dst];
+            int offset = loadOffsetX(insn.op.imm) * 1;
             Reg a;
-            mov(a, ptr[regptrs + sizeof(void *) * (insn.op.imm.u + 1)]);
-            VEX1(movq, t1.first, mmword_ptr[a]);
+            mov(a, ptr[regptrs + sizeof(void *) * (loadInput(insn.op.imm) + 1)]);
+            VEX1(movq, t1.first, mmword_ptr[a + offset]);
             VEX2(punpcklbw, t1.first, t1.first, zero);
             VEX2(punpckhwd, t1.second, t1.first, zero);
             VEX2(punpcklwd, t1.first, t1.first, zero);
@@ -242,9 +256,13 @@ do { \
         deferred.push_back(EMIT()
         {
             auto t1 = bytecodeRegs[insn.dst];
+            int offset = loadOffsetX(insn.op.imm) * 2;
             Reg a;
-            mov(a, ptr[regptrs + sizeof(void *) * (insn.op.imm.u + 1)]);
-            VEX1(movdqa, t1.first, xmmword_ptr[a]);
+            mov(a, ptr[regptrs + sizeof(void *) * (loadInput(insn.op.imm) + 1)]);
+            if (offset)
+                VEX1(movdqu, t1.first, xmmword_ptr[a + offset]);
+            else
+                VEX1(movdqa, t1.first, xmmword_ptr[a]);
             VEX2(punpckhwd, t1.second, t1.first, zero);
             VEX2(punpcklwd, t1.first, t1.first, zero);
             VEX1(cvtdq2ps, t1.first, t1.first);
@@ -257,10 +275,11 @@ do { \
         deferred.push_back(EMIT()
         {
             auto t1 = bytecodeRegs[insn.dst];
+            int offset = loadOffsetX(insn.op.imm) * 2;
             Reg a;
-            mov(a, ptr[regptrs + sizeof(void *) * (insn.op.imm.u + 1)]);
-            vcvtph2ps(t1.first, qword_ptr[a]);
-            vcvtph2ps(t1.second, qword_ptr[a + 8]);
+            mov(a, ptr[regptrs + sizeof(void *) * (loadInput(insn.op.imm) + 1)]);
+            vcvtph2ps(t1.first, qword_ptr[a + offset]);
+            vcvtph2ps(t1.second, qword_ptr[a + offset + 8]);
         });
     }
 
@@ -269,10 +288,16 @@ do { \
         deferred.push_back(EMIT()
         {
             auto t1 = bytecodeRegs[insn.dst];
+            int offset = loadOffsetX(insn.op.imm) * 4;
             Reg a;
-            mov(a, ptr[regptrs + sizeof(void *) * (insn.op.imm.u + 1)]);
-            VEX1(movdqa, t1.first, xmmword_ptr[a]);
-            VEX1(movdqa, t1.second, xmmword_ptr[a + 16]);
+            mov(a, ptr[regptrs + sizeof(void *) * (loadInput(insn.op.imm) + 1)]);
+            if (offset) {
+                VEX1(movdqu, t1.first, xmmword_ptr[a + offset]);
+                VEX1(movdqu, t1.second, xmmword_ptr[a + offset + 16]);
+            } else {
+                VEX1(movdqa, t1.first, xmmword_ptr[a]);
+                VEX1(movdqa, t1.second, xmmword_ptr[a + 16]);
+            }
         });
     }
 
@@ -296,6 +321,28 @@ do { \
         });
     }
 
+    void loadRuntimeConst(const ExprInstruction &insn) override
+    {
+        deferred.push_back(EMIT()
+        {
+            auto t1 = bytecodeRegs[insn.dst];
+            VEX1(movd, t1.first, dword_ptr[runtimeConsts + insn.op.imm.u * 4]);
+            VEX2IMM(shufps, t1.first, t1.first, t1.first, 0);
+            VEX1(movaps, t1.second, t1.first);
+        });
+    }
+
+    void loadCoordX(const ExprInstruction &insn) override
+    {
+        usesCoordX = true;
+        deferred.push_back(EMIT()
+        {
+            auto t1 = bytecodeRegs[insn.dst];
+            VEX1(movaps, t1.first, coordX[0]);
+            VEX1(movaps, t1.second, coordX[1]);
+        });
+    }
+
     void store8(const ExprInstruction &insn) override
     {
         deferred.push_back(EMIT()
@@ -310,7 +357,7 @@ do { \
             VEX1(cvtps2dq, r2, r2);
             VEX2(packssdw, r1, r1, r2);
             VEX2(packuswb, r1, r1, zero);
-            mov(a, ptr[regptrs]);
+            mov(a, ptr[regptrs + sizeof(void *) * storeSlot(insn.op.imm)]);
             VEX1(movq, mmword_ptr[a], r1);
         });
     }
@@ -319,7 +366,7 @@ do { \
     {
         deferred.push_back(EMIT()
         {
-            int depth = insn.op.imm.u;
+            int depth = storeDepth(insn.op.imm);
             auto t1 = bytecodeRegs[insn.src1];
             XmmReg r1, r2, limit;
             Reg a;
@@ -346,7 +393,7 @@ do { \
                     // without SSE4.1's packusdw clamp it up to 0 to match the interpreter/other tiers
                     VEX2(pmaxsw, r1, r1, zero);
             }
-            mov(a, ptr[regptrs]);
+            mov(a, ptr[regptrs + sizeof(void *) * storeSlot(insn.op.imm)]);
             VEX1(movaps, xmmword_ptr[a], r1);
         });
     }
@@ -358,7 +405,7 @@ do { \
             auto t1 = bytecodeRegs[insn.src1];
 
             Reg a;
-            mov(a, ptr[regptrs]);
+            mov(a, ptr[regptrs + sizeof(void *) * storeSlot(insn.op.imm)]);
             vcvtps2ph(qword_ptr[a], t1.first, 0);
             vcvtps2ph(qword_ptr[a + 8], t1.second, 0);
         });
@@ -371,7 +418,7 @@ do { \
             auto t1 = bytecodeRegs[insn.src1];
 
             Reg a;
-            mov(a, ptr[regptrs]);
+            mov(a, ptr[regptrs + sizeof(void *) * storeSlot(insn.op.imm)]);
             VEX1(movaps, xmmword_ptr[a], t1.first);
             VEX1(movaps, xmmword_ptr[a + 16], t1.second);
         });
@@ -935,13 +982,19 @@ do { \
         sincos(false, insn);
     }
 
-    void main(Reg regptrs, Reg regoffs, Reg niter)
+    void main(Reg regptrs, Reg regoffs, Reg niter, Reg regconsts)
     {
         std::unordered_map<int, std::pair<XmmReg, XmmReg>> bytecodeRegs;
         XmmReg zero;
         VEX2(pxor, zero, zero, zero);
         Reg constants;
         mov(constants, (uintptr_t)constData);
+        runtimeConsts = regconsts;
+
+        if (usesCoordX) {
+            VEX1(movaps, coordX[0], xmmword_ptr[constants + ConstantIndex::lane_index_lo * 16]);
+            VEX1(movaps, coordX[1], xmmword_ptr[constants + ConstantIndex::lane_index_hi * 16]);
+        }
 
         L("wloop");
 
@@ -967,26 +1020,28 @@ do { \
         }
 #endif
 
+        if (usesCoordX) {
+            VEX2(addps, coordX[0], coordX[0], xmmword_ptr[constants + ConstantIndex::float_8 * 16]);
+            VEX2(addps, coordX[1], coordX[1], xmmword_ptr[constants + ConstantIndex::float_8 * 16]);
+        }
+
         jit::sub(niter, 1);
         jnz("wloop");
     }
 
 public:
-    explicit ExprCompiler128(int numInputs) : cpuFeatures(*getCPUFeatures()), numInputs(numInputs), curLabel() {}
+    explicit ExprCompiler128(int numInputs) : cpuFeatures(*getCPUFeatures()), numInputs(numInputs), curLabel(), usesCoordX() {}
 
     int pixelsPerIteration() const override { return 8; }
 
+    std::vector<const void *> getSymbols() const override { return { constData }; }
+
     std::pair<ProcessLineProc, size_t> getCode() override
     {
         size_t size;
         if (jit::GetCode() && (size = GetCodeSize())) {
-#ifdef VS_TARGET_OS_WINDOWS
-            void *ptr = VirtualAlloc(nullptr, size, MEM_COMMIT, PAGE_EXECUTE_READWRITE);
-#else
-            void *ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_ANON | MAP_PRIVATE, 0, 0);
-#endif
-            memcpy(ptr, jit::GetCode(), size);
-            return { reinterpret_cast<ProcessLineProc>(ptr), size };
+            if (void *ptr = alloc_jit_code(jit::GetCode(), size))
+                return { reinterpret_cast<ProcessLineProc>(ptr), size };
         }
         return { nullptr, 0 };
     }
@@ -997,15 +1052,15 @@ public:
 #undef EMIT
 };
 
-constexpr ExprUnion ExprCompiler128::constData alignas(16)[53][4];
+constexpr ExprUnion ExprCompiler128::constData alignas(16)[56][4];
 
-class ExprCompiler256 : public ExprCompiler, private jitasm::function<void, ExprCompiler256, uint8_t *, const intptr_t *, intptr_t> {
-    typedef jitasm::function<void, ExprCompiler256, uint8_t *, const intptr_t *, intptr_t> jit;
-    friend struct jitasm::function<void, ExprCompiler256, uint8_t *, const intptr_t *, intptr_t>;
-    friend struct jitasm::function_cdecl<void, ExprCompiler256, uint8_t *, const intptr_t *, intptr_t>;
+class ExprCompiler256 : public ExprCompiler, private jitasm::function<void, ExprCompiler256, uint8_t *, const intptr_t *, intptr_t, const float *> {
+    typedef jitasm::function<void, ExprCompiler256, uint8_t *, const intptr_t *, intptr_t, const float *> jit;
+    friend struct jitasm::function<void, ExprCompiler256, uint8_t *, const intptr_t *, intptr_t, const float *>;
+    friend struct jitasm::function_cdecl<void, ExprCompiler256, uint8_t *, const intptr_t *, intptr_t, const float *>;
 
 #define SPLAT(x) { (x), (x), (x), (x), (x), (x), (x), (x) }
-    static constexpr ExprUnion constData alignas(32)[53][8] = {
+    static constexpr ExprUnion constData alignas(32)[55][8] = {
         SPLAT(0x7FFFFFFF), // absmask
         SPLAT(0x80000000), // negmask
         SPLAT(0x7F), // x7F
@@ -1059,6 +1114,8 @@ class ExprCompiler256 : public ExprCompiler, private jitasm::function<void, Expr
         SPLAT(0x3D2AA73C), // float_cosC4
         SPLAT(static_cast<int32_t>(0XBAB58D50)), // float_cosC6
         SPLAT(0x37C1AD76), // float_cosC8
+        { 0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f }, // lane_index
+        SPLAT(8.0f), // float_8
     };
 
     struct ConstantIndex {
@@ -1117,6 +1174,8 @@ class ExprCompiler256 : public ExprCompiler, private jitasm::function<void, Expr
         static constexpr int float_cosC4 = float_cosC2 + 1;
         static constexpr int float_cosC6 = float_cosC2 + 2;
         static constexpr int float_cosC8 = float_cosC2 + 3;
+        static constexpr int lane_index = 53;
+        static constexpr int float_8 = 54;
     };
 #undef SPLAT
 
@@ -1126,6 +1185,11 @@ class ExprCompiler256 : public ExprCompiler, private jitasm::function<void, Expr
     CPUFeatures cpuFeatures;
     int numInputs;
     int curLabel;
+    bool usesCoordX;
+
+    // Assigned in main(), read by the runtime constant and x coordinate loads.
+    Reg runtimeConsts;
+    YmmReg coordX;
 
 #define EMIT() [this, insn](Reg regptrs, YmmReg zero, Reg constants, std::unordered_map<int, YmmReg> &bytecodeRegs)
 
@@ -1134,9 +1198,10 @@ class ExprCompiler256 : public ExprCompiler, private jitasm::function<void, Expr
         deferred.push_back(EMIT()
         {
             auto t1 = bytecodeRegs[insn.dst];
+            int offset = loadOffsetX(insn.op.imm) * 1;
             Reg a;
-            mov(a, ptr[regptrs + sizeof(void *) * (insn.op.imm.u + 1)]);
-            vpmovzxbd(t1, mmword_ptr[a]);
+            mov(a, ptr[regptrs + sizeof(void *) * (loadInput(insn.op.imm) + 1)]);
+            vpmovzxbd(t1, mmword_ptr[a + offset]);
             vcvtdq2ps(t1, t1);
         });
     }
@@ -1146,9 +1211,10 @@ class ExprCompiler256 : public ExprCompiler, private jitasm::function<void, Expr
         deferred.push_back(EMIT()
         {
             auto t1 = bytecodeRegs[insn.dst];
+            int offset = loadOffsetX(insn.op.imm) * 2;
             Reg a;
-            mov(a, ptr[regptrs + sizeof(void *) * (insn.op.imm.u + 1)]);
-            vpmovzxwd(t1, xmmword_ptr[a]);
+            mov(a, ptr[regptrs + sizeof(void *) * (loadInput(insn.op.imm) + 1)]);
+            vpmovzxwd(t1, xmmword_ptr[a + offset]);
             vcvtdq2ps(t1, t1);
         });
     }
@@ -1158,9 +1224,10 @@ class ExprCompiler256 : public ExprCompiler, private jitasm::function<void, Expr
         deferred.push_back(EMIT()
         {
             auto t1 = bytecodeRegs[insn.dst];
+            int offset = loadOffsetX(insn.op.imm) * 2;
             Reg a;
-            mov(a, ptr[regptrs + sizeof(void *) * (insn.op.imm.u + 1)]);
-            vcvtph2ps(t1, xmmword_ptr[a]);
+            mov(a, ptr[regptrs + sizeof(void *) * (loadInput(insn.op.imm) + 1)]);
+            vcvtph2ps(t1, xmmword_ptr[a + offset]);
         });
     }
 
@@ -1169,9 +1236,13 @@ class ExprCompiler256 : public ExprCompiler, private jitasm::function<void, Expr
         deferred.push_back(EMIT()
         {
             auto t1 = bytecodeRegs[insn.dst];
+            int offset = loadOffsetX(insn.op.imm) * 4;
             Reg a;
-            mov(a, ptr[regptrs + sizeof(void *) * (insn.op.imm.u + 1)]);
-            vmovaps(t1, ymmword_ptr[a]);
+            mov(a, ptr[regptrs + sizeof(void *) * (loadInput(insn.op.imm) + 1)]);
+            if (offset)
+                vmovups(t1, ymmword_ptr[a + offset]);
+            else
+                vmovaps(t1, ymmword_ptr[a]);
         });
     }
 
@@ -1194,6 +1265,25 @@ class ExprCompiler256 : public ExprCompiler, private jitasm::function<void, Expr
         });
     }
 
+    void loadRuntimeConst(const ExprInstruction &insn) override
+    {
+        deferred.push_back(EMIT()
+        {
+            auto t1 = bytecodeRegs[insn.dst];
+            vbroadcastss(t1, dword_ptr[runtimeConsts + insn.op.imm.u * 4]);
+        });
+    }
+
+    void loadCoordX(const ExprInstruction &insn) override
+    {
+        usesCoordX = true;
+        deferred.push_back(EMIT()
+        {
+            auto t1 = bytecodeRegs[insn.dst];
+            vmovaps(t1, coordX);
+        });
+    }
+
     void store8(const ExprInstruction &insn) override
     {
         deferred.push_back(EMIT()
@@ -1206,7 +1296,7 @@ class ExprCompiler256 : public ExprCompiler, private jitasm::function<void, Expr
             vpackssdw(r1, r1, r1);
             vpermq(r1, r1, 0x08);
             vpackuswb(r1, r1, zero);
-            mov(a, ptr[regptrs]);
+            mov(a, ptr[regptrs + sizeof(void *) * storeSlot(insn.op.imm)]);
             vmovq(qword_ptr[a], r1.as128());
         });
     }
@@ -1215,7 +1305,7 @@ class ExprCompiler256 : public ExprCompiler, private jitasm::function<void, Expr
     {
         deferred.push_back(EMIT()
         {
-            int depth = insn.op.imm.u;
+            int depth = storeDepth(insn.op.imm);
             auto t1 = bytecodeRegs[insn.src1];
             YmmReg r1, limit;
             Reg a;
@@ -1223,7 +1313,7 @@ class ExprCompiler256 : public ExprCompiler, private jitasm::function<void, Expr
             vcvtps2dq(r1, r1);
             vpackusdw(r1, r1, r1);
             vpermq(r1, r1, 0x08);
-            mov(a, ptr[regptrs]);
+            mov(a, ptr[regptrs + sizeof(void *) * storeSlot(insn.op.imm)]);
             vmovaps(xmmword_ptr[a], r1.as128());
         });
     }
@@ -1234,7 +1324,7 @@ class ExprCompiler256 : public ExprCompiler, private jitasm::function<void, Expr
         {
             auto t1 = bytecodeRegs[insn.src1];
             Reg a;
-            mov(a, ptr[regptrs]);
+            mov(a, ptr[regptrs + sizeof(void *) * storeSlot(insn.op.imm)]);
             vcvtps2ph(xmmword_ptr[a], t1, 0);
         });
     }
@@ -1245,7 +1335,7 @@ class ExprCompiler256 : public ExprCompiler, private jitasm::function<void, Expr
         {
             auto t1 = bytecodeRegs[insn.src1];
             Reg a;
-            mov(a, ptr[regptrs]);
+            mov(a, ptr[regptrs + sizeof(void *) * storeSlot(insn.op.imm)]);
             vmovaps(ymmword_ptr[a], t1);
         });
     }
@@ -1619,13 +1709,17 @@ do { \
         });
     }
 
-    void main(Reg regptrs, Reg regoffs, Reg niter)
+    void main(Reg regptrs, Reg regoffs, Reg niter, Reg regconsts)
     {
         std::unordered_map<int, YmmReg> bytecodeRegs;
         YmmReg zero;
         vpxor(zero, zero, zero);
         Reg constants;
         mov(constants, (uintptr_t)constData);
+        runtimeConsts = regconsts;
+
+        if (usesCoordX)
+            vmovaps(coordX, ymmword_ptr[constants + ConstantIndex::lane_index * 32]);
 
         L("wloop");
 
@@ -1651,33 +1745,399 @@ do { \
         }
 #endif
 
+        if (usesCoordX)
+            vaddps(coordX, coordX, ymmword_ptr[constants + ConstantIndex::float_8 * 32]);
+
         jit::sub(niter, 1);
         jnz("wloop");
     }
 
 public:
-    explicit ExprCompiler256(int numInputs) : cpuFeatures(*getCPUFeatures()), numInputs(numInputs) {}
+    explicit ExprCompiler256(int numInputs) : cpuFeatures(*getCPUFeatures()), numInputs(numInputs), curLabel(), usesCoordX() {}
 
     int pixelsPerIteration() const override { return 8; }
 
+    std::vector<const void *> getSymbols() const override { return { constData }; }
+
     std::pair<ProcessLineProc, size_t> getCode() override
     {
         size_t size;
         if (jit::GetCode(true) && (size = GetCodeSize())) {
-#ifdef VS_TARGET_OS_WINDOWS
-            void *ptr = VirtualAlloc(nullptr, size, MEM_COMMIT, PAGE_EXECUTE_READWRITE);
-#else
-            void *ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_ANON | MAP_PRIVATE, 0, 0);
-#endif
-            memcpy(ptr, jit::GetCode(true), size);
-            return { reinterpret_cast<ProcessLineProc>(ptr), size };
+            if (void *ptr = alloc_jit_code(jit::GetCode(true), size))
+                return { reinterpret_cast<ProcessLineProc>(ptr), size };
         }
         return { nullptr, 0 };
     }
 #undef EMIT
 };
 
-constexpr ExprUnion ExprCompiler256::constData alignas(32)[53][8];
+constexpr ExprUnion ExprCompiler256::constData alignas(32)[55][8];
+
+// AVX2 compiler for programs that analyzeInt16 proved exact in int16 lanes. Each
+// register holds 16 pixels as value * 2^frac, where frac comes from the analysis, so
+// twice as many pixels fit in a register as on the float path.
+class ExprCompilerInt16 : public ExprCompiler, private jitasm::function<void, ExprCompilerInt16, uint8_t *, const intptr_t *, intptr_t, const float *> {
+    typedef jitasm::function<void, ExprCompilerInt16, uint8_t *, const intptr_t *, intptr_t, const float *> jit;
+    friend struct jitasm::function<void, ExprCompilerInt16, uint8_t *, const intptr_t *, intptr_t, const float *>;
+    friend struct jitasm::function_cdecl<void, ExprCompilerInt16, uint8_t *, const intptr_t *, intptr_t, const float *>;
+
+    // JitASM compiles everything from main(), so record the operations for later.
+    std::vector<std::function<void(Reg, YmmReg, YmmReg, std::unordered_map<int, YmmReg> &)>> deferred;
+
+    int numInputs;
+    std::vector<int> fracBits;
+    size_t pos;
+    std::unordered_map<int, int> regFrac;
+    bool unsupported;
+
+    // Read the source fractions before calling this, dst may be one of the sources.
+    int resultFrac(const ExprInstruction &insn)
+    {
+        int frac = fracBits[pos++];
+        if (insn.dst >= 0)
+            regFrac[insn.dst] = frac;
+        return frac;
+    }
+
+    void broadcast(YmmReg dst, int value)
+    {
+        XmmReg r1;
+        Reg32 a;
+        mov(a, static_cast<uint32_t>(value) & 0xFFFF);
+        vmovd(r1, a);
+        vpbroadcastw(dst, r1);
+    }
+
+    // jitasm takes psub and pcmp whose destination is also the second source for the
+    // pxor r, r style dependency breaking idiom, which doesn't hold for the three operand
+    // forms. Going through a temporary keeps it from seeing that pattern.
+    void sub16(YmmReg dst, YmmReg a, YmmReg b) { YmmReg r1; vpsubw(r1, a, b); vmovdqa(dst, r1); }
+    void cmpeq16(YmmReg dst, YmmReg a, YmmReg b) { YmmReg r1; vpcmpeqw(r1, a, b); vmovdqa(dst, r1); }
+    void cmpgt16(YmmReg dst, YmmReg a, YmmReg b) { YmmReg r1; vpcmpgtw(r1, a, b); vmovdqa(dst, r1); }
+
+    YmmReg shiftLeft(YmmReg src, int shift)
+    {
+        if (!shift)
+            return src;
+        YmmReg r1;
+        vpsllw(r1, src, shift);
+        return r1;
+    }
+
+    // Removes frac fractional bits, rounding half to even like the float store.
+    YmmReg roundFraction(YmmReg src, int frac)
+    {
+        if (!frac)
+            return src;
+        YmmReg r1, bit;
+        vpsllw(bit, src, 15 - frac);
+        vpsrlw(bit, bit, 15);
+        vpaddw(r1, src, bit);
+        if (frac > 1) {
+            YmmReg bias;
+            broadcast(bias, (1 << (frac - 1)) - 1);
+            vpaddw(r1, r1, bias);
+        }
+        vpsraw(r1, r1, frac);
+        return r1;
+    }
+
+#define EMIT() [=, this](Reg regptrs, YmmReg zero, YmmReg ones, std::unordered_map<int, YmmReg> &bytecodeRegs)
+
+    void load8(const ExprInstruction &insn) override
+    {
+        resultFrac(insn);
+        deferred.push_back(EMIT()
+        {
+            auto t1 = bytecodeRegs[insn.dst];
+            Reg a;
+            mov(a, ptr[regptrs + sizeof(void *) * (loadInput(insn.op.imm) + 1)]);
+            vpmovzxbw(t1, xmmword_ptr[a + loadOffsetX(insn.op.imm)]);
+        });
+    }
+
+    void load16(const ExprInstruction &insn) override
+    {
+        resultFrac(insn);
+        deferred.push_back(EMIT()
+        {
+            auto t1 = bytecodeRegs[insn.dst];
+            Reg a;
+            mov(a, ptr[regptrs + sizeof(void *) * (loadInput(insn.op.imm) + 1)]);
+            vmovdqu(t1, ymmword_ptr[a + loadOffsetX(insn.op.imm) * 2]);
+        });
+    }
+
+    void loadConst(const ExprInstruction &insn) override
+    {
+        int value = static_cast<int>(std::ldexp(insn.op.imm.f, resultFrac(insn)));
+        deferred.push_back(EMIT()
+        {
+            auto t1 = bytecodeRegs[insn.dst];
+            if (value)
+                broadcast(t1, value);
+            else
+                vmovdqa(t1, zero);
+        });
+    }
+
+    void store8(const ExprInstruction &insn) override
+    {
+        int frac = resultFrac(insn);
+        deferred.push_back(EMIT()
+        {
+            YmmReg r1 = roundFraction(bytecodeRegs[insn.src1], frac);
+            YmmReg r2;
+            Reg a;
+            vpackuswb(r2, r1, r1);
+            vpermq(r2, r2, 0x08);
+            mov(a, ptr[regptrs + sizeof(void *) * storeSlot(insn.op.imm)]);
+            vmovdqu(xmmword_ptr[a], r2.as128());
+        });
+    }
+
+    void store16(const ExprInstruction &insn) override
+    {
+        int frac = resultFrac(insn);
+        deferred.push_back(EMIT()
+        {
+            int depth = storeDepth(insn.op.imm);
+            YmmReg r1 = roundFraction(bytecodeRegs[insn.src1], frac);
+            YmmReg r2;
+            Reg a;
+            vpmaxsw(r2, r1, zero);
+            if (depth < 15) {
+                YmmReg limit;
+                broadcast(limit, (1 << depth) - 1);
+                vpminsw(r2, r2, limit);
+            }
+            mov(a, ptr[regptrs + sizeof(void *) * storeSlot(insn.op.imm)]);
+            vmovdqu(ymmword_ptr[a], r2);
+        });
+    }
+
+    void add(const ExprInstruction &insn) override { binary(insn); }
+    void sub(const ExprInstruction &insn) override { binary(insn); }
+    void max(const ExprInstruction &insn) override { binary(insn); }
+    void min(const ExprInstruction &insn) override { binary(insn); }
+
+    void binary(const ExprInstruction &insn)
+    {
+        int frac1 = regFrac[insn.src1];
+        int frac2 = regFrac[insn.src2];
+        int frac = resultFrac(insn);
+        deferred.push_back(EMIT()
+        {
+            auto t1 = shiftLeft(bytecodeRegs[insn.src1], frac - frac1);
+            auto t2 = shiftLeft(bytecodeRegs[insn.src2], frac - frac2);
+            auto t3 = bytecodeRegs[insn.dst];
+            switch (insn.op.type) {
+            case ExprOpType::ADD: vpaddw(t3, t1, t2); break;
+            case ExprOpType::SUB: sub16(t3, t1, t2); break;
+            case ExprOpType::MAX: vpmaxsw(t3, t1, t2); break;
+            case ExprOpType::MIN: vpminsw(t3, t1, t2); break;
+            default: break;
+            }
+        });
+    }
+
+    void mul(const ExprInstruction &insn) override
+    {
+        resultFrac(insn);
+        deferred.push_back(EMIT()
+        {
+            vpmullw(bytecodeRegs[insn.dst], bytecodeRegs[insn.src1], bytecodeRegs[insn.src2]);
+        });
+    }
+
+    void fma(const ExprInstruction &insn) override
+    {
+        int frac1 = regFrac[insn.src1];
+        int fracProd = regFrac[insn.src2] + regFrac[insn.src3];
+        int frac = resultFrac(insn);
+        deferred.push_back(EMIT()
+        {
+            YmmReg r1;
+            vpmullw(r1, bytecodeRegs[insn.src2], bytecodeRegs[insn.src3]);
+            auto prod = shiftLeft(r1, frac - fracProd);
+            auto t1 = shiftLeft(bytecodeRegs[insn.src1], frac - frac1);
+            auto t2 = bytecodeRegs[insn.dst];
+
+            switch (static_cast<FMAType>(insn.op.imm.u)) {
+            case FMAType::FMADD: vpaddw(t2, prod, t1); break;
+            case FMAType::FMSUB: sub16(t2, prod, t1); break;
+            case FMAType::FNMADD: sub16(t2, t1, prod); break;
+            case FMAType::FNMSUB: {
+                YmmReg r2;
+                vpsubw(r2, zero, prod);
+                sub16(t2, r2, t1);
+                break;
+            }
+            }
+        });
+    }
+
+    void abs(const ExprInstruction &insn) override
+    {
+        resultFrac(insn);
+        deferred.push_back(EMIT()
+        {
+            vpabsw(bytecodeRegs[insn.dst], bytecodeRegs[insn.src1]);
+        });
+    }
+
+    void neg(const ExprInstruction &insn) override
+    {
+        resultFrac(insn);
+        deferred.push_back(EMIT()
+        {
+            sub16(bytecodeRegs[insn.dst], zero, bytecodeRegs[insn.src1]);
+        });
+    }
+
+    // Compare masks are 0 or -1. Shifting right gives 1 for a set mask, subtracting -1
+    // gives 1 for a clear one.
+    void not_(const ExprInstruction &insn) override
+    {
+        resultFrac(insn);
+        deferred.push_back(EMIT()
+        {
+            auto t1 = bytecodeRegs[insn.dst];
+            cmpgt16(t1, bytecodeRegs[insn.src1], zero);
+            vpsubw(t1, t1, ones);
+        });
+    }
+
+    void and_(const ExprInstruction &insn) override { logic(insn); }
+    void or_(const ExprInstruction &insn) override { logic(insn); }
+    void xor_(const ExprInstruction &insn) override { logic(insn); }
+
+    void logic(const ExprInstruction &insn)
+    {
+        resultFrac(insn);
+        deferred.push_back(EMIT()
+        {
+            auto t3 = bytecodeRegs[insn.dst];
+            YmmReg r1, r2;
+            vpcmpgtw(r1, bytecodeRegs[insn.src1], zero);
+            vpcmpgtw(r2, bytecodeRegs[insn.src2], zero);
+            switch (insn.op.type) {
+            case ExprOpType::AND: vpand(t3, r1, r2); break;
+            case ExprOpType::OR: vpor(t3, r1, r2); break;
+            case ExprOpType::XOR: vpxor(t3, r1, r2); break;
+            default: break;
+            }
+            vpsrlw(t3, t3, 15);
+        });
+    }
+
+    void cmp(const ExprInstruction &insn) override
+    {
+        int frac1 = regFrac[insn.src1];
+        int frac2 = regFrac[insn.src2];
+        int frac = std::max(frac1, frac2);
+        resultFrac(insn);
+        deferred.push_back(EMIT()
+        {
+            auto t1 = shiftLeft(bytecodeRegs[insn.src1], frac - frac1);
+            auto t2 = shiftLeft(bytecodeRegs[insn.src2], frac - frac2);
+            auto t3 = bytecodeRegs[insn.dst];
+
+            switch (static_cast<ComparisonType>(insn.op.imm.u)) {
+            case ComparisonType::EQ: cmpeq16(t3, t1, t2); vpsrlw(t3, t3, 15); break;
+            case ComparisonType::NEQ: cmpeq16(t3, t1, t2); vpsubw(t3, t3, ones); break;
+            case ComparisonType::LT: cmpgt16(t3, t2, t1); vpsrlw(t3, t3, 15); break;
+            case ComparisonType::NLT: cmpgt16(t3, t2, t1); vpsubw(t3, t3, ones); break;
+            case ComparisonType::LE: cmpgt16(t3, t1, t2); vpsubw(t3, t3, ones); break;
+            case ComparisonType::NLE: cmpgt16(t3, t1, t2); vpsrlw(t3, t3, 15); break;
+            }
+        });
+    }
+
+    void ternary(const ExprInstruction &insn) override
+    {
+        int frac2 = regFrac[insn.src2];
+        int frac3 = regFrac[insn.src3];
+        int frac = resultFrac(insn);
+        deferred.push_back(EMIT()
+        {
+            auto t2 = shiftLeft(bytecodeRegs[insn.src2], frac - frac2);
+            auto t3 = shiftLeft(bytecodeRegs[insn.src3], frac - frac3);
+            auto t4 = bytecodeRegs[insn.dst];
+            YmmReg r1;
+            vpcmpgtw(r1, bytecodeRegs[insn.src1], zero);
+            vpblendvb(t4, t3, t2, r1);
+        });
+    }
+#undef EMIT
+
+    // Rejected by analyzeInt16.
+    void loadF16(const ExprInstruction &) override { unsupported = true; }
+    void loadF32(const ExprInstruction &) override { unsupported = true; }
+    void loadRuntimeConst(const ExprInstruction &) override { unsupported = true; }
+    void loadCoordX(const ExprInstruction &) override { unsupported = true; }
+    void storeF16(const ExprInstruction &) override { unsupported = true; }
+    void storeF32(const ExprInstruction &) override { unsupported = true; }
+    void div(const ExprInstruction &) override { unsupported = true; }
+    void sqrt(const ExprInstruction &) override { unsupported = true; }
+    void exp(const ExprInstruction &) override { unsupported = true; }
+    void log(const ExprInstruction &) override { unsupported = true; }
+    void pow(const ExprInstruction &) override { unsupported = true; }
+    void sin(const ExprInstruction &) override { unsupported = true; }
+    void cos(const ExprInstruction &) override { unsupported = true; }
+
+    void main(Reg regptrs, Reg regoffs, Reg niter, Reg regconsts)
+    {
+        std::unordered_map<int, YmmReg> bytecodeRegs;
+        YmmReg zero, ones;
+        vpxor(zero, zero, zero);
+        vpcmpeqw(ones, ones, ones);
+
+        L("wloop");
+
+        for (const auto &f : deferred) {
+            f(regptrs, zero, ones, bytecodeRegs);
+        }
+
+#if UINTPTR_MAX > UINT32_MAX
+        for (int i = 0; i < numInputs / 4 + 1; i++) {
+            YmmReg r1, r2;
+            vmovdqu(r1, ymmword_ptr[regptrs + 32 * i]);
+            vmovdqu(r2, ymmword_ptr[regoffs + 32 * i]);
+            vpaddq(r1, r1, r2);
+            vmovdqu(ymmword_ptr[regptrs + 32 * i], r1);
+        }
+#else
+        for (int i = 0; i < numInputs / 8 + 1; i++) {
+            YmmReg r1, r2;
+            vmovdqu(r1, ymmword_ptr[regptrs + 32 * i]);
+            vmovdqu(r2, ymmword_ptr[regoffs + 32 * i]);
+            vpaddd(r1, r1, r2);
+            vmovdqu(ymmword_ptr[regptrs + 32 * i], r1);
+        }
+#endif
+
+        jit::sub(niter, 1);
+        jnz("wloop");
+    }
+
+public:
+    ExprCompilerInt16(int numInputs, const std::vector<int> &fracBits) : numInputs(numInputs), fracBits(fracBits), pos(), unsupported() {}
+
+    int pixelsPerIteration() const override { return 16; }
+
+    std::vector<const void *> getSymbols() const override { return {}; }
+
+    std::pair<ProcessLineProc, size_t> getCode() override
+    {
+        size_t size;
+        if (!unsupported && pos == fracBits.size() && jit::GetCode(true) && (size = GetCodeSize())) {
+            if (void *ptr = alloc_jit_code(jit::GetCode(true), size))
+                return { reinterpret_cast<ProcessLineProc>(ptr), size };
+        }
+        return { nullptr, 0 };
+    }
+};
 
 
 // AVX-512 compiler: processes 16 lanes per iteration in a single ZMM register,
@@ -1685,10 +2145,10 @@ constexpr ExprUnion ExprCompiler256::constData alignas(32)[53][8];
 // compare-based ops: AVX-512 vcmpps writes an opmask (k1) register, which is then
 // consumed directly -- a zero-masked broadcast of 1.0 for boolean results, and
 // vblendmps for ternary/select -- instead of expanding it back to a vector mask.
-class ExprCompiler512 : public ExprCompiler, private jitasm::function<void, ExprCompiler512, uint8_t *, const intptr_t *, intptr_t> {
-    typedef jitasm::function<void, ExprCompiler512, uint8_t *, const intptr_t *, intptr_t> jit;
-    friend struct jitasm::function<void, ExprCompiler512, uint8_t *, const intptr_t *, intptr_t>;
-    friend struct jitasm::function_cdecl<void, ExprCompiler512, uint8_t *, const intptr_t *, intptr_t>;
+class ExprCompiler512 : public ExprCompiler, private jitasm::function<void, ExprCompiler512, uint8_t *, const intptr_t *, intptr_t, const float *> {
+    typedef jitasm::function<void, ExprCompiler512, uint8_t *, const intptr_t *, intptr_t, const float *> jit;
+    friend struct jitasm::function<void, ExprCompiler512, uint8_t *, const intptr_t *, intptr_t, const float *>;
+    friend struct jitasm::function_cdecl<void, ExprCompiler512, uint8_t *, const intptr_t *, intptr_t, const float *>;
 
     typedef jitasm::ZmmReg ZmmReg;
     typedef jitasm::XmmReg XmmReg;
@@ -1699,7 +2159,7 @@ class ExprCompiler512 : public ExprCompiler, private jitasm::function<void, Expr
     // Embedded broadcast ({1to16}) reads one dword per constant and replicates it across all 16 lanes in
     // hardware, so the pool holds a single value each rather than sixteen copies. SPLAT is the identity here.
 #define SPLAT(x) (x)
-    static constexpr ExprUnion constData[53] = {
+    static constexpr ExprUnion constData[54] = {
         SPLAT(0x7FFFFFFF), // absmask
         SPLAT(0x80000000), // negmask
         SPLAT(0x7F), // x7F
@@ -1753,6 +2213,12 @@ class ExprCompiler512 : public ExprCompiler, private jitasm::function<void, Expr
         SPLAT(0x3D2AA73C), // float_cosC4
         SPLAT(static_cast<int32_t>(0XBAB58D50)), // float_cosC6
         SPLAT(0x37C1AD76), // float_cosC8
+        SPLAT(16.0f), // float_16
+    };
+
+    // Not broadcast, loaded as a whole vector.
+    static constexpr ExprUnion laneIndex alignas(64)[16] = {
+        0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f, 8.0f, 9.0f, 10.0f, 11.0f, 12.0f, 13.0f, 14.0f, 15.0f
     };
 
     struct ConstantIndex {
@@ -1803,6 +2269,7 @@ class ExprCompiler512 : public ExprCompiler, private jitasm::function<void, Expr
         static constexpr int float_cosC4 = float_cosC2 + 1;
         static constexpr int float_cosC6 = float_cosC2 + 2;
         static constexpr int float_cosC8 = float_cosC2 + 3;
+        static constexpr int float_16 = 53;
     };
 #undef SPLAT
 
@@ -1811,6 +2278,11 @@ class ExprCompiler512 : public ExprCompiler, private jitasm::function<void, Expr
     CPUFeatures cpuFeatures;
     int numInputs;
     int curLabel;
+    bool usesCoordX;
+
+    // Assigned in main(), read by the runtime constant and x coordinate loads.
+    Reg runtimeConsts;
+    ZmmReg coordX;
 
 #define EMIT() [this, insn](Reg regptrs, ZmmReg zero, Reg constants, std::unordered_map<int, ZmmReg> &bytecodeRegs)
 
@@ -1819,9 +2291,10 @@ class ExprCompiler512 : public ExprCompiler, private jitasm::function<void, Expr
         deferred.push_back(EMIT()
         {
             auto t1 = bytecodeRegs[insn.dst];
+            int offset = loadOffsetX(insn.op.imm) * 1;
             Reg a;
-            mov(a, ptr[regptrs + sizeof(void *) * (insn.op.imm.u + 1)]);
-            vpmovzxbd(t1, xmmword_ptr[a]);
+            mov(a, ptr[regptrs + sizeof(void *) * (loadInput(insn.op.imm) + 1)]);
+            vpmovzxbd(t1, xmmword_ptr[a + offset]);
             vcvtdq2ps(t1, t1);
         });
     }
@@ -1831,9 +2304,10 @@ class ExprCompiler512 : public ExprCompiler, private jitasm::function<void, Expr
         deferred.push_back(EMIT()
         {
             auto t1 = bytecodeRegs[insn.dst];
+            int offset = loadOffsetX(insn.op.imm) * 2;
             Reg a;
-            mov(a, ptr[regptrs + sizeof(void *) * (insn.op.imm.u + 1)]);
-            vpmovzxwd(t1, ymmword_ptr[a]);
+            mov(a, ptr[regptrs + sizeof(void *) * (loadInput(insn.op.imm) + 1)]);
+            vpmovzxwd(t1, ymmword_ptr[a + offset]);
             vcvtdq2ps(t1, t1);
         });
     }
@@ -1843,9 +2317,10 @@ class ExprCompiler512 : public ExprCompiler, private jitasm::function<void, Expr
         deferred.push_back(EMIT()
         {
             auto t1 = bytecodeRegs[insn.dst];
+            int offset = loadOffsetX(insn.op.imm) * 2;
             Reg a;
-            mov(a, ptr[regptrs + sizeof(void *) * (insn.op.imm.u + 1)]);
-            vcvtph2ps(t1, ymmword_ptr[a]);
+            mov(a, ptr[regptrs + sizeof(void *) * (loadInput(insn.op.imm) + 1)]);
+            vcvtph2ps(t1, ymmword_ptr[a + offset]);
         });
     }
 
@@ -1854,9 +2329,13 @@ class ExprCompiler512 : public ExprCompiler, private jitasm::function<void, Expr
         deferred.push_back(EMIT()
         {
             auto t1 = bytecodeRegs[insn.dst];
+            int offset = loadOffsetX(insn.op.imm) * 4;
             Reg a;
-            mov(a, ptr[regptrs + sizeof(void *) * (insn.op.imm.u + 1)]);
-            vmovaps(t1, zmmword_ptr[a]);
+            mov(a, ptr[regptrs + sizeof(void *) * (loadInput(insn.op.imm) + 1)]);
+            if (offset)
+                vmovups(t1, zmmword_ptr[a + offset]);
+            else
+                vmovaps(t1, zmmword_ptr[a]);
         });
     }
 
@@ -1879,6 +2358,25 @@ class ExprCompiler512 : public ExprCompiler, private jitasm::function<void, Expr
         });
     }
 
+    void loadRuntimeConst(const ExprInstruction &insn) override
+    {
+        deferred.push_back(EMIT()
+        {
+            auto t1 = bytecodeRegs[insn.dst];
+            vbroadcastss(t1, dword_ptr[runtimeConsts + insn.op.imm.u * 4]);
+        });
+    }
+
+    void loadCoordX(const ExprInstruction &insn) override
+    {
+        usesCoordX = true;
+        deferred.push_back(EMIT()
+        {
+            auto t1 = bytecodeRegs[insn.dst];
+            vmovaps(t1, coordX);
+        });
+    }
+
     void store8(const ExprInstruction &insn) override
     {
         deferred.push_back(EMIT()
@@ -1889,7 +2387,7 @@ class ExprCompiler512 : public ExprCompiler, private jitasm::function<void, Expr
             vminps(r1, t1, dword_ptr[constants + ConstantIndex::float_255 * 4]);
             vmaxps(r1, r1, zero); // vpmovusdb treats the dword as unsigned, so clamp negatives to 0 here
             vcvtps2dq(r1, r1);
-            mov(a, ptr[regptrs]);
+            mov(a, ptr[regptrs + sizeof(void *) * storeSlot(insn.op.imm)]);
             vpmovusdb(xmmword_ptr[a], r1);
         });
     }
@@ -1898,14 +2396,14 @@ class ExprCompiler512 : public ExprCompiler, private jitasm::function<void, Expr
     {
         deferred.push_back(EMIT()
         {
-            int depth = insn.op.imm.u;
+            int depth = storeDepth(insn.op.imm);
             auto t1 = bytecodeRegs[insn.src1];
             ZmmReg r1;
             Reg a;
             vminps(r1, t1, dword_ptr[constants + (ConstantIndex::float_255 + depth - 8) * 4]);
             vmaxps(r1, r1, zero); // vpmovusdw treats the dword as unsigned, so clamp negatives to 0 here
             vcvtps2dq(r1, r1);
-            mov(a, ptr[regptrs]);
+            mov(a, ptr[regptrs + sizeof(void *) * storeSlot(insn.op.imm)]);
             vpmovusdw(ymmword_ptr[a], r1);
         });
     }
@@ -1916,7 +2414,7 @@ class ExprCompiler512 : public ExprCompiler, private jitasm::function<void, Expr
         {
             auto t1 = bytecodeRegs[insn.src1];
             Reg a;
-            mov(a, ptr[regptrs]);
+            mov(a, ptr[regptrs + sizeof(void *) * storeSlot(insn.op.imm)]);
             vcvtps2ph(ymmword_ptr[a], t1, 0);
         });
     }
@@ -1927,7 +2425,7 @@ class ExprCompiler512 : public ExprCompiler, private jitasm::function<void, Expr
         {
             auto t1 = bytecodeRegs[insn.src1];
             Reg a;
-            mov(a, ptr[regptrs]);
+            mov(a, ptr[regptrs + sizeof(void *) * storeSlot(insn.op.imm)]);
             vmovaps(zmmword_ptr[a], t1);
         });
     }
@@ -2268,13 +2766,20 @@ do { \
         deferred.push_back(EMIT() { sincos_(false, insn, constants, bytecodeRegs); });
     }
 
-    void main(Reg regptrs, Reg regoffs, Reg niter)
+    void main(Reg regptrs, Reg regoffs, Reg niter, Reg regconsts)
     {
         std::unordered_map<int, ZmmReg> bytecodeRegs;
         ZmmReg zero;
         vxorps(zero, zero, zero);
         Reg constants;
         mov(constants, (uintptr_t)constData);
+        runtimeConsts = regconsts;
+
+        if (usesCoordX) {
+            Reg a;
+            mov(a, (uintptr_t)laneIndex);
+            vmovaps(coordX, zmmword_ptr[a]);
+        }
 
         L("wloop");
 
@@ -2302,12 +2807,15 @@ do { \
         }
 #endif
 
+        if (usesCoordX)
+            vaddps(coordX, coordX, dword_ptr[constants + ConstantIndex::float_16 * 4]);
+
         jit::sub(niter, 1);
         jnz("wloop");
     }
 
 public:
-    explicit ExprCompiler512(int numInputs) : cpuFeatures(*getCPUFeatures()), numInputs(numInputs), curLabel()
+    explicit ExprCompiler512(int numInputs) : cpuFeatures(*getCPUFeatures()), numInputs(numInputs), curLabel(), usesCoordX()
     {
         // AVX-512 exposes 32 vector registers (zmm0-31), not 16. This tier is only
         // selected when the aggregate avx512 feature (which includes AVX-512VL) is
@@ -2318,24 +2826,22 @@ public:
 
     int pixelsPerIteration() const override { return 16; }
 
+    std::vector<const void *> getSymbols() const override { return { constData, laneIndex }; }
+
     std::pair<ProcessLineProc, size_t> getCode() override
     {
         size_t size;
         if (jit::GetCode(true) && (size = GetCodeSize())) {
-#ifdef VS_TARGET_OS_WINDOWS
-            void *ptr = VirtualAlloc(nullptr, size, MEM_COMMIT, PAGE_EXECUTE_READWRITE);
-#else
-            void *ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_ANON | MAP_PRIVATE, 0, 0);
-#endif
-            memcpy(ptr, jit::GetCode(true), size);
-            return { reinterpret_cast<ProcessLineProc>(ptr), size };
+            if (void *ptr = alloc_jit_code(jit::GetCode(true), size))
+                return { reinterpret_cast<ProcessLineProc>(ptr), size };
         }
         return { nullptr, 0 };
     }
 #undef EMIT
 };
 
-constexpr ExprUnion ExprCompiler512::constData[53];
+constexpr ExprUnion ExprCompiler512::constData[54];
+constexpr ExprUnion ExprCompiler512::laneIndex alignas(64)[16];
 
 
 } // namespace
@@ -2350,6 +2856,11 @@ std::unique_ptr<ExprCompiler> make_ymm_compiler(int numInputs)
     return std::make_unique<ExprCompiler256>(numInputs);
 }
 
+std::unique_ptr<ExprCompiler> make_int16_compiler(int numInputs, const std::vector<int> &fracBits)
+{
+    return std::make_unique<ExprCompilerInt16>(numInputs, fracBits);
+}
+
 std::unique_ptr<ExprCompiler> make_zmm_compiler(int numInputs)
 {
     return std::make_unique<ExprCompiler512>(numInputs);
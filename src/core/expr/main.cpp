@@ -6,7 +6,7 @@
 using namespace expr;
 
 static const char *op_names[] = {
-	"loadu8", "loadu16", "loadf16", "loadf32", "constant",
+	"loadu8", "loadu16", "loadf16", "loadf32", "constant", "runtimeconst", "coordx",
 	"storeu8", "storeu16", "storef16", "storef32",
 	"add", "sub", "mul", "div", "fma", "sqrt", "abs", "neg", "max", "min", "cmp",
 	"and", "or", "xor", "not",
@@ -37,7 +37,8 @@ int main(int argc, char **argv) try
 		std::cout << argv[1] << '\n';
 		bool optimize = argc > 2 ? !!std::atoi(argv[2]) : true;
 
-		std::vector<ExprInstruction> code = compile(argv[1], vi, 26, realvi, optimize);
+		std::vector<PropertyAccess> props;
+		std::vector<ExprInstruction> code = compile(argv[1], vi, 26, realvi, props, optimize);
 
 		for (auto &insn : code) {
 			std::cout << std::setw(12) << std::left << op_names[static_cast<size_t>(insn.op.type)];
@@ -61,11 +62,21 @@ int main(int argc, char **argv) try
 			case ExprOpType::MEM_LOAD_U16:
 			case ExprOpType::MEM_LOAD_F16:
 			case ExprOpType::MEM_LOAD_F32:
-				std::cout << ',' << static_cast<char>(insn.op.imm.u < 3 ? 'x' + insn.op.imm.u : 'a' + insn.op.imm.u - 3);
+				std::cout << ',' << static_cast<char>(loadInput(insn.op.imm) < 3 ? 'x' + loadInput(insn.op.imm) : 'a' + loadInput(insn.op.imm) - 3);
+				if (loadOffsetX(insn.op.imm) || loadOffsetY(insn.op.imm))
+					std::cout << '[' << loadOffsetX(insn.op.imm) << ',' << loadOffsetY(insn.op.imm) << ']' << (loadEdgeMode(insn.op.imm) == EdgeMode::MIRROR ? ":m" : "");
 				break;
 			case ExprOpType::CONSTANT:
 				std::cout << ',' << insn.op.imm.f;
 				break;
+			case ExprOpType::RUNTIME_CONST:
+				if (insn.op.imm.u >= RC_FIRST_PROP) {
+					const PropertyAccess &prop = props[insn.op.imm.u - RC_FIRST_PROP];
+					std::cout << ',' << static_cast<char>(prop.input < 3 ? 'x' + prop.input : 'a' + prop.input - 3) << '.' << prop.name;
+				} else {
+					std::cout << ',' << insn.op.imm.u;
+				}
+				break;
 			case ExprOpType::FMA:
 				std::cout << "," << insn.op.imm.u;
 				break;
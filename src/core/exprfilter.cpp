@@ -21,11 +21,12 @@
 #include <algorithm>
 #include <cmath>
 #include <cstdlib>
+#include <cstring>
 #include <limits>
 #include <memory>
+#include <mutex>
 #include <stdexcept>
 #include <string>
-#include <tuple>
 #include <vector>
 #include "VapourSynth4.h"
 #include "VSHelper4.h"
@@ -36,48 +37,55 @@
 #include "expr/expr.h"
 #include "expr/jitcompiler.h"
 #include "kernel/cpulevel.h"
-
-#ifdef VS_TARGET_OS_WINDOWS
-#include <windows.h>
-#else
-#include <sys/mman.h>
-#endif
+#include "kernel/planestats.h"
 
 using namespace expr;
 using namespace vsh;
 
+// Frame property of the first MultiExpr output holding the other outputs.
+#define MULTI_EXPR_OUTPUTS_KEY "MultiExprOutputs"
+
 namespace {
 
 enum PlaneOp {
     poProcess, poCopy, poUndefined
 };
 
+// A source row read by neighbourhood loads. Rows read with a horizontal offset are copied
+// into a line buffer with pad samples of edge extension on both sides, the others are
+// used in place.
+struct NeighbourRow {
+    int input;
+    int dy;
+    EdgeMode mode;
+    int pad;
+};
+
 struct ExprData {
     VSNode *node[MAX_EXPR_INPUTS];
     VSVideoInfo vi;
+    // Formats of the outputs after the first, only MultiExpr has them.
+    std::vector<VSVideoFormat> extraFormats;
     std::vector<ExprInstruction> bytecode[3];
+    std::vector<NeighbourRow> rows[3];
+    std::vector<PropertyAccess> props[3];
     int plane[3];
     int numInputs;
-    ExprCompiler::ProcessLineProc proc[3];
-    size_t procSize[3];
-    int procPixels[3] = { 8, 8, 8 };  // pixels/iteration of the JIT proc (16 for the AVX-512 path)
+    int cpulevel;
+    bool useJit[3];
+    std::vector<int> intFracBits[3];
+    std::once_flag jitOnce[3];
+    std::shared_ptr<const JitCode> jit[3];
 
-    ExprData() : node(), vi(), plane(), numInputs(), proc() {}
-
-    ~ExprData() {
-        for (int i = 0; i < 3; i++) {
-            if (proc[i]) {
-#ifdef VS_TARGET_OS_WINDOWS
-                VirtualFree((LPVOID)proc[i], 0, MEM_RELEASE);
-#else
-                munmap((void *)proc[i], procSize[i]);
-#endif
-            }
-        }
-    }
+    ExprData() : node(), vi(), plane(), numInputs(), cpulevel(), useJit() {}
 };
 
+// Evaluates the bytecode for a block of pixels at a time. Every register holds a whole
+// block, so each instruction is decoded once per block and its loop can be vectorized.
 class ExprInterpreter {
+public:
+    static constexpr int BLOCK_SIZE = 64;
+private:
     const ExprInstruction *bytecode;
     size_t numInsns;
     std::vector<float> registers;
@@ -98,71 +106,277 @@ public:
         for (size_t i = 0; i < numInsns; ++i) {
             maxreg = std::max(maxreg, bytecode[i].dst);
         }
-        registers.resize(maxreg + 1);
+        registers.resize((maxreg + 1) * BLOCK_SIZE);
     }
 
-    void eval(const uint8_t * const *srcp, uint8_t *dstp, int x)
+    // Evaluates pixels x to x + count - 1 of the row, count must not exceed BLOCK_SIZE.
+    // The pointers are laid out as for the compiled code, so input i is ptrs[i + 1] and
+    // each store writes the pointer its slot names.
+    void eval(uint8_t * const *ptrs, const float *consts, int x, int count)
     {
-        for (size_t i = 0; i < numInsns; ++i) {
-            const ExprInstruction &insn = bytecode[i];
-
-#define SRC1 registers[insn.src1]
-#define SRC2 registers[insn.src2]
-#define SRC3 registers[insn.src3]
-#define DST registers[insn.dst]
+        for (size_t n = 0; n < numInsns; ++n) {
+            const ExprInstruction &insn = bytecode[n];
+            float *dst = insn.dst >= 0 ? registers.data() + insn.dst * BLOCK_SIZE : nullptr;
+            const float *src1 = insn.src1 >= 0 ? registers.data() + insn.src1 * BLOCK_SIZE : nullptr;
+            const float *src2 = insn.src2 >= 0 ? registers.data() + insn.src2 * BLOCK_SIZE : nullptr;
+            const float *src3 = insn.src3 >= 0 ? registers.data() + insn.src3 * BLOCK_SIZE : nullptr;
+            int loadx = x + loadOffsetX(insn.op.imm);
+            const uint8_t * const *srcp = ptrs + 1;
+
+#define LOOP(...) for (int i = 0; i < count; i++) { __VA_ARGS__; } break
+#define SRC1 src1[i]
+#define SRC2 src2[i]
+#define SRC3 src3[i]
+#define DST dst[i]
             switch (insn.op.type) {
-            case ExprOpType::MEM_LOAD_U8: DST = reinterpret_cast<const uint8_t *>(srcp[insn.op.imm.u])[x]; break;
-            case ExprOpType::MEM_LOAD_U16: DST = reinterpret_cast<const uint16_t *>(srcp[insn.op.imm.u])[x]; break;
-            case ExprOpType::MEM_LOAD_F16: DST = halfToFloat(reinterpret_cast<const uint16_t *>(srcp[insn.op.imm.u])[x]); break;
-            case ExprOpType::MEM_LOAD_F32: DST = reinterpret_cast<const float *>(srcp[insn.op.imm.u])[x]; break;
-            case ExprOpType::CONSTANT: DST = insn.op.imm.f; break;
-            case ExprOpType::ADD: DST = SRC1 + SRC2; break;
-            case ExprOpType::SUB: DST = SRC1 - SRC2; break;
-            case ExprOpType::MUL: DST = SRC1 * SRC2; break;
-            case ExprOpType::DIV: DST = SRC1 / SRC2; break;
+            case ExprOpType::MEM_LOAD_U8: { const uint8_t *p = reinterpret_cast<const uint8_t *>(srcp[loadInput(insn.op.imm)]) + loadx; LOOP(DST = p[i]); }
+            case ExprOpType::MEM_LOAD_U16: { const uint16_t *p = reinterpret_cast<const uint16_t *>(srcp[loadInput(insn.op.imm)]) + loadx; LOOP(DST = p[i]); }
+            case ExprOpType::MEM_LOAD_F16: { const uint16_t *p = reinterpret_cast<const uint16_t *>(srcp[loadInput(insn.op.imm)]) + loadx; LOOP(DST = halfToFloat(p[i])); }
+            case ExprOpType::MEM_LOAD_F32: { const float *p = reinterpret_cast<const float *>(srcp[loadInput(insn.op.imm)]) + loadx; LOOP(DST = p[i]); }
+            case ExprOpType::CONSTANT: LOOP(DST = insn.op.imm.f);
+            case ExprOpType::RUNTIME_CONST: LOOP(DST = consts[insn.op.imm.u]);
+            case ExprOpType::COORD_X: LOOP(DST = static_cast<float>(x + i));
+            case ExprOpType::ADD: LOOP(DST = SRC1 + SRC2);
+            case ExprOpType::SUB: LOOP(DST = SRC1 - SRC2);
+            case ExprOpType::MUL: LOOP(DST = SRC1 * SRC2);
+            case ExprOpType::DIV: LOOP(DST = SRC1 / SRC2);
             case ExprOpType::FMA:
                 switch (static_cast<FMAType>(insn.op.imm.u)) {
-                case FMAType::FMADD: DST = SRC2 * SRC3 + SRC1; break;
-                case FMAType::FMSUB: DST = SRC2 * SRC3 - SRC1; break;
-                case FMAType::FNMADD: DST = -(SRC2 * SRC3) + SRC1; break;
-                case FMAType::FNMSUB: DST = -(SRC2 * SRC3) - SRC1; break;
+                case FMAType::FMADD: LOOP(DST = SRC2 * SRC3 + SRC1);
+                case FMAType::FMSUB: LOOP(DST = SRC2 * SRC3 - SRC1);
+                case FMAType::FNMADD: LOOP(DST = -(SRC2 * SRC3) + SRC1);
+                case FMAType::FNMSUB: LOOP(DST = -(SRC2 * SRC3) - SRC1);
                 };
                 break;
-            case ExprOpType::MAX: DST = std::max(SRC1, SRC2); break;
-            case ExprOpType::MIN: DST = std::min(SRC1, SRC2); break;
-            case ExprOpType::EXP: DST = std::exp(SRC1); break;
-            case ExprOpType::LOG: DST = std::log(SRC1); break;
-            case ExprOpType::POW: DST = std::pow(SRC1, SRC2); break;
-            case ExprOpType::SQRT: DST = std::sqrt(SRC1); break;
-            case ExprOpType::SIN: DST = std::sin(SRC1); break;
-            case ExprOpType::COS: DST = std::cos(SRC1); break;
-            case ExprOpType::ABS: DST = std::fabs(SRC1); break;
-            case ExprOpType::NEG: DST = -SRC1; break;
+            case ExprOpType::MAX: LOOP(DST = std::max(SRC1, SRC2));
+            case ExprOpType::MIN: LOOP(DST = std::min(SRC1, SRC2));
+            case ExprOpType::EXP: LOOP(DST = std::exp(SRC1));
+            case ExprOpType::LOG: LOOP(DST = std::log(SRC1));
+            case ExprOpType::POW: LOOP(DST = std::pow(SRC1, SRC2));
+            case ExprOpType::SQRT: LOOP(DST = std::sqrt(SRC1));
+            case ExprOpType::SIN: LOOP(DST = std::sin(SRC1));
+            case ExprOpType::COS: LOOP(DST = std::cos(SRC1));
+            case ExprOpType::ABS: LOOP(DST = std::fabs(SRC1));
+            case ExprOpType::NEG: LOOP(DST = -SRC1);
             case ExprOpType::CMP:
                 switch (static_cast<ComparisonType>(insn.op.imm.u)) {
-                case ComparisonType::EQ: DST = bool2float(SRC1 == SRC2); break;
-                case ComparisonType::LT: DST = bool2float(SRC1 < SRC2); break;
-                case ComparisonType::LE: DST = bool2float(SRC1 <= SRC2); break;
-                case ComparisonType::NEQ: DST = bool2float(SRC1 != SRC2); break;
-                case ComparisonType::NLT: DST = bool2float(SRC1 >= SRC2); break;
-                case ComparisonType::NLE: DST = bool2float(SRC1 > SRC2); break;
+                case ComparisonType::EQ: LOOP(DST = bool2float(SRC1 == SRC2));
+                case ComparisonType::LT: LOOP(DST = bool2float(SRC1 < SRC2));
+                case ComparisonType::LE: LOOP(DST = bool2float(SRC1 <= SRC2));
+                case ComparisonType::NEQ: LOOP(DST = bool2float(SRC1 != SRC2));
+                case ComparisonType::NLT: LOOP(DST = bool2float(SRC1 >= SRC2));
+                case ComparisonType::NLE: LOOP(DST = bool2float(SRC1 > SRC2));
                 }
                 break;
-            case ExprOpType::TERNARY: DST = float2bool(SRC1) ? SRC2 : SRC3; break;
-            case ExprOpType::AND: DST = bool2float((float2bool(SRC1) && float2bool(SRC2))); break;
-            case ExprOpType::OR:  DST = bool2float((float2bool(SRC1) || float2bool(SRC2))); break;
-            case ExprOpType::XOR: DST = bool2float((float2bool(SRC1) != float2bool(SRC2))); break;
-            case ExprOpType::NOT: DST = bool2float(!float2bool(SRC1)); break;
-            case ExprOpType::MEM_STORE_U8:  reinterpret_cast<uint8_t *>(dstp)[x] = clamp_int<uint8_t>(SRC1); return;
-            case ExprOpType::MEM_STORE_U16: reinterpret_cast<uint16_t *>(dstp)[x] = clamp_int<uint16_t>(SRC1, insn.op.imm.u); return;
-            case ExprOpType::MEM_STORE_F16: reinterpret_cast<uint16_t *>(dstp)[x] = floatToHalf(SRC1); return;
-            case ExprOpType::MEM_STORE_F32: reinterpret_cast<float *>(dstp)[x] = SRC1; return;
+            case ExprOpType::TERNARY: LOOP(float t = SRC2; float f = SRC3; DST = float2bool(SRC1) ? t : f);
+            case ExprOpType::AND: LOOP(DST = bool2float((float2bool(SRC1) && float2bool(SRC2))));
+            case ExprOpType::OR:  LOOP(DST = bool2float((float2bool(SRC1) || float2bool(SRC2))));
+            case ExprOpType::XOR: LOOP(DST = bool2float((float2bool(SRC1) != float2bool(SRC2))));
+            case ExprOpType::NOT: LOOP(DST = bool2float(!float2bool(SRC1)));
+            case ExprOpType::MEM_STORE_U8: { uint8_t *p = ptrs[storeSlot(insn.op.imm)] + x; for (int i = 0; i < count; i++) p[i] = clamp_int<uint8_t>(SRC1); break; }
+            case ExprOpType::MEM_STORE_U16: { uint16_t *p = reinterpret_cast<uint16_t *>(ptrs[storeSlot(insn.op.imm)]) + x; for (int i = 0; i < count; i++) p[i] = clamp_int<uint16_t>(SRC1, storeDepth(insn.op.imm)); break; }
+            case ExprOpType::MEM_STORE_F16: { uint16_t *p = reinterpret_cast<uint16_t *>(ptrs[storeSlot(insn.op.imm)]) + x; for (int i = 0; i < count; i++) p[i] = floatToHalf(SRC1); break; }
+            case ExprOpType::MEM_STORE_F32: { float *p = reinterpret_cast<float *>(ptrs[storeSlot(insn.op.imm)]) + x; for (int i = 0; i < count; i++) p[i] = SRC1; break; }
             default: fprintf(stderr, "%s", "illegal opcode\n"); std::terminate(); return;
             }
 #undef DST
 #undef SRC3
 #undef SRC2
 #undef SRC1
+#undef LOOP
+        }
+    }
+};
+
+static int edgeIndex(int pos, int len, EdgeMode mode) {
+    if (mode == EdgeMode::MIRROR) {
+        if (pos < 0)
+            pos = -pos - 1;
+        else if (pos >= len)
+            pos = 2 * len - 1 - pos;
+    }
+    return std::clamp(pos, 0, len - 1);
+}
+
+template<typename T>
+static void padRow(const void *srcp, void *dstp, int width, int left, int right, EdgeMode mode) {
+    const T *src = static_cast<const T *>(srcp);
+    T *dst = static_cast<T *>(dstp);
+    memcpy(dst, src, width * sizeof(T));
+    for (int x = -left; x < 0; x++)
+        dst[x] = src[edgeIndex(x, width, mode)];
+    for (int x = width; x < width + right; x++)
+        dst[x] = src[edgeIndex(x, width, mode)];
+}
+
+// Gives every distinct (input, dy, edge mode) row read by a neighbourhood load its own source
+// pointer after the inputs and points the loads at it. Only the x offset is still applied by
+// the load itself.
+static std::vector<NeighbourRow> assignNeighbourRows(std::vector<ExprInstruction> &bytecode, int numInputs) {
+    std::vector<NeighbourRow> rows;
+
+    for (ExprInstruction &insn : bytecode) {
+        if (insn.op.type != ExprOpType::MEM_LOAD_U8 && insn.op.type != ExprOpType::MEM_LOAD_U16 && insn.op.type != ExprOpType::MEM_LOAD_F16 && insn.op.type != ExprOpType::MEM_LOAD_F32)
+            continue;
+
+        int input = loadInput(insn.op.imm);
+        int dx = loadOffsetX(insn.op.imm);
+        int dy = loadOffsetY(insn.op.imm);
+        EdgeMode mode = loadEdgeMode(insn.op.imm);
+        if (!dx && !dy)
+            continue;
+
+        auto it = std::find_if(rows.begin(), rows.end(), [=](const NeighbourRow &row) { return row.input == input && row.dy == dy && row.mode == mode; });
+        if (it == rows.end()) {
+            if (rows.size() >= MAX_EXPR_NEIGHBOUR_ROWS)
+                throw std::runtime_error("too many distinct rows accessed with pixel offsets");
+            it = rows.insert(rows.end(), { input, dy, mode, 0 });
+        }
+
+        it->pad = std::max(it->pad, std::abs(dx));
+        insn.op.imm = makeLoadImm(numInputs + static_cast<int>(it - rows.begin()), dx, 0, mode);
+    }
+
+    return rows;
+}
+
+static float getPropertyValue(const VSMap *props, const char *name, const VSAPI *vsapi) {
+    int err;
+    switch (vsapi->mapGetType(props, name)) {
+    case ptInt:
+        return static_cast<float>(vsapi->mapGetInt(props, name, 0, &err));
+    case ptFloat:
+        return static_cast<float>(vsapi->mapGetFloat(props, name, 0, &err));
+    default:
+        return 0.0f;
+    }
+}
+
+// Evaluates the program of one plane a range of rows at a time. Everything that stays
+// the same for the whole frame, like the source pointers, line buffers and runtime
+// constants, is set up once.
+class PlaneEvaluator {
+    ExprData *d;
+    int plane;
+    int numSources;
+    int lanes;
+    int width;
+    int height;
+    int span;
+    const uint8_t *srcp[MAX_EXPR_INPUTS] = {};
+    ptrdiff_t src_stride[MAX_EXPR_INPUTS] = {};
+    int src_bytes[MAX_EXPR_INPUTS] = {};
+    uint8_t *rowBuffer[MAX_EXPR_NEIGHBOUR_ROWS] = {};
+    alignas(32) intptr_t ptroffsets[((MAX_EXPR_SOURCES + MAX_EXPR_OUTPUTS) + 7) & ~7] = {};
+    std::vector<float> consts;
+    ExprInterpreter interpreter;
+    bool allocated = true;
+public:
+    PlaneEvaluator(ExprData *d, int plane, int n, const VSFrame * const src[], VSFrameContext *frameCtx, const VSAPI *vsapi) :
+        d(d), plane(plane), interpreter(d->bytecode[plane].data(), d->bytecode[plane].size())
+    {
+        int numInputs = d->numInputs;
+
+        // Code generation is deferred to the first frame of each plane so creating
+        // filters whose output is never requested stays cheap.
+        if (d->useJit[plane]) {
+            std::call_once(d->jitOnce[plane], [d, plane] {
+                int numPointers = d->numInputs + static_cast<int>(d->rows[plane].size() + d->extraFormats.size());
+                d->jit[plane] = compile_jit_cached(d->bytecode[plane].data(), d->bytecode[plane].size(), numPointers, d->cpulevel, d->intFracBits[plane]);
+            });
+        }
+
+        // Pixels the compiled proc consumes per iteration (16 on the AVX-512 path,
+        // 8 otherwise). Drives both the per-iteration pointer advance and the count.
+        lanes = d->jit[plane] ? d->jit[plane]->pixelsPerIteration : 8;
+        ptroffsets[0] = d->vi.format.bytesPerSample * lanes;
+
+        for (int i = 0; i < numInputs; i++) {
+            srcp[i] = vsapi->getReadPtr(src[i], plane);
+            src_stride[i] = vsapi->getStride(src[i], plane);
+            src_bytes[i] = vsapi->getVideoFrameFormat(src[i])->bytesPerSample;
+            ptroffsets[i + 1] = src_bytes[i] * lanes;
+        }
+
+        height = vsapi->getFrameHeight(src[0], plane);
+        width = vsapi->getFrameWidth(src[0], plane);
+
+        // The JIT reads up to a whole iteration past the end of the row, so the line
+        // buffers cover that too.
+        const std::vector<NeighbourRow> &rows = d->rows[plane];
+        numSources = numInputs + static_cast<int>(rows.size());
+        span = (width + 63) & ~63;
+
+        for (size_t r = 0; r < rows.size(); r++) {
+            int bytes = src_bytes[rows[r].input];
+            ptroffsets[numInputs + r + 1] = bytes * lanes;
+            if (rows[r].pad) {
+                size_t padBytes = (rows[r].pad * bytes + 63) & ~63;
+                uint8_t *buf = static_cast<uint8_t *>(vsapi->allocScratch(padBytes * 2 + span * bytes, frameCtx));
+                allocated = allocated && buf;
+                rowBuffer[r] = buf ? buf + padBytes : nullptr;
+            }
+        }
+
+        // The other outputs follow the neighbour rows, see assignOutputSlots().
+        for (size_t k = 0; k < d->extraFormats.size(); k++)
+            ptroffsets[numSources + k + 1] = d->extraFormats[k].bytesPerSample * lanes;
+
+        const std::vector<PropertyAccess> &props = d->props[plane];
+        consts.resize(RC_FIRST_PROP + props.size());
+        consts[RC_N] = static_cast<float>(n);
+        consts[RC_WIDTH] = static_cast<float>(width);
+        consts[RC_HEIGHT] = static_cast<float>(height);
+        for (size_t i = 0; i < props.size(); i++)
+            consts[RC_FIRST_PROP + i] = getPropertyValue(vsapi->getFramePropertiesRO(src[props[i].input]), props[i].name.c_str(), vsapi);
+    }
+
+    // false if a line buffer couldn't be allocated, eval() must not be called then
+    bool isValid() const { return allocated; }
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+
+    // Evaluates rows y0 to y1 - 1. Output k writes row y to out[k] + outStride[k] * (y - y0).
+    void eval(uint8_t * const out[], const ptrdiff_t outStride[], int y0, int y1)
+    {
+        int numInputs = d->numInputs;
+        int numExtra = static_cast<int>(d->extraFormats.size());
+        const std::vector<NeighbourRow> &rows = d->rows[plane];
+
+        for (int y = y0; y < y1; y++) {
+            consts[RC_Y] = static_cast<float>(y);
+
+            alignas(32) uint8_t *rwptrs[((MAX_EXPR_SOURCES + MAX_EXPR_OUTPUTS) + 7) & ~7] = { out[0] + outStride[0] * (y - y0) };
+            for (int i = 0; i < numInputs; i++) {
+                rwptrs[i + 1] = const_cast<uint8_t *>(srcp[i] + src_stride[i] * y);
+            }
+
+            for (size_t r = 0; r < rows.size(); r++) {
+                const NeighbourRow &row = rows[r];
+                const uint8_t *rowp = srcp[row.input] + src_stride[row.input] * edgeIndex(y + row.dy, height, row.mode);
+
+                if (row.pad) {
+                    int right = span + row.pad - width;
+                    switch (src_bytes[row.input]) {
+                    case 1: padRow<uint8_t>(rowp, rowBuffer[r], width, row.pad, right, row.mode); break;
+                    case 2: padRow<uint16_t>(rowp, rowBuffer[r], width, row.pad, right, row.mode); break;
+                    case 4: padRow<float>(rowp, rowBuffer[r], width, row.pad, right, row.mode); break;
+                    }
+                    rowp = rowBuffer[r];
+                }
+                rwptrs[numInputs + r + 1] = const_cast<uint8_t *>(rowp);
+            }
+
+            for (int k = 0; k < numExtra; k++)
+                rwptrs[numSources + k + 1] = out[k + 1] + outStride[k + 1] * (y - y0);
+
+            if (d->jit[plane]) {
+                d->jit[plane]->proc(rwptrs, ptroffsets, (width + lanes - 1) / lanes, consts.data());
+            } else {
+                for (int x = 0; x < width; x += ExprInterpreter::BLOCK_SIZE) {
+                    interpreter.eval(rwptrs, consts.data(), x, std::min(width - x, ExprInterpreter::BLOCK_SIZE));
+                }
+            }
         }
     }
 };
@@ -183,63 +397,45 @@ static const VSFrame *VS_CC exprGetFrame(int n, int activationReason, void *inst
         int width = vsapi->getFrameWidth(src[0], 0);
         int planes[3] = { 0, 1, 2 };
         const VSFrame *srcf[3] = { d->plane[0] != poCopy ? nullptr : src[0], d->plane[1] != poCopy ? nullptr : src[0], d->plane[2] != poCopy ? nullptr : src[0] };
-        VSFrame *dst = vsapi->newVideoFrame2(&d->vi.format, width, height, srcf, planes, src[0], core);
-
-        const uint8_t *srcp[MAX_EXPR_INPUTS] = {};
-        ptrdiff_t src_stride[MAX_EXPR_INPUTS] = {};
-        alignas(32) intptr_t ptroffsets[((MAX_EXPR_INPUTS + 1) + 7) & ~7] = {};
+        VSFrame *dst[MAX_EXPR_OUTPUTS] = { vsapi->newVideoFrame2(&d->vi.format, width, height, srcf, planes, src[0], core) };
+        int numOutputs = 1 + static_cast<int>(d->extraFormats.size());
+        for (int k = 1; k < numOutputs; k++)
+            dst[k] = vsapi->newVideoFrame(&d->extraFormats[k - 1], width, height, src[0], core);
 
         for (int plane = 0; plane < d->vi.format.numPlanes; plane++) {
             if (d->plane[plane] != poProcess)
                 continue;
 
-            // Pixels the compiled proc consumes per iteration (16 on the AVX-512 path,
-            // 8 otherwise). Drives both the per-iteration pointer advance and the count.
-            int lanes = d->procPixels[plane];
-            ptroffsets[0] = d->vi.format.bytesPerSample * lanes;
-
-            for (int i = 0; i < numInputs; i++) {
-                srcp[i] = vsapi->getReadPtr(src[i], plane);
-                src_stride[i] = vsapi->getStride(src[i], plane);
-                ptroffsets[i + 1] = vsapi->getVideoFrameFormat(src[i])->bytesPerSample * lanes;
+            uint8_t *dstp[MAX_EXPR_OUTPUTS] = {};
+            ptrdiff_t dst_stride[MAX_EXPR_OUTPUTS] = {};
+            for (int k = 0; k < numOutputs; k++) {
+                dstp[k] = vsapi->getWritePtr(dst[k], plane);
+                dst_stride[k] = vsapi->getStride(dst[k], plane);
             }
 
-            uint8_t *dstp = vsapi->getWritePtr(dst, plane);
-            ptrdiff_t dst_stride = vsapi->getStride(dst, plane);
-            int h = vsapi->getFrameHeight(dst, plane);
-            int w = vsapi->getFrameWidth(dst, plane);
-
-            if (d->proc[plane]) {
-                ExprCompiler::ProcessLineProc proc = d->proc[plane];
-                int niterations = (w + lanes - 1) / lanes;
-
-                for (int y = 0; y < h; y++) {
-                    alignas(32) uint8_t *rwptrs[((MAX_EXPR_INPUTS + 1) + 7) & ~7] = { dstp + dst_stride * y };
-                    for (int i = 0; i < numInputs; i++) {
-                        rwptrs[i + 1] = const_cast<uint8_t *>(srcp[i] + src_stride[i] * y);
-                    }
-                    proc(rwptrs, ptroffsets, niterations);
-                }
-            } else {
-                ExprInterpreter interpreter(d->bytecode[plane].data(), d->bytecode[plane].size());
-
-                for (int y = 0; y < h; y++) {
-                    for (int x = 0; x < w; x++) {
-                        interpreter.eval(srcp, dstp, x);
-                    }
-
-                    for (int i = 0; i < numInputs; i++) {
-                        srcp[i] += src_stride[i];
-                    }
-                    dstp += dst_stride;
-                }
+            PlaneEvaluator evaluator(d, plane, n, src, frameCtx, vsapi);
+            if (!evaluator.isValid()) {
+                vsapi->setFilterError("Expr: failed to allocate scratch memory", frameCtx);
+                for (int i = 0; i < MAX_EXPR_INPUTS; i++)
+                    vsapi->freeFrame(src[i]);
+                for (int k = 0; k < numOutputs; k++)
+                    vsapi->freeFrame(dst[k]);
+                return nullptr;
             }
+            evaluator.eval(dstp, dst_stride, 0, evaluator.getHeight());
         }
 
         for (int i = 0; i < MAX_EXPR_INPUTS; i++) {
             vsapi->freeFrame(src[i]);
         }
-        return dst;
+
+        // MultiExpr hands the other outputs to its output nodes attached to the first one.
+        if (numOutputs > 1) {
+            VSMap *dstProps = vsapi->getFramePropertiesRW(dst[0]);
+            for (int k = 1; k < numOutputs; k++)
+                vsapi->mapConsumeFrame(dstProps, MULTI_EXPR_OUTPUTS_KEY, dst[k], maAppend);
+        }
+        return dst[0];
     }
 
     return nullptr;
@@ -252,63 +448,118 @@ static void VS_CC exprFree(void *instanceData, VSCore *core, const VSAPI *vsapi)
     delete d;
 }
 
-static void VS_CC exprCreate(const VSMap *in, VSMap *out, void *userData, VSCore *core, const VSAPI *vsapi) {
-    std::unique_ptr<ExprData> d(new ExprData);
+// Moves the stores of outputs after the first to the pointers following the sources,
+// the first output keeps pointer 0.
+static void assignOutputSlots(std::vector<ExprInstruction> &bytecode, int numSources) {
+    for (ExprInstruction &insn : bytecode) {
+        if (insn.op.type != ExprOpType::MEM_STORE_U8 && insn.op.type != ExprOpType::MEM_STORE_U16 && insn.op.type != ExprOpType::MEM_STORE_F16 && insn.op.type != ExprOpType::MEM_STORE_F32)
+            continue;
+
+        int slot = storeSlot(insn.op.imm);
+        if (slot > 0)
+            insn.op.imm = makeStoreImm(storeDepth(insn.op.imm), numSources + slot);
+    }
+}
+
+// Reads the clips argument into d and checks that the inputs can be combined.
+static void getInputs(const VSMap *in, ExprData *d, const VSVideoInfo *vi[], const VSAPI *vsapi) {
     int err;
 
-    // Half input/output is always accepted: the scalar interpreter handles it on any CPU
-    // (via float16_helper). The JIT's half load/store use F16C (vcvtph2ps/vcvtps2ph), so
-    // when the CPU lacks F16C we fall back to the interpreter per-plane (see below) rather
-    // than rejecting half.
+    d->numInputs = vsapi->mapNumElements(in, "clips");
+    if (d->numInputs > 26)
+        throw std::runtime_error("More than 26 input clips provided");
+
+    for (int i = 0; i < d->numInputs; i++) {
+        d->node[i] = vsapi->mapGetNode(in, "clips", i, &err);
+    }
+
+    for (int i = 0; i < d->numInputs; i++)
+        vi[i] = vsapi->getVideoInfo(d->node[i]);
+
+    for (int i = 0; i < d->numInputs; i++) {
+        if (!isConstantVideoFormat(vi[i]))
+            throw std::runtime_error("Only clips with constant format and dimensions allowed");
+        if (vi[0]->format.numPlanes != vi[i]->format.numPlanes
+            || vi[0]->format.subSamplingW != vi[i]->format.subSamplingW
+            || vi[0]->format.subSamplingH != vi[i]->format.subSamplingH
+            || vi[0]->width != vi[i]->width
+            || vi[0]->height != vi[i]->height)
+        {
+            throw std::runtime_error("All inputs must have the same number of planes and the same dimensions, subsampling included");
+        }
+
+        if (!is8to16orFloatFormat(vi[i]->format))
+            throw std::runtime_error(invalidVideoFormatMessage(vi[i]->format, vsapi, nullptr));
+    }
+}
+
+static VSVideoFormat getOutputFormat(const VSVideoFormat &src, int format, VSCore *core, const VSAPI *vsapi) {
+    VSVideoFormat f;
+    if (!vsapi->getVideoFormatByID(&f, format, core) || f.colorFamily == cfUndefined)
+        throw std::runtime_error("the format id specified in format is invalid");
+    if (src.colorFamily != f.colorFamily || src.subSamplingW != f.subSamplingW || src.subSamplingH != f.subSamplingH)
+        throw std::runtime_error("the output format must have the same color family and subsampling as the input");
+    if (src.numPlanes != f.numPlanes)
+        throw std::runtime_error("The number of planes in the inputs and output must match");
+
+    VSVideoFormat result;
+    vsapi->queryVideoFormat(&result, f.colorFamily, f.sampleType, f.bitsPerSample, f.subSamplingW, f.subSamplingH, core);
+    if (!is8to16orFloatFormat(result))
+        throw std::runtime_error(invalidVideoFormatMessage(result, vsapi, nullptr));
+    return result;
+}
+
+// Half input/output is always accepted: the scalar interpreter handles it on any CPU
+// (via float16_helper). The JIT's half load/store use F16C (vcvtph2ps/vcvtps2ph), so
+// when the CPU lacks F16C we fall back to the interpreter per-plane (see preparePlane) rather
+// than rejecting half. AArch64 always has the conversions (fcvtl/fcvtn).
+static bool jitHasF16C() {
 #ifdef VS_TARGET_CPU_X86
-    const bool jitHasF16C = getCPUFeatures()->f16c;
+    return getCPUFeatures()->f16c;
+#elif defined(VS_TARGET_CPU_ARM64)
+    return true;
 #else
-    const bool jitHasF16C = false;
+    return false;
 #endif
+}
 
-    try {
-        int cpulevel = vs_get_cpulevel(core);
+// Lays out the pointers of a compiled plane and decides whether it gets JIT code.
+static void preparePlane(ExprData *d, int plane, const VSVideoInfo * const vi[]) {
+    d->intFracBits[plane] = analyzeInt16(d->bytecode[plane], vi);
+    d->rows[plane] = assignNeighbourRows(d->bytecode[plane], d->numInputs);
+    assignOutputSlots(d->bytecode[plane], d->numInputs + static_cast<int>(d->rows[plane].size()));
+
+    // The JIT converts half via F16C; when that's missing, leave jit[plane] null for
+    // any plane that loads or stores half so exprGetFrame runs the interpreter for
+    // it (which does the conversion in software) instead of emitting an illegal
+    // vcvtph2ps.
+    bool planeUsesHalf = false;
+    if (!jitHasF16C()) {
+        for (const ExprInstruction &insn : d->bytecode[plane]) {
+            if (insn.op.type == ExprOpType::MEM_LOAD_F16 || insn.op.type == ExprOpType::MEM_STORE_F16) {
+                planeUsesHalf = true;
+                break;
+            }
+        }
+    }
 
-        d->numInputs = vsapi->mapNumElements(in, "clips");
-        if (d->numInputs > 26)
-            throw std::runtime_error("More than 26 input clips provided");
+    d->useJit[plane] = d->cpulevel > VS_CPU_LEVEL_NONE && !planeUsesHalf;
+}
 
-        for (int i = 0; i < d->numInputs; i++) {
-            d->node[i] = vsapi->mapGetNode(in, "clips", i, &err);
-        }
+static void VS_CC exprCreate(const VSMap *in, VSMap *out, void *userData, VSCore *core, const VSAPI *vsapi) {
+    std::unique_ptr<ExprData> d(new ExprData);
+    int err;
 
-        const VSVideoInfo *vi[MAX_EXPR_INPUTS] = {};
-        for (int i = 0; i < d->numInputs; i++)
-            vi[i] = vsapi->getVideoInfo(d->node[i]);
-
-        for (int i = 0; i < d->numInputs; i++) {
-            if (!isConstantVideoFormat(vi[i]))
-                throw std::runtime_error("Only clips with constant format and dimensions allowed");
-            if (vi[0]->format.numPlanes != vi[i]->format.numPlanes
-                || vi[0]->format.subSamplingW != vi[i]->format.subSamplingW
-                || vi[0]->format.subSamplingH != vi[i]->format.subSamplingH
-                || vi[0]->width != vi[i]->width
-                || vi[0]->height != vi[i]->height)
-            {
-                throw std::runtime_error("All inputs must have the same number of planes and the same dimensions, subsampling included");
-            }
+    try {
+        d->cpulevel = vs_get_cpulevel(core);
 
-            if (!is8to16orFloatFormat(vi[i]->format))
-                throw std::runtime_error(invalidVideoFormatMessage(vi[i]->format, vsapi, nullptr));
-        }
+        const VSVideoInfo *vi[MAX_EXPR_INPUTS] = {};
+        getInputs(in, d.get(), vi, vsapi);
 
         d->vi = *vi[0];
         int format = vsapi->mapGetIntSaturated(in, "format", 0, &err);
-        if (!err) {
-            VSVideoFormat f;
-            if (!vsapi->getVideoFormatByID(&f, format, core) || f.colorFamily == cfUndefined)
-                throw std::runtime_error("the format id specified in format is invalid");
-            if (d->vi.format.colorFamily != f.colorFamily || d->vi.format.subSamplingW != f.subSamplingW || d->vi.format.subSamplingH != f.subSamplingH)
-                throw std::runtime_error("the output format must have the same color family and subsampling as the input");
-            if (d->vi.format.numPlanes != f.numPlanes)
-                throw std::runtime_error("The number of planes in the inputs and output must match");
-            vsapi->queryVideoFormat(&d->vi.format, f.colorFamily, f.sampleType, f.bitsPerSample, f.subSamplingW, f.subSamplingH, core);
-        }
+        if (!err)
+            d->vi.format = getOutputFormat(d->vi.format, format, core, vsapi);
 
         if (!is8to16orFloatFormat(d->vi.format))
             throw std::runtime_error(invalidVideoFormatMessage(d->vi.format, vsapi, nullptr));
@@ -338,28 +589,9 @@ static void VS_CC exprCreate(const VSMap *in, VSMap *out, void *userData, VSCore
             if (d->plane[i] != poProcess)
                 continue;
 
-            d->bytecode[i] = compile(expr[i], vi, d->numInputs, d->vi);
-
-            // The JIT converts half via F16C; when that's missing, leave proc[i] null for
-            // any plane that loads or stores half so exprGetFrame runs the interpreter for
-            // it (which does the conversion in software) instead of emitting an illegal
-            // vcvtph2ps.
-            bool planeUsesHalf = false;
-            if (!jitHasF16C) {
-                for (const ExprInstruction &insn : d->bytecode[i]) {
-                    if (insn.op.type == ExprOpType::MEM_LOAD_F16 || insn.op.type == ExprOpType::MEM_STORE_F16) {
-                        planeUsesHalf = true;
-                        break;
-                    }
-                }
-            }
-
-            if (cpulevel > VS_CPU_LEVEL_NONE && !planeUsesHalf)
-                std::tie(d->proc[i], d->procSize[i]) = expr::compile_jit(d->bytecode[i].data(), d->bytecode[i].size(), d->numInputs, cpulevel, &d->procPixels[i]);
+            d->bytecode[i] = compile(expr[i], vi, d->numInputs, d->vi, d->props[i]);
+            preparePlane(d.get(), i, vi);
         }
-#ifdef VS_TARGET_OS_WINDOWS
-        FlushInstructionCache(GetCurrentProcess(), nullptr, 0);
-#endif
     } catch (std::runtime_error &e) {
         for (int i = 0; i < MAX_EXPR_INPUTS; i++) {
             vsapi->freeNode(d->node[i]);
@@ -375,12 +607,345 @@ static void VS_CC exprCreate(const VSMap *in, VSMap *out, void *userData, VSCore
     d.release();
 }
 
+//////////////////////////////////////////
+// MultiExpr
+
+// One node evaluates all the expressions together and returns the first output with the
+// others attached to it. Every output is a node that extracts its frame from there, so
+// the frame cache of the shared node makes all of them come from a single evaluation.
+
+typedef struct {
+    VSVideoInfo vi;
+    int index;
+} MultiExprOutputDataExtra;
+
+typedef SingleNodeData<MultiExprOutputDataExtra> MultiExprOutputData;
+
+static const VSFrame *VS_CC multiExprOutputGetFrame(int n, int activationReason, void *instanceData, void **frameData, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi) {
+    MultiExprOutputData *d = static_cast<MultiExprOutputData *>(instanceData);
+
+    if (activationReason == arInitial) {
+        vsapi->requestFrameFilter(n, d->node, frameCtx);
+    } else if (activationReason == arAllFramesReady) {
+        const VSFrame *src = vsapi->getFrameFilter(n, d->node, frameCtx);
+
+        if (d->index > 0) {
+            const VSFrame *dst = vsapi->mapGetFrame(vsapi->getFramePropertiesRO(src), MULTI_EXPR_OUTPUTS_KEY, d->index - 1, nullptr);
+            vsapi->freeFrame(src);
+            return dst;
+        }
+
+        VSFrame *dst = vsapi->copyFrame(src, core);
+        vsapi->freeFrame(src);
+        vsapi->mapDeleteKey(vsapi->getFramePropertiesRW(dst), MULTI_EXPR_OUTPUTS_KEY);
+        return dst;
+    }
+
+    return nullptr;
+}
+
+static void VS_CC multiExprCreate(const VSMap *in, VSMap *out, void *userData, VSCore *core, const VSAPI *vsapi) {
+    std::unique_ptr<ExprData> d(new ExprData);
+    int numOutputs = vsapi->mapNumElements(in, "expr");
+    std::vector<VSVideoInfo> outVi;
+
+    try {
+        d->cpulevel = vs_get_cpulevel(core);
+
+        const VSVideoInfo *vi[MAX_EXPR_INPUTS] = {};
+        getInputs(in, d.get(), vi, vsapi);
+
+        if (numOutputs > MAX_EXPR_OUTPUTS)
+            throw std::runtime_error("More than 8 expressions provided");
+
+        int nformat = vsapi->mapNumElements(in, "format");
+        if (nformat > numOutputs)
+            throw std::runtime_error("More formats given than there are expressions");
+
+        std::vector<std::string> exprs;
+        const VSVideoInfo *dstFormats[MAX_EXPR_OUTPUTS] = {};
+        outVi.assign(numOutputs, *vi[0]);
+
+        for (int i = 0; i < numOutputs; i++) {
+            exprs.push_back(vsapi->mapGetData(in, "expr", i, nullptr));
+            if (exprs.back().empty())
+                throw std::runtime_error("Expressions can't be empty");
+
+            if (nformat > 0)
+                outVi[i].format = getOutputFormat(vi[0]->format, vsapi->mapGetIntSaturated(in, "format", std::min(i, nformat - 1), nullptr), core, vsapi);
+            dstFormats[i] = &outVi[i];
+        }
+
+        d->vi = outVi[0];
+        for (int i = 1; i < numOutputs; i++)
+            d->extraFormats.push_back(outVi[i].format);
+
+        // Every plane runs the same program.
+        std::vector<PropertyAccess> props;
+        std::vector<ExprInstruction> bytecode = compile(exprs, vi, d->numInputs, dstFormats, props);
+
+        for (int i = 0; i < d->vi.format.numPlanes; i++) {
+            d->plane[i] = poProcess;
+            d->bytecode[i] = bytecode;
+            d->props[i] = props;
+            preparePlane(d.get(), i, vi);
+        }
+    } catch (std::runtime_error &e) {
+        for (int i = 0; i < MAX_EXPR_INPUTS; i++) {
+            vsapi->freeNode(d->node[i]);
+        }
+        vsapi->mapSetError(out, (std::string{ "MultiExpr: " } + e.what()).c_str());
+        return;
+    }
+
+    std::vector<VSFilterDependency> deps;
+    for (int i = 0; i < d->numInputs; i++)
+        deps.push_back({d->node[i], (d->vi.numFrames <= vsapi->getVideoInfo(d->node[i])->numFrames) ? rpStrictSpatial : rpFrameReuseLastOnly });
+
+    if (numOutputs == 1) {
+        vsapi->createVideoFilter(out, "MultiExpr", &d->vi, exprGetFrame, exprFree, fmParallel, deps.data(), d->numInputs, d.get(), core);
+        d.release();
+        return;
+    }
+
+    VSNode *node = vsapi->createVideoFilter2("MultiExpr", &d->vi, exprGetFrame, exprFree, fmParallel, deps.data(), d->numInputs, d.get(), core);
+    d.release();
+
+    for (int i = 0; i < numOutputs; i++) {
+        std::unique_ptr<MultiExprOutputData> od(new MultiExprOutputData(vsapi));
+        od->node = vsapi->addNodeRef(node);
+        od->vi = outVi[i];
+        od->index = i;
+
+        VSFilterDependency dep = { od->node, rpStrictSpatial };
+        vsapi->createVideoFilter(out, "MultiExprOutput", &od->vi, multiExprOutputGetFrame, filterFree<MultiExprOutputData>, fmParallel, &dep, 1, od.get(), core);
+        od.release();
+    }
+
+    vsapi->freeNode(node);
+}
+
+//////////////////////////////////////////
+// ExprStats
+
+// The expression is evaluated a strip of rows at a time into a float line buffer that
+// stays in cache, which is then reduced with the PlaneStats kernels. Count is the number
+// of pixels where the expression is true, greater than zero as in Expr.
+#define EXPR_STATS_STRIP_HEIGHT 16
+
+struct ExprStatsData : public ExprData {
+    std::string propMin;
+    std::string propMax;
+    std::string propSum;
+    std::string propAverage;
+    std::string propCount;
+    int statsPlane;
+    void (*statsFunc)(union vs_plane_stats *, const void *, ptrdiff_t, unsigned, unsigned);
+
+    ExprStatsData() : statsPlane(), statsFunc() {}
+};
+
+static const VSFrame *VS_CC exprStatsGetFrame(int n, int activationReason, void *instanceData, void **frameData, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi) {
+    ExprStatsData *d = static_cast<ExprStatsData *>(instanceData);
+    int numInputs = d->numInputs;
+
+    if (activationReason == arInitial) {
+        for (int i = 0; i < numInputs; i++)
+            vsapi->requestFrameFilter(n, d->node[i], frameCtx);
+    } else if (activationReason == arAllFramesReady) {
+        const VSFrame *src[MAX_EXPR_INPUTS] = {};
+        for (int i = 0; i < numInputs; i++)
+            src[i] = vsapi->getFrameFilter(n, d->node[i], frameCtx);
+
+        PlaneEvaluator evaluator(d, d->statsPlane, n, src, frameCtx, vsapi);
+        int width = evaluator.getWidth();
+        int height = evaluator.getHeight();
+
+        // The JIT writes whole iterations, so the rows are padded like the line buffers.
+        ptrdiff_t stride = ((width + 63) & ~63) * sizeof(float);
+        uint8_t *bufp = static_cast<uint8_t *>(vsapi->allocScratch(stride * EXPR_STATS_STRIP_HEIGHT, frameCtx));
+        if (!evaluator.isValid() || !bufp) {
+            vsapi->setFilterError("ExprStats: failed to allocate scratch memory", frameCtx);
+            for (int i = 0; i < MAX_EXPR_INPUTS; i++)
+                vsapi->freeFrame(src[i]);
+            return nullptr;
+        }
+
+        float fmin = INFINITY;
+        float fmax = -INFINITY;
+        double sum = 0;
+        uint64_t count = 0;
+
+        for (int y = 0; y < height; y += EXPR_STATS_STRIP_HEIGHT) {
+            int h = std::min(height - y, EXPR_STATS_STRIP_HEIGHT);
+            evaluator.eval(&bufp, &stride, y, y + h);
+
+            union vs_plane_stats stats = {};
+            d->statsFunc(&stats, bufp, stride, width, h);
+
+            fmin = std::min(fmin, stats.f.min);
+            fmax = std::max(fmax, stats.f.max);
+            sum += stats.f.acc;
+            count += stats.f.count;
+        }
+
+        VSFrame *dst = vsapi->copyFrame(src[0], core);
+        VSMap *dstProps = vsapi->getFramePropertiesRW(dst);
+        vsapi->mapSetFloat(dstProps, d->propMin.c_str(), fmin, maReplace);
+        vsapi->mapSetFloat(dstProps, d->propMax.c_str(), fmax, maReplace);
+        vsapi->mapSetFloat(dstProps, d->propSum.c_str(), sum, maReplace);
+        vsapi->mapSetFloat(dstProps, d->propAverage.c_str(), sum / ((int64_t)width * height), maReplace);
+        vsapi->mapSetInt(dstProps, d->propCount.c_str(), static_cast<int64_t>(count), maReplace);
+
+        for (int i = 0; i < MAX_EXPR_INPUTS; i++) {
+            vsapi->freeFrame(src[i]);
+        }
+        return dst;
+    }
+
+    return nullptr;
+}
+
+static void VS_CC exprStatsFree(void *instanceData, VSCore *core, const VSAPI *vsapi) {
+    ExprStatsData *d = static_cast<ExprStatsData *>(instanceData);
+    for (int i = 0; i < MAX_EXPR_INPUTS; i++)
+        vsapi->freeNode(d->node[i]);
+    delete d;
+}
+
+static void VS_CC exprStatsCreate(const VSMap *in, VSMap *out, void *userData, VSCore *core, const VSAPI *vsapi) {
+    std::unique_ptr<ExprStatsData> d(new ExprStatsData);
+    int err;
+
+    try {
+        d->cpulevel = vs_get_cpulevel(core);
+
+        const VSVideoInfo *vi[MAX_EXPR_INPUTS] = {};
+        getInputs(in, d.get(), vi, vsapi);
+
+        d->statsPlane = vsapi->mapGetIntSaturated(in, "plane", 0, &err);
+        if (d->statsPlane < 0 || d->statsPlane >= vi[0]->format.numPlanes)
+            throw std::runtime_error("invalid plane specified");
+
+        std::string expr = vsapi->mapGetData(in, "expr", 0, nullptr);
+        if (expr.empty())
+            throw std::runtime_error("The expression can't be empty");
+
+        // The program stores float so the values are reduced unclamped.
+        d->vi = *vi[0];
+        vsapi->queryVideoFormat(&d->vi.format, vi[0]->format.colorFamily, stFloat, 32, vi[0]->format.subSamplingW, vi[0]->format.subSamplingH, core);
+
+        int plane = d->statsPlane;
+        d->plane[plane] = poProcess;
+        d->bytecode[plane] = compile(expr, vi, d->numInputs, d->vi, d->props[plane]);
+        preparePlane(d.get(), plane, vi);
+
+        const char *prop = vsapi->mapGetData(in, "prop", 0, &err);
+        std::string propBase = prop ? prop : "ExprStats";
+        d->propMin = propBase + "Min";
+        d->propMax = propBase + "Max";
+        d->propSum = propBase + "Sum";
+        d->propAverage = propBase + "Average";
+        d->propCount = propBase + "Count";
+    } catch (std::runtime_error &e) {
+        for (int i = 0; i < MAX_EXPR_INPUTS; i++) {
+            vsapi->freeNode(d->node[i]);
+        }
+        vsapi->mapSetError(out, (std::string{ "ExprStats: " } + e.what()).c_str());
+        return;
+    }
+
+    d->statsFunc = vs_plane_stats_count_float_c;
+#ifdef VS_TARGET_CPU_X86
+    if (getCPUFeatures()->avx2 && d->cpulevel >= VS_CPU_LEVEL_AVX2)
+        d->statsFunc = vs_plane_stats_count_float_avx2;
+    else if (d->cpulevel >= VS_CPU_LEVEL_SSE2)
+        d->statsFunc = vs_plane_stats_count_float_sse2;
+#endif
+
+    const VSVideoInfo *vi = vsapi->getVideoInfo(d->node[0]);
+    std::vector<VSFilterDependency> deps;
+    for (int i = 0; i < d->numInputs; i++)
+        deps.push_back({d->node[i], (vi->numFrames <= vsapi->getVideoInfo(d->node[i])->numFrames) ? rpStrictSpatial : rpFrameReuseLastOnly });
+    vsapi->createVideoFilter(out, "ExprStats", vi, exprStatsGetFrame, exprStatsFree, fmParallel, deps.data(), d->numInputs, d.get(), core);
+    d.release();
+}
+
 } // namespace
 
+//////////////////////////////////////////
+// Lut tables
+
+void expr::evaluateTable(const std::string &expr, const VSVideoInfo * const srcFormats[], int numInputs, const VSVideoInfo &dstFormat, void *table, int cpulevel) {
+    std::vector<PropertyAccess> props;
+    std::vector<ExprInstruction> bytecode = compile(expr, srcFormats, numInputs, dstFormat, props);
+
+    for (const ExprInstruction &insn : bytecode) {
+        ExprOpType type = insn.op.type;
+        if (type == ExprOpType::RUNTIME_CONST || type == ExprOpType::COORD_X)
+            throw std::runtime_error("expr can't use frame properties, coordinates or frame dimensions");
+        if ((type == ExprOpType::MEM_LOAD_U8 || type == ExprOpType::MEM_LOAD_U16) && (loadOffsetX(insn.op.imm) || loadOffsetY(insn.op.imm)))
+            throw std::runtime_error("expr can't load neighbouring pixels");
+    }
+
+    std::shared_ptr<const JitCode> jit;
+    if (cpulevel > VS_CPU_LEVEL_NONE)
+        jit = compile_jit_cached(bytecode.data(), bytecode.size(), numInputs, cpulevel, analyzeInt16(bytecode, srcFormats));
+    ExprInterpreter interpreter(bytecode.data(), bytecode.size());
+
+    // Input 0 is a ramp over every value and input 1 holds the value of the current row. The
+    // compiled code wants aligned rows, so each one is evaluated into a line buffer first.
+    // The widths are powers of two of at least 256, whole iterations of every target.
+    int width = 1 << srcFormats[0]->format.bitsPerSample;
+    int height = numInputs > 1 ? 1 << srcFormats[1]->format.bitsPerSample : 1;
+    int lanes = jit ? jit->pixelsPerIteration : 8;
+    size_t rowBytes = static_cast<size_t>(width) * dstFormat.format.bytesPerSample;
+
+    std::unique_ptr<uint8_t[], decltype(&vsh_aligned_free)> buffer(vsh_aligned_malloc<uint8_t>(width * (2 + 2) + rowBytes, 64), &vsh_aligned_free);
+    if (!buffer)
+        throw std::runtime_error("failed to allocate the table buffers");
+    uint8_t *ramp = buffer.get();
+    uint8_t *row = ramp + width * 2;
+    uint8_t *line = row + width * 2;
+
+    for (int x = 0; x < width; x++) {
+        if (srcFormats[0]->format.bytesPerSample == 1)
+            ramp[x] = static_cast<uint8_t>(x);
+        else
+            reinterpret_cast<uint16_t *>(ramp)[x] = static_cast<uint16_t>(x);
+    }
+
+    alignas(32) intptr_t ptroffsets[((MAX_EXPR_SOURCES + MAX_EXPR_OUTPUTS) + 7) & ~7] = { dstFormat.format.bytesPerSample * lanes };
+    for (int i = 0; i < numInputs; i++)
+        ptroffsets[i + 1] = srcFormats[i]->format.bytesPerSample * lanes;
+    std::vector<float> consts(RC_FIRST_PROP);
+
+    for (int y = 0; y < height; y++) {
+        if (numInputs > 1) {
+            if (srcFormats[1]->format.bytesPerSample == 1)
+                std::fill_n(row, width, static_cast<uint8_t>(y));
+            else
+                std::fill_n(reinterpret_cast<uint16_t *>(row), width, static_cast<uint16_t>(y));
+        }
+
+        alignas(32) uint8_t *rwptrs[((MAX_EXPR_SOURCES + MAX_EXPR_OUTPUTS) + 7) & ~7] = { line, ramp, row };
+
+        if (jit) {
+            jit->proc(rwptrs, ptroffsets, width / lanes, consts.data());
+        } else {
+            for (int x = 0; x < width; x += ExprInterpreter::BLOCK_SIZE)
+                interpreter.eval(rwptrs, consts.data(), x, std::min(width - x, ExprInterpreter::BLOCK_SIZE));
+        }
+
+        memcpy(static_cast<uint8_t *>(table) + rowBytes * y, line, rowBytes);
+    }
+}
 
 //////////////////////////////////////////
 // Init
 
 void exprInitialize(VSPlugin *plugin, const VSPLUGINAPI *vspapi) {
     vspapi->registerFunction("Expr", "clips:vnode[];expr:data[];format:int:opt;", "clip:vnode;", exprCreate, nullptr, plugin);
+    vspapi->registerFunction("MultiExpr", "clips:vnode[];expr:data[];format:int[]:opt;", "clip:vnode[];", multiExprCreate, nullptr, plugin);
+    vspapi->registerFunction("ExprStats", "clips:vnode[];expr:data;plane:int:opt;prop:data:opt;", "clip:vnode;", exprStatsCreate, nullptr, plugin);
 }
@@ -123,7 +123,12 @@ enum ConvolutionTypes {
     ConvolutionSquare,
     ConvolutionHorizontal,
     ConvolutionVertical,
-    ConvolutionSeparable
+    ConvolutionSeparable,
+    ConvolutionFFT // Square matrices larger than 11x11
+};
+
+struct FFTPlanFree {
+    void operator()(vs_generic_fft_plan *plan) const { vs_generic_fft_plan_free(plan); }
 };
 
 struct GenericDataExtra {
@@ -139,8 +144,10 @@ struct GenericDataExtra {
     uint16_t th;
     float thf;
 
-    // Minimum, Maximum
+    // Minimum, Maximum, Median
     uint8_t enable;
+    int hradius;
+    int vradius;
 
     // Convolution
     ConvolutionTypes convolution_type;
@@ -152,6 +159,7 @@ struct GenericDataExtra {
     bool saturate;
     bool conv_int8;   // all coefficients fit int8 -> byte square conv may take the VNNI path
     bool conv_f16;    // all coefficients survive a round trip through half -> fmlal (FHM) is lossless
+    std::unique_ptr<vs_generic_fft_plan, FFTPlanFree> fft;
 
     int cpulevel;
 
@@ -238,12 +246,17 @@ vs_generic_params make_generic_params(const GenericData *d, const VSVideoFormat
     params.threshold = d->th;
     params.thresholdf = d->thf;
     params.stencil = d->enable;
+    params.hradius = d->hradius;
+    params.vradius = d->vradius;
 
-    for (int i = 0; i < d->matrix_elements; ++i) {
-        params.matrix[i] = d->matrix[i];
-        params.matrixf[i] = d->matrixf[i];
+    if (d->convolution_type != ConvolutionFFT) {
+        for (int i = 0; i < d->matrix_elements; ++i) {
+            params.matrix[i] = d->matrix[i];
+            params.matrixf[i] = d->matrixf[i];
+        }
     }
     params.matrixsize = d->matrix_elements;
+    params.fft = d->fft.get();
 
     params.div = d->rdiv;
     params.bias = d->bias;
@@ -262,6 +275,13 @@ static bool convByteVNNI(const GenericData *d) {
 
 template <GenericOperations op>
 static decltype(&vs_generic_3x3_conv_byte_c) genericSelectAVX512(const VSVideoFormat *fi, GenericData *d) {
+    // The van Herk/Gil-Werman kernels are bound by memory bandwidth, AVX2 is as fast. Median with a radius
+    // and the FFT convolution stop at AVX2 too.
+    if ((op == GenericMinimum || op == GenericMaximum || op == GenericMedian) && (d->hradius || d->vradius))
+        return nullptr;
+    if (op == GenericConvolution && d->convolution_type == ConvolutionFFT)
+        return nullptr;
+
     if (fi->sampleType == stInteger && fi->bytesPerSample == 1) {
         switch (op) {
         case GenericPrewitt: return vs_generic_3x3_prewitt_byte_avx512;
@@ -352,12 +372,26 @@ static decltype(&vs_generic_3x3_conv_byte_c) genericSelectAVX512(const VSVideoFo
         case GenericSobel: return vs_generic_3x3_sobel_half_avx512;
         case GenericMinimum: return vs_generic_3x3_min_half_avx512;
         case GenericMaximum: return vs_generic_3x3_max_half_avx512;
-        case GenericMedian: return vs_generic_3x3_median_half_avx512;
+        case GenericMedian: return getCPUFeatures()->avx512_fp16 ? vs_generic_3x3_median_half_avx512fp16 : vs_generic_3x3_median_half_avx512;
         case GenericDeflate: return vs_generic_3x3_deflate_half_avx512;
         case GenericInflate: return vs_generic_3x3_inflate_half_avx512;
         case GenericConvolution:
             if (d->convolution_type == ConvolutionSquare && d->matrix_elements == 9)
                 return vs_generic_3x3_conv_half_avx512;
+            else if (d->convolution_type == ConvolutionSquare && d->matrix_elements == 25)
+                return vs_generic_5x5_conv_half_avx512;
+            else if (d->convolution_type == ConvolutionSquare && d->matrix_elements == 49)
+                return vs_generic_7x7_conv_half_avx512;
+            else if (d->convolution_type == ConvolutionSquare && d->matrix_elements == 81)
+                return vs_generic_9x9_conv_half_avx512;
+            else if (d->convolution_type == ConvolutionSquare && d->matrix_elements == 121)
+                return vs_generic_11x11_conv_half_avx512;
+            else if (d->convolution_type == ConvolutionHorizontal)
+                return vs_generic_1d_conv_h_half_avx512;
+            else if (d->convolution_type == ConvolutionVertical)
+                return vs_generic_1d_conv_v_half_avx512;
+            else if (d->convolution_type == ConvolutionSeparable)
+                return vs_generic_2d_conv_sep_half_avx512;
             break;
         }
     }
@@ -370,9 +404,9 @@ static decltype(&vs_generic_3x3_conv_byte_c) genericSelectAVX2(const VSVideoForm
         switch (op) {
         case GenericPrewitt: return vs_generic_3x3_prewitt_byte_avx2;
         case GenericSobel: return vs_generic_3x3_sobel_byte_avx2;
-        case GenericMinimum: return vs_generic_3x3_min_byte_avx2;
-        case GenericMaximum: return vs_generic_3x3_max_byte_avx2;
-        case GenericMedian: return vs_generic_3x3_median_byte_avx2;
+        case GenericMinimum: return (d->hradius || d->vradius) ? vs_generic_vhgw_min_byte_avx2 : vs_generic_3x3_min_byte_avx2;
+        case GenericMaximum: return (d->hradius || d->vradius) ? vs_generic_vhgw_max_byte_avx2 : vs_generic_3x3_max_byte_avx2;
+        case GenericMedian: return d->hradius ? vs_generic_median_radius_byte_avx2 : vs_generic_3x3_median_byte_avx2;
         case GenericDeflate: return vs_generic_3x3_deflate_byte_avx2;
         case GenericInflate: return vs_generic_3x3_inflate_byte_avx2;
         case GenericConvolution:
@@ -392,15 +426,17 @@ static decltype(&vs_generic_3x3_conv_byte_c) genericSelectAVX2(const VSVideoForm
                 return vs_generic_1d_conv_v_byte_avx2;
             else if (d->convolution_type == ConvolutionSeparable)
                 return vs_generic_2d_conv_sep_byte_avx2;
+            else if (d->convolution_type == ConvolutionFFT)
+                return vs_generic_fft_conv_byte_avx2;
             break;
         }
     } else if (fi->sampleType == stInteger && fi->bytesPerSample == 2) {
         switch (op) {
         case GenericPrewitt: return vs_generic_3x3_prewitt_word_avx2;
         case GenericSobel: return vs_generic_3x3_sobel_word_avx2;
-        case GenericMinimum: return vs_generic_3x3_min_word_avx2;
-        case GenericMaximum: return vs_generic_3x3_max_word_avx2;
-        case GenericMedian: return vs_generic_3x3_median_word_avx2;
+        case GenericMinimum: return (d->hradius || d->vradius) ? vs_generic_vhgw_min_word_avx2 : vs_generic_3x3_min_word_avx2;
+        case GenericMaximum: return (d->hradius || d->vradius) ? vs_generic_vhgw_max_word_avx2 : vs_generic_3x3_max_word_avx2;
+        case GenericMedian: return d->hradius ? vs_generic_median_radius_word_avx2 : vs_generic_3x3_median_word_avx2;
         case GenericDeflate: return vs_generic_3x3_deflate_word_avx2;
         case GenericInflate: return vs_generic_3x3_inflate_word_avx2;
         case GenericConvolution:
@@ -420,15 +456,17 @@ static decltype(&vs_generic_3x3_conv_byte_c) genericSelectAVX2(const VSVideoForm
                 return vs_generic_1d_conv_v_word_avx2;
             else if (d->convolution_type == ConvolutionSeparable)
                 return vs_generic_2d_conv_sep_word_avx2;
+            else if (d->convolution_type == ConvolutionFFT)
+                return vs_generic_fft_conv_word_avx2;
             break;
         }
     } else if (fi->sampleType == stFloat && fi->bytesPerSample == 4) {
         switch (op) {
         case GenericPrewitt: return vs_generic_3x3_prewitt_float_avx2;
         case GenericSobel: return vs_generic_3x3_sobel_float_avx2;
-        case GenericMinimum: return vs_generic_3x3_min_float_avx2;
-        case GenericMaximum: return vs_generic_3x3_max_float_avx2;
-        case GenericMedian: return vs_generic_3x3_median_float_avx2;
+        case GenericMinimum: return (d->hradius || d->vradius) ? vs_generic_vhgw_min_float_avx2 : vs_generic_3x3_min_float_avx2;
+        case GenericMaximum: return (d->hradius || d->vradius) ? vs_generic_vhgw_max_float_avx2 : vs_generic_3x3_max_float_avx2;
+        case GenericMedian: return d->hradius ? vs_generic_median_radius_float_avx2 : vs_generic_3x3_median_float_avx2;
         case GenericDeflate: return vs_generic_3x3_deflate_float_avx2;
         case GenericInflate: return vs_generic_3x3_inflate_float_avx2;
         case GenericConvolution:
@@ -448,20 +486,38 @@ static decltype(&vs_generic_3x3_conv_byte_c) genericSelectAVX2(const VSVideoForm
                 return vs_generic_1d_conv_v_float_avx2;
             else if (d->convolution_type == ConvolutionSeparable)
                 return vs_generic_2d_conv_sep_float_avx2;
+            else if (d->convolution_type == ConvolutionFFT)
+                return vs_generic_fft_conv_float_avx2;
             break;
         }
     } else if (fi->sampleType == stFloat && fi->bytesPerSample == 2) {
         switch (op) {
         case GenericPrewitt: return vs_generic_3x3_prewitt_half_avx2;
         case GenericSobel: return vs_generic_3x3_sobel_half_avx2;
-        case GenericMinimum: return vs_generic_3x3_min_half_avx2;
-        case GenericMaximum: return vs_generic_3x3_max_half_avx2;
-        case GenericMedian: return vs_generic_3x3_median_half_avx2;
+        case GenericMinimum: return (d->hradius || d->vradius) ? vs_generic_vhgw_min_half_avx2 : vs_generic_3x3_min_half_avx2;
+        case GenericMaximum: return (d->hradius || d->vradius) ? vs_generic_vhgw_max_half_avx2 : vs_generic_3x3_max_half_avx2;
+        case GenericMedian: return d->hradius ? vs_generic_median_radius_half_avx2 : vs_generic_3x3_median_half_avx2;
         case GenericDeflate: return vs_generic_3x3_deflate_half_avx2;
         case GenericInflate: return vs_generic_3x3_inflate_half_avx2;
         case GenericConvolution:
             if (d->convolution_type == ConvolutionSquare && d->matrix_elements == 9)
                 return vs_generic_3x3_conv_half_avx2;
+            else if (d->convolution_type == ConvolutionSquare && d->matrix_elements == 25)
+                return vs_generic_5x5_conv_half_avx2;
+            else if (d->convolution_type == ConvolutionSquare && d->matrix_elements == 49)
+                return vs_generic_7x7_conv_half_avx2;
+            else if (d->convolution_type == ConvolutionSquare && d->matrix_elements == 81)
+                return vs_generic_9x9_conv_half_avx2;
+            else if (d->convolution_type == ConvolutionSquare && d->matrix_elements == 121)
+                return vs_generic_11x11_conv_half_avx2;
+            else if (d->convolution_type == ConvolutionHorizontal)
+                return vs_generic_1d_conv_h_half_avx2;
+            else if (d->convolution_type == ConvolutionVertical)
+                return vs_generic_1d_conv_v_half_avx2;
+            else if (d->convolution_type == ConvolutionSeparable)
+                return vs_generic_2d_conv_sep_half_avx2;
+            else if (d->convolution_type == ConvolutionFFT)
+                return vs_generic_fft_conv_half_avx2;
             break;
         }
     }
@@ -474,9 +530,9 @@ static decltype(&vs_generic_3x3_conv_byte_c) genericSelectSSE2(const VSVideoForm
         switch (op) {
         case GenericPrewitt: return vs_generic_3x3_prewitt_byte_sse2;
         case GenericSobel: return vs_generic_3x3_sobel_byte_sse2;
-        case GenericMinimum: return vs_generic_3x3_min_byte_sse2;
-        case GenericMaximum: return vs_generic_3x3_max_byte_sse2;
-        case GenericMedian: return vs_generic_3x3_median_byte_sse2;
+        case GenericMinimum: return (d->hradius || d->vradius) ? vs_generic_vhgw_min_byte_sse2 : vs_generic_3x3_min_byte_sse2;
+        case GenericMaximum: return (d->hradius || d->vradius) ? vs_generic_vhgw_max_byte_sse2 : vs_generic_3x3_max_byte_sse2;
+        case GenericMedian: return d->hradius ? vs_generic_median_radius_byte_sse2 : vs_generic_3x3_median_byte_sse2;
         case GenericDeflate: return vs_generic_3x3_deflate_byte_sse2;
         case GenericInflate: return vs_generic_3x3_inflate_byte_sse2;
         case GenericConvolution:
@@ -488,15 +544,17 @@ static decltype(&vs_generic_3x3_conv_byte_c) genericSelectSSE2(const VSVideoForm
                 return vs_generic_1d_conv_v_byte_sse2;
             else if (d->convolution_type == ConvolutionSeparable)
                 return vs_generic_2d_conv_sep_byte_sse2;
+            else if (d->convolution_type == ConvolutionFFT)
+                return vs_generic_fft_conv_byte_sse2;
             break;
         }
     } else if (fi->sampleType == stInteger && fi->bytesPerSample == 2) {
         switch (op) {
         case GenericPrewitt: return vs_generic_3x3_prewitt_word_sse2;
         case GenericSobel: return vs_generic_3x3_sobel_word_sse2;
-        case GenericMinimum: return vs_generic_3x3_min_word_sse2;
-        case GenericMaximum: return vs_generic_3x3_max_word_sse2;
-        case GenericMedian: return vs_generic_3x3_median_word_sse2;
+        case GenericMinimum: return (d->hradius || d->vradius) ? vs_generic_vhgw_min_word_sse2 : vs_generic_3x3_min_word_sse2;
+        case GenericMaximum: return (d->hradius || d->vradius) ? vs_generic_vhgw_max_word_sse2 : vs_generic_3x3_max_word_sse2;
+        case GenericMedian: return d->hradius ? vs_generic_median_radius_word_sse2 : vs_generic_3x3_median_word_sse2;
         case GenericDeflate: return vs_generic_3x3_deflate_word_sse2;
         case GenericInflate: return vs_generic_3x3_inflate_word_sse2;
         case GenericConvolution:
@@ -508,15 +566,17 @@ static decltype(&vs_generic_3x3_conv_byte_c) genericSelectSSE2(const VSVideoForm
                 return vs_generic_1d_conv_v_word_sse2;
             else if (d->convolution_type == ConvolutionSeparable)
                 return vs_generic_2d_conv_sep_word_sse2;
+            else if (d->convolution_type == ConvolutionFFT)
+                return vs_generic_fft_conv_word_sse2;
             break;
         }
     } else if (fi->sampleType == stFloat && fi->bytesPerSample == 4) {
         switch (op) {
         case GenericPrewitt: return vs_generic_3x3_prewitt_float_sse2;
         case GenericSobel: return vs_generic_3x3_sobel_float_sse2;
-        case GenericMinimum: return vs_generic_3x3_min_float_sse2;
-        case GenericMaximum: return vs_generic_3x3_max_float_sse2;
-        case GenericMedian: return vs_generic_3x3_median_float_sse2;
+        case GenericMinimum: return (d->hradius || d->vradius) ? vs_generic_vhgw_min_float_sse2 : vs_generic_3x3_min_float_sse2;
+        case GenericMaximum: return (d->hradius || d->vradius) ? vs_generic_vhgw_max_float_sse2 : vs_generic_3x3_max_float_sse2;
+        case GenericMedian: return d->hradius ? vs_generic_median_radius_float_sse2 : vs_generic_3x3_median_float_sse2;
         case GenericDeflate: return vs_generic_3x3_deflate_float_sse2;
         case GenericInflate: return vs_generic_3x3_inflate_float_sse2;
         case GenericConvolution:
@@ -528,8 +588,13 @@ static decltype(&vs_generic_3x3_conv_byte_c) genericSelectSSE2(const VSVideoForm
                 return vs_generic_1d_conv_v_float_sse2;
             else if (d->convolution_type == ConvolutionSeparable)
                 return vs_generic_2d_conv_sep_float_sse2;
+            else if (d->convolution_type == ConvolutionFFT)
+                return vs_generic_fft_conv_float_sse2;
             break;
         }
+    } else if (fi->sampleType == stFloat && fi->bytesPerSample == 2) {
+        if (op == GenericConvolution && d->convolution_type == ConvolutionFFT)
+            return vs_generic_fft_conv_half_sse2;
     }
     return nullptr;
 }
@@ -687,9 +752,9 @@ static decltype(&vs_generic_3x3_conv_byte_c) genericSelectC(const VSVideoFormat
         switch (op) {
         case GenericPrewitt: return vs_generic_3x3_prewitt_byte_c;
         case GenericSobel: return vs_generic_3x3_sobel_byte_c;
-        case GenericMinimum: return vs_generic_3x3_min_byte_c;
-        case GenericMaximum: return vs_generic_3x3_max_byte_c;
-        case GenericMedian: return vs_generic_3x3_median_byte_c;
+        case GenericMinimum: return (d->hradius || d->vradius) ? vs_generic_vhgw_min_byte_c : vs_generic_3x3_min_byte_c;
+        case GenericMaximum: return (d->hradius || d->vradius) ? vs_generic_vhgw_max_byte_c : vs_generic_3x3_max_byte_c;
+        case GenericMedian: return d->hradius ? vs_generic_median_radius_byte_c : vs_generic_3x3_median_byte_c;
         case GenericDeflate: return vs_generic_3x3_deflate_byte_c;
         case GenericInflate: return vs_generic_3x3_inflate_byte_c;
         case GenericConvolution:
@@ -709,15 +774,17 @@ static decltype(&vs_generic_3x3_conv_byte_c) genericSelectC(const VSVideoFormat
                 return vs_generic_1d_conv_v_byte_c;
             else if (d->convolution_type == ConvolutionSeparable)
                 return vs_generic_2d_conv_sep_byte_c;
+            else if (d->convolution_type == ConvolutionFFT)
+                return vs_generic_fft_conv_byte_c;
             break;
         }
     } else if (fi->sampleType == stInteger && fi->bytesPerSample == 2) {
         switch (op) {
         case GenericPrewitt: return vs_generic_3x3_prewitt_word_c;
         case GenericSobel: return vs_generic_3x3_sobel_word_c;
-        case GenericMinimum: return vs_generic_3x3_min_word_c;
-        case GenericMaximum: return vs_generic_3x3_max_word_c;
-        case GenericMedian: return vs_generic_3x3_median_word_c;
+        case GenericMinimum: return (d->hradius || d->vradius) ? vs_generic_vhgw_min_word_c : vs_generic_3x3_min_word_c;
+        case GenericMaximum: return (d->hradius || d->vradius) ? vs_generic_vhgw_max_word_c : vs_generic_3x3_max_word_c;
+        case GenericMedian: return d->hradius ? vs_generic_median_radius_word_c : vs_generic_3x3_median_word_c;
         case GenericDeflate: return vs_generic_3x3_deflate_word_c;
         case GenericInflate: return vs_generic_3x3_inflate_word_c;
         case GenericConvolution:
@@ -737,15 +804,17 @@ static decltype(&vs_generic_3x3_conv_byte_c) genericSelectC(const VSVideoFormat
                 return vs_generic_1d_conv_v_word_c;
             else if (d->convolution_type == ConvolutionSeparable)
                 return vs_generic_2d_conv_sep_word_c;
+            else if (d->convolution_type == ConvolutionFFT)
+                return vs_generic_fft_conv_word_c;
             break;
         }
     } else if (fi->sampleType == stFloat && fi->bytesPerSample == 4) {
         switch (op) {
         case GenericPrewitt: return vs_generic_3x3_prewitt_float_c;
         case GenericSobel: return vs_generic_3x3_sobel_float_c;
-        case GenericMinimum: return vs_generic_3x3_min_float_c;
-        case GenericMaximum: return vs_generic_3x3_max_float_c;
-        case GenericMedian: return vs_generic_3x3_median_float_c;
+        case GenericMinimum: return (d->hradius || d->vradius) ? vs_generic_vhgw_min_float_c : vs_generic_3x3_min_float_c;
+        case GenericMaximum: return (d->hradius || d->vradius) ? vs_generic_vhgw_max_float_c : vs_generic_3x3_max_float_c;
+        case GenericMedian: return d->hradius ? vs_generic_median_radius_float_c : vs_generic_3x3_median_float_c;
         case GenericDeflate: return vs_generic_3x3_deflate_float_c;
         case GenericInflate: return vs_generic_3x3_inflate_float_c;
         case GenericConvolution:
@@ -765,15 +834,17 @@ static decltype(&vs_generic_3x3_conv_byte_c) genericSelectC(const VSVideoFormat
                 return vs_generic_1d_conv_v_float_c;
             else if (d->convolution_type == ConvolutionSeparable)
                 return vs_generic_2d_conv_sep_float_c;
+            else if (d->convolution_type == ConvolutionFFT)
+                return vs_generic_fft_conv_float_c;
             break;
         }
     } else if (fi->sampleType == stFloat && fi->bytesPerSample == 2) {
         switch (op) {
         case GenericPrewitt: return vs_generic_3x3_prewitt_half_c;
         case GenericSobel: return vs_generic_3x3_sobel_half_c;
-        case GenericMinimum: return vs_generic_3x3_min_half_c;
-        case GenericMaximum: return vs_generic_3x3_max_half_c;
-        case GenericMedian: return vs_generic_3x3_median_half_c;
+        case GenericMinimum: return (d->hradius || d->vradius) ? vs_generic_vhgw_min_half_c : vs_generic_3x3_min_half_c;
+        case GenericMaximum: return (d->hradius || d->vradius) ? vs_generic_vhgw_max_half_c : vs_generic_3x3_max_half_c;
+        case GenericMedian: return d->hradius ? vs_generic_median_radius_half_c : vs_generic_3x3_median_half_c;
         case GenericDeflate: return vs_generic_3x3_deflate_half_c;
         case GenericInflate: return vs_generic_3x3_inflate_half_c;
         case GenericConvolution:
@@ -793,6 +864,8 @@ static decltype(&vs_generic_3x3_conv_byte_c) genericSelectC(const VSVideoFormat
                 return vs_generic_1d_conv_v_half_c;
             else if (d->convolution_type == ConvolutionSeparable)
                 return vs_generic_2d_conv_sep_half_c;
+            else if (d->convolution_type == ConvolutionFFT)
+                return vs_generic_fft_conv_half_c;
             break;
         }
     }
@@ -801,7 +874,9 @@ static decltype(&vs_generic_3x3_conv_byte_c) genericSelectC(const VSVideoFormat
 
 template <GenericOperations op>
 static const char *checkPlaneDims(const GenericData *d, int width, int height) {
-    if (width < 4 || height < 4)
+    // The rectangle kernels clamp the radius to the plane, they take any size.
+    bool rectangle = (op == GenericMinimum || op == GenericMaximum) && (d->hradius || d->vradius);
+    if (!rectangle && (width < 4 || height < 4))
         return "Cannot process planes smaller than 4x4.";
     if constexpr (op == GenericConvolution) {
         int radius = d->matrix_elements / 2;
@@ -809,6 +884,14 @@ static const char *checkPlaneDims(const GenericData *d, int width, int height) {
             return "Width must be bigger than convolution radius.";
         if ((d->convolution_type == ConvolutionVertical || d->convolution_type == ConvolutionSeparable) && radius >= height)
             return "Height must be bigger than convolution radius.";
+        // The FFT mirrors the borders like the direct kernels, which only reaches one plane size out.
+        if (d->convolution_type == ConvolutionFFT) {
+            radius = static_cast<int>(std::lround(std::sqrt(d->matrix_elements))) / 2;
+            if (radius >= width)
+                return "Width must be bigger than convolution radius.";
+            if (radius >= height)
+                return "Height must be bigger than convolution radius.";
+        }
     }
     return nullptr;
 }
@@ -846,7 +929,40 @@ static const VSFrame *VS_CC genericGetframe(int n, int activationReason, void *i
 
         VSFrame *dst = vsapi->newVideoFrame2(fi, vsapi->getFrameWidth(src, 0), vsapi->getFrameHeight(src, 0), fr, pl, src, core);
 
-        const vs_generic_params params = d->params;
+        vs_generic_params params = d->params;
+        bool needScratch = false;
+
+        if constexpr (op == GenericConvolution) {
+            needScratch = d->convolution_type != ConvolutionSquare;
+            if (d->convolution_type == ConvolutionFFT)
+                params.scratch = vsapi->allocScratch(VS_GENERIC_FFT_SCRATCH_SIZE(d->fft->n), frameCtx);
+            else if (d->convolution_type != ConvolutionSquare)
+                params.scratch = vsapi->allocScratch(VS_GENERIC_SCRATCH_SIZE(vsapi->getFrameWidth(src, 0)), frameCtx);
+        }
+
+        if constexpr (op == GenericMinimum || op == GenericMaximum) {
+            if (d->hradius || d->vradius) {
+                int width = vsapi->getFrameWidth(src, 0);
+                int height = vsapi->getFrameHeight(src, 0);
+                int radius = std::max(std::min(d->hradius, width - 1), std::min(d->vradius, height - 1));
+                params.scratch = vsapi->allocScratch(VS_GENERIC_VHGW_SCRATCH_SIZE(width, radius), frameCtx);
+                needScratch = true;
+            }
+        }
+
+        if constexpr (op == GenericMedian) {
+            if (d->hradius) {
+                params.scratch = vsapi->allocScratch(VS_GENERIC_MEDIAN_SCRATCH_SIZE(vsapi->getFrameWidth(src, 0), d->hradius), frameCtx);
+                needScratch = true;
+            }
+        }
+
+        if (needScratch && !params.scratch) {
+            vsapi->setFilterError((d->filter_name + ": failed to allocate scratch memory"s).c_str(), frameCtx);
+            vsapi->freeFrame(src);
+            vsapi->freeFrame(dst);
+            return nullptr;
+        }
 
         for (int plane = 0; plane < fi->numPlanes; plane++) {
             if (d->process[plane]) {
@@ -926,6 +1042,46 @@ static void VS_CC genericCreate(const VSMap *in, VSMap *out, void *userData, VSC
             } else {
                 throw std::runtime_error("coordinates must contain exactly 8 numbers.");
             }
+
+            int radius_elements = vsapi->mapNumElements(in, "radius");
+            if (radius_elements > 0) {
+                if (enable_elements != -1)
+                    throw std::runtime_error("coordinates can't be used together with radius.");
+                if (radius_elements > 2)
+                    throw std::runtime_error("radius must contain one or two numbers.");
+
+                int64_t hradius = vsapi->mapGetInt(in, "radius", 0, nullptr);
+                int64_t vradius = vsapi->mapGetInt(in, "radius", radius_elements - 1, nullptr);
+                if (hradius < 0 || vradius < 0)
+                    throw std::runtime_error("radius must not be negative.");
+                if (!hradius && !vradius)
+                    throw std::runtime_error("at least one radius must be greater than 0.");
+
+                // A window bigger than the plane is the same as one that covers all of it.
+                d->hradius = static_cast<int>(std::min<int64_t>(hradius, std::numeric_limits<int>::max()));
+                d->vradius = static_cast<int>(std::min<int64_t>(vradius, std::numeric_limits<int>::max()));
+
+                // A radius of at most 1 is a 3x3 stencil, which has faster kernels.
+                if (d->hradius <= 1 && d->vradius <= 1) {
+                    d->enable = (d->hradius ? 0x18 : 0) | (d->vradius ? 0x42 : 0) | (d->hradius && d->vradius ? 0xA5 : 0);
+                    d->hradius = 0;
+                    d->vradius = 0;
+                }
+            }
+        }
+
+        if (op == GenericMedian) {
+            int64_t radius = vsapi->mapGetInt(in, "radius", 0, &err);
+            if (err)
+                radius = 1;
+            if (radius < 1 || radius > VS_GENERIC_MEDIAN_MAX_RADIUS)
+                throw std::runtime_error("radius must be between 1 and 127.");
+
+            // Radius 1 is the 3x3 kernel.
+            if (radius > 1) {
+                d->hradius = static_cast<int>(radius);
+                d->vradius = static_cast<int>(radius);
+            }
         }
 
 
@@ -951,10 +1107,12 @@ static void VS_CC genericCreate(const VSMap *in, VSMap *out, void *userData, VSC
 
             const char *mode = vsapi->mapGetData(in, "mode", 0, &err);
             if (err || mode == "s"s) {
-                d->convolution_type = ConvolutionSquare;
+                int size = static_cast<int>(std::lround(std::sqrt(d->matrix_elements)));
+                if (size * size != d->matrix_elements || size % 2 == 0 || size < 3 || size > VS_GENERIC_FFT_MAX_SIZE)
+                    throw std::runtime_error("When mode starts with 's', matrix must contain the numbers of an odd square of 3x3 to 127x127.");
 
-                if (d->matrix_elements != 9 && d->matrix_elements != 25 && d->matrix_elements != 49 && d->matrix_elements != 81 && d->matrix_elements != 121)
-                    throw std::runtime_error("When mode starts with 's', matrix must contain exactly 9, 25, 49, 81 or 121 numbers (a 3x3, 5x5, 7x7, 9x9 or 11x11 square).");
+                // Up to 11x11 the direct kernels win, larger squares go through the FFT.
+                d->convolution_type = size > 11 ? ConvolutionFFT : ConvolutionSquare;
             } else if (mode == "h"s || mode == "v"s || mode == "hv"s || mode == "vh"s) {
                 if (mode == "h"s)
                     d->convolution_type = ConvolutionHorizontal;
@@ -974,6 +1132,7 @@ static void VS_CC genericCreate(const VSMap *in, VSMap *out, void *userData, VSC
 
             float matrix_sumf = 0;
             const double *matrix = vsapi->mapGetFloatArray(in, "matrix", nullptr);
+            std::vector<float> matrixf(d->matrix_elements);
             d->conv_int8 = true;
             d->conv_f16 = true;
             for (int i = 0; i < d->matrix_elements; i++) {
@@ -985,22 +1144,25 @@ static void VS_CC genericCreate(const VSMap *in, VSMap *out, void *userData, VSC
                     if (r < -1023.0 || r > 1023.0)
                         throw std::runtime_error("coefficients may only be between -1023 and 1023");
                     int ci = static_cast<int>(r);
-                    d->matrix[i] = ci;
-                    d->matrixf[i] = static_cast<float>(ci);
+                    if (d->convolution_type != ConvolutionFFT)
+                        d->matrix[i] = ci;
+                    matrixf[i] = static_cast<float>(ci);
                     if (ci < -128 || ci > 127)
                         d->conv_int8 = false;
                 } else {
-                    d->matrixf[i] = static_cast<float>(c);
+                    matrixf[i] = static_cast<float>(c);
                 }
+                if (d->convolution_type != ConvolutionFFT)
+                    d->matrixf[i] = matrixf[i];
 
                 // Kernels that must take their coefficients in a narrower type may
                 // only do so when the value survives the trip exactly -- same rule
                 // conv_int8 applies to the VNNI path. Rounding a coefficient to buy
                 // speed is not on the table.
-                if (halfToFloat(floatToHalf(d->matrixf[i])) != d->matrixf[i])
+                if (halfToFloat(floatToHalf(matrixf[i])) != matrixf[i])
                     d->conv_f16 = false;
 
-                matrix_sumf += d->matrixf[i];
+                matrix_sumf += matrixf[i];
             }
 
             if (std::abs(matrix_sumf) < std::numeric_limits<float>::epsilon())
@@ -1013,6 +1175,12 @@ static void VS_CC genericCreate(const VSMap *in, VSMap *out, void *userData, VSC
                 d->rdiv = static_cast<float>(matrix_sumf);
 
             d->rdiv = 1.0f / d->rdiv;
+
+            if (d->convolution_type == ConvolutionFFT) {
+                d->fft.reset(vs_generic_fft_plan_create(matrixf.data(), static_cast<unsigned>(std::lround(std::sqrt(d->matrix_elements))), d->rdiv));
+                if (!d->fft)
+                    throw std::runtime_error("out of memory.");
+            }
         }
 
         if (d->vi->width && d->vi->height) {
@@ -1498,7 +1666,8 @@ void genericInitialize(VSPlugin *plugin, const VSPLUGINAPI *vspapi) {
             "clip:vnode;"
             "planes:int[]:opt;"
             "threshold:float:opt;"
-            "coordinates:int[]:opt;",
+            "coordinates:int[]:opt;"
+            "radius:int[]:opt;",
             "clip:vnode;",
             genericCreate<GenericMinimum>, const_cast<char *>("Minimum"), plugin);
 
@@ -1506,13 +1675,15 @@ void genericInitialize(VSPlugin *plugin, const VSPLUGINAPI *vspapi) {
             "clip:vnode;"
             "planes:int[]:opt;"
             "threshold:float:opt;"
-            "coordinates:int[]:opt;",
+            "coordinates:int[]:opt;"
+            "radius:int[]:opt;",
             "clip:vnode;",
             genericCreate<GenericMaximum>, const_cast<char *>("Maximum"), plugin);
 
     vspapi->registerFunction("Median",
             "clip:vnode;"
-            "planes:int[]:opt;",
+            "planes:int[]:opt;"
+            "radius:int:opt;",
             "clip:vnode;",
             genericCreate<GenericMedian>, const_cast<char *>("Median"), plugin);
 
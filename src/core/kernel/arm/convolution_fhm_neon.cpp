@@ -440,7 +440,7 @@ void fhm_plane_x_impl(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_
     float32x4_t sc = vdupq_n_f32(p.div), bi = vdupq_n_f32(p.bias);
     uint32x4_t sm = nc_satmask(p.saturate);
 
-    uint16_t *tmp = static_cast<uint16_t *>(vsh::vsh_aligned_malloc(width * sizeof(uint16_t), 64));
+    uint16_t *tmp = static_cast<uint16_t *>(p.scratch);
     if (!tmp) {
         // Deterministic zeros rather than whatever the frame allocator handed
         // out; see conv_plane_x_impl.
@@ -456,8 +456,6 @@ void fhm_plane_x_impl(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_
         fhm_v_scanline<FW>(srcp, tmp, width, p, sc, bi, sm);
         fhm_h_scanline<FW>(tmp, dstp, width, p, sc, bi, sm);
     }
-
-    vsh::vsh_aligned_free(tmp);
 }
 
 // Same tap-count switch as convolution_neon.cpp's VS_CONV_PLANE_SELECT: runs
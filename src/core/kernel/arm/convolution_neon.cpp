@@ -685,7 +685,7 @@ void conv_plane_x_impl(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff
     uint16x8_t mv = vdupq_n_u16(p.maxval);
     int32_t wb = word_bias_sum<TY>(cv_coeffs<TY>(p), p.matrixsize);
 
-    T *tmp = static_cast<T *>(vsh::vsh_aligned_malloc(width * sizeof(T), 64));
+    T *tmp = static_cast<T *>(p.scratch);
     if (!tmp) {
         // Returning quietly would leave the destination plane as whatever the
         // frame allocator handed out (possibly other frames' data). Zero is
@@ -710,8 +710,6 @@ void conv_plane_x_impl(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff
 #endif
         conv_h_scanline<TY, FW>(tmp, dstp, width, p, sc, bi, sm, mv, wb);
     }
-
-    vsh::vsh_aligned_free(tmp);
 }
 
 // Compile-time tap counts for the fwidths the filter actually accepts (odd,
@@ -0,0 +1,255 @@
+/*
+* Copyright (c) 2016 Fredrik Mellbin & other contributors
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <algorithm>
+#include <cmath>
+#include "average.h"
+#include "../float16_helper.h"
+
+// Pure scalar C, written to auto-vectorise: the source count is a compile-time
+// template parameter (AverageFrames caps it at 31) so the reduction unrolls, and
+// __restrict on the row pointers lets the store be proven not to alias the
+// sources. Build this file with -fno-math-errno so lrintf lowers to a vector
+// convert instead of a libcall.
+
+namespace {
+
+// Round to nearest, ties to even (matches SSE cvtps_epi32).
+static inline int32_t round_nearest_i32(float x)
+{
+#if defined(__aarch64__)
+    // lrintf returns long, so the vectorizer widens through f64 (frintx + fcvtl +
+    // fcvtzs.2d + repack per half). roundevenf keeps 32-bit lanes (frintn + fcvtzs)
+    // and gives the same ties-to-even result independent of the rounding mode.
+    return static_cast<int32_t>(__builtin_roundevenf(x));
+#else
+    return static_cast<int32_t>(std::lrintf(x));
+#endif
+}
+
+template <class T, unsigned N>
+static void average_int_n(const int *weights, const void * const *srcs, void *dst_, float rscale, int32_t maxval, int32_t bias, unsigned w, unsigned h, ptrdiff_t stride)
+{
+    for (unsigned i = 0; i < h; ++i) {
+        T *__restrict dst = reinterpret_cast<T *>(static_cast<uint8_t *>(dst_) + static_cast<ptrdiff_t>(i) * stride);
+        const T * __restrict rows[N];
+        for (unsigned k = 0; k < N; ++k)
+            rows[k] = reinterpret_cast<const T *>(static_cast<const uint8_t *>(srcs[k]) + static_cast<ptrdiff_t>(i) * stride);
+
+        for (unsigned j = 0; j < w; ++j) {
+            int32_t accum = 0;
+            for (unsigned k = 0; k < N; ++k)
+                accum += (static_cast<int32_t>(rows[k][j]) - bias) * weights[k];
+
+            int32_t r = round_nearest_i32(static_cast<float>(accum) * rscale) + bias;
+            dst[j] = static_cast<T>(std::min(std::max(r, 0), maxval));
+        }
+    }
+}
+
+template <class T>
+static void average_int_runtime(const int *weights, const void * const *srcs, unsigned num_srcs, void *dst_, float rscale, int32_t maxval, int32_t bias, unsigned w, unsigned h, ptrdiff_t stride)
+{
+    for (unsigned i = 0; i < h; ++i) {
+        T *__restrict dst = reinterpret_cast<T *>(static_cast<uint8_t *>(dst_) + static_cast<ptrdiff_t>(i) * stride);
+
+        for (unsigned j = 0; j < w; ++j) {
+            int32_t accum = 0;
+            for (unsigned k = 0; k < num_srcs; ++k) {
+                const T *src = reinterpret_cast<const T *>(static_cast<const uint8_t *>(srcs[k]) + static_cast<ptrdiff_t>(i) * stride);
+                accum += (static_cast<int32_t>(src[j]) - bias) * weights[k];
+            }
+
+            int32_t r = round_nearest_i32(static_cast<float>(accum) * rscale) + bias;
+            dst[j] = static_cast<T>(std::min(std::max(r, 0), maxval));
+        }
+    }
+}
+
+template <unsigned N>
+static void average_float_n(const float *weights, const void * const *srcs, void *dst_, float rscale, unsigned w, unsigned h, ptrdiff_t stride)
+{
+    for (unsigned i = 0; i < h; ++i) {
+        float *__restrict dst = reinterpret_cast<float *>(static_cast<uint8_t *>(dst_) + static_cast<ptrdiff_t>(i) * stride);
+        const float * __restrict rows[N];
+        for (unsigned k = 0; k < N; ++k)
+            rows[k] = reinterpret_cast<const float *>(static_cast<const uint8_t *>(srcs[k]) + static_cast<ptrdiff_t>(i) * stride);
+
+        for (unsigned j = 0; j < w; ++j) {
+            float accum = 0.0f;
+            for (unsigned k = 0; k < N; ++k)
+                accum += rows[k][j] * weights[k];
+            dst[j] = accum * rscale;
+        }
+    }
+}
+
+static void average_float_runtime(const float *weights, const void * const *srcs, unsigned num_srcs, void *dst_, float rscale, unsigned w, unsigned h, ptrdiff_t stride)
+{
+    for (unsigned i = 0; i < h; ++i) {
+        float *__restrict dst = reinterpret_cast<float *>(static_cast<uint8_t *>(dst_) + static_cast<ptrdiff_t>(i) * stride);
+
+        for (unsigned j = 0; j < w; ++j) {
+            float accum = 0.0f;
+            for (unsigned k = 0; k < num_srcs; ++k) {
+                const float *src = reinterpret_cast<const float *>(static_cast<const uint8_t *>(srcs[k]) + static_cast<ptrdiff_t>(i) * stride);
+                accum += src[j] * weights[k];
+            }
+            dst[j] = accum * rscale;
+        }
+    }
+}
+
+template <unsigned N>
+static void average_half_n(const float *weights, const void * const *srcs, void *dst_, float rscale, unsigned w, unsigned h, ptrdiff_t stride)
+{
+    for (unsigned i = 0; i < h; ++i) {
+        uint16_t *__restrict dst = reinterpret_cast<uint16_t *>(static_cast<uint8_t *>(dst_) + static_cast<ptrdiff_t>(i) * stride);
+        const uint16_t * __restrict rows[N];
+        for (unsigned k = 0; k < N; ++k)
+            rows[k] = reinterpret_cast<const uint16_t *>(static_cast<const uint8_t *>(srcs[k]) + static_cast<ptrdiff_t>(i) * stride);
+
+        for (unsigned j = 0; j < w; ++j) {
+            float accum = 0.0f;
+            for (unsigned k = 0; k < N; ++k)
+                accum += halfToFloat(rows[k][j]) * weights[k];
+            dst[j] = floatToHalf(accum * rscale);
+        }
+    }
+}
+
+static void average_half_runtime(const float *weights, const void * const *srcs, unsigned num_srcs, void *dst_, float rscale, unsigned w, unsigned h, ptrdiff_t stride)
+{
+    for (unsigned i = 0; i < h; ++i) {
+        uint16_t *__restrict dst = reinterpret_cast<uint16_t *>(static_cast<uint8_t *>(dst_) + static_cast<ptrdiff_t>(i) * stride);
+
+        for (unsigned j = 0; j < w; ++j) {
+            float accum = 0.0f;
+            for (unsigned k = 0; k < num_srcs; ++k) {
+                const uint16_t *src = reinterpret_cast<const uint16_t *>(static_cast<const uint8_t *>(srcs[k]) + static_cast<ptrdiff_t>(i) * stride);
+                accum += halfToFloat(src[j]) * weights[k];
+            }
+            dst[j] = floatToHalf(accum * rscale);
+        }
+    }
+}
+
+template <class T>
+static void average_int(const void * const *srcs, void *dst, ptrdiff_t stride, const struct vs_average_params *params, unsigned w, unsigned h)
+{
+    const int *weights = params->weights;
+    float rscale = params->rscale;
+    int32_t maxval = params->maxval;
+    int32_t bias = params->bias;
+
+#define AVG_CASE(k) case k: average_int_n<T, k>(weights, srcs, dst, rscale, maxval, bias, w, h, stride); return;
+    switch (params->num_srcs) {
+    AVG_CASE(1)  AVG_CASE(2)  AVG_CASE(3)  AVG_CASE(4)  AVG_CASE(5)  AVG_CASE(6)  AVG_CASE(7)  AVG_CASE(8)
+    AVG_CASE(9)  AVG_CASE(10) AVG_CASE(11) AVG_CASE(12) AVG_CASE(13) AVG_CASE(14) AVG_CASE(15) AVG_CASE(16)
+    AVG_CASE(17) AVG_CASE(18) AVG_CASE(19) AVG_CASE(20) AVG_CASE(21) AVG_CASE(22) AVG_CASE(23) AVG_CASE(24)
+    AVG_CASE(25) AVG_CASE(26) AVG_CASE(27) AVG_CASE(28) AVG_CASE(29) AVG_CASE(30) AVG_CASE(31)
+    default: average_int_runtime<T>(weights, srcs, params->num_srcs, dst, rscale, maxval, bias, w, h, stride); return;
+    }
+#undef AVG_CASE
+}
+
+template <class T>
+static void average_running(const void * const *add, unsigned num_add, const void * const *sub, unsigned num_sub, void *acc_, ptrdiff_t acc_stride, void *dst_, ptrdiff_t stride, const struct vs_average_params *params, unsigned w, unsigned h)
+{
+    int32_t weight = params->weights[0];
+    int32_t offset = static_cast<int32_t>(params->num_srcs) * params->bias;
+    float rscale = params->rscale;
+    int32_t maxval = params->maxval;
+    int32_t bias = params->bias;
+
+    for (unsigned i = 0; i < h; ++i) {
+        int32_t *acc = reinterpret_cast<int32_t *>(static_cast<uint8_t *>(acc_) + static_cast<ptrdiff_t>(i) * acc_stride);
+        T *dst = reinterpret_cast<T *>(static_cast<uint8_t *>(dst_) + static_cast<ptrdiff_t>(i) * stride);
+
+        for (unsigned j = 0; j < w; ++j) {
+            int32_t sum = 0;
+            if (sub) {
+                sum = acc[j];
+                for (unsigned k = 0; k < num_sub; ++k)
+                    sum -= reinterpret_cast<const T *>(static_cast<const uint8_t *>(sub[k]) + static_cast<ptrdiff_t>(i) * stride)[j];
+            }
+            for (unsigned k = 0; k < num_add; ++k)
+                sum += reinterpret_cast<const T *>(static_cast<const uint8_t *>(add[k]) + static_cast<ptrdiff_t>(i) * stride)[j];
+            acc[j] = sum;
+
+            int32_t r = round_nearest_i32(static_cast<float>((sum - offset) * weight) * rscale) + bias;
+            dst[j] = static_cast<T>(std::min(std::max(r, 0), maxval));
+        }
+    }
+}
+
+} // namespace
+
+void vs_average_byte_c(const void * const *srcs, void *dst, ptrdiff_t stride, const struct vs_average_params *params, unsigned width, unsigned height)
+{
+    average_int<uint8_t>(srcs, dst, stride, params, width, height);
+}
+
+void vs_average_word_c(const void * const *srcs, void *dst, ptrdiff_t stride, const struct vs_average_params *params, unsigned width, unsigned height)
+{
+    average_int<uint16_t>(srcs, dst, stride, params, width, height);
+}
+
+void vs_average_float_c(const void * const *srcs, void *dst, ptrdiff_t stride, const struct vs_average_params *params, unsigned width, unsigned height)
+{
+    const float *weights = params->fweights;
+    float rscale = params->rscale;
+
+#define AVG_CASE(k) case k: average_float_n<k>(weights, srcs, dst, rscale, width, height, stride); return;
+    switch (params->num_srcs) {
+    AVG_CASE(1)  AVG_CASE(2)  AVG_CASE(3)  AVG_CASE(4)  AVG_CASE(5)  AVG_CASE(6)  AVG_CASE(7)  AVG_CASE(8)
+    AVG_CASE(9)  AVG_CASE(10) AVG_CASE(11) AVG_CASE(12) AVG_CASE(13) AVG_CASE(14) AVG_CASE(15) AVG_CASE(16)
+    AVG_CASE(17) AVG_CASE(18) AVG_CASE(19) AVG_CASE(20) AVG_CASE(21) AVG_CASE(22) AVG_CASE(23) AVG_CASE(24)
+    AVG_CASE(25) AVG_CASE(26) AVG_CASE(27) AVG_CASE(28) AVG_CASE(29) AVG_CASE(30) AVG_CASE(31)
+    default: average_float_runtime(weights, srcs, params->num_srcs, dst, rscale, width, height, stride); return;
+    }
+#undef AVG_CASE
+}
+
+void vs_average_half_c(const void * const *srcs, void *dst, ptrdiff_t stride, const struct vs_average_params *params, unsigned width, unsigned height)
+{
+    const float *weights = params->fweights;
+    float rscale = params->rscale;
+
+#define AVG_CASE(k) case k: average_half_n<k>(weights, srcs, dst, rscale, width, height, stride); return;
+    switch (params->num_srcs) {
+    AVG_CASE(1)  AVG_CASE(2)  AVG_CASE(3)  AVG_CASE(4)  AVG_CASE(5)  AVG_CASE(6)  AVG_CASE(7)  AVG_CASE(8)
+    AVG_CASE(9)  AVG_CASE(10) AVG_CASE(11) AVG_CASE(12) AVG_CASE(13) AVG_CASE(14) AVG_CASE(15) AVG_CASE(16)
+    AVG_CASE(17) AVG_CASE(18) AVG_CASE(19) AVG_CASE(20) AVG_CASE(21) AVG_CASE(22) AVG_CASE(23) AVG_CASE(24)
+    AVG_CASE(25) AVG_CASE(26) AVG_CASE(27) AVG_CASE(28) AVG_CASE(29) AVG_CASE(30) AVG_CASE(31)
+    default: average_half_runtime(weights, srcs, params->num_srcs, dst, rscale, width, height, stride); return;
+    }
+#undef AVG_CASE
+}
+
+void vs_average_running_byte_c(const void * const *add, unsigned num_add, const void * const *sub, unsigned num_sub, void *acc, ptrdiff_t acc_stride, void *dst, ptrdiff_t stride, const struct vs_average_params *params, unsigned width, unsigned height)
+{
+    average_running<uint8_t>(add, num_add, sub, num_sub, acc, acc_stride, dst, stride, params, width, height);
+}
+
+void vs_average_running_word_c(const void * const *add, unsigned num_add, const void * const *sub, unsigned num_sub, void *acc, ptrdiff_t acc_stride, void *dst, ptrdiff_t stride, const struct vs_average_params *params, unsigned width, unsigned height)
+{
+    average_running<uint16_t>(add, num_add, sub, num_sub, acc, acc_stride, dst, stride, params, width, height);
+}
@@ -0,0 +1,89 @@
+/*
+* Copyright (c) 2016 Fredrik Mellbin & other contributors
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef AVERAGE_H
+#define AVERAGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define VS_AVERAGE_MAX_SRCS 31
+
+struct vs_average_params {
+    unsigned num_srcs;
+
+    /* Integer formats. Weights are in [-1023, 1023]. */
+    int weights[VS_AVERAGE_MAX_SRCS];
+    int32_t maxval;
+    int32_t bias;
+
+    /* Float formats. */
+    float fweights[VS_AVERAGE_MAX_SRCS];
+
+    /* 1 / scale. */
+    float rscale;
+};
+
+/* All sources and dst share the same stride. The SIMD kernels process whole vectors and rely on the stride padding. */
+#define DECL(pixel, isa) void vs_average_##pixel##_##isa(const void * const *srcs, void *dst, ptrdiff_t stride, const struct vs_average_params *params, unsigned width, unsigned height);
+
+/*
+ * Running sum for uniform weights. acc holds the plain int32 sum of the window. Without sub it's reset to the
+ * sum of the num_add sources, otherwise the num_add sources are added and the num_sub frames in sub are
+ * subtracted. At most VS_AVERAGE_MAX_SRCS / 2 frames can be subtracted at once. dst is then computed from
+ * acc with params->weights[0] as the weight of every one of the params->num_srcs sources, bit-exact with the
+ * full weighted sum. acc rows have to be padded to a multiple of 32 samples.
+ */
+#define DECL_RUNNING(pixel, isa) void vs_average_running_##pixel##_##isa(const void * const *add, unsigned num_add, const void * const *sub, unsigned num_sub, void *acc, ptrdiff_t acc_stride, void *dst, ptrdiff_t stride, const struct vs_average_params *params, unsigned width, unsigned height);
+
+DECL(byte, c)
+DECL(word, c)
+DECL(float, c)
+DECL(half, c)
+
+DECL_RUNNING(byte, c)
+DECL_RUNNING(word, c)
+
+#ifdef VS_TARGET_CPU_X86
+DECL(byte, sse2)
+DECL(word, sse2)
+DECL(float, sse2)
+
+DECL_RUNNING(byte, sse2)
+DECL_RUNNING(word, sse2)
+
+DECL(byte, avx2)
+DECL(word, avx2)
+DECL(float, avx2)
+DECL(half, avx2)
+
+DECL_RUNNING(byte, avx2)
+DECL_RUNNING(word, avx2)
+
+DECL(byte, avx512)
+DECL(word, avx512)
+DECL(float, avx512)
+DECL(half, avx512)
+#endif /* VS_TARGET_CPU_X86 */
+
+#undef DECL_RUNNING
+#undef DECL
+
+#endif // AVERAGE_H
@@ -0,0 +1,135 @@
+/*
+* Copyright (c) 2017-2020 Fredrik Mellbin & other contributors
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <algorithm>
+#include "boxblur.h"
+#include "../float16_helper.h"
+
+// The running sum walks down the plane row by row and keeps one accumulator per
+// column, so every inner loop is a plain contiguous loop over a row that the
+// compiler can vectorise. The order of the float operations is the same as in the
+// horizontal pass, the results are identical to a transposed horizontal blur.
+
+namespace {
+
+template <bool Add>
+static inline uint32_t divide(uint32_t n, uint32_t magic, uint32_t shift)
+{
+    uint32_t q = static_cast<uint32_t>((static_cast<uint64_t>(magic) * n) >> 32);
+    if (Add)
+        q = ((n - q) >> 1) + q;
+    return q >> shift;
+}
+
+template <class T>
+static inline const T *row(const void *src, ptrdiff_t stride, int y)
+{
+    return reinterpret_cast<const T *>(static_cast<const uint8_t *>(src) + y * stride);
+}
+
+template <class T, bool Add>
+static void boxblur_v_int(const void *src, ptrdiff_t src_stride, void *dst_, ptrdiff_t dst_stride, void *acc_, const vs_boxblur_params *params, unsigned width, unsigned height)
+{
+    uint32_t * __restrict acc = static_cast<uint32_t *>(acc_);
+    int radius = static_cast<int>(params->radius);
+    int h = static_cast<int>(height);
+    uint32_t round = params->round;
+    uint32_t magic = params->div_magic;
+    uint32_t shift = params->div_shift;
+
+    const T *first = row<T>(src, src_stride, 0);
+    for (unsigned x = 0; x < width; ++x)
+        acc[x] = radius * first[x];
+    for (int i = 0; i < radius; ++i) {
+        const T *s = row<T>(src, src_stride, std::min(i, h - 1));
+        for (unsigned x = 0; x < width; ++x)
+            acc[x] += s[x];
+    }
+
+    for (int y = 0; y < h; ++y) {
+        const T * __restrict add = row<T>(src, src_stride, std::min(y + radius, h - 1));
+        const T * __restrict sub = row<T>(src, src_stride, std::max(y - radius, 0));
+        T * __restrict dst = reinterpret_cast<T *>(static_cast<uint8_t *>(dst_) + y * dst_stride);
+
+        for (unsigned x = 0; x < width; ++x) {
+            uint32_t a = acc[x] + add[x];
+            dst[x] = static_cast<T>(divide<Add>(a + round, magic, shift));
+            acc[x] = a - sub[x];
+        }
+    }
+}
+
+template <class T, class Load, class Store>
+static void boxblur_v_float(const void *src, ptrdiff_t src_stride, void *dst_, ptrdiff_t dst_stride, void *acc_, const vs_boxblur_params *params, unsigned width, unsigned height, Load load, Store store)
+{
+    float * __restrict acc = static_cast<float *>(acc_);
+    int radius = static_cast<int>(params->radius);
+    int h = static_cast<int>(height);
+    float div = params->div;
+
+    const T *first = row<T>(src, src_stride, 0);
+    for (unsigned x = 0; x < width; ++x)
+        acc[x] = radius * load(first[x]);
+    for (int i = 0; i < radius; ++i) {
+        const T *s = row<T>(src, src_stride, std::min(i, h - 1));
+        for (unsigned x = 0; x < width; ++x)
+            acc[x] += load(s[x]);
+    }
+
+    for (int y = 0; y < h; ++y) {
+        const T * __restrict add = row<T>(src, src_stride, std::min(y + radius, h - 1));
+        const T * __restrict sub = row<T>(src, src_stride, std::max(y - radius, 0));
+        T * __restrict dst = reinterpret_cast<T *>(static_cast<uint8_t *>(dst_) + y * dst_stride);
+
+        for (unsigned x = 0; x < width; ++x) {
+            float a = acc[x] + load(add[x]);
+            dst[x] = store(a * div);
+            acc[x] = a - load(sub[x]);
+        }
+    }
+}
+
+} // namespace
+
+void vs_boxblur_v_byte_c(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, void *acc, const struct vs_boxblur_params *params, unsigned width, unsigned height)
+{
+    if (params->div_add)
+        boxblur_v_int<uint8_t, true>(src, src_stride, dst, dst_stride, acc, params, width, height);
+    else
+        boxblur_v_int<uint8_t, false>(src, src_stride, dst, dst_stride, acc, params, width, height);
+}
+
+void vs_boxblur_v_word_c(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, void *acc, const struct vs_boxblur_params *params, unsigned width, unsigned height)
+{
+    if (params->div_add)
+        boxblur_v_int<uint16_t, true>(src, src_stride, dst, dst_stride, acc, params, width, height);
+    else
+        boxblur_v_int<uint16_t, false>(src, src_stride, dst, dst_stride, acc, params, width, height);
+}
+
+void vs_boxblur_v_float_c(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, void *acc, const struct vs_boxblur_params *params, unsigned width, unsigned height)
+{
+    boxblur_v_float<float>(src, src_stride, dst, dst_stride, acc, params, width, height, [](float x) { return x; }, [](float x) { return x; });
+}
+
+void vs_boxblur_v_half_c(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, void *acc, const struct vs_boxblur_params *params, unsigned width, unsigned height)
+{
+    boxblur_v_float<uint16_t>(src, src_stride, dst, dst_stride, acc, params, width, height, halfToFloat, floatToHalf);
+}
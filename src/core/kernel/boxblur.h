@@ -0,0 +1,67 @@
+/*
+* Copyright (c) 2017-2020 Fredrik Mellbin & other contributors
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef BOXBLUR_H
+#define BOXBLUR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct vs_boxblur_params {
+    unsigned radius;
+
+    /* Integer formats. (acc + round) / (2 * radius + 1) with the multiply-high divisor of
+     * makeFastDivU32, the divisor is odd so the magic is never 0. */
+    uint32_t round;
+    uint32_t div_magic;
+    uint32_t div_shift;
+    uint32_t div_add;
+
+    /* Float formats. 1 / (2 * radius + 1). */
+    float div;
+};
+
+/*
+ * One vertical box blur pass with the borders clamped, the same running sum as the horizontal
+ * pass in boxblurfilter.cpp applied to every column at once. src and dst can't overlap. acc is
+ * scratch space for width 32-bit accumulators. The SIMD kernels process whole 16 (SSE2) or
+ * 32 (AVX2) byte blocks of every row and rely on the stride padding.
+ */
+#define DECL(pixel, isa) void vs_boxblur_v_##pixel##_##isa(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, void *acc, const struct vs_boxblur_params *params, unsigned width, unsigned height);
+
+DECL(byte, c)
+DECL(word, c)
+DECL(float, c)
+DECL(half, c)
+
+#ifdef VS_TARGET_CPU_X86
+DECL(byte, sse2)
+DECL(word, sse2)
+DECL(float, sse2)
+
+DECL(byte, avx2)
+DECL(word, avx2)
+DECL(float, avx2)
+DECL(half, avx2)
+#endif /* VS_TARGET_CPU_X86 */
+
+#undef DECL
+
+#endif // BOXBLUR_H
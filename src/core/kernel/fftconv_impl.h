@@ -0,0 +1,351 @@
+/*
+* Copyright (c) 2012-2019 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+/*
+* Square convolution with an overlap-save FFT, shared by the C and x86 tiers.
+*
+* The plane is cut into blocks of n - 2 * radius pixels. Each block is read
+* with radius pixels of context on every side (mirrored at the plane edges like
+* the direct kernels) into an n x n tile, so the circular convolution of the
+* tile with the kernel is exact on the block. Two horizontally adjacent blocks
+* share one complex transform, one in the real and one in the imaginary part,
+* which works because the kernel is real.
+*
+* The 2D transform is a radix-2 transform down the columns, a transpose and the
+* same transform again. Every butterfly combines two whole rows, so all the
+* work is elementwise over rows and the ISA only has to provide the vector
+* arithmetic (the Prims template parameter). The forward transform leaves the
+* spectrum in bit reversed order and the inverse transform takes it in that
+* order, so there is no permutation: the kernel spectrum in the plan is
+* computed with the same passes and is in the same order.
+*
+* Prims provides:
+*   typedef scalar; typedef vec; static constexpr unsigned SIZE (scalars per vec);
+*   static vec load(const scalar *); static void store(scalar *, vec);
+*   static vec add(vec, vec); static vec sub(vec, vec); static vec mul(vec, vec); static vec set1(scalar);
+* Tiles are at least VS_GENERIC_FFT_MIN_SIZE wide, a multiple of every vec.
+*/
+
+#ifndef FFTCONV_IMPL_H
+#define FFTCONV_IMPL_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include "generic.h"
+#include "../float16_helper.h"
+
+namespace fftconv {
+
+typedef void (*transpose_func)(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, unsigned width, unsigned height);
+
+template <class T>
+struct ScalarPrims {
+    typedef T scalar;
+    typedef T vec;
+    static constexpr unsigned SIZE = 1;
+
+    static vec load(const scalar *p) { return *p; }
+    static void store(scalar *p, vec v) { *p = v; }
+    static vec add(vec a, vec b) { return a + b; }
+    static vec sub(vec a, vec b) { return a - b; }
+    static vec mul(vec a, vec b) { return a * b; }
+    static vec set1(scalar x) { return x; }
+};
+
+// One row of a butterfly: a, b = a + b, (a - b) * w.
+template <class P>
+struct Row {
+    typename P::vec re;
+    typename P::vec im;
+};
+
+template <class P>
+inline void dif(Row<P> &a, Row<P> &b, typename P::vec wr, typename P::vec wi)
+{
+    auto d_re = P::sub(a.re, b.re);
+    auto d_im = P::sub(a.im, b.im);
+    a.re = P::add(a.re, b.re);
+    a.im = P::add(a.im, b.im);
+    b.re = P::sub(P::mul(d_re, wr), P::mul(d_im, wi));
+    b.im = P::add(P::mul(d_re, wi), P::mul(d_im, wr));
+}
+
+// a, b = a + b * conj(w), a - b * conj(w).
+template <class P>
+inline void dit(Row<P> &a, Row<P> &b, typename P::vec wr, typename P::vec wi)
+{
+    auto t_re = P::add(P::mul(b.re, wr), P::mul(b.im, wi));
+    auto t_im = P::sub(P::mul(b.im, wr), P::mul(b.re, wi));
+    b.re = P::sub(a.re, t_re);
+    b.im = P::sub(a.im, t_im);
+    a.re = P::add(a.re, t_re);
+    a.im = P::add(a.im, t_im);
+}
+
+template <class P>
+inline Row<P> load_row(const typename P::scalar *re, const typename P::scalar *im, size_t pos)
+{
+    return { P::load(re + pos), P::load(im + pos) };
+}
+
+template <class P>
+inline void store_row(typename P::scalar *re, typename P::scalar *im, size_t pos, const Row<P> &r)
+{
+    P::store(re + pos, r.re);
+    P::store(im + pos, r.im);
+}
+
+// Radix-2 transforms down the columns of an n x n tile, two stages per sweep over the tile. Forward
+// is decimation in frequency, natural order in and bit reversed order out. Inverse is decimation
+// in time with the conjugate twiddles, the unscaled inverse of forward. The twiddles are
+// exp(-2 pi i k / n) for k < n / 2.
+template <class P, bool Inverse>
+void column_pass(typename P::scalar *re, typename P::scalar *im, const typename P::scalar *tw_re, const typename P::scalar *tw_im, unsigned n)
+{
+    unsigned log2n = 0;
+    while ((1U << log2n) < n)
+        ++log2n;
+
+    // Spans of the stages, largest first going forward and smallest first going back.
+    // With an odd number of stages the one with span n / 2 runs by itself.
+    auto single = [&](unsigned half) {
+        unsigned step = n / (2 * half);
+        for (unsigned base = 0; base < n; base += 2 * half) {
+            for (unsigned j = 0; j < half; ++j) {
+                auto wr = P::set1(tw_re[j * step]);
+                auto wi = P::set1(tw_im[j * step]);
+                size_t a = static_cast<size_t>(base + j) * n;
+                size_t b = a + static_cast<size_t>(half) * n;
+
+                for (unsigned x = 0; x < n; x += P::SIZE) {
+                    Row<P> ra = load_row<P>(re, im, a + x);
+                    Row<P> rb = load_row<P>(re, im, b + x);
+                    if (Inverse)
+                        dit<P>(ra, rb, wr, wi);
+                    else
+                        dif<P>(ra, rb, wr, wi);
+                    store_row<P>(re, im, a + x, ra);
+                    store_row<P>(re, im, b + x, rb);
+                }
+            }
+        }
+    };
+
+    // The stages with spans half and half / 2.
+    auto fused = [&](unsigned half) {
+        unsigned quarter = half / 2;
+        unsigned step = n / (2 * half);
+        for (unsigned base = 0; base < n; base += 2 * half) {
+            for (unsigned j = 0; j < quarter; ++j) {
+                auto w0r = P::set1(tw_re[j * step]);
+                auto w0i = P::set1(tw_im[j * step]);
+                auto w1r = P::set1(tw_re[(j + quarter) * step]);
+                auto w1i = P::set1(tw_im[(j + quarter) * step]);
+                auto w2r = P::set1(tw_re[2 * j * step]);
+                auto w2i = P::set1(tw_im[2 * j * step]);
+                size_t p0 = static_cast<size_t>(base + j) * n;
+                size_t p1 = p0 + static_cast<size_t>(quarter) * n;
+                size_t p2 = p1 + static_cast<size_t>(quarter) * n;
+                size_t p3 = p2 + static_cast<size_t>(quarter) * n;
+
+                for (unsigned x = 0; x < n; x += P::SIZE) {
+                    Row<P> r0 = load_row<P>(re, im, p0 + x);
+                    Row<P> r1 = load_row<P>(re, im, p1 + x);
+                    Row<P> r2 = load_row<P>(re, im, p2 + x);
+                    Row<P> r3 = load_row<P>(re, im, p3 + x);
+                    if (Inverse) {
+                        dit<P>(r0, r1, w2r, w2i);
+                        dit<P>(r2, r3, w2r, w2i);
+                        dit<P>(r0, r2, w0r, w0i);
+                        dit<P>(r1, r3, w1r, w1i);
+                    } else {
+                        dif<P>(r0, r2, w0r, w0i);
+                        dif<P>(r1, r3, w1r, w1i);
+                        dif<P>(r0, r1, w2r, w2i);
+                        dif<P>(r2, r3, w2r, w2i);
+                    }
+                    store_row<P>(re, im, p0 + x, r0);
+                    store_row<P>(re, im, p1 + x, r1);
+                    store_row<P>(re, im, p2 + x, r2);
+                    store_row<P>(re, im, p3 + x, r3);
+                }
+            }
+        }
+    };
+
+    if (Inverse) {
+        unsigned half = 2;
+        for (; half < n; half *= 4)
+            fused(half);
+        if (half == n)
+            single(n / 2);
+    } else {
+        if (log2n % 2)
+            single(n / 2);
+        for (unsigned half = log2n % 2 ? n / 4 : n / 2; half >= 2; half /= 4)
+            fused(half);
+    }
+}
+
+template <class P>
+void multiply(typename P::scalar *re, typename P::scalar *im, const typename P::scalar *s_re, const typename P::scalar *s_im, size_t count)
+{
+    for (size_t i = 0; i < count; i += P::SIZE) {
+        auto a_re = P::load(re + i), a_im = P::load(im + i);
+        auto b_re = P::load(s_re + i), b_im = P::load(s_im + i);
+        P::store(re + i, P::sub(P::mul(a_re, b_re), P::mul(a_im, b_im)));
+        P::store(im + i, P::add(P::mul(a_re, b_im), P::mul(a_im, b_re)));
+    }
+}
+
+// Same border handling as the direct convolution kernels.
+inline unsigned mirror(int pos, int len)
+{
+    if (pos < 0)
+        pos = -pos - 1;
+    else if (pos >= len)
+        pos = 2 * len - 1 - pos;
+    return static_cast<unsigned>(std::min(std::max(pos, 0), len - 1));
+}
+
+// The output follows the direct kernels: value * div + bias (div is folded into the kernel
+// spectrum), the absolute value unless saturate is set, rounded and limited to maxval.
+template <class T>
+struct IntPixel {
+    static float load(const void *p, unsigned x) { return static_cast<const T *>(p)[x]; }
+
+    static void store(void *p, unsigned x, float v, const vs_generic_params &params)
+    {
+        float tmp = v + params.bias;
+        tmp = params.saturate ? tmp : std::fabs(tmp);
+        tmp = std::min(std::max(tmp, static_cast<float>(std::numeric_limits<T>::min())), static_cast<float>(std::numeric_limits<T>::max()));
+        static_cast<T *>(p)[x] = static_cast<T>(std::min(static_cast<uint16_t>(std::lrint(tmp)), params.maxval));
+    }
+};
+
+struct FloatPixel {
+    static float load(const void *p, unsigned x) { return static_cast<const float *>(p)[x]; }
+
+    static void store(void *p, unsigned x, float v, const vs_generic_params &params)
+    {
+        float tmp = v + params.bias;
+        static_cast<float *>(p)[x] = params.saturate ? tmp : std::fabs(tmp);
+    }
+};
+
+struct HalfPixel {
+    static float load(const void *p, unsigned x) { return halfToFloat(static_cast<const uint16_t *>(p)[x]); }
+
+    static void store(void *p, unsigned x, float v, const vs_generic_params &params)
+    {
+        float tmp = v + params.bias;
+        static_cast<uint16_t *>(p)[x] = floatToHalf(params.saturate ? tmp : std::fabs(tmp));
+    }
+};
+
+template <class Pixel>
+void load_tile(float *tile, unsigned n, const void *src, ptrdiff_t src_stride, unsigned width, unsigned height, int x0, int y0)
+{
+    bool inside = x0 >= 0 && x0 + static_cast<int>(n) <= static_cast<int>(width);
+
+    for (unsigned y = 0; y < n; ++y) {
+        const uint8_t *srcp = static_cast<const uint8_t *>(src) + mirror(y0 + static_cast<int>(y), static_cast<int>(height)) * src_stride;
+        float *row = tile + static_cast<size_t>(y) * n;
+
+        if (inside) {
+            for (unsigned x = 0; x < n; ++x)
+                row[x] = Pixel::load(srcp, x0 + x);
+        } else {
+            for (unsigned x = 0; x < n; ++x)
+                row[x] = Pixel::load(srcp, mirror(x0 + static_cast<int>(x), static_cast<int>(width)));
+        }
+    }
+}
+
+template <class Pixel>
+void store_tile(const float *tile, unsigned n, unsigned radius, void *dst, ptrdiff_t dst_stride, unsigned x0, unsigned y0, unsigned width, unsigned height, const vs_generic_params &params)
+{
+    for (unsigned y = 0; y < height; ++y) {
+        uint8_t *dstp = static_cast<uint8_t *>(dst) + (y0 + y) * dst_stride;
+        const float *row = tile + static_cast<size_t>(y + radius) * n + radius;
+
+        for (unsigned x = 0; x < width; ++x)
+            Pixel::store(dstp, x0 + x, row[x], params);
+    }
+}
+
+template <class P, class Pixel>
+void filter_plane(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const vs_generic_params *params, unsigned width, unsigned height, transpose_func transpose)
+{
+    const vs_generic_fft_plan *plan = params->fft;
+    unsigned n = plan->n;
+    unsigned radius = plan->radius;
+    unsigned block = n - 2 * radius;
+    size_t count = static_cast<size_t>(n) * n;
+    ptrdiff_t tile_stride = n * sizeof(float);
+
+    const float *tw_re = plan->twiddle;
+    const float *tw_im = tw_re + n / 2;
+    const float *s_re = plan->spectrum;
+    const float *s_im = s_re + count;
+
+    float *re = static_cast<float *>(params->scratch);
+    float *im = re + count;
+    float *t_re = im + count;
+    float *t_im = t_re + count;
+
+    for (unsigned y = 0; y < height; y += block) {
+        unsigned h = std::min(block, height - y);
+
+        for (unsigned x = 0; x < width; x += 2 * block) {
+            unsigned w0 = std::min(block, width - x);
+            unsigned w1 = x + block < width ? std::min(block, width - x - block) : 0;
+
+            load_tile<Pixel>(re, n, src, src_stride, width, height, static_cast<int>(x - radius), static_cast<int>(y - radius));
+            if (w1)
+                load_tile<Pixel>(im, n, src, src_stride, width, height, static_cast<int>(x + block - radius), static_cast<int>(y - radius));
+            else
+                std::fill_n(im, count, 0.0f);
+
+            column_pass<P, false>(re, im, tw_re, tw_im, n);
+            transpose(re, tile_stride, t_re, tile_stride, n, n);
+            transpose(im, tile_stride, t_im, tile_stride, n, n);
+            column_pass<P, false>(t_re, t_im, tw_re, tw_im, n);
+
+            multiply<P>(t_re, t_im, s_re, s_im, count);
+
+            column_pass<P, true>(t_re, t_im, tw_re, tw_im, n);
+            transpose(t_re, tile_stride, re, tile_stride, n, n);
+            transpose(t_im, tile_stride, im, tile_stride, n, n);
+            column_pass<P, true>(re, im, tw_re, tw_im, n);
+
+            store_tile<Pixel>(re, n, radius, dst, dst_stride, x, y, w0, h, *params);
+            if (w1)
+                store_tile<Pixel>(im, n, radius, dst, dst_stride, x + block, y, w1, h, *params);
+        }
+    }
+}
+
+} // namespace fftconv
+
+#endif // FFTCONV_IMPL_H
@@ -22,10 +22,17 @@
 #include <array>
 #include <cmath>
 #include <cstdint>
+#include <cstring>
+#include <functional>
 #include <limits>
 #include <type_traits>
+#include <vector>
 #include <VSHelper4.h>
+#include "fftconv_impl.h"
 #include "generic.h"
+#include "median_impl.h"
+#include "transpose.h"
+#include "vhgw_impl.h"
 #include "../float16_helper.h"
 
 namespace {
@@ -593,7 +600,7 @@ void conv_plane_v(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t ds
 template <class T>
 void conv_plane_x(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const vs_generic_params &params, unsigned width, unsigned height)
 {
-    void *tmp = vsh::vsh_aligned_malloc(width * sizeof(T), 64);
+    void *tmp = params.scratch;
     unsigned fwidth = params.matrixsize;
     unsigned support = fwidth / 2;
 
@@ -615,8 +622,6 @@ void conv_plane_x(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t ds
         conv_scanline_v<T>(srcp, tmp, params, width);
         conv_scanline_h<T>(tmp, dstp, params, width);
     }
-
-    vsh::vsh_aligned_free(tmp);
 }
 
 } // namespace
@@ -861,3 +866,297 @@ void vs_generic_2d_conv_sep_half_c(const void *src, ptrdiff_t src_stride, void *
     conv_plane_x<half_t>(src, src_stride, dst, dst_stride, *params, width, height);
 }
 
+
+namespace {
+
+template <class T, bool Max>
+struct VHGWPrims {
+    typedef T vec;
+    typedef typename std::conditional<std::is_integral<T>::value, int32_t, float>::type Signed;
+    static constexpr unsigned SIZE = sizeof(T);
+
+    Signed threshold;
+    bool limited;
+
+    explicit VHGWPrims(const vs_generic_params &params) :
+        threshold{ std::is_integral<T>::value ? static_cast<Signed>(params.threshold) : static_cast<Signed>(params.thresholdf) },
+        limited{ std::is_integral<T>::value ? params.threshold < params.maxval : params.thresholdf < std::numeric_limits<float>::max() }
+    {}
+
+    static vec load(const uint8_t *p) { return *reinterpret_cast<const T *>(p); }
+    static void store(uint8_t *p, vec v) { *reinterpret_cast<T *>(p) = v; }
+
+    vec reduce(vec a, vec b) const { return Max ? std::max(a, b) : std::min(a, b); }
+
+    bool thresholded() const { return limited; }
+
+    vec limit(vec val, vec src) const
+    {
+        Signed minval = std::is_integral<T>::value ? Signed{} : static_cast<Signed>(-INFINITY);
+        Signed lim = Max ? static_cast<Signed>(src) + threshold : std::max(static_cast<Signed>(src) - threshold, minval);
+        return static_cast<T>(Max ? std::min(static_cast<Signed>(val), lim) : std::max(static_cast<Signed>(val), lim));
+    }
+};
+
+// Half samples are compared as sign-magnitude integers, flipping the magnitude of
+// negative values makes the order of the bits match the order of the values.
+template <bool Max>
+struct VHGWHalfPrims {
+    typedef uint16_t vec;
+    static constexpr unsigned SIZE = sizeof(uint16_t);
+
+    float threshold;
+    bool limited;
+
+    explicit VHGWHalfPrims(const vs_generic_params &params) :
+        threshold{ params.thresholdf },
+        limited{ params.thresholdf < std::numeric_limits<float>::max() }
+    {}
+
+    static int16_t key(uint16_t x) { return static_cast<int16_t>((x & 0x8000) ? x ^ 0x7FFF : x); }
+
+    static vec load(const uint8_t *p) { return *reinterpret_cast<const uint16_t *>(p); }
+    static void store(uint8_t *p, vec v) { *reinterpret_cast<uint16_t *>(p) = v; }
+
+    vec reduce(vec a, vec b) const { return (Max ? key(a) < key(b) : key(b) < key(a)) ? b : a; }
+
+    bool thresholded() const { return limited; }
+
+    vec limit(vec val, vec src) const
+    {
+        float v = halfToFloat(val);
+        float lim = Max ? halfToFloat(src) + threshold : halfToFloat(src) - threshold;
+        return (Max ? v > lim : v < lim) ? floatToHalf(lim) : val;
+    }
+};
+
+} // namespace
+
+void vs_generic_vhgw_min_byte_c(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height)
+{
+    vhgw::filter_plane<VHGWPrims<uint8_t, false>>(src, src_stride, dst, dst_stride, params, width, height, 1, vs_transpose_plane_byte_c);
+}
+
+void vs_generic_vhgw_min_word_c(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height)
+{
+    vhgw::filter_plane<VHGWPrims<uint16_t, false>>(src, src_stride, dst, dst_stride, params, width, height, 2, vs_transpose_plane_word_c);
+}
+
+void vs_generic_vhgw_min_float_c(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height)
+{
+    vhgw::filter_plane<VHGWPrims<float, false>>(src, src_stride, dst, dst_stride, params, width, height, 4, vs_transpose_plane_dword_c);
+}
+
+void vs_generic_vhgw_min_half_c(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height)
+{
+    vhgw::filter_plane<VHGWHalfPrims<false>>(src, src_stride, dst, dst_stride, params, width, height, 2, vs_transpose_plane_word_c);
+}
+
+void vs_generic_vhgw_max_byte_c(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height)
+{
+    vhgw::filter_plane<VHGWPrims<uint8_t, true>>(src, src_stride, dst, dst_stride, params, width, height, 1, vs_transpose_plane_byte_c);
+}
+
+void vs_generic_vhgw_max_word_c(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height)
+{
+    vhgw::filter_plane<VHGWPrims<uint16_t, true>>(src, src_stride, dst, dst_stride, params, width, height, 2, vs_transpose_plane_word_c);
+}
+
+void vs_generic_vhgw_max_float_c(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height)
+{
+    vhgw::filter_plane<VHGWPrims<float, true>>(src, src_stride, dst, dst_stride, params, width, height, 4, vs_transpose_plane_dword_c);
+}
+
+void vs_generic_vhgw_max_half_c(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height)
+{
+    vhgw::filter_plane<VHGWHalfPrims<true>>(src, src_stride, dst, dst_stride, params, width, height, 2, vs_transpose_plane_word_c);
+}
+
+namespace {
+
+template <class T>
+struct MedianNetPrims {
+    typedef T vec;
+    static constexpr unsigned SIZE = sizeof(T);
+
+    static vec loadu(const uint8_t *p) { return *reinterpret_cast<const T *>(p); }
+    static void store(uint8_t *p, vec v) { *reinterpret_cast<T *>(p) = v; }
+    static vec min(vec a, vec b) { return std::min(a, b); }
+    static vec max(vec a, vec b) { return std::max(a, b); }
+    static void to_key(uint8_t *, unsigned) {}
+    static vec from_key(vec v) { return v; }
+};
+
+struct MedianNetHalfPrims : MedianNetPrims<uint16_t> {
+    static void to_key(uint8_t *p, unsigned n)
+    {
+        uint16_t *line = reinterpret_cast<uint16_t *>(p);
+        for (unsigned i = 0; i < n / 2; ++i)
+            line[i] = median::half_key(line[i]);
+    }
+
+    static vec from_key(vec v) { return median::half_unkey(v); }
+};
+
+struct MedianHistPrims {
+    typedef std::array<uint16_t, 16> hist;
+
+    static hist zero() { return {}; }
+    static hist load(const uint16_t *p) { hist h; std::copy_n(p, 16, h.begin()); return h; }
+    static void store(uint16_t *p, const hist &h) { std::copy_n(h.begin(), 16, p); }
+
+    static hist add(hist h, const uint16_t *a)
+    {
+        for (unsigned i = 0; i < 16; ++i)
+            h[i] += a[i];
+        return h;
+    }
+
+    static hist add_sub(hist h, const uint16_t *a, const uint16_t *b)
+    {
+        for (unsigned i = 0; i < 16; ++i)
+            h[i] += a[i] - b[i];
+        return h;
+    }
+
+    // The first bin where sum + the running sum passes half, sum is advanced to the bin.
+    static unsigned find(const hist &h, unsigned &sum, unsigned half)
+    {
+        unsigned i = 0;
+        while (sum + h[i] <= half)
+            sum += h[i++];
+        return i;
+    }
+};
+
+} // namespace
+
+// One pixel at a time the network is slower than the histograms for bytes.
+void vs_generic_median_radius_byte_c(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height)
+{
+    median::ctmf_byte<MedianHistPrims>(src, src_stride, dst, dst_stride, width, height, params->hradius, static_cast<uint8_t *>(params->scratch));
+}
+
+void vs_generic_median_radius_word_c(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height)
+{
+    uint8_t *scratch = static_cast<uint8_t *>(params->scratch);
+    unsigned maxval = params->maxval;
+
+    if (params->hradius == 2)
+        median::network_5x5<MedianNetPrims<uint16_t>>(src, src_stride, dst, dst_stride, width, height, 2, scratch);
+    else
+        median::hist_word<MedianHistPrims>(src, src_stride, dst, dst_stride, width, height, params->hradius, median::sample_bits(maxval), scratch,
+            [=](uint16_t x) { return std::min<unsigned>(x, maxval); }, [](unsigned x) { return static_cast<uint16_t>(x); });
+}
+
+void vs_generic_median_radius_float_c(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height)
+{
+    uint8_t *scratch = static_cast<uint8_t *>(params->scratch);
+
+    if (params->hradius == 2)
+        median::network_5x5<MedianNetPrims<float>>(src, src_stride, dst, dst_stride, width, height, 4, scratch);
+    else
+        median::sorted_median<float>(src, src_stride, dst, dst_stride, width, height, params->hradius, scratch,
+            [](float x) { int32_t i; std::memcpy(&i, &x, sizeof(i)); return median::float_key(i); },
+            [](int32_t i) { float x; i = median::float_key(i); std::memcpy(&x, &i, sizeof(x)); return x; });
+}
+
+void vs_generic_median_radius_half_c(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height)
+{
+    uint8_t *scratch = static_cast<uint8_t *>(params->scratch);
+
+    if (params->hradius == 2)
+        median::network_5x5<MedianNetHalfPrims>(src, src_stride, dst, dst_stride, width, height, 2, scratch);
+    else
+        median::hist_word<MedianHistPrims>(src, src_stride, dst, dst_stride, width, height, params->hradius, 16, scratch, median::half_key, [](unsigned x) { return median::half_unkey(static_cast<uint16_t>(x)); });
+}
+
+namespace {
+
+// At least half of every tile is output. Larger tiles take fewer butterflies per pixel on paper
+// but fall out of cache.
+unsigned fft_tile_size(unsigned radius)
+{
+    unsigned n = VS_GENERIC_FFT_MIN_SIZE;
+    while (n < 8 * radius)
+        n *= 2;
+    return n;
+}
+
+} // namespace
+
+struct vs_generic_fft_plan *vs_generic_fft_plan_create(const float *matrix, unsigned size, float div)
+{
+    unsigned radius = size / 2;
+    unsigned n = fft_tile_size(radius);
+    size_t count = static_cast<size_t>(n) * n;
+
+    vs_generic_fft_plan *plan = new vs_generic_fft_plan{ n, radius, vsh::vsh_aligned_malloc<float>(n * sizeof(float), 64), vsh::vsh_aligned_malloc<float>(2 * count * sizeof(float), 64) };
+    if (!plan->twiddle || !plan->spectrum) {
+        vs_generic_fft_plan_free(plan);
+        return nullptr;
+    }
+
+    // The kernel spectrum goes through the same passes as the tiles, in double precision.
+    std::vector<double> tw(n);
+    std::vector<double> a(2 * count);
+    std::vector<double> b(2 * count);
+    double *tw_re = tw.data();
+    double *tw_im = tw_re + n / 2;
+
+    const double pi = 3.14159265358979323846;
+    for (unsigned k = 0; k < n / 2; ++k) {
+        tw_re[k] = std::cos(2 * pi * k / n);
+        tw_im[k] = -std::sin(2 * pi * k / n);
+        plan->twiddle[k] = static_cast<float>(tw_re[k]);
+        plan->twiddle[n / 2 + k] = static_cast<float>(tw_im[k]);
+    }
+
+    // Tap (dx, dy) goes to (-dx, -dy) modulo n, so the product is a correlation like the direct kernels.
+    double scale = static_cast<double>(div) / count;
+    for (unsigned y = 0; y < size; ++y) {
+        for (unsigned x = 0; x < size; ++x)
+            a[static_cast<size_t>((n + radius - y) % n) * n + (n + radius - x) % n] = matrix[y * size + x] * scale;
+    }
+
+    fftconv::column_pass<fftconv::ScalarPrims<double>, false>(a.data(), a.data() + count, tw_re, tw_im, n);
+    for (unsigned y = 0; y < n; ++y) {
+        for (unsigned x = 0; x < n; ++x) {
+            b[static_cast<size_t>(x) * n + y] = a[static_cast<size_t>(y) * n + x];
+            b[count + static_cast<size_t>(x) * n + y] = a[count + static_cast<size_t>(y) * n + x];
+        }
+    }
+    fftconv::column_pass<fftconv::ScalarPrims<double>, false>(b.data(), b.data() + count, tw_re, tw_im, n);
+
+    std::transform(b.begin(), b.end(), plan->spectrum, [](double x) { return static_cast<float>(x); });
+    return plan;
+}
+
+void vs_generic_fft_plan_free(struct vs_generic_fft_plan *plan)
+{
+    if (!plan)
+        return;
+    vsh::vsh_aligned_free(plan->twiddle);
+    vsh::vsh_aligned_free(plan->spectrum);
+    delete plan;
+}
+
+void vs_generic_fft_conv_byte_c(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height)
+{
+    fftconv::filter_plane<fftconv::ScalarPrims<float>, fftconv::IntPixel<uint8_t>>(src, src_stride, dst, dst_stride, params, width, height, vs_transpose_plane_dword_c);
+}
+
+void vs_generic_fft_conv_word_c(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height)
+{
+    fftconv::filter_plane<fftconv::ScalarPrims<float>, fftconv::IntPixel<uint16_t>>(src, src_stride, dst, dst_stride, params, width, height, vs_transpose_plane_dword_c);
+}
+
+void vs_generic_fft_conv_float_c(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height)
+{
+    fftconv::filter_plane<fftconv::ScalarPrims<float>, fftconv::FloatPixel>(src, src_stride, dst, dst_stride, params, width, height, vs_transpose_plane_dword_c);
+}
+
+void vs_generic_fft_conv_half_c(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height)
+{
+    fftconv::filter_plane<fftconv::ScalarPrims<float>, fftconv::HalfPixel>(src, src_stride, dst, dst_stride, params, width, height, vs_transpose_plane_dword_c);
+}
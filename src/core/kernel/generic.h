@@ -37,6 +37,10 @@ struct vs_generic_params {
 	/* Minimum, Maximum. */
 	uint8_t stencil;
 
+	/* Minimum, Maximum with a radius. Either may be 0 for a one-dimensional window. */
+	unsigned hradius;
+	unsigned vradius;
+
 	/* Convolution. Square mode allows up to 11x11 = 121 coefficients. */
 	unsigned matrixsize;
 	int16_t matrix[121];
@@ -44,8 +48,54 @@ struct vs_generic_params {
 	float div;
 	float bias;
 	uint8_t saturate;
+
+	/* Convolution with a square matrix larger than 11x11. */
+	const struct vs_generic_fft_plan *fft;
+
+	/* 1D and separable convolution. Line buffers of at least VS_GENERIC_SCRATCH_SIZE(width) bytes, 64 byte aligned. */
+	void *scratch;
 };
 
+/* Overlap-save FFT convolution with a square matrix of up to VS_GENERIC_FFT_MAX_SIZE x VS_GENERIC_FFT_MAX_SIZE
+   coefficients, see fftconv_impl.h. The plan is made once per filter and shared read-only by every thread. */
+struct vs_generic_fft_plan {
+	unsigned n;      /* Tile size, a power of 2 between VS_GENERIC_FFT_MIN_SIZE and VS_GENERIC_FFT_MAX_TILE. */
+	unsigned radius; /* Each tile gives n - 2 * radius output pixels in both directions. */
+	float *twiddle;  /* n / 2 real parts of exp(-2 pi i k / n), then n / 2 imaginary parts. */
+	float *spectrum; /* n * n real parts of the kernel spectrum, then n * n imaginary parts. */
+};
+
+#define VS_GENERIC_FFT_MAX_SIZE 127
+#define VS_GENERIC_FFT_MIN_SIZE 64
+#define VS_GENERIC_FFT_MAX_TILE 512
+/* Two tiles and their transposes. */
+#define VS_GENERIC_FFT_SCRATCH_SIZE(n) (4 * (size_t)(n) * (n) * sizeof(float))
+
+/* Coefficients are size x size, row by row. Every coefficient is multiplied by div. Returns NULL if out of memory. */
+struct vs_generic_fft_plan *vs_generic_fft_plan_create(const float *matrix, unsigned size, float div);
+void vs_generic_fft_plan_free(struct vs_generic_fft_plan *plan);
+
+/* Size of one scratch line, every kernel uses at most two of them. */
+#define VS_GENERIC_SCRATCH_LINE(width) ((((size_t)(width) + 64) * sizeof(int32_t) + 63) & ~(size_t)63)
+#define VS_GENERIC_SCRATCH_SIZE(width) (2 * VS_GENERIC_SCRATCH_LINE(width))
+
+/* Minimum, Maximum with a radius. Two transposed bands of 64 bytes by width, then the
+   running extrema of 2 * radius + 2 column strips. A strip is at least VS_GENERIC_VHGW_STRIP
+   bytes wide and widened up to the whole row while they all fit in VS_GENERIC_VHGW_BUDGET bytes.
+   radius is the larger of the two radii, each limited to the plane size - 1. */
+#define VS_GENERIC_VHGW_STRIP 256
+#define VS_GENERIC_VHGW_BUDGET (256 * 1024)
+#define VS_GENERIC_VHGW_LINES_SIZE(radius) ((2 * (size_t)(radius) + 2) * VS_GENERIC_VHGW_STRIP > VS_GENERIC_VHGW_BUDGET ? (2 * (size_t)(radius) + 2) * VS_GENERIC_VHGW_STRIP : VS_GENERIC_VHGW_BUDGET)
+#define VS_GENERIC_VHGW_SCRATCH_SIZE(width, radius) (2 * 64 * (size_t)(width) + VS_GENERIC_VHGW_LINES_SIZE(radius))
+
+/* Median with a radius of 2 to VS_GENERIC_MEDIAN_MAX_RADIUS needs 16 coarse and 256 fine uint16_t
+   bins per column for 8-bit samples, a 16-bit histogram for 9-16 bit samples, or a sorted column of
+   2 * radius + 1 keys per sample for float. */
+#define VS_GENERIC_MEDIAN_MAX_RADIUS 127
+#define VS_GENERIC_MEDIAN_HIST_SIZE(width) (((size_t)(width) + 1) * 544 + 64 + 512 * 1024)
+#define VS_GENERIC_MEDIAN_SORTED_SIZE(width, radius) ((size_t)(width) * (2 * (size_t)(radius) + 1) * 4)
+#define VS_GENERIC_MEDIAN_SCRATCH_SIZE(width, radius) (VS_GENERIC_MEDIAN_SORTED_SIZE(width, radius) > VS_GENERIC_MEDIAN_HIST_SIZE(width) ? VS_GENERIC_MEDIAN_SORTED_SIZE(width, radius) : VS_GENERIC_MEDIAN_HIST_SIZE(width))
+
 #define DECL(kernel, pixel, isa) void vs_generic_##kernel##_##pixel##_##isa(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height);
 #define DECL_3x3(kernel, pixel, isa) DECL(3x3_##kernel, pixel, isa)
 
@@ -91,6 +141,10 @@ DECL_3x3(median, half, c)
 DECL_3x3(deflate, half, c)
 DECL_3x3(inflate, half, c)
 DECL_3x3(conv, half, c)
+DECL(vhgw_min, half, c)
+DECL(vhgw_max, half, c)
+DECL(median_radius, half, c)
+DECL(fft_conv, half, c)
 DECL(5x5_conv, half, c)
 DECL(7x7_conv, half, c)
 DECL(9x9_conv, half, c)
@@ -127,6 +181,26 @@ DECL(2d_conv_sep, byte, c)
 DECL(2d_conv_sep, word, c)
 DECL(2d_conv_sep, float, c)
 
+/* Minimum, Maximum over a (2 * hradius + 1) x (2 * vradius + 1) rectangle with the
+   van Herk/Gil-Werman algorithm, a constant number of operations per pixel for any radius. */
+DECL(vhgw_min, byte, c)
+DECL(vhgw_min, word, c)
+DECL(vhgw_min, float, c)
+
+DECL(vhgw_max, byte, c)
+DECL(vhgw_max, word, c)
+DECL(vhgw_max, float, c)
+
+/* Median over a (2 * hradius + 1) square, a sorting network for radius 2 and histograms above that. */
+DECL(median_radius, byte, c)
+DECL(median_radius, word, c)
+DECL(median_radius, float, c)
+
+/* Square convolution larger than 11x11 with params->fft, see fftconv_impl.h. */
+DECL(fft_conv, byte, c)
+DECL(fft_conv, word, c)
+DECL(fft_conv, float, c)
+
 #ifdef VS_TARGET_CPU_X86
 DECL_3x3(prewitt, byte, sse2)
 DECL_3x3(prewitt, word, sse2)
@@ -260,7 +334,7 @@ DECL(2d_conv_sep, byte, avx512)
 DECL(2d_conv_sep, word, avx512)
 DECL(2d_conv_sep, float, avx512)
 
-/* float16 (half): 3x3 neighbourhood family + square 3x3 convolution only.
+/* float16 (half): 3x3 neighbourhood family and every convolution but the FFT one.
    F16C tiers (avx2/avx512); arithmetic runs in float32. */
 DECL_3x3(prewitt, half, avx2)
 DECL_3x3(sobel, half, avx2)
@@ -280,6 +354,26 @@ DECL_3x3(deflate, half, avx512)
 DECL_3x3(inflate, half, avx512)
 DECL_3x3(conv, half, avx512)
 
+DECL(5x5_conv, half, avx2)
+DECL(7x7_conv, half, avx2)
+DECL(9x9_conv, half, avx2)
+DECL(11x11_conv, half, avx2)
+DECL(1d_conv_h, half, avx2)
+DECL(1d_conv_v, half, avx2)
+DECL(2d_conv_sep, half, avx2)
+
+DECL(5x5_conv, half, avx512)
+DECL(7x7_conv, half, avx512)
+DECL(9x9_conv, half, avx512)
+DECL(11x11_conv, half, avx512)
+DECL(1d_conv_h, half, avx512)
+DECL(1d_conv_v, half, avx512)
+DECL(2d_conv_sep, half, avx512)
+
+/* AVX-512-FP16 half median, compares 32 halves per vector without converting. Only
+   selects values so it is bit-exact with the F16C kernels. */
+DECL_3x3(median, half, avx512fp16)
+
 /* Square (mode 's') NxN convolution SIMD, byte/word/float for 5x5..11x11. */
 DECL(5x5_conv, byte, avx2)
 DECL(7x7_conv, byte, avx2)
@@ -314,6 +408,43 @@ DECL(7x7_conv, byte, avx512vnni)
 DECL(9x9_conv, byte, avx512vnni)
 DECL(11x11_conv, byte, avx512vnni)
 
+DECL(vhgw_min, byte, sse2)
+DECL(vhgw_min, word, sse2)
+DECL(vhgw_min, float, sse2)
+
+DECL(vhgw_max, byte, sse2)
+DECL(vhgw_max, word, sse2)
+DECL(vhgw_max, float, sse2)
+
+DECL(vhgw_min, byte, avx2)
+DECL(vhgw_min, word, avx2)
+DECL(vhgw_min, float, avx2)
+DECL(vhgw_min, half, avx2)
+
+DECL(vhgw_max, byte, avx2)
+DECL(vhgw_max, word, avx2)
+DECL(vhgw_max, float, avx2)
+DECL(vhgw_max, half, avx2)
+
+DECL(median_radius, byte, sse2)
+DECL(median_radius, word, sse2)
+DECL(median_radius, float, sse2)
+
+DECL(median_radius, byte, avx2)
+DECL(median_radius, word, avx2)
+DECL(median_radius, float, avx2)
+DECL(median_radius, half, avx2)
+
+DECL(fft_conv, byte, sse2)
+DECL(fft_conv, word, sse2)
+DECL(fft_conv, float, sse2)
+DECL(fft_conv, half, sse2)
+
+DECL(fft_conv, byte, avx2)
+DECL(fft_conv, word, avx2)
+DECL(fft_conv, float, avx2)
+DECL(fft_conv, half, avx2)
+
 #endif /* VS_TARGET_CPU_X86 */
 
 #ifdef VS_TARGET_CPU_ARM64
@@ -0,0 +1,484 @@
+/*
+* Copyright (c) 2012-2019 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+/*
+* Median with a radius, shared by the C and x86 tiers. Samples outside the
+* plane are clamped to the nearest edge, the same as the 3x3 kernels.
+*
+* Radius 2 runs a 99 comparator median-of-25 network on whole vectors of
+* output pixels. NetPrims provides:
+*   typedef vec; static constexpr unsigned SIZE (bytes per vec);
+*   static vec loadu(const uint8_t *); static void store(uint8_t *, vec);
+*   static vec min(vec, vec); static vec max(vec, vec);
+*   static void to_key(uint8_t *, unsigned n); static vec from_key(vec);
+* to_key maps a line in place to values min/max can order (for example
+* biased words when there is no unsigned compare) and from_key undoes it.
+*
+* Larger radii on 8-bit samples use the constant-time median of Perreault and
+* Hebert. Every column keeps a 256 bin histogram of its 2 * radius + 1 rows,
+* updated with one sample in and one out per row. The window histogram is kept
+* as 16 coarse bins that follow the columns at every pixel and 16 fine segments
+* of 16 bins that are only brought up to date when the median falls in them.
+* HistPrims holds 16 uint16_t counts in registers (typedef hist), adds and
+* subtracts segments to them and finds the bin where their running sum passes a
+* count.
+*
+* 9-16 bit (and half) samples would need 65536 bins per column, so they keep a
+* single histogram of the window instead and slide it along the row, Huang's
+* algorithm with 2 * (2 * radius + 1) updates per pixel. The histogram has a
+* level for every 4 bits, so the median is found with one HistPrims search per
+* level.
+*
+* Float samples are compared as integer keys. Every column keeps its 2 * radius + 1
+* rows sorted, updated with one sample out and one in per row. The rank of the
+* previous median in the window is counted with a binary search in every column.
+* Moving the window by one column changes it by at most 2 * radius + 1, so a heap
+* over the columns only has to step that far to reach the middle, O(radius log
+* radius) per pixel.
+*/
+
+#ifndef MEDIAN_IMPL_H
+#define MEDIAN_IMPL_H
+
+#include <algorithm>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include "generic.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace median {
+
+inline unsigned ctz(unsigned x)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, x);
+    return index;
+#else
+    return __builtin_ctz(x);
+#endif
+}
+
+inline int clamp(int x, int n)
+{
+    return std::min(std::max(x, 0), n - 1);
+}
+
+inline unsigned sample_bits(unsigned maxval)
+{
+    unsigned bits = 1;
+    while ((1U << bits) <= maxval)
+        ++bits;
+    return bits;
+}
+
+// Maps half bits to unsigned integers in the order of their values and back.
+inline uint16_t half_key(uint16_t x)
+{
+    return static_cast<uint16_t>((x & 0x8000) ? ~x : x | 0x8000);
+}
+
+inline uint16_t half_unkey(uint16_t x)
+{
+    return static_cast<uint16_t>((x & 0x8000) ? x & 0x7FFF : ~x);
+}
+
+// Bytes in one padded line of the 5x5 network: 2 samples on either side and a whole vector of slack.
+inline size_t network_pitch(unsigned width, unsigned bytes_per_sample)
+{
+    return ((width + 4) * bytes_per_sample + 64 + 63) & ~static_cast<size_t>(63);
+}
+
+template <class P>
+inline typename P::vec median25(typename P::vec *p)
+{
+#define SORT(a, b) { auto lo = P::min(p[a], p[b]); p[b] = P::max(p[a], p[b]); p[a] = lo; }
+    SORT(0, 1)   SORT(3, 4)   SORT(2, 4)   SORT(2, 3)   SORT(6, 7)   SORT(5, 7)
+    SORT(5, 6)   SORT(9, 10)  SORT(8, 10)  SORT(8, 9)   SORT(12, 13) SORT(11, 13)
+    SORT(11, 12) SORT(15, 16) SORT(14, 16) SORT(14, 15) SORT(18, 19) SORT(17, 19)
+    SORT(17, 18) SORT(21, 22) SORT(20, 22) SORT(20, 21) SORT(23, 24) SORT(2, 5)
+    SORT(3, 6)   SORT(0, 6)   SORT(0, 3)   SORT(4, 7)   SORT(1, 7)   SORT(1, 4)
+    SORT(11, 14) SORT(8, 14)  SORT(8, 11)  SORT(12, 15) SORT(9, 15)  SORT(9, 12)
+    SORT(13, 16) SORT(10, 16) SORT(10, 13) SORT(20, 23) SORT(17, 23) SORT(17, 20)
+    SORT(21, 24) SORT(18, 24) SORT(18, 21) SORT(19, 22) SORT(8, 17)  SORT(9, 18)
+    SORT(0, 18)  SORT(0, 9)   SORT(10, 19) SORT(1, 19)  SORT(1, 10)  SORT(11, 20)
+    SORT(2, 20)  SORT(2, 11)  SORT(12, 21) SORT(3, 21)  SORT(3, 12)  SORT(13, 22)
+    SORT(4, 22)  SORT(4, 13)  SORT(14, 23) SORT(5, 23)  SORT(5, 14)  SORT(15, 24)
+    SORT(6, 24)  SORT(6, 15)  SORT(7, 16)  SORT(7, 19)  SORT(13, 21) SORT(15, 23)
+    SORT(7, 13)  SORT(7, 15)  SORT(1, 9)   SORT(3, 11)  SORT(5, 17)  SORT(11, 17)
+    SORT(9, 17)  SORT(4, 10)  SORT(6, 12)  SORT(7, 14)  SORT(4, 6)   SORT(4, 7)
+    SORT(12, 14) SORT(10, 14) SORT(6, 7)   SORT(10, 12) SORT(6, 10)  SORT(6, 17)
+    SORT(12, 17) SORT(7, 17)  SORT(7, 10)  SORT(12, 18) SORT(7, 12)  SORT(10, 18)
+    SORT(12, 20) SORT(10, 20) SORT(10, 12)
+#undef SORT
+    return p[12];
+}
+
+// scratch holds 5 lines of network_pitch bytes, 64 byte aligned.
+template <class P>
+void network_5x5(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, unsigned width, unsigned height, unsigned bytes_per_sample, uint8_t *scratch)
+{
+    size_t pitch = network_pitch(width, bytes_per_sample);
+    unsigned bps = bytes_per_sample;
+    int h = static_cast<int>(height);
+
+    // Source row y lives in line y % 5, rows y - 2 to y + 2 never share one.
+    auto fill = [&](int y) {
+        const uint8_t *srcp = static_cast<const uint8_t *>(src) + y * src_stride;
+        uint8_t *line = scratch + (y % 5) * pitch;
+
+        std::memcpy(line + 2 * bps, srcp, width * bps);
+        for (unsigned i = 0; i < 2; ++i) {
+            std::memcpy(line + i * bps, srcp, bps);
+            std::memcpy(line + (width + 2 + i) * bps, srcp + (width - 1) * bps, bps);
+        }
+        P::to_key(line, (width + 4) * bps);
+    };
+
+    fill(0);
+    for (int y = 1; y < std::min(h, 2); ++y)
+        fill(y);
+
+    for (int y = 0; y < h; ++y) {
+        if (y + 2 < h)
+            fill(y + 2);
+
+        const uint8_t *lines[5];
+        for (int i = 0; i < 5; ++i)
+            lines[i] = scratch + (clamp(y - 2 + i, h) % 5) * pitch;
+
+        uint8_t *dstp = static_cast<uint8_t *>(dst) + y * dst_stride;
+
+        for (unsigned x = 0; x < width * bps; x += P::SIZE) {
+            typename P::vec p[25];
+
+            for (unsigned i = 0; i < 5; ++i) {
+                for (unsigned j = 0; j < 5; ++j)
+                    p[i * 5 + j] = P::loadu(lines[i] + x + j * bps);
+            }
+
+            P::store(dstp + x, P::from_key(median25<P>(p)));
+        }
+    }
+}
+
+constexpr unsigned CTMF_BINS = 256 + 16;
+
+template <class H>
+void ctmf_byte(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, unsigned width, unsigned height, unsigned radius, uint8_t *scratch)
+{
+    int w = static_cast<int>(width);
+    int h = static_cast<int>(height);
+    int r = static_cast<int>(radius);
+    unsigned half = (2 * radius + 1) * (2 * radius + 1) / 2;
+
+    // Column x has 256 fine bins followed by 16 coarse ones, the fine bins of the window follow the last column.
+    uint16_t *cols = reinterpret_cast<uint16_t *>(scratch);
+    uint16_t *fine = cols + width * CTMF_BINS;
+    int *last = reinterpret_cast<int *>(fine + 256);
+
+    auto row = [&](int y) { return static_cast<const uint8_t *>(src) + clamp(y, h) * src_stride; };
+    auto col = [&](int x) { return cols + clamp(x, w) * CTMF_BINS; };
+
+    std::memset(cols, 0, width * CTMF_BINS * sizeof(uint16_t));
+    for (int i = -r; i <= r; ++i) {
+        const uint8_t *srcp = row(i);
+        for (int x = 0; x < w; ++x) {
+            uint16_t *c = cols + x * CTMF_BINS;
+            ++c[srcp[x]];
+            ++c[256 + (srcp[x] >> 4)];
+        }
+    }
+
+    for (int y = 0; y < h; ++y) {
+        if (y > 0) {
+            const uint8_t *out = row(y - r - 1);
+            const uint8_t *in = row(y + r);
+
+            if (out != in) {
+                for (int x = 0; x < w; ++x) {
+                    uint16_t *c = cols + x * CTMF_BINS;
+                    --c[out[x]];
+                    --c[256 + (out[x] >> 4)];
+                    ++c[in[x]];
+                    ++c[256 + (in[x] >> 4)];
+                }
+            }
+        }
+
+        typename H::hist coarse = H::zero();
+        for (int i = -r; i <= r; ++i)
+            coarse = H::add(coarse, col(i) + 256);
+        for (int i = 0; i < 16; ++i)
+            last[i] = INT_MIN / 2;
+
+        // The fine segment of the last median stays in seg, the others wait in fine.
+        typename H::hist seg = H::zero();
+        unsigned cur = 16;
+
+        uint8_t *dstp = static_cast<uint8_t *>(dst) + y * dst_stride;
+
+        for (int x = 0; x < w; ++x) {
+            if (x > 0)
+                coarse = H::add_sub(coarse, col(x + r) + 256, col(x - r - 1) + 256);
+
+            unsigned sum = 0;
+            unsigned c = H::find(coarse, sum, half);
+
+            if (c == cur) {
+                seg = H::add_sub(seg, col(x + r) + c * 16, col(x - r - 1) + c * 16);
+            } else {
+                if (cur < 16) {
+                    H::store(fine + cur * 16, seg);
+                    last[cur] = x - 1;
+                }
+
+                // Catch the segment up column by column, or rebuild it when that's more work.
+                if (x - last[c] > r) {
+                    seg = H::zero();
+                    for (int i = -r; i <= r; ++i)
+                        seg = H::add(seg, col(x + i) + c * 16);
+                } else {
+                    seg = H::load(fine + c * 16);
+                    for (int i = last[c] + 1; i <= x; ++i)
+                        seg = H::add_sub(seg, col(i + r) + c * 16, col(i - r - 1) + c * 16);
+                }
+                cur = c;
+            }
+
+            unsigned b = H::find(seg, sum, half);
+            dstp[x] = static_cast<uint8_t>(c * 16 + b);
+        }
+    }
+}
+
+// Levels of 16 bins the histogram of a bits wide key needs.
+inline unsigned hist_levels(unsigned bits)
+{
+    return (bits + 3) / 4;
+}
+
+// Bytes of scratch for hist_word.
+inline size_t hist_scratch_size(unsigned bits)
+{
+    size_t size = 0;
+    for (unsigned i = 0; i < hist_levels(bits); ++i)
+        size += static_cast<size_t>(16) << (4 * i);
+    return size * sizeof(uint16_t);
+}
+
+template <class H, unsigned levels, class Key, class Unkey>
+void hist_word_levels(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, unsigned width, unsigned height, unsigned radius, uint8_t *scratch, Key key, Unkey unkey)
+{
+    int w = static_cast<int>(width);
+    int h = static_cast<int>(height);
+    int r = static_cast<int>(radius);
+    unsigned half = (2 * radius + 1) * (2 * radius + 1) / 2;
+
+    // level[0] counts every key, every following level sums 16 bins of the one before.
+    uint16_t *level[levels];
+    level[levels - 1] = reinterpret_cast<uint16_t *>(scratch);
+    for (unsigned i = levels - 1; i > 0; --i)
+        level[i - 1] = level[i] + (static_cast<size_t>(16) << (4 * (levels - 1 - i)));
+
+    // Every row removes its last window again, so this is the only clear.
+    std::memset(scratch, 0, hist_scratch_size(4 * levels));
+
+    for (int y = 0; y < h; ++y) {
+        const uint16_t *rows[2 * VS_GENERIC_MEDIAN_MAX_RADIUS + 1];
+        for (int i = -r; i <= r; ++i)
+            rows[i + r] = reinterpret_cast<const uint16_t *>(static_cast<const uint8_t *>(src) + clamp(y + i, h) * src_stride);
+
+        auto column = [&](int x, int delta) {
+            x = clamp(x, w);
+            for (int i = 0; i < 2 * r + 1; ++i) {
+                unsigned v = key(rows[i][x]);
+                for (unsigned j = 0; j < levels; ++j)
+                    level[j][v >> (4 * j)] += delta;
+            }
+        };
+
+        for (int i = -r; i <= r; ++i)
+            column(i, 1);
+
+        uint16_t *dstp = reinterpret_cast<uint16_t *>(static_cast<uint8_t *>(dst) + y * dst_stride);
+
+        for (int x = 0; x < w; ++x) {
+            if (x > 0 && clamp(x - r - 1, w) != clamp(x + r, w)) {
+                column(x - r - 1, -1);
+                column(x + r, 1);
+            }
+
+            unsigned sum = 0;
+            unsigned v = 0;
+            for (unsigned j = levels; j-- > 0;)
+                v = v * 16 + H::find(H::load(level[j] + v * 16), sum, half);
+
+            dstp[x] = unkey(v);
+        }
+
+        for (int i = w - 1 - r; i <= w - 1 + r; ++i)
+            column(i, -1);
+    }
+}
+
+// Key maps a sample to a bits wide unsigned integer in the same order, Unkey maps it back.
+template <class H, class Key, class Unkey>
+void hist_word(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, unsigned width, unsigned height, unsigned radius, unsigned bits, uint8_t *scratch, Key key, Unkey unkey)
+{
+    if (hist_levels(bits) == 3)
+        hist_word_levels<H, 3>(src, src_stride, dst, dst_stride, width, height, radius, scratch, key, unkey);
+    else
+        hist_word_levels<H, 4>(src, src_stride, dst, dst_stride, width, height, radius, scratch, key, unkey);
+}
+
+// Key maps a sample to an int32_t in the same order, Unkey maps it back.
+// scratch holds VS_GENERIC_MEDIAN_SORTED_SIZE(width, radius) bytes.
+template <class T, class Key, class Unkey>
+void sorted_median(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, unsigned width, unsigned height, unsigned radius, uint8_t *scratch, Key key, Unkey unkey)
+{
+    struct Cursor {
+        int32_t value;
+        int col;
+        int pos;
+    };
+
+    int w = static_cast<int>(width);
+    int h = static_cast<int>(height);
+    int r = static_cast<int>(radius);
+    int m = 2 * r + 1;
+    int k = m * m / 2;
+    int32_t *cols = reinterpret_cast<int32_t *>(scratch);
+
+    auto row = [&](int y) { return reinterpret_cast<const T *>(static_cast<const uint8_t *>(src) + clamp(y, h) * src_stride); };
+    auto greater = [](const Cursor &a, const Cursor &b) { return a.value > b.value; };
+    auto less = [](const Cursor &a, const Cursor &b) { return a.value < b.value; };
+
+    for (int x = 0; x < w; ++x) {
+        int32_t *col = cols + static_cast<ptrdiff_t>(x) * m;
+        for (int i = 0; i < m; ++i)
+            col[i] = key(row(i - r)[x]);
+        std::sort(col, col + m);
+    }
+
+    for (int y = 0; y < h; ++y) {
+        if (y > 0 && clamp(y - r - 1, h) != clamp(y + r, h)) {
+            const T *outp = row(y - r - 1);
+            const T *inp = row(y + r);
+
+            for (int x = 0; x < w; ++x) {
+                int32_t *col = cols + static_cast<ptrdiff_t>(x) * m;
+                int32_t out = key(outp[x]);
+                int32_t in = key(inp[x]);
+                int32_t *p = std::lower_bound(col, col + m, out);
+
+                if (in < out) {
+                    int32_t *q = std::upper_bound(col, p, in);
+                    std::copy_backward(q, p, p + 1);
+                    *q = in;
+                } else if (in > out) {
+                    int32_t *q = std::lower_bound(p + 1, col + m, in);
+                    std::copy(p + 1, q, p);
+                    q[-1] = in;
+                }
+            }
+        }
+
+        T *dstp = reinterpret_cast<T *>(static_cast<uint8_t *>(dst) + y * dst_stride);
+        int32_t v = cols[r];
+
+        for (int x = 0; x < w; ++x) {
+            const int32_t *window[2 * VS_GENERIC_MEDIAN_MAX_RADIUS + 1];
+            int lo[2 * VS_GENERIC_MEDIAN_MAX_RADIUS + 1];
+            int hi[2 * VS_GENERIC_MEDIAN_MAX_RADIUS + 1];
+            int below = 0;
+            int through = 0;
+
+            for (int j = 0; j < m; ++j) {
+                window[j] = cols + static_cast<ptrdiff_t>(clamp(x + j - r, w)) * m;
+                auto range = std::equal_range(window[j], window[j] + m, v);
+                lo[j] = static_cast<int>(range.first - window[j]);
+                hi[j] = static_cast<int>(range.second - window[j]);
+                below += lo[j];
+                through += hi[j];
+            }
+
+            Cursor heap[2 * VS_GENERIC_MEDIAN_MAX_RADIUS + 1];
+            int size = 0;
+
+            if (k >= through) {
+                // Step up from the samples after v.
+                for (int j = 0; j < m; ++j) {
+                    if (hi[j] < m)
+                        heap[size++] = { window[j][hi[j]], j, hi[j] };
+                }
+                std::make_heap(heap, heap + size, greater);
+
+                for (int i = through; i < k; ++i) {
+                    std::pop_heap(heap, heap + size, greater);
+                    Cursor &c = heap[size - 1];
+                    if (++c.pos < m) {
+                        c.value = window[c.col][c.pos];
+                        std::push_heap(heap, heap + size, greater);
+                    } else {
+                        --size;
+                    }
+                }
+                v = heap[0].value;
+            } else if (k < below) {
+                // Step down from the samples before v.
+                for (int j = 0; j < m; ++j) {
+                    if (lo[j] > 0)
+                        heap[size++] = { window[j][lo[j] - 1], j, lo[j] - 1 };
+                }
+                std::make_heap(heap, heap + size, less);
+
+                for (int i = below - 1; i > k; --i) {
+                    std::pop_heap(heap, heap + size, less);
+                    Cursor &c = heap[size - 1];
+                    if (--c.pos >= 0) {
+                        c.value = window[c.col][c.pos];
+                        std::push_heap(heap, heap + size, less);
+                    } else {
+                        --size;
+                    }
+                }
+                v = heap[0].value;
+            }
+
+            dstp[x] = unkey(v);
+        }
+    }
+}
+
+// Orders floats by their bits, negative values have their magnitude flipped. Its own inverse.
+inline int32_t float_key(int32_t x)
+{
+    return x < 0 ? x ^ INT32_MAX : x;
+}
+
+} // namespace median
+
+#endif // MEDIAN_IMPL_H
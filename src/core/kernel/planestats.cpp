@@ -233,3 +233,29 @@ void vs_plane_stats_2_half_c(union vs_plane_stats *stats, const void *src1, ptrd
     stats->f.acc = facc;
     stats->f.diffacc = fdiffacc;
 }
+
+void vs_plane_stats_count_float_c(union vs_plane_stats *stats, const void *src, ptrdiff_t stride, unsigned width, unsigned height)
+{
+    const uint8_t *srcp = (const uint8_t *)src;
+    unsigned x, y;
+    float fmin = INFINITY;
+    float fmax = -INFINITY;
+    double facc = 0;
+    uint64_t count = 0;
+
+    for (y = 0; y < height; y++) {
+        for (x = 0; x < width; x++) {
+            float v = ((const float *)srcp)[x];
+            fmin = VSMIN(fmin, v);
+            fmax = VSMAX(fmax, v);
+            facc += v;
+            count += v > 0.0f;
+        }
+        srcp += stride;
+    }
+
+    stats->f.min = fmin;
+    stats->f.max = fmax;
+    stats->f.acc = facc;
+    stats->f.count = count;
+}
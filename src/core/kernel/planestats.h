@@ -37,10 +37,12 @@ union vs_plane_stats {
         float max;
         double acc;
         double diffacc;
+        uint64_t count; /* samples greater than zero, only set by the count functions */
     } f;
 };
 
 #define DECL_1(pixel, isa) void vs_plane_stats_1_##pixel##_##isa(union vs_plane_stats *stats, const void *src, ptrdiff_t stride, unsigned width, unsigned height);
+#define DECL_COUNT(isa) void vs_plane_stats_count_float_##isa(union vs_plane_stats *stats, const void *src, ptrdiff_t stride, unsigned width, unsigned height);
 #define DECL_2(pixel, isa) void vs_plane_stats_2_##pixel##_##isa(union vs_plane_stats *stats, const void *src1, ptrdiff_t src1_stride, const void *src2, ptrdiff_t src2_stride, unsigned width, unsigned height);
 
 DECL_1(byte, c)
@@ -53,6 +55,8 @@ DECL_2(word, c)
 DECL_2(float, c)
 DECL_2(half, c)
 
+DECL_COUNT(c)
+
 #ifdef VS_TARGET_CPU_X86
 DECL_1(byte, sse2)
 DECL_1(word, sse2)
@@ -62,6 +66,8 @@ DECL_2(byte, sse2)
 DECL_2(word, sse2)
 DECL_2(float, sse2)
 
+DECL_COUNT(sse2)
+
 DECL_1(byte, avx2)
 DECL_1(word, avx2)
 DECL_1(float, avx2)
@@ -71,9 +77,12 @@ DECL_2(byte, avx2)
 DECL_2(word, avx2)
 DECL_2(float, avx2)
 DECL_2(half, avx2)
+
+DECL_COUNT(avx2)
 #endif /* VS_TARGET_CPU_X86 */
 
 #undef DECL_2
+#undef DECL_COUNT
 #undef DECL_1
 
 #endif
\ No newline at end of file
@@ -33,6 +33,12 @@ void vs_transpose_plane_dword_c(const void * VS_RESTRICT src, ptrdiff_t src_stri
 void vs_transpose_plane_byte_sse2(const void * VS_RESTRICT src, ptrdiff_t src_stride, void * VS_RESTRICT dst, ptrdiff_t dst_stride, unsigned width, unsigned height);
 void vs_transpose_plane_word_sse2(const void * VS_RESTRICT src, ptrdiff_t src_stride, void * VS_RESTRICT dst, ptrdiff_t dst_stride, unsigned width, unsigned height);
 void vs_transpose_plane_dword_sse2(const void * VS_RESTRICT src, ptrdiff_t src_stride, void * VS_RESTRICT dst, ptrdiff_t dst_stride, unsigned width, unsigned height);
+void vs_transpose_plane_byte_avx2(const void * VS_RESTRICT src, ptrdiff_t src_stride, void * VS_RESTRICT dst, ptrdiff_t dst_stride, unsigned width, unsigned height);
+void vs_transpose_plane_word_avx2(const void * VS_RESTRICT src, ptrdiff_t src_stride, void * VS_RESTRICT dst, ptrdiff_t dst_stride, unsigned width, unsigned height);
+void vs_transpose_plane_dword_avx2(const void * VS_RESTRICT src, ptrdiff_t src_stride, void * VS_RESTRICT dst, ptrdiff_t dst_stride, unsigned width, unsigned height);
+void vs_transpose_plane_byte_avx512(const void * VS_RESTRICT src, ptrdiff_t src_stride, void * VS_RESTRICT dst, ptrdiff_t dst_stride, unsigned width, unsigned height);
+void vs_transpose_plane_word_avx512(const void * VS_RESTRICT src, ptrdiff_t src_stride, void * VS_RESTRICT dst, ptrdiff_t dst_stride, unsigned width, unsigned height);
+void vs_transpose_plane_dword_avx512(const void * VS_RESTRICT src, ptrdiff_t src_stride, void * VS_RESTRICT dst, ptrdiff_t dst_stride, unsigned width, unsigned height);
 #endif
 
 /* Implementation details. */
@@ -45,6 +51,12 @@ void vs_transpose_plane_dword_sse2(const void * VS_RESTRICT src, ptrdiff_t src_s
 #define CACHELINE_SIZE_WORD (CACHELINE_SIZE / sizeof(uint16_t))
 #define CACHELINE_SIZE_DWORD (CACHELINE_SIZE / sizeof(uint32_t))
 
+/* The plane is done in columns of TILE_WIDTH samples, so the destination rows of one strip of
+ * source rows stay in cache and in the TLB on large planes. A multiple of every block width. */
+#ifndef TILE_WIDTH
+#define TILE_WIDTH 256
+#endif
+
 static void transpose_block_byte(const uint8_t * VS_RESTRICT src, ptrdiff_t src_stride, uint8_t * VS_RESTRICT dst, ptrdiff_t dst_stride);
 static void transpose_block_word(const uint16_t * VS_RESTRICT src, ptrdiff_t src_stride, uint16_t * VS_RESTRICT dst, ptrdiff_t dst_stride);
 static void transpose_block_dword(const uint32_t * VS_RESTRICT src, ptrdiff_t src_stride, uint32_t * VS_RESTRICT dst, ptrdiff_t dst_stride);
@@ -57,33 +69,32 @@ static void transpose_plane_byte(const void * VS_RESTRICT src, ptrdiff_t src_str
     unsigned width_floor = width - width % BLOCK_WIDTH_BYTE;
     unsigned height_floor = height - height % CACHELINE_SIZE_BYTE;
     unsigned height_floor2 = height - height % BLOCK_HEIGHT_BYTE;
-    unsigned i, j, ii;
+    unsigned i, j, ii, jj, tile_end;
+
+    for (jj = 0; jj < width_floor; jj += TILE_WIDTH) {
+        tile_end = jj + TILE_WIDTH < width_floor ? jj + TILE_WIDTH : width_floor;
 
-    for (i = 0; i < height_floor; i += CACHELINE_SIZE_BYTE) {
-        for (j = 0; j < width_floor; j += BLOCK_WIDTH_BYTE) {
-            /* Prioritize contiguous stores over contiguous loads. */
-            for (ii = i; ii < i + CACHELINE_SIZE_BYTE; ii += BLOCK_HEIGHT_BYTE) {
-                transpose_block_byte(ADD_OFFSET(src_p, ii * src_stride) + j, src_stride, ADD_OFFSET(dst_p, j * dst_stride) + ii, dst_stride);
+        for (i = 0; i < height_floor; i += CACHELINE_SIZE_BYTE) {
+            for (j = jj; j < tile_end; j += BLOCK_WIDTH_BYTE) {
+                /* Prioritize contiguous stores over contiguous loads. */
+                for (ii = i; ii < i + CACHELINE_SIZE_BYTE; ii += BLOCK_HEIGHT_BYTE) {
+                    transpose_block_byte(ADD_OFFSET(src_p, ii * src_stride) + j, src_stride, ADD_OFFSET(dst_p, j * dst_stride) + ii, dst_stride);
+                }
             }
         }
-        for (j = width_floor; j < width; ++j) {
-            for (ii = i; ii < i + CACHELINE_SIZE_BYTE; ++ii) {
-                *(ADD_OFFSET(dst_p, j * dst_stride) + ii) = *(ADD_OFFSET(src_p, ii * src_stride) + j);
+        for (i = height_floor; i < height_floor2; i += BLOCK_HEIGHT_BYTE) {
+            for (j = jj; j < tile_end; j += BLOCK_WIDTH_BYTE) {
+                transpose_block_byte(ADD_OFFSET(src_p, i * src_stride) + j, src_stride, ADD_OFFSET(dst_p, j * dst_stride) + i, dst_stride);
             }
         }
-    }
-    for (i = height_floor; i < height_floor2; i += BLOCK_HEIGHT_BYTE) {
-        for (j = 0; j < width_floor; j += BLOCK_WIDTH_BYTE) {
-            transpose_block_byte(ADD_OFFSET(src_p, i * src_stride) + j, src_stride, ADD_OFFSET(dst_p, j * dst_stride) + i, dst_stride);
-        }
-        for (j = width_floor; j < width; ++j) {
-            for (ii = i; ii < i + BLOCK_HEIGHT_BYTE; ++ii) {
-                *(ADD_OFFSET(dst_p, j * dst_stride) + ii) = *(ADD_OFFSET(src_p, ii * src_stride) + j);
+        for (i = height_floor2; i < height; ++i) {
+            for (j = jj; j < tile_end; ++j) {
+                *(ADD_OFFSET(dst_p, j * dst_stride) + i) = *(ADD_OFFSET(src_p, i * src_stride) + j);
             }
         }
     }
-    for (i = height_floor2; i < height; ++i) {
-        for (j = 0; j < width; ++j) {
+    for (j = width_floor; j < width; ++j) {
+        for (i = 0; i < height; ++i) {
             *(ADD_OFFSET(dst_p, j * dst_stride) + i) = *(ADD_OFFSET(src_p, i * src_stride) + j);
         }
     }
@@ -97,33 +108,32 @@ static void transpose_plane_word(const void * VS_RESTRICT src, ptrdiff_t src_str
     unsigned width_floor = width - width % BLOCK_WIDTH_WORD;
     unsigned height_floor = height - height % CACHELINE_SIZE_WORD;
     unsigned height_floor2 = height - height % BLOCK_HEIGHT_WORD;
-    unsigned i, j, ii;
+    unsigned i, j, ii, jj, tile_end;
+
+    for (jj = 0; jj < width_floor; jj += TILE_WIDTH) {
+        tile_end = jj + TILE_WIDTH < width_floor ? jj + TILE_WIDTH : width_floor;
 
-    for (i = 0; i < height_floor; i += CACHELINE_SIZE_WORD) {
-        for (j = 0; j < width_floor; j += BLOCK_WIDTH_WORD) {
-            /* Prioritize contiguous stores over contiguous loads. */
-            for (ii = i; ii < i + CACHELINE_SIZE_WORD; ii += BLOCK_HEIGHT_WORD) {
-                transpose_block_word(ADD_OFFSET(src_p, ii * src_stride) + j, src_stride, ADD_OFFSET(dst_p, j * dst_stride) + ii, dst_stride);
+        for (i = 0; i < height_floor; i += CACHELINE_SIZE_WORD) {
+            for (j = jj; j < tile_end; j += BLOCK_WIDTH_WORD) {
+                /* Prioritize contiguous stores over contiguous loads. */
+                for (ii = i; ii < i + CACHELINE_SIZE_WORD; ii += BLOCK_HEIGHT_WORD) {
+                    transpose_block_word(ADD_OFFSET(src_p, ii * src_stride) + j, src_stride, ADD_OFFSET(dst_p, j * dst_stride) + ii, dst_stride);
+                }
             }
         }
-        for (j = width_floor; j < width; ++j) {
-            for (ii = i; ii < i + CACHELINE_SIZE_WORD; ++ii) {
-                *(ADD_OFFSET(dst_p, j * dst_stride) + ii) = *(ADD_OFFSET(src_p, ii * src_stride) + j);
+        for (i = height_floor; i < height_floor2; i += BLOCK_HEIGHT_WORD) {
+            for (j = jj; j < tile_end; j += BLOCK_WIDTH_WORD) {
+                transpose_block_word(ADD_OFFSET(src_p, i * src_stride) + j, src_stride, ADD_OFFSET(dst_p, j * dst_stride) + i, dst_stride);
             }
         }
-    }
-    for (i = height_floor; i < height_floor2; i += BLOCK_HEIGHT_WORD) {
-        for (j = 0; j < width_floor; j += BLOCK_WIDTH_WORD) {
-            transpose_block_word(ADD_OFFSET(src_p, i * src_stride) + j, src_stride, ADD_OFFSET(dst_p, j * dst_stride) + i, dst_stride);
-        }
-        for (j = width_floor; j < width; ++j) {
-            for (ii = i; ii < i + BLOCK_HEIGHT_WORD; ++ii) {
-                *(ADD_OFFSET(dst_p, j * dst_stride) + ii) = *(ADD_OFFSET(src_p, ii * src_stride) + j);
+        for (i = height_floor2; i < height; ++i) {
+            for (j = jj; j < tile_end; ++j) {
+                *(ADD_OFFSET(dst_p, j * dst_stride) + i) = *(ADD_OFFSET(src_p, i * src_stride) + j);
             }
         }
     }
-    for (i = height_floor2; i < height; ++i) {
-        for (j = 0; j < width; ++j) {
+    for (j = width_floor; j < width; ++j) {
+        for (i = 0; i < height; ++i) {
             *(ADD_OFFSET(dst_p, j * dst_stride) + i) = *(ADD_OFFSET(src_p, i * src_stride) + j);
         }
     }
@@ -137,33 +147,32 @@ static void transpose_plane_dword(const void * VS_RESTRICT src, ptrdiff_t src_st
     unsigned width_floor = width - width % BLOCK_WIDTH_DWORD;
     unsigned height_floor = height - height % CACHELINE_SIZE_DWORD;
     unsigned height_floor2 = height - height % BLOCK_HEIGHT_DWORD;
-    unsigned i, j, ii;
+    unsigned i, j, ii, jj, tile_end;
+
+    for (jj = 0; jj < width_floor; jj += TILE_WIDTH) {
+        tile_end = jj + TILE_WIDTH < width_floor ? jj + TILE_WIDTH : width_floor;
 
-    for (i = 0; i < height_floor; i += CACHELINE_SIZE_DWORD) {
-        for (j = 0; j < width_floor; j += BLOCK_WIDTH_DWORD) {
-            /* Prioritize contiguous stores over contiguous loads. */
-            for (ii = i; ii < i + CACHELINE_SIZE_DWORD; ii += BLOCK_HEIGHT_DWORD) {
-                transpose_block_dword(ADD_OFFSET(src_p, ii * src_stride) + j, src_stride, ADD_OFFSET(dst_p, j * dst_stride) + ii, dst_stride);
+        for (i = 0; i < height_floor; i += CACHELINE_SIZE_DWORD) {
+            for (j = jj; j < tile_end; j += BLOCK_WIDTH_DWORD) {
+                /* Prioritize contiguous stores over contiguous loads. */
+                for (ii = i; ii < i + CACHELINE_SIZE_DWORD; ii += BLOCK_HEIGHT_DWORD) {
+                    transpose_block_dword(ADD_OFFSET(src_p, ii * src_stride) + j, src_stride, ADD_OFFSET(dst_p, j * dst_stride) + ii, dst_stride);
+                }
             }
         }
-        for (j = width_floor; j < width; ++j) {
-            for (ii = i; ii < i + CACHELINE_SIZE_DWORD; ++ii) {
-                *(ADD_OFFSET(dst_p, j * dst_stride) + ii) = *(ADD_OFFSET(src_p, ii * src_stride) + j);
+        for (i = height_floor; i < height_floor2; i += BLOCK_HEIGHT_DWORD) {
+            for (j = jj; j < tile_end; j += BLOCK_WIDTH_DWORD) {
+                transpose_block_dword(ADD_OFFSET(src_p, i * src_stride) + j, src_stride, ADD_OFFSET(dst_p, j * dst_stride) + i, dst_stride);
             }
         }
-    }
-    for (i = height_floor; i < height_floor2; i += BLOCK_HEIGHT_DWORD) {
-        for (j = 0; j < width_floor; j += BLOCK_WIDTH_DWORD) {
-            transpose_block_dword(ADD_OFFSET(src_p, i * src_stride) + j, src_stride, ADD_OFFSET(dst_p, j * dst_stride) + i, dst_stride);
-        }
-        for (j = width_floor; j < width; ++j) {
-            for (ii = i; ii < i + BLOCK_HEIGHT_DWORD; ++ii) {
-                *(ADD_OFFSET(dst_p, j * dst_stride) + ii) = *(ADD_OFFSET(src_p, ii * src_stride) + j);
+        for (i = height_floor2; i < height; ++i) {
+            for (j = jj; j < tile_end; ++j) {
+                *(ADD_OFFSET(dst_p, j * dst_stride) + i) = *(ADD_OFFSET(src_p, i * src_stride) + j);
             }
         }
     }
-    for (i = height_floor2; i < height; ++i) {
-        for (j = 0; j < width; ++j) {
+    for (j = width_floor; j < width; ++j) {
+        for (i = 0; i < height; ++i) {
             *(ADD_OFFSET(dst_p, j * dst_stride) + i) = *(ADD_OFFSET(src_p, i * src_stride) + j);
         }
     }
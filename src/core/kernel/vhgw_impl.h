@@ -0,0 +1,172 @@
+/*
+* Copyright (c) 2012-2019 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+/*
+* van Herk/Gil-Werman minimum/maximum, shared by the C and x86 tiers.
+*
+* A window of k = 2 * radius + 1 rows starting at row y - radius ends in the
+* next block of k rows, so it is the extremum of the suffix of one block and the
+* prefix of the next. Both are running extrema, about three min/max operations
+* per pixel whatever the radius. Rows outside the plane are clamped, which gives
+* the same result as leaving them out of the window.
+*
+* Every pass runs down columns, so all the work is elementwise over a row and
+* the ISA only has to provide the vector min/max (the Prims template parameter).
+* The vertical pass runs in column strips as wide as the block suffixes allow
+* while they stay in cache (see VS_GENERIC_VHGW_BUDGET). The horizontal pass transposes bands of 64 bytes
+* worth of rows, runs the vertical pass on them and transposes them back.
+*
+* Prims provides:
+*   typedef vec; static constexpr unsigned SIZE (bytes per vec);
+*   static vec load(const uint8_t *); static void store(uint8_t *, vec);
+*   vec reduce(vec, vec) const; bool thresholded() const; vec limit(vec val, vec src) const;
+* Rows are processed in whole vecs and may run into the stride padding.
+*/
+
+#ifndef VHGW_IMPL_H
+#define VHGW_IMPL_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include "generic.h"
+
+namespace vhgw {
+
+typedef void (*transpose_func)(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, unsigned width, unsigned height);
+
+constexpr unsigned BAND = 64;
+
+template <class Prims>
+inline void reduce_row(const Prims &p, uint8_t *dst, const uint8_t *a, const uint8_t *b, unsigned n)
+{
+    for (unsigned i = 0; i < n; i += Prims::SIZE)
+        Prims::store(dst + i, p.reduce(Prims::load(a + i), Prims::load(b + i)));
+}
+
+// acc = reduce(prev, next), dst = reduce(acc, suffix). prev may alias acc.
+template <class Prims>
+inline void step_row(const Prims &p, uint8_t *dst, uint8_t *acc, const uint8_t *prev, const uint8_t *next, const uint8_t *suffix, unsigned n)
+{
+    for (unsigned i = 0; i < n; i += Prims::SIZE) {
+        auto v = p.reduce(Prims::load(prev + i), Prims::load(next + i));
+        Prims::store(acc + i, v);
+        Prims::store(dst + i, p.reduce(v, Prims::load(suffix + i)));
+    }
+}
+
+// Vertical pass over width bytes. src and dst can't overlap. lines is VS_GENERIC_VHGW_LINES_SIZE(radius) bytes.
+template <class Prims>
+void vpass(const Prims &p, const uint8_t *src, ptrdiff_t src_stride, uint8_t *dst, ptrdiff_t dst_stride, unsigned width, unsigned height, unsigned radius, uint8_t *lines)
+{
+    int h = static_cast<int>(height);
+    int r = static_cast<int>(radius);
+    int k = 2 * r + 1;
+
+    // The widest strip (in whole vecs) whose k + 1 lines fit in the budget.
+    unsigned strip = std::max<unsigned>(VS_GENERIC_VHGW_STRIP, VS_GENERIC_VHGW_BUDGET / (k + 1) / Prims::SIZE * Prims::SIZE);
+    strip = std::min(strip, (width + Prims::SIZE - 1) / Prims::SIZE * Prims::SIZE);
+    uint8_t *acc = lines;
+    uint8_t *suffix = lines + strip;
+
+    auto row = [=](int y) { return src + std::min(std::max(y, 0), h - 1) * src_stride; };
+
+    for (unsigned x = 0; x < width; x += strip) {
+        unsigned n = std::min(width - x, strip);
+        n = (n + Prims::SIZE - 1) / Prims::SIZE * Prims::SIZE;
+
+        for (int y = 0; y < h; y += k) {
+            int base = y - r;
+
+            std::memcpy(suffix + (k - 1) * strip, row(base + k - 1) + x, n);
+            for (int i = k - 2; i >= 0; --i)
+                reduce_row(p, suffix + i * strip, row(base + i) + x, suffix + (i + 1) * strip, n);
+
+            std::memcpy(dst + y * dst_stride + x, suffix, n);
+
+            const uint8_t *prev = nullptr;
+            for (int j = 1; j < k && y + j < h; ++j) {
+                const uint8_t *next = row(base + k + j - 1) + x;
+                uint8_t *dstp = dst + (y + j) * dst_stride + x;
+
+                if (!prev) {
+                    reduce_row(p, dstp, next, suffix + j * strip, n);
+                    prev = next;
+                } else {
+                    step_row(p, dstp, acc, prev, next, suffix + j * strip, n);
+                    prev = acc;
+                }
+            }
+        }
+    }
+}
+
+template <class Prims>
+void filter_plane(const void *src_, ptrdiff_t src_stride, void *dst_, ptrdiff_t dst_stride, const vs_generic_params *params, unsigned width, unsigned height, unsigned bytes_per_sample, transpose_func transpose)
+{
+    Prims p{ *params };
+    const uint8_t *src = static_cast<const uint8_t *>(src_);
+    uint8_t *dst = static_cast<uint8_t *>(dst_);
+    unsigned hradius = std::min(params->hradius, width - 1);
+    unsigned vradius = std::min(params->vradius, height - 1);
+
+    uint8_t *band[2] = { static_cast<uint8_t *>(params->scratch), static_cast<uint8_t *>(params->scratch) + BAND * width };
+    uint8_t *lines = band[1] + BAND * width;
+
+    if (vradius)
+        vpass(p, src, src_stride, dst, dst_stride, width * bytes_per_sample, height, vradius, lines);
+
+    // Both radii are clamped to nothing on single row or column planes, the plane is then only copied.
+    if (!vradius && !hradius) {
+        for (unsigned y = 0; y < height; ++y)
+            std::memcpy(dst + y * dst_stride, src + y * src_stride, width * bytes_per_sample);
+    }
+
+    if (hradius) {
+        const uint8_t *in = vradius ? dst : src;
+        ptrdiff_t in_stride = vradius ? dst_stride : src_stride;
+        unsigned band_rows = BAND / bytes_per_sample;
+
+        for (unsigned y = 0; y < height; y += band_rows) {
+            unsigned rows = std::min(height - y, band_rows);
+
+            transpose(in + y * in_stride, in_stride, band[0], BAND, width, rows);
+            vpass(p, band[0], BAND, band[1], BAND, BAND, width, hradius, lines);
+            transpose(band[1], BAND, dst + y * dst_stride, dst_stride, rows, width);
+        }
+    }
+
+    if (p.thresholded()) {
+        unsigned n = (width * bytes_per_sample + Prims::SIZE - 1) / Prims::SIZE * Prims::SIZE;
+
+        for (unsigned y = 0; y < height; ++y) {
+            const uint8_t *srcp = src + y * src_stride;
+            uint8_t *dstp = dst + y * dst_stride;
+
+            for (unsigned i = 0; i < n; i += Prims::SIZE)
+                Prims::store(dstp + i, p.limit(Prims::load(dstp + i), Prims::load(srcp + i)));
+        }
+    }
+}
+
+} // namespace vhgw
+
+#endif // VHGW_IMPL_H
@@ -0,0 +1,266 @@
+/*
+* Copyright (c) 2016 Fredrik Mellbin & other contributors
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <immintrin.h>
+#include "../average.h"
+#include "average_impl.h"
+
+/* Scale, clamp and round 8 accumulators, then add the bias back. */
+static __m256i finish_int(__m256i acc, const struct vs_average_int_consts *c)
+{
+    __m256 x = _mm256_mul_ps(_mm256_cvtepi32_ps(acc), _mm256_set1_ps(c->rscale));
+    x = _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(c->lo)), _mm256_set1_ps(c->hi));
+    return _mm256_add_epi32(_mm256_cvtps_epi32(x), _mm256_set1_epi32(c->bias));
+}
+
+void vs_average_byte_avx2(const void * const *srcs, void *dst, ptrdiff_t stride, const struct vs_average_params *params, unsigned width, unsigned height)
+{
+    struct vs_average_int_consts c;
+    const uint8_t *rows[VS_AVERAGE_MAX_SRCS + 1];
+    unsigned npairs = vs_average_int_setup(&c, srcs, params, 0);
+
+    for (unsigned y = 0; y < height; ++y) {
+        uint8_t *dstp = (uint8_t *)dst + y * stride;
+        for (unsigned k = 0; k < npairs * 2; ++k)
+            rows[k] = (const uint8_t *)c.srcs[k] + y * stride;
+
+        for (unsigned x = 0; x < width; x += 32) {
+            __m256i acc0 = _mm256_set1_epi32(c.offset);
+            __m256i acc1 = acc0;
+            __m256i acc2 = acc0;
+            __m256i acc3 = acc0;
+
+            for (unsigned k = 0; k < npairs; ++k) {
+                __m256i w = _mm256_set1_epi32(c.wpairs[k]);
+                __m256i alo = _mm256_cvtepu8_epi16(_mm_load_si128((const __m128i *)(rows[2 * k + 0] + x + 0)));
+                __m256i ahi = _mm256_cvtepu8_epi16(_mm_load_si128((const __m128i *)(rows[2 * k + 0] + x + 16)));
+                __m256i blo = _mm256_cvtepu8_epi16(_mm_load_si128((const __m128i *)(rows[2 * k + 1] + x + 0)));
+                __m256i bhi = _mm256_cvtepu8_epi16(_mm_load_si128((const __m128i *)(rows[2 * k + 1] + x + 16)));
+
+                acc0 = _mm256_add_epi32(acc0, _mm256_madd_epi16(_mm256_unpacklo_epi16(alo, blo), w));
+                acc1 = _mm256_add_epi32(acc1, _mm256_madd_epi16(_mm256_unpackhi_epi16(alo, blo), w));
+                acc2 = _mm256_add_epi32(acc2, _mm256_madd_epi16(_mm256_unpacklo_epi16(ahi, bhi), w));
+                acc3 = _mm256_add_epi32(acc3, _mm256_madd_epi16(_mm256_unpackhi_epi16(ahi, bhi), w));
+            }
+
+            // The unpacks and packs are both lane-local, so only the final byte pack needs a fixup.
+            __m256i lo = _mm256_packs_epi32(finish_int(acc0, &c), finish_int(acc1, &c));
+            __m256i hi = _mm256_packs_epi32(finish_int(acc2, &c), finish_int(acc3, &c));
+            __m256i r = _mm256_permute4x64_epi64(_mm256_packus_epi16(lo, hi), _MM_SHUFFLE(3, 1, 2, 0));
+            _mm256_store_si256((__m256i *)(dstp + x), r);
+        }
+    }
+}
+
+void vs_average_word_avx2(const void * const *srcs, void *dst, ptrdiff_t stride, const struct vs_average_params *params, unsigned width, unsigned height)
+{
+    struct vs_average_int_consts c;
+    const uint16_t *rows[VS_AVERAGE_MAX_SRCS + 1];
+    unsigned npairs = vs_average_int_setup(&c, srcs, params, 1);
+    const __m256i sign = _mm256_set1_epi16(INT16_MIN);
+
+    for (unsigned y = 0; y < height; ++y) {
+        uint16_t *dstp = (uint16_t *)((uint8_t *)dst + y * stride);
+        for (unsigned k = 0; k < npairs * 2; ++k)
+            rows[k] = (const uint16_t *)((const uint8_t *)c.srcs[k] + y * stride);
+
+        for (unsigned x = 0; x < width; x += 16) {
+            __m256i acc0 = _mm256_set1_epi32(c.offset);
+            __m256i acc1 = acc0;
+
+            for (unsigned k = 0; k < npairs; ++k) {
+                __m256i w = _mm256_set1_epi32(c.wpairs[k]);
+                __m256i a = _mm256_xor_si256(_mm256_load_si256((const __m256i *)(rows[2 * k + 0] + x)), sign);
+                __m256i b = _mm256_xor_si256(_mm256_load_si256((const __m256i *)(rows[2 * k + 1] + x)), sign);
+
+                acc0 = _mm256_add_epi32(acc0, _mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), w));
+                acc1 = _mm256_add_epi32(acc1, _mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), w));
+            }
+
+            _mm256_store_si256((__m256i *)(dstp + x), _mm256_packus_epi32(finish_int(acc0, &c), finish_int(acc1, &c)));
+        }
+    }
+}
+
+void vs_average_float_avx2(const void * const *srcs, void *dst, ptrdiff_t stride, const struct vs_average_params *params, unsigned width, unsigned height)
+{
+    const float *rows[VS_AVERAGE_MAX_SRCS];
+    unsigned num_srcs = params->num_srcs;
+    __m256 rscale = _mm256_set1_ps(params->rscale);
+
+    for (unsigned y = 0; y < height; ++y) {
+        float *dstp = (float *)((uint8_t *)dst + y * stride);
+        for (unsigned k = 0; k < num_srcs; ++k)
+            rows[k] = (const float *)((const uint8_t *)srcs[k] + y * stride);
+
+        // Two vectors per iteration hide the add latency, but the stride is only padded to 32 bytes.
+        unsigned x;
+        for (x = 0; x + 8 < width; x += 16) {
+            __m256 acc0 = _mm256_setzero_ps();
+            __m256 acc1 = _mm256_setzero_ps();
+
+            for (unsigned k = 0; k < num_srcs; ++k) {
+                __m256 w = _mm256_set1_ps(params->fweights[k]);
+                acc0 = _mm256_fmadd_ps(_mm256_load_ps(rows[k] + x + 0), w, acc0);
+                acc1 = _mm256_fmadd_ps(_mm256_load_ps(rows[k] + x + 8), w, acc1);
+            }
+
+            _mm256_store_ps(dstp + x + 0, _mm256_mul_ps(acc0, rscale));
+            _mm256_store_ps(dstp + x + 8, _mm256_mul_ps(acc1, rscale));
+        }
+        if (x < width) {
+            __m256 acc = _mm256_setzero_ps();
+
+            for (unsigned k = 0; k < num_srcs; ++k)
+                acc = _mm256_fmadd_ps(_mm256_load_ps(rows[k] + x), _mm256_set1_ps(params->fweights[k]), acc);
+
+            _mm256_store_ps(dstp + x, _mm256_mul_ps(acc, rscale));
+        }
+    }
+}
+
+void vs_average_half_avx2(const void * const *srcs, void *dst, ptrdiff_t stride, const struct vs_average_params *params, unsigned width, unsigned height)
+{
+    const uint16_t *rows[VS_AVERAGE_MAX_SRCS];
+    unsigned num_srcs = params->num_srcs;
+    __m256 rscale = _mm256_set1_ps(params->rscale);
+
+    for (unsigned y = 0; y < height; ++y) {
+        uint16_t *dstp = (uint16_t *)((uint8_t *)dst + y * stride);
+        for (unsigned k = 0; k < num_srcs; ++k)
+            rows[k] = (const uint16_t *)((const uint8_t *)srcs[k] + y * stride);
+
+        for (unsigned x = 0; x < width; x += 16) {
+            __m256 acc0 = _mm256_setzero_ps();
+            __m256 acc1 = _mm256_setzero_ps();
+
+            for (unsigned k = 0; k < num_srcs; ++k) {
+                __m256 w = _mm256_set1_ps(params->fweights[k]);
+                acc0 = _mm256_fmadd_ps(_mm256_cvtph_ps(_mm_load_si128((const __m128i *)(rows[k] + x + 0))), w, acc0);
+                acc1 = _mm256_fmadd_ps(_mm256_cvtph_ps(_mm_load_si128((const __m128i *)(rows[k] + x + 8))), w, acc1);
+            }
+
+            __m128i r0 = _mm256_cvtps_ph(_mm256_mul_ps(acc0, rscale), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+            __m128i r1 = _mm256_cvtps_ph(_mm256_mul_ps(acc1, rscale), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+            _mm256_store_si256((__m256i *)(dstp + x), _mm256_setr_m128i(r0, r1));
+        }
+    }
+}
+
+/* Turn 8 running sums into output values, see vs_average_running_setup. */
+static __m256i finish_running(__m256i sum, const struct vs_average_running_consts *c)
+{
+    __m256 x = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_sub_epi32(sum, _mm256_set1_epi32(c->offset))), _mm256_set1_ps(c->weight));
+    x = _mm256_mul_ps(x, _mm256_set1_ps(c->rscale));
+    x = _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(c->lo)), _mm256_set1_ps(c->hi));
+    return _mm256_add_epi32(_mm256_cvtps_epi32(x), _mm256_set1_epi32(c->bias));
+}
+
+void vs_average_running_byte_avx2(const void * const *add, unsigned num_add, const void * const *sub, unsigned num_sub, void *acc, ptrdiff_t acc_stride, void *dst, ptrdiff_t stride, const struct vs_average_params *params, unsigned width, unsigned height)
+{
+    struct vs_average_running_consts c;
+    vs_average_running_setup(&c, params);
+
+    for (unsigned y = 0; y < height; ++y) {
+        int32_t *accp = (int32_t *)((uint8_t *)acc + y * acc_stride);
+        uint8_t *dstp = (uint8_t *)dst + y * stride;
+
+        for (unsigned x = 0; x < width; x += 32) {
+            __m256i sum[4];
+
+            // Sums of up to 31 bytes fit in 16 bits, so widen only once.
+            if (sub) {
+                __m256i sublo = _mm256_setzero_si256();
+                __m256i subhi = _mm256_setzero_si256();
+                for (unsigned k = 0; k < num_sub; ++k) {
+                    const uint8_t *subp = (const uint8_t *)sub[k] + y * stride + x;
+                    sublo = _mm256_add_epi16(sublo, _mm256_cvtepu8_epi16(_mm_load_si128((const __m128i *)(subp + 0))));
+                    subhi = _mm256_add_epi16(subhi, _mm256_cvtepu8_epi16(_mm_load_si128((const __m128i *)(subp + 16))));
+                }
+                sum[0] = _mm256_sub_epi32(_mm256_load_si256((const __m256i *)(accp + x + 0)), _mm256_cvtepu16_epi32(_mm256_castsi256_si128(sublo)));
+                sum[1] = _mm256_sub_epi32(_mm256_load_si256((const __m256i *)(accp + x + 8)), _mm256_cvtepu16_epi32(_mm256_extracti128_si256(sublo, 1)));
+                sum[2] = _mm256_sub_epi32(_mm256_load_si256((const __m256i *)(accp + x + 16)), _mm256_cvtepu16_epi32(_mm256_castsi256_si128(subhi)));
+                sum[3] = _mm256_sub_epi32(_mm256_load_si256((const __m256i *)(accp + x + 24)), _mm256_cvtepu16_epi32(_mm256_extracti128_si256(subhi, 1)));
+            } else {
+                for (unsigned i = 0; i < 4; ++i)
+                    sum[i] = _mm256_setzero_si256();
+            }
+
+            __m256i addlo = _mm256_setzero_si256();
+            __m256i addhi = _mm256_setzero_si256();
+            for (unsigned k = 0; k < num_add; ++k) {
+                const uint8_t *addp = (const uint8_t *)add[k] + y * stride + x;
+                addlo = _mm256_add_epi16(addlo, _mm256_cvtepu8_epi16(_mm_load_si128((const __m128i *)(addp + 0))));
+                addhi = _mm256_add_epi16(addhi, _mm256_cvtepu8_epi16(_mm_load_si128((const __m128i *)(addp + 16))));
+            }
+            sum[0] = _mm256_add_epi32(sum[0], _mm256_cvtepu16_epi32(_mm256_castsi256_si128(addlo)));
+            sum[1] = _mm256_add_epi32(sum[1], _mm256_cvtepu16_epi32(_mm256_extracti128_si256(addlo, 1)));
+            sum[2] = _mm256_add_epi32(sum[2], _mm256_cvtepu16_epi32(_mm256_castsi256_si128(addhi)));
+            sum[3] = _mm256_add_epi32(sum[3], _mm256_cvtepu16_epi32(_mm256_extracti128_si256(addhi, 1)));
+
+            for (unsigned i = 0; i < 4; ++i)
+                _mm256_store_si256((__m256i *)(accp + x + 8 * i), sum[i]);
+
+            // packs and packus interleave the 128 bit lanes, so the dwords end up as 0 2 4 6 1 3 5 7.
+            __m256i lo = _mm256_packs_epi32(finish_running(sum[0], &c), finish_running(sum[1], &c));
+            __m256i hi = _mm256_packs_epi32(finish_running(sum[2], &c), finish_running(sum[3], &c));
+            __m256i r = _mm256_permutevar8x32_epi32(_mm256_packus_epi16(lo, hi), _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+            _mm256_store_si256((__m256i *)(dstp + x), r);
+        }
+    }
+}
+
+void vs_average_running_word_avx2(const void * const *add, unsigned num_add, const void * const *sub, unsigned num_sub, void *acc, ptrdiff_t acc_stride, void *dst, ptrdiff_t stride, const struct vs_average_params *params, unsigned width, unsigned height)
+{
+    struct vs_average_running_consts c;
+    vs_average_running_setup(&c, params);
+
+    for (unsigned y = 0; y < height; ++y) {
+        int32_t *accp = (int32_t *)((uint8_t *)acc + y * acc_stride);
+        uint16_t *dstp = (uint16_t *)((uint8_t *)dst + y * stride);
+
+        for (unsigned x = 0; x < width; x += 16) {
+            __m256i sum0 = _mm256_setzero_si256();
+            __m256i sum1 = _mm256_setzero_si256();
+
+            if (sub) {
+                sum0 = _mm256_load_si256((const __m256i *)(accp + x + 0));
+                sum1 = _mm256_load_si256((const __m256i *)(accp + x + 8));
+                for (unsigned k = 0; k < num_sub; ++k) {
+                    const uint16_t *subp = (const uint16_t *)((const uint8_t *)sub[k] + y * stride) + x;
+                    sum0 = _mm256_sub_epi32(sum0, _mm256_cvtepu16_epi32(_mm_load_si128((const __m128i *)(subp + 0))));
+                    sum1 = _mm256_sub_epi32(sum1, _mm256_cvtepu16_epi32(_mm_load_si128((const __m128i *)(subp + 8))));
+                }
+            }
+
+            for (unsigned k = 0; k < num_add; ++k) {
+                const uint16_t *addp = (const uint16_t *)((const uint8_t *)add[k] + y * stride) + x;
+                sum0 = _mm256_add_epi32(sum0, _mm256_cvtepu16_epi32(_mm_load_si128((const __m128i *)(addp + 0))));
+                sum1 = _mm256_add_epi32(sum1, _mm256_cvtepu16_epi32(_mm_load_si128((const __m128i *)(addp + 8))));
+            }
+
+            _mm256_store_si256((__m256i *)(accp + x + 0), sum0);
+            _mm256_store_si256((__m256i *)(accp + x + 8), sum1);
+
+            __m256i r = _mm256_packus_epi32(finish_running(sum0, &c), finish_running(sum1, &c));
+            _mm256_store_si256((__m256i *)(dstp + x), _mm256_permute4x64_epi64(r, _MM_SHUFFLE(3, 1, 2, 0)));
+        }
+    }
+}
@@ -0,0 +1,170 @@
+/*
+* Copyright (c) 2016 Fredrik Mellbin & other contributors
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+/*
+ * AVX-512 (F+BW) AverageFrames kernels. Frames are 64 byte aligned when
+ * AVX-512 is available, so every kernel works on whole 64 byte rows of
+ * output. The byte kernel narrows with vpmovwb instead of packus + vpermq,
+ * the values are already clamped by then.
+ */
+
+#include <immintrin.h>
+#include "../average.h"
+#include "average_impl.h"
+
+/* Scale, clamp and round 16 accumulators, then add the bias back. */
+static __m512i finish_int(__m512i acc, const struct vs_average_int_consts *c)
+{
+    __m512 x = _mm512_mul_ps(_mm512_cvtepi32_ps(acc), _mm512_set1_ps(c->rscale));
+    x = _mm512_min_ps(_mm512_max_ps(x, _mm512_set1_ps(c->lo)), _mm512_set1_ps(c->hi));
+    return _mm512_add_epi32(_mm512_cvtps_epi32(x), _mm512_set1_epi32(c->bias));
+}
+
+void vs_average_byte_avx512(const void * const *srcs, void *dst, ptrdiff_t stride, const struct vs_average_params *params, unsigned width, unsigned height)
+{
+    struct vs_average_int_consts c;
+    const uint8_t *rows[VS_AVERAGE_MAX_SRCS + 1];
+    unsigned npairs = vs_average_int_setup(&c, srcs, params, 0);
+
+    for (unsigned y = 0; y < height; ++y) {
+        uint8_t *dstp = (uint8_t *)dst + y * stride;
+        for (unsigned k = 0; k < npairs * 2; ++k)
+            rows[k] = (const uint8_t *)c.srcs[k] + y * stride;
+
+        for (unsigned x = 0; x < width; x += 64) {
+            __m512i acc0 = _mm512_set1_epi32(c.offset);
+            __m512i acc1 = acc0;
+            __m512i acc2 = acc0;
+            __m512i acc3 = acc0;
+
+            for (unsigned k = 0; k < npairs; ++k) {
+                __m512i w = _mm512_set1_epi32(c.wpairs[k]);
+                __m512i alo = _mm512_cvtepu8_epi16(_mm256_load_si256((const __m256i *)(rows[2 * k + 0] + x + 0)));
+                __m512i ahi = _mm512_cvtepu8_epi16(_mm256_load_si256((const __m256i *)(rows[2 * k + 0] + x + 32)));
+                __m512i blo = _mm512_cvtepu8_epi16(_mm256_load_si256((const __m256i *)(rows[2 * k + 1] + x + 0)));
+                __m512i bhi = _mm512_cvtepu8_epi16(_mm256_load_si256((const __m256i *)(rows[2 * k + 1] + x + 32)));
+
+                acc0 = _mm512_add_epi32(acc0, _mm512_madd_epi16(_mm512_unpacklo_epi16(alo, blo), w));
+                acc1 = _mm512_add_epi32(acc1, _mm512_madd_epi16(_mm512_unpackhi_epi16(alo, blo), w));
+                acc2 = _mm512_add_epi32(acc2, _mm512_madd_epi16(_mm512_unpacklo_epi16(ahi, bhi), w));
+                acc3 = _mm512_add_epi32(acc3, _mm512_madd_epi16(_mm512_unpackhi_epi16(ahi, bhi), w));
+            }
+
+            __m512i lo = _mm512_packs_epi32(finish_int(acc0, &c), finish_int(acc1, &c));
+            __m512i hi = _mm512_packs_epi32(finish_int(acc2, &c), finish_int(acc3, &c));
+            _mm256_store_si256((__m256i *)(dstp + x + 0), _mm512_cvtepi16_epi8(lo));
+            _mm256_store_si256((__m256i *)(dstp + x + 32), _mm512_cvtepi16_epi8(hi));
+        }
+    }
+}
+
+void vs_average_word_avx512(const void * const *srcs, void *dst, ptrdiff_t stride, const struct vs_average_params *params, unsigned width, unsigned height)
+{
+    struct vs_average_int_consts c;
+    const uint16_t *rows[VS_AVERAGE_MAX_SRCS + 1];
+    unsigned npairs = vs_average_int_setup(&c, srcs, params, 1);
+    const __m512i sign = _mm512_set1_epi16(INT16_MIN);
+
+    for (unsigned y = 0; y < height; ++y) {
+        uint16_t *dstp = (uint16_t *)((uint8_t *)dst + y * stride);
+        for (unsigned k = 0; k < npairs * 2; ++k)
+            rows[k] = (const uint16_t *)((const uint8_t *)c.srcs[k] + y * stride);
+
+        for (unsigned x = 0; x < width; x += 32) {
+            __m512i acc0 = _mm512_set1_epi32(c.offset);
+            __m512i acc1 = acc0;
+
+            for (unsigned k = 0; k < npairs; ++k) {
+                __m512i w = _mm512_set1_epi32(c.wpairs[k]);
+                __m512i a = _mm512_xor_si512(_mm512_load_si512(rows[2 * k + 0] + x), sign);
+                __m512i b = _mm512_xor_si512(_mm512_load_si512(rows[2 * k + 1] + x), sign);
+
+                acc0 = _mm512_add_epi32(acc0, _mm512_madd_epi16(_mm512_unpacklo_epi16(a, b), w));
+                acc1 = _mm512_add_epi32(acc1, _mm512_madd_epi16(_mm512_unpackhi_epi16(a, b), w));
+            }
+
+            _mm512_store_si512(dstp + x, _mm512_packus_epi32(finish_int(acc0, &c), finish_int(acc1, &c)));
+        }
+    }
+}
+
+void vs_average_float_avx512(const void * const *srcs, void *dst, ptrdiff_t stride, const struct vs_average_params *params, unsigned width, unsigned height)
+{
+    const float *rows[VS_AVERAGE_MAX_SRCS];
+    unsigned num_srcs = params->num_srcs;
+    __m512 rscale = _mm512_set1_ps(params->rscale);
+
+    for (unsigned y = 0; y < height; ++y) {
+        float *dstp = (float *)((uint8_t *)dst + y * stride);
+        for (unsigned k = 0; k < num_srcs; ++k)
+            rows[k] = (const float *)((const uint8_t *)srcs[k] + y * stride);
+
+        unsigned x;
+        for (x = 0; x + 16 < width; x += 32) {
+            __m512 acc0 = _mm512_setzero_ps();
+            __m512 acc1 = _mm512_setzero_ps();
+
+            for (unsigned k = 0; k < num_srcs; ++k) {
+                __m512 w = _mm512_set1_ps(params->fweights[k]);
+                acc0 = _mm512_fmadd_ps(_mm512_load_ps(rows[k] + x + 0), w, acc0);
+                acc1 = _mm512_fmadd_ps(_mm512_load_ps(rows[k] + x + 16), w, acc1);
+            }
+
+            _mm512_store_ps(dstp + x + 0, _mm512_mul_ps(acc0, rscale));
+            _mm512_store_ps(dstp + x + 16, _mm512_mul_ps(acc1, rscale));
+        }
+        if (x < width) {
+            __m512 acc = _mm512_setzero_ps();
+
+            for (unsigned k = 0; k < num_srcs; ++k)
+                acc = _mm512_fmadd_ps(_mm512_load_ps(rows[k] + x), _mm512_set1_ps(params->fweights[k]), acc);
+
+            _mm512_store_ps(dstp + x, _mm512_mul_ps(acc, rscale));
+        }
+    }
+}
+
+void vs_average_half_avx512(const void * const *srcs, void *dst, ptrdiff_t stride, const struct vs_average_params *params, unsigned width, unsigned height)
+{
+    const uint16_t *rows[VS_AVERAGE_MAX_SRCS];
+    unsigned num_srcs = params->num_srcs;
+    __m512 rscale = _mm512_set1_ps(params->rscale);
+
+    for (unsigned y = 0; y < height; ++y) {
+        uint16_t *dstp = (uint16_t *)((uint8_t *)dst + y * stride);
+        for (unsigned k = 0; k < num_srcs; ++k)
+            rows[k] = (const uint16_t *)((const uint8_t *)srcs[k] + y * stride);
+
+        for (unsigned x = 0; x < width; x += 32) {
+            __m512 acc0 = _mm512_setzero_ps();
+            __m512 acc1 = _mm512_setzero_ps();
+
+            for (unsigned k = 0; k < num_srcs; ++k) {
+                __m512 w = _mm512_set1_ps(params->fweights[k]);
+                acc0 = _mm512_fmadd_ps(_mm512_cvtph_ps(_mm256_load_si256((const __m256i *)(rows[k] + x + 0))), w, acc0);
+                acc1 = _mm512_fmadd_ps(_mm512_cvtph_ps(_mm256_load_si256((const __m256i *)(rows[k] + x + 16))), w, acc1);
+            }
+
+            __m256i r0 = _mm512_cvtps_ph(_mm512_mul_ps(acc0, rscale), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+            __m256i r1 = _mm512_cvtps_ph(_mm512_mul_ps(acc1, rscale), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+            _mm512_store_si512(dstp + x, _mm512_inserti64x4(_mm512_castsi256_si512(r0), r1, 1));
+        }
+    }
+}
@@ -0,0 +1,110 @@
+/*
+* Copyright (c) 2016 Fredrik Mellbin & other contributors
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+/*
+* Setup shared by the integer AverageFrames kernels.
+*
+* Sources are processed in pairs with pmaddwd, so samples have to fit in int16.
+* Bytes are used as is, words are biased by -0x8000 (an xor of the sign bit).
+* The bias and the chroma offset are then folded into one constant that starts
+* the accumulator:
+*
+*   sum((src - bias) * w) = sum((src - pixel_offset) * w) + (pixel_offset - bias) * sum(w)
+*
+* With |w| <= 1023 and at most 31 sources every partial sum fits in int32, the
+* same as in the C reference. An odd source is paired with itself and weight 0.
+*
+* Clamping to [0, maxval] is done before rounding, on the float value. The
+* bounds are integers, so this gives the same result as rounding first and
+* avoids unsigned min/max and packus_epi32, which SSE2 doesn't have.
+*
+* The integer kernels are bit-exact with the C reference (kernel/average.cpp).
+* The float and half kernels aren't across tiers: AVX2 and AVX-512 accumulate
+* with FMA, SSE2 and the C reference with a separate multiply and add.
+*/
+
+#ifndef AVERAGE_IMPL_H
+#define AVERAGE_IMPL_H
+
+#include <stdint.h>
+#include "../average.h"
+
+struct vs_average_int_consts {
+    const void *srcs[VS_AVERAGE_MAX_SRCS + 1];
+    int32_t wpairs[(VS_AVERAGE_MAX_SRCS + 1) / 2];
+    int32_t offset;
+    int32_t bias;
+    float rscale;
+    float lo;
+    float hi;
+};
+
+static inline unsigned vs_average_int_setup(struct vs_average_int_consts *c, const void * const *srcs, const struct vs_average_params *params, int word)
+{
+    unsigned num_srcs = params->num_srcs;
+    unsigned npairs = (num_srcs + 1) / 2;
+    int32_t pixel_offset = word ? 0x8000 : 0;
+    int32_t sumw = 0;
+
+    for (unsigned k = 0; k < npairs; ++k) {
+        unsigned k0 = 2 * k;
+        unsigned k1 = k0 + 1 < num_srcs ? k0 + 1 : k0;
+        int w0 = params->weights[k0];
+        int w1 = k1 != k0 ? params->weights[k1] : 0;
+
+        c->srcs[k0] = srcs[k0];
+        c->srcs[k0 + 1] = srcs[k1];
+        c->wpairs[k] = (int32_t)(((uint32_t)(uint16_t)w1 << 16) | (uint16_t)w0);
+        sumw += w0 + w1;
+    }
+
+    c->offset = (pixel_offset - params->bias) * sumw;
+    c->bias = params->bias;
+    c->rscale = params->rscale;
+    c->lo = (float)-params->bias;
+    c->hi = (float)(params->maxval - params->bias);
+    return npairs;
+}
+
+/*
+* The running sum kernels convert (sum - num_srcs * bias) to float and multiply by
+* the weight in float. Both factors are exact in float (|sum| < 2^24), so this
+* rounds the same as converting the int32 product like the C reference does.
+*/
+struct vs_average_running_consts {
+    int32_t offset;
+    int32_t bias;
+    float weight;
+    float rscale;
+    float lo;
+    float hi;
+};
+
+static inline void vs_average_running_setup(struct vs_average_running_consts *c, const struct vs_average_params *params)
+{
+    c->offset = (int32_t)params->num_srcs * params->bias;
+    c->bias = params->bias;
+    c->weight = (float)params->weights[0];
+    c->rscale = params->rscale;
+    c->lo = (float)-params->bias;
+    c->hi = (float)(params->maxval - params->bias);
+}
+
+#endif // AVERAGE_IMPL_H
@@ -0,0 +1,232 @@
+/*
+* Copyright (c) 2016 Fredrik Mellbin & other contributors
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <emmintrin.h>
+#include "../average.h"
+#include "average_impl.h"
+
+/* Scale, clamp and round 4 accumulators, then add the bias back. */
+static __m128i finish_int(__m128i acc, const struct vs_average_int_consts *c)
+{
+    __m128 x = _mm_mul_ps(_mm_cvtepi32_ps(acc), _mm_set1_ps(c->rscale));
+    x = _mm_min_ps(_mm_max_ps(x, _mm_set1_ps(c->lo)), _mm_set1_ps(c->hi));
+    return _mm_add_epi32(_mm_cvtps_epi32(x), _mm_set1_epi32(c->bias));
+}
+
+void vs_average_byte_sse2(const void * const *srcs, void *dst, ptrdiff_t stride, const struct vs_average_params *params, unsigned width, unsigned height)
+{
+    struct vs_average_int_consts c;
+    const uint8_t *rows[VS_AVERAGE_MAX_SRCS + 1];
+    unsigned npairs = vs_average_int_setup(&c, srcs, params, 0);
+
+    for (unsigned y = 0; y < height; ++y) {
+        uint8_t *dstp = (uint8_t *)dst + y * stride;
+        for (unsigned k = 0; k < npairs * 2; ++k)
+            rows[k] = (const uint8_t *)c.srcs[k] + y * stride;
+
+        for (unsigned x = 0; x < width; x += 16) {
+            __m128i acc0 = _mm_set1_epi32(c.offset);
+            __m128i acc1 = acc0;
+            __m128i acc2 = acc0;
+            __m128i acc3 = acc0;
+
+            for (unsigned k = 0; k < npairs; ++k) {
+                __m128i w = _mm_set1_epi32(c.wpairs[k]);
+                __m128i a = _mm_load_si128((const __m128i *)(rows[2 * k + 0] + x));
+                __m128i b = _mm_load_si128((const __m128i *)(rows[2 * k + 1] + x));
+                __m128i alo = _mm_unpacklo_epi8(a, _mm_setzero_si128());
+                __m128i ahi = _mm_unpackhi_epi8(a, _mm_setzero_si128());
+                __m128i blo = _mm_unpacklo_epi8(b, _mm_setzero_si128());
+                __m128i bhi = _mm_unpackhi_epi8(b, _mm_setzero_si128());
+
+                acc0 = _mm_add_epi32(acc0, _mm_madd_epi16(_mm_unpacklo_epi16(alo, blo), w));
+                acc1 = _mm_add_epi32(acc1, _mm_madd_epi16(_mm_unpackhi_epi16(alo, blo), w));
+                acc2 = _mm_add_epi32(acc2, _mm_madd_epi16(_mm_unpacklo_epi16(ahi, bhi), w));
+                acc3 = _mm_add_epi32(acc3, _mm_madd_epi16(_mm_unpackhi_epi16(ahi, bhi), w));
+            }
+
+            __m128i lo = _mm_packs_epi32(finish_int(acc0, &c), finish_int(acc1, &c));
+            __m128i hi = _mm_packs_epi32(finish_int(acc2, &c), finish_int(acc3, &c));
+            _mm_store_si128((__m128i *)(dstp + x), _mm_packus_epi16(lo, hi));
+        }
+    }
+}
+
+void vs_average_word_sse2(const void * const *srcs, void *dst, ptrdiff_t stride, const struct vs_average_params *params, unsigned width, unsigned height)
+{
+    struct vs_average_int_consts c;
+    const uint16_t *rows[VS_AVERAGE_MAX_SRCS + 1];
+    unsigned npairs = vs_average_int_setup(&c, srcs, params, 1);
+    const __m128i sign = _mm_set1_epi16(INT16_MIN);
+
+    for (unsigned y = 0; y < height; ++y) {
+        uint16_t *dstp = (uint16_t *)((uint8_t *)dst + y * stride);
+        for (unsigned k = 0; k < npairs * 2; ++k)
+            rows[k] = (const uint16_t *)((const uint8_t *)c.srcs[k] + y * stride);
+
+        for (unsigned x = 0; x < width; x += 8) {
+            __m128i acc0 = _mm_set1_epi32(c.offset);
+            __m128i acc1 = acc0;
+
+            for (unsigned k = 0; k < npairs; ++k) {
+                __m128i w = _mm_set1_epi32(c.wpairs[k]);
+                __m128i a = _mm_xor_si128(_mm_load_si128((const __m128i *)(rows[2 * k + 0] + x)), sign);
+                __m128i b = _mm_xor_si128(_mm_load_si128((const __m128i *)(rows[2 * k + 1] + x)), sign);
+
+                acc0 = _mm_add_epi32(acc0, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), w));
+                acc1 = _mm_add_epi32(acc1, _mm_madd_epi16(_mm_unpackhi_epi16(a, b), w));
+            }
+
+            // No packus_epi32 in SSE2, pack as signed around 0x8000 instead.
+            __m128i offset = _mm_set1_epi32(0x8000);
+            __m128i r = _mm_packs_epi32(_mm_sub_epi32(finish_int(acc0, &c), offset), _mm_sub_epi32(finish_int(acc1, &c), offset));
+            _mm_store_si128((__m128i *)(dstp + x), _mm_xor_si128(r, sign));
+        }
+    }
+}
+
+void vs_average_float_sse2(const void * const *srcs, void *dst, ptrdiff_t stride, const struct vs_average_params *params, unsigned width, unsigned height)
+{
+    const float *rows[VS_AVERAGE_MAX_SRCS];
+    unsigned num_srcs = params->num_srcs;
+    __m128 rscale = _mm_set1_ps(params->rscale);
+
+    for (unsigned y = 0; y < height; ++y) {
+        float *dstp = (float *)((uint8_t *)dst + y * stride);
+        for (unsigned k = 0; k < num_srcs; ++k)
+            rows[k] = (const float *)((const uint8_t *)srcs[k] + y * stride);
+
+        for (unsigned x = 0; x < width; x += 8) {
+            __m128 acc0 = _mm_setzero_ps();
+            __m128 acc1 = _mm_setzero_ps();
+
+            for (unsigned k = 0; k < num_srcs; ++k) {
+                __m128 w = _mm_set1_ps(params->fweights[k]);
+                acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_load_ps(rows[k] + x + 0), w));
+                acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_load_ps(rows[k] + x + 4), w));
+            }
+
+            _mm_store_ps(dstp + x + 0, _mm_mul_ps(acc0, rscale));
+            _mm_store_ps(dstp + x + 4, _mm_mul_ps(acc1, rscale));
+        }
+    }
+}
+
+/* Turn 4 running sums into output values, see vs_average_running_setup. */
+static __m128i finish_running(__m128i sum, const struct vs_average_running_consts *c)
+{
+    __m128 x = _mm_mul_ps(_mm_cvtepi32_ps(_mm_sub_epi32(sum, _mm_set1_epi32(c->offset))), _mm_set1_ps(c->weight));
+    x = _mm_mul_ps(x, _mm_set1_ps(c->rscale));
+    x = _mm_min_ps(_mm_max_ps(x, _mm_set1_ps(c->lo)), _mm_set1_ps(c->hi));
+    return _mm_add_epi32(_mm_cvtps_epi32(x), _mm_set1_epi32(c->bias));
+}
+
+void vs_average_running_byte_sse2(const void * const *add, unsigned num_add, const void * const *sub, unsigned num_sub, void *acc, ptrdiff_t acc_stride, void *dst, ptrdiff_t stride, const struct vs_average_params *params, unsigned width, unsigned height)
+{
+    struct vs_average_running_consts c;
+    vs_average_running_setup(&c, params);
+    const __m128i zero = _mm_setzero_si128();
+
+    for (unsigned y = 0; y < height; ++y) {
+        int32_t *accp = (int32_t *)((uint8_t *)acc + y * acc_stride);
+        uint8_t *dstp = (uint8_t *)dst + y * stride;
+
+        for (unsigned x = 0; x < width; x += 16) {
+            __m128i sum[4];
+
+            // Sums of up to 31 bytes fit in 16 bits, so widen only once.
+            if (sub) {
+                __m128i sublo = zero;
+                __m128i subhi = zero;
+                for (unsigned k = 0; k < num_sub; ++k) {
+                    __m128i v = _mm_load_si128((const __m128i *)((const uint8_t *)sub[k] + y * stride + x));
+                    sublo = _mm_add_epi16(sublo, _mm_unpacklo_epi8(v, zero));
+                    subhi = _mm_add_epi16(subhi, _mm_unpackhi_epi8(v, zero));
+                }
+                sum[0] = _mm_sub_epi32(_mm_load_si128((const __m128i *)(accp + x + 0)), _mm_unpacklo_epi16(sublo, zero));
+                sum[1] = _mm_sub_epi32(_mm_load_si128((const __m128i *)(accp + x + 4)), _mm_unpackhi_epi16(sublo, zero));
+                sum[2] = _mm_sub_epi32(_mm_load_si128((const __m128i *)(accp + x + 8)), _mm_unpacklo_epi16(subhi, zero));
+                sum[3] = _mm_sub_epi32(_mm_load_si128((const __m128i *)(accp + x + 12)), _mm_unpackhi_epi16(subhi, zero));
+            } else {
+                sum[0] = sum[1] = sum[2] = sum[3] = zero;
+            }
+
+            __m128i addlo = zero;
+            __m128i addhi = zero;
+            for (unsigned k = 0; k < num_add; ++k) {
+                __m128i v = _mm_load_si128((const __m128i *)((const uint8_t *)add[k] + y * stride + x));
+                addlo = _mm_add_epi16(addlo, _mm_unpacklo_epi8(v, zero));
+                addhi = _mm_add_epi16(addhi, _mm_unpackhi_epi8(v, zero));
+            }
+            sum[0] = _mm_add_epi32(sum[0], _mm_unpacklo_epi16(addlo, zero));
+            sum[1] = _mm_add_epi32(sum[1], _mm_unpackhi_epi16(addlo, zero));
+            sum[2] = _mm_add_epi32(sum[2], _mm_unpacklo_epi16(addhi, zero));
+            sum[3] = _mm_add_epi32(sum[3], _mm_unpackhi_epi16(addhi, zero));
+
+            for (unsigned i = 0; i < 4; ++i)
+                _mm_store_si128((__m128i *)(accp + x + 4 * i), sum[i]);
+
+            __m128i lo = _mm_packs_epi32(finish_running(sum[0], &c), finish_running(sum[1], &c));
+            __m128i hi = _mm_packs_epi32(finish_running(sum[2], &c), finish_running(sum[3], &c));
+            _mm_store_si128((__m128i *)(dstp + x), _mm_packus_epi16(lo, hi));
+        }
+    }
+}
+
+void vs_average_running_word_sse2(const void * const *add, unsigned num_add, const void * const *sub, unsigned num_sub, void *acc, ptrdiff_t acc_stride, void *dst, ptrdiff_t stride, const struct vs_average_params *params, unsigned width, unsigned height)
+{
+    struct vs_average_running_consts c;
+    vs_average_running_setup(&c, params);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i sign = _mm_set1_epi16(INT16_MIN);
+
+    for (unsigned y = 0; y < height; ++y) {
+        int32_t *accp = (int32_t *)((uint8_t *)acc + y * acc_stride);
+        uint16_t *dstp = (uint16_t *)((uint8_t *)dst + y * stride);
+
+        for (unsigned x = 0; x < width; x += 8) {
+            __m128i sum0 = zero;
+            __m128i sum1 = zero;
+
+            if (sub) {
+                sum0 = _mm_load_si128((const __m128i *)(accp + x + 0));
+                sum1 = _mm_load_si128((const __m128i *)(accp + x + 4));
+                for (unsigned k = 0; k < num_sub; ++k) {
+                    __m128i v = _mm_load_si128((const __m128i *)((const uint16_t *)((const uint8_t *)sub[k] + y * stride) + x));
+                    sum0 = _mm_sub_epi32(sum0, _mm_unpacklo_epi16(v, zero));
+                    sum1 = _mm_sub_epi32(sum1, _mm_unpackhi_epi16(v, zero));
+                }
+            }
+
+            for (unsigned k = 0; k < num_add; ++k) {
+                __m128i v = _mm_load_si128((const __m128i *)((const uint16_t *)((const uint8_t *)add[k] + y * stride) + x));
+                sum0 = _mm_add_epi32(sum0, _mm_unpacklo_epi16(v, zero));
+                sum1 = _mm_add_epi32(sum1, _mm_unpackhi_epi16(v, zero));
+            }
+
+            _mm_store_si128((__m128i *)(accp + x + 0), sum0);
+            _mm_store_si128((__m128i *)(accp + x + 4), sum1);
+
+            __m128i offset = _mm_set1_epi32(0x8000);
+            __m128i r = _mm_packs_epi32(_mm_sub_epi32(finish_running(sum0, &c), offset), _mm_sub_epi32(finish_running(sum1, &c), offset));
+            _mm_store_si128((__m128i *)(dstp + x), _mm_xor_si128(r, sign));
+        }
+    }
+}
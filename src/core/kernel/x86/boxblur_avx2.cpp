@@ -0,0 +1,189 @@
+/*
+* Copyright (c) 2017-2020 Fredrik Mellbin & other contributors
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <immintrin.h>
+#include "../boxblur.h"
+
+/* Unsigned multiply-high division of 8 accumulators, see fastDivU32 in boxblurfilter.cpp. */
+static inline __m256i divide(__m256i n, const struct vs_boxblur_params *params)
+{
+    __m256i magic = _mm256_set1_epi32(params->div_magic);
+    __m256i even = _mm256_srli_epi64(_mm256_mul_epu32(n, magic), 32);
+    __m256i odd = _mm256_mul_epu32(_mm256_srli_epi64(n, 32), magic);
+    __m256i q = _mm256_blend_epi32(even, odd, 0xAA);
+
+    if (params->div_add)
+        q = _mm256_add_epi32(_mm256_srli_epi32(_mm256_sub_epi32(n, q), 1), q);
+    return _mm256_srl_epi32(q, _mm_cvtsi32_si128(params->div_shift));
+}
+
+static inline const uint8_t *row(const void *src, ptrdiff_t stride, int y)
+{
+    return (const uint8_t *)src + y * stride;
+}
+
+static inline int clamp_row(int y, int h)
+{
+    return y < 0 ? 0 : y >= h ? h - 1 : y;
+}
+
+/* Loads 8 samples widened to 32 bits. */
+static inline __m256i load8(const void *p, int word)
+{
+    return word ? _mm256_cvtepu16_epi32(_mm_load_si128((const __m128i *)p)) : _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)p));
+}
+
+/* Sets every accumulator to radius * first row + rows 0 to radius - 1. */
+static void init_int(const void *src, ptrdiff_t src_stride, uint32_t *acc, unsigned width, int radius, int h, int word)
+{
+    const uint8_t *first = row(src, src_stride, 0);
+    __m256i r = _mm256_set1_epi32(radius);
+    for (unsigned x = 0; x < width; x += 8)
+        _mm256_store_si256((__m256i *)(acc + x), _mm256_mullo_epi32(load8(first + (x << word), word), r));
+
+    for (int i = 0; i < radius; ++i) {
+        const uint8_t *s = row(src, src_stride, clamp_row(i, h));
+        for (unsigned x = 0; x < width; x += 8)
+            _mm256_store_si256((__m256i *)(acc + x), _mm256_add_epi32(_mm256_load_si256((const __m256i *)(acc + x)), load8(s + (x << word), word)));
+    }
+}
+
+/* Adds 8 samples to their accumulators, divides and subtracts the leaving samples. */
+static inline __m256i step8(__m256i add, __m256i sub, uint32_t *acc, __m256i round, const struct vs_boxblur_params *params)
+{
+    __m256i a = _mm256_add_epi32(_mm256_load_si256((const __m256i *)acc), add);
+    _mm256_store_si256((__m256i *)acc, _mm256_sub_epi32(a, sub));
+    return divide(_mm256_add_epi32(a, round), params);
+}
+
+void vs_boxblur_v_byte_avx2(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, void *acc_, const struct vs_boxblur_params *params, unsigned width, unsigned height)
+{
+    uint32_t *acc = (uint32_t *)acc_;
+    int radius = (int)params->radius;
+    int h = (int)height;
+    __m256i round = _mm256_set1_epi32(params->round);
+
+    width = (width + 31) & ~31U;
+    init_int(src, src_stride, acc, width, radius, h, 0);
+
+    for (int y = 0; y < h; ++y) {
+        const uint8_t *addp = row(src, src_stride, clamp_row(y + radius, h));
+        const uint8_t *subp = row(src, src_stride, clamp_row(y - radius, h));
+        uint8_t *dstp = (uint8_t *)dst + y * dst_stride;
+
+        for (unsigned x = 0; x < width; x += 32) {
+            __m256i q[4];
+
+            for (unsigned i = 0; i < 4; ++i)
+                q[i] = step8(load8(addp + x + 8 * i, 0), load8(subp + x + 8 * i, 0), acc + x + 8 * i, round, params);
+
+            // packs and packus interleave the 128 bit lanes, so the dwords end up as 0 2 4 6 1 3 5 7.
+            __m256i r = _mm256_packus_epi16(_mm256_packs_epi32(q[0], q[1]), _mm256_packs_epi32(q[2], q[3]));
+            _mm256_store_si256((__m256i *)(dstp + x), _mm256_permutevar8x32_epi32(r, _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7)));
+        }
+    }
+}
+
+void vs_boxblur_v_word_avx2(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, void *acc_, const struct vs_boxblur_params *params, unsigned width, unsigned height)
+{
+    uint32_t *acc = (uint32_t *)acc_;
+    int radius = (int)params->radius;
+    int h = (int)height;
+    __m256i round = _mm256_set1_epi32(params->round);
+
+    width = (width + 15) & ~15U;
+    init_int(src, src_stride, acc, width, radius, h, 1);
+
+    for (int y = 0; y < h; ++y) {
+        const uint16_t *addp = (const uint16_t *)row(src, src_stride, clamp_row(y + radius, h));
+        const uint16_t *subp = (const uint16_t *)row(src, src_stride, clamp_row(y - radius, h));
+        uint16_t *dstp = (uint16_t *)((uint8_t *)dst + y * dst_stride);
+
+        for (unsigned x = 0; x < width; x += 16) {
+            __m256i q0 = step8(load8(addp + x + 0, 1), load8(subp + x + 0, 1), acc + x + 0, round, params);
+            __m256i q1 = step8(load8(addp + x + 8, 1), load8(subp + x + 8, 1), acc + x + 8, round, params);
+
+            __m256i r = _mm256_packus_epi32(q0, q1);
+            _mm256_store_si256((__m256i *)(dstp + x), _mm256_permute4x64_epi64(r, _MM_SHUFFLE(3, 1, 2, 0)));
+        }
+    }
+}
+
+void vs_boxblur_v_float_avx2(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, void *acc_, const struct vs_boxblur_params *params, unsigned width, unsigned height)
+{
+    float *acc = (float *)acc_;
+    int radius = (int)params->radius;
+    int h = (int)height;
+    __m256 div = _mm256_set1_ps(params->div);
+
+    width = (width + 7) & ~7U;
+
+    const float *first = (const float *)row(src, src_stride, 0);
+    for (unsigned x = 0; x < width; x += 8)
+        _mm256_store_ps(acc + x, _mm256_mul_ps(_mm256_set1_ps((float)radius), _mm256_load_ps(first + x)));
+    for (int i = 0; i < radius; ++i) {
+        const float *s = (const float *)row(src, src_stride, clamp_row(i, h));
+        for (unsigned x = 0; x < width; x += 8)
+            _mm256_store_ps(acc + x, _mm256_add_ps(_mm256_load_ps(acc + x), _mm256_load_ps(s + x)));
+    }
+
+    for (int y = 0; y < h; ++y) {
+        const float *addp = (const float *)row(src, src_stride, clamp_row(y + radius, h));
+        const float *subp = (const float *)row(src, src_stride, clamp_row(y - radius, h));
+        float *dstp = (float *)((uint8_t *)dst + y * dst_stride);
+
+        for (unsigned x = 0; x < width; x += 8) {
+            __m256 a = _mm256_add_ps(_mm256_load_ps(acc + x), _mm256_load_ps(addp + x));
+            _mm256_store_ps(dstp + x, _mm256_mul_ps(a, div));
+            _mm256_store_ps(acc + x, _mm256_sub_ps(a, _mm256_load_ps(subp + x)));
+        }
+    }
+}
+
+void vs_boxblur_v_half_avx2(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, void *acc_, const struct vs_boxblur_params *params, unsigned width, unsigned height)
+{
+    float *acc = (float *)acc_;
+    int radius = (int)params->radius;
+    int h = (int)height;
+    __m256 div = _mm256_set1_ps(params->div);
+
+    width = (width + 7) & ~7U;
+
+    const uint16_t *first = (const uint16_t *)row(src, src_stride, 0);
+    for (unsigned x = 0; x < width; x += 8)
+        _mm256_store_ps(acc + x, _mm256_mul_ps(_mm256_set1_ps((float)radius), _mm256_cvtph_ps(_mm_load_si128((const __m128i *)(first + x)))));
+    for (int i = 0; i < radius; ++i) {
+        const uint16_t *s = (const uint16_t *)row(src, src_stride, clamp_row(i, h));
+        for (unsigned x = 0; x < width; x += 8)
+            _mm256_store_ps(acc + x, _mm256_add_ps(_mm256_load_ps(acc + x), _mm256_cvtph_ps(_mm_load_si128((const __m128i *)(s + x)))));
+    }
+
+    for (int y = 0; y < h; ++y) {
+        const uint16_t *addp = (const uint16_t *)row(src, src_stride, clamp_row(y + radius, h));
+        const uint16_t *subp = (const uint16_t *)row(src, src_stride, clamp_row(y - radius, h));
+        uint16_t *dstp = (uint16_t *)((uint8_t *)dst + y * dst_stride);
+
+        for (unsigned x = 0; x < width; x += 8) {
+            __m256 a = _mm256_add_ps(_mm256_load_ps(acc + x), _mm256_cvtph_ps(_mm_load_si128((const __m128i *)(addp + x))));
+            _mm_store_si128((__m128i *)(dstp + x), _mm256_cvtps_ph(_mm256_mul_ps(a, div), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+            _mm256_store_ps(acc + x, _mm256_sub_ps(a, _mm256_cvtph_ps(_mm_load_si128((const __m128i *)(subp + x)))));
+        }
+    }
+}
@@ -0,0 +1,166 @@
+/*
+* Copyright (c) 2017-2020 Fredrik Mellbin & other contributors
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <emmintrin.h>
+#include "../boxblur.h"
+
+/* Unsigned multiply-high division of 4 accumulators, see fastDivU32 in boxblurfilter.cpp. */
+static inline __m128i divide(__m128i n, const struct vs_boxblur_params *params)
+{
+    __m128i magic = _mm_set1_epi32(params->div_magic);
+    __m128i even = _mm_srli_epi64(_mm_mul_epu32(n, magic), 32);
+    __m128i odd = _mm_and_si128(_mm_mul_epu32(_mm_srli_epi64(n, 32), magic), _mm_set_epi32(-1, 0, -1, 0));
+    __m128i q = _mm_or_si128(even, odd);
+
+    if (params->div_add)
+        q = _mm_add_epi32(_mm_srli_epi32(_mm_sub_epi32(n, q), 1), q);
+    return _mm_srl_epi32(q, _mm_cvtsi32_si128(params->div_shift));
+}
+
+static inline const uint8_t *row(const void *src, ptrdiff_t stride, int y)
+{
+    return (const uint8_t *)src + y * stride;
+}
+
+static inline int clamp_row(int y, int h)
+{
+    return y < 0 ? 0 : y >= h ? h - 1 : y;
+}
+
+/* Sets every accumulator to radius * first row + rows 0 to radius - 1. */
+static void init_int(const void *src, ptrdiff_t src_stride, uint32_t *acc, unsigned width, int radius, int h, int word)
+{
+    const uint8_t *first = row(src, src_stride, 0);
+    for (unsigned x = 0; x < width; ++x)
+        acc[x] = radius * (word ? ((const uint16_t *)first)[x] : first[x]);
+
+    for (int i = 0; i < radius; ++i) {
+        const uint8_t *s = row(src, src_stride, clamp_row(i, h));
+
+        for (unsigned x = 0; x < width; x += 8) {
+            __m128i v = word ? _mm_load_si128((const __m128i *)(s + x * 2)) : _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(s + x)), _mm_setzero_si128());
+            __m128i lo = _mm_unpacklo_epi16(v, _mm_setzero_si128());
+            __m128i hi = _mm_unpackhi_epi16(v, _mm_setzero_si128());
+            _mm_store_si128((__m128i *)(acc + x + 0), _mm_add_epi32(_mm_load_si128((const __m128i *)(acc + x + 0)), lo));
+            _mm_store_si128((__m128i *)(acc + x + 4), _mm_add_epi32(_mm_load_si128((const __m128i *)(acc + x + 4)), hi));
+        }
+    }
+}
+
+/* Adds 8 samples to their accumulators, divides and subtracts the leaving samples. */
+static inline void step8(__m128i add, __m128i sub, uint32_t *acc, __m128i round, const struct vs_boxblur_params *params, __m128i *q0, __m128i *q1)
+{
+    __m128i a0 = _mm_add_epi32(_mm_load_si128((const __m128i *)(acc + 0)), _mm_unpacklo_epi16(add, _mm_setzero_si128()));
+    __m128i a1 = _mm_add_epi32(_mm_load_si128((const __m128i *)(acc + 4)), _mm_unpackhi_epi16(add, _mm_setzero_si128()));
+
+    *q0 = divide(_mm_add_epi32(a0, round), params);
+    *q1 = divide(_mm_add_epi32(a1, round), params);
+
+    _mm_store_si128((__m128i *)(acc + 0), _mm_sub_epi32(a0, _mm_unpacklo_epi16(sub, _mm_setzero_si128())));
+    _mm_store_si128((__m128i *)(acc + 4), _mm_sub_epi32(a1, _mm_unpackhi_epi16(sub, _mm_setzero_si128())));
+}
+
+void vs_boxblur_v_byte_sse2(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, void *acc_, const struct vs_boxblur_params *params, unsigned width, unsigned height)
+{
+    uint32_t *acc = (uint32_t *)acc_;
+    int radius = (int)params->radius;
+    int h = (int)height;
+    __m128i round = _mm_set1_epi32(params->round);
+
+    width = (width + 15) & ~15U;
+    init_int(src, src_stride, acc, width, radius, h, 0);
+
+    for (int y = 0; y < h; ++y) {
+        const uint8_t *addp = row(src, src_stride, clamp_row(y + radius, h));
+        const uint8_t *subp = row(src, src_stride, clamp_row(y - radius, h));
+        uint8_t *dstp = (uint8_t *)dst + y * dst_stride;
+
+        for (unsigned x = 0; x < width; x += 16) {
+            __m128i add = _mm_load_si128((const __m128i *)(addp + x));
+            __m128i sub = _mm_load_si128((const __m128i *)(subp + x));
+            __m128i q0, q1, q2, q3;
+
+            step8(_mm_unpacklo_epi8(add, _mm_setzero_si128()), _mm_unpacklo_epi8(sub, _mm_setzero_si128()), acc + x + 0, round, params, &q0, &q1);
+            step8(_mm_unpackhi_epi8(add, _mm_setzero_si128()), _mm_unpackhi_epi8(sub, _mm_setzero_si128()), acc + x + 8, round, params, &q2, &q3);
+
+            _mm_store_si128((__m128i *)(dstp + x), _mm_packus_epi16(_mm_packs_epi32(q0, q1), _mm_packs_epi32(q2, q3)));
+        }
+    }
+}
+
+void vs_boxblur_v_word_sse2(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, void *acc_, const struct vs_boxblur_params *params, unsigned width, unsigned height)
+{
+    uint32_t *acc = (uint32_t *)acc_;
+    int radius = (int)params->radius;
+    int h = (int)height;
+    __m128i round = _mm_set1_epi32(params->round);
+    __m128i bias32 = _mm_set1_epi32(0x8000);
+    __m128i bias16 = _mm_set1_epi16(INT16_MIN);
+
+    width = (width + 7) & ~7U;
+    init_int(src, src_stride, acc, width, radius, h, 1);
+
+    for (int y = 0; y < h; ++y) {
+        const uint16_t *addp = (const uint16_t *)row(src, src_stride, clamp_row(y + radius, h));
+        const uint16_t *subp = (const uint16_t *)row(src, src_stride, clamp_row(y - radius, h));
+        uint16_t *dstp = (uint16_t *)((uint8_t *)dst + y * dst_stride);
+
+        for (unsigned x = 0; x < width; x += 8) {
+            __m128i q0, q1;
+
+            step8(_mm_load_si128((const __m128i *)(addp + x)), _mm_load_si128((const __m128i *)(subp + x)), acc + x, round, params, &q0, &q1);
+
+            // No packus_epi32 in SSE2, so pack with a signed bias.
+            __m128i q = _mm_packs_epi32(_mm_sub_epi32(q0, bias32), _mm_sub_epi32(q1, bias32));
+            _mm_store_si128((__m128i *)(dstp + x), _mm_xor_si128(q, bias16));
+        }
+    }
+}
+
+void vs_boxblur_v_float_sse2(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, void *acc_, const struct vs_boxblur_params *params, unsigned width, unsigned height)
+{
+    float *acc = (float *)acc_;
+    int radius = (int)params->radius;
+    int h = (int)height;
+    __m128 div = _mm_set1_ps(params->div);
+
+    width = (width + 3) & ~3U;
+
+    const float *first = (const float *)row(src, src_stride, 0);
+    for (unsigned x = 0; x < width; x += 4)
+        _mm_store_ps(acc + x, _mm_mul_ps(_mm_set1_ps((float)radius), _mm_load_ps(first + x)));
+    for (int i = 0; i < radius; ++i) {
+        const float *s = (const float *)row(src, src_stride, clamp_row(i, h));
+        for (unsigned x = 0; x < width; x += 4)
+            _mm_store_ps(acc + x, _mm_add_ps(_mm_load_ps(acc + x), _mm_load_ps(s + x)));
+    }
+
+    for (int y = 0; y < h; ++y) {
+        const float *addp = (const float *)row(src, src_stride, clamp_row(y + radius, h));
+        const float *subp = (const float *)row(src, src_stride, clamp_row(y - radius, h));
+        float *dstp = (float *)((uint8_t *)dst + y * dst_stride);
+
+        for (unsigned x = 0; x < width; x += 4) {
+            __m128 a = _mm_add_ps(_mm_load_ps(acc + x), _mm_load_ps(addp + x));
+            _mm_store_ps(dstp + x, _mm_mul_ps(a, div));
+            _mm_store_ps(acc + x, _mm_sub_ps(a, _mm_load_ps(subp + x)));
+        }
+    }
+}
@@ -104,6 +104,13 @@ struct ISA_AVX2 {
 
     // Unaligned stores for the square-convolution interior (starts at an unaligned column).
     static void storeu_ps(float *p, fvec v) { _mm256_storeu_ps(p, v); }
+
+    // Half (float16) through F16C, the arithmetic stays in float. Stores round to nearest-even
+    // like floatToHalf.
+    static fvec half_load(const uint16_t *p) { return _mm256_cvtph_ps(_mm_load_si128((const __m128i *)p)); }
+    static fvec half_loadu(const uint16_t *p) { return _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)p)); }
+    static void half_store(uint16_t *p, fvec v) { _mm_store_si128((__m128i *)p, _mm256_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC)); }
+    static void half_storeu(uint16_t *p, fvec v) { _mm_storeu_si128((__m128i *)p, _mm256_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC)); }
     static void storeu_u8(uint8_t *dst, ivec lo, ivec hi, fvec scale, fvec bias, fvec mask)
     {
         fvec t;
@@ -161,3 +168,5 @@ struct ISA_AVX2 {
 
 VS_CONV_ENTRYPOINTS(ISA_AVX2, avx2)
 VS_SQUARE_ENTRYPOINTS(ISA_AVX2, avx2)
+VS_CONV_ENTRYPOINTS_HALF(ISA_AVX2, avx2)
+VS_SQUARE_ENTRYPOINTS_HALF(ISA_AVX2, avx2)
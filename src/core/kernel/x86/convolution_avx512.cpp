@@ -112,6 +112,12 @@ struct ISA_AVX512 {
 
     // Unaligned stores for the square-convolution interior (starts at an unaligned column).
     static void storeu_ps(float *p, fvec v) { _mm512_storeu_ps(p, v); }
+
+    // Half (float16) through the AVX-512F conversions, the arithmetic stays in float.
+    static fvec half_load(const uint16_t *p) { return _mm512_cvtph_ps(_mm256_load_si256((const __m256i *)p)); }
+    static fvec half_loadu(const uint16_t *p) { return _mm512_cvtph_ps(_mm256_loadu_si256((const __m256i *)p)); }
+    static void half_store(uint16_t *p, fvec v) { _mm256_store_si256((__m256i *)p, _mm512_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC)); }
+    static void half_storeu(uint16_t *p, fvec v) { _mm256_storeu_si256((__m256i *)p, _mm512_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC)); }
     static void storeu_u8(uint8_t *dst, ivec lo, ivec hi, fvec scale, fvec bias, fvec mask)
     {
         fvec t;
@@ -162,4 +168,6 @@ struct ISA_AVX512 {
 
 VS_CONV_ENTRYPOINTS(ISA_AVX512, avx512)
 VS_SQUARE_ENTRYPOINTS(ISA_AVX512, avx512)
+VS_CONV_ENTRYPOINTS_HALF(ISA_AVX512, avx512)
+VS_SQUARE_ENTRYPOINTS_HALF(ISA_AVX512, avx512)
 VS_SQUARE_VNNI_ENTRYPOINTS
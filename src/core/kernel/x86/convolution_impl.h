@@ -42,9 +42,27 @@
 #include <type_traits>
 #include <VSHelper4.h>
 #include "../generic.h"
+#include "../../float16_helper.h"
 
 namespace {
 
+// Half (float16) pixels. Only the AVX2/AVX-512 tiers instantiate the half kernels, where F16C
+// converts whole vectors on load and store and the arithmetic is the float one. The scalar
+// conversions are for the mirrored edges of the square kernels.
+struct half_t {
+    uint16_t bits;
+    operator float() const { return halfToFloat(bits); }
+};
+
+template <class ISA> typename ISA::fvec load_fp(const float *p) { return ISA::load_ps(p); }
+template <class ISA> typename ISA::fvec load_fp(const half_t *p) { return ISA::half_load(&p->bits); }
+template <class ISA> typename ISA::fvec loadu_fp(const float *p) { return ISA::loadu_ps(p); }
+template <class ISA> typename ISA::fvec loadu_fp(const half_t *p) { return ISA::half_loadu(&p->bits); }
+template <class ISA> void store_fp(float *p, typename ISA::fvec v) { ISA::store_ps(p, v); }
+template <class ISA> void store_fp(half_t *p, typename ISA::fvec v) { ISA::half_store(&p->bits, v); }
+template <class ISA> void storeu_fp(float *p, typename ISA::fvec v) { ISA::storeu_ps(p, v); }
+template <class ISA> void storeu_fp(half_t *p, typename ISA::fvec v) { ISA::half_storeu(&p->bits, v); }
+
 template <class T>
 T *line_ptr(T *ptr, unsigned i, ptrdiff_t stride)
 {
@@ -232,8 +250,10 @@ void conv_scanline_h_word_pass(const uint16_t *src, uint16_t *dst, int32_t *tmp,
     }
 }
 
-template <class ISA, unsigned N, unsigned K, bool First, bool Last>
-void conv_scanline_h_float_pass(const float *src, float *dst, const vs_generic_params &params, unsigned n)
+// The partial sums of the first passes go to acc, the last pass writes dst. Float passes dst as
+// acc, half keeps the partial sums in a float line.
+template <class ISA, unsigned N, unsigned K, bool First, bool Last, class T>
+void conv_scanline_h_float_pass(const T *src, float *acc, T *dst, const vs_generic_params &params, unsigned n)
 {
     typedef typename ISA::fvec fvec;
     auto weight = [=](unsigned k) -> float { return k < N ? params.matrixf[K + k] : 0; };
@@ -250,23 +270,25 @@ void conv_scanline_h_float_pass(const float *src, float *dst, const vs_generic_p
     src = src - static_cast<ptrdiff_t>(params.matrixsize / 2) + K;
 
     for (ptrdiff_t j = 0; j < static_cast<ptrdiff_t>(n); j += ISA::FLANES) {
-        fvec accum0 = First ? ISA::fzero() : ISA::load_ps(dst + j);
+        fvec accum0 = First ? ISA::fzero() : ISA::load_ps(acc + j);
         fvec accum1 = ISA::fzero();
 
-        if (N >= 1) accum0 = ISA::fmadd(ISA::loadu_ps(src + j + 0), w0, accum0);
-        if (N >= 2) accum1 = ISA::fmadd(ISA::loadu_ps(src + j + 1), w1, accum1);
-        if (N >= 3) accum0 = ISA::fmadd(ISA::loadu_ps(src + j + 2), w2, accum0);
-        if (N >= 4) accum1 = ISA::fmadd(ISA::loadu_ps(src + j + 3), w3, accum1);
-        if (N >= 5) accum0 = ISA::fmadd(ISA::loadu_ps(src + j + 4), w4, accum0);
-        if (N >= 6) accum1 = ISA::fmadd(ISA::loadu_ps(src + j + 5), w5, accum1);
-        if (N >= 7) accum0 = ISA::fmadd(ISA::loadu_ps(src + j + 6), w6, accum0);
-        if (N >= 8) accum1 = ISA::fmadd(ISA::loadu_ps(src + j + 7), w7, accum1);
-        if (N >= 9) accum0 = ISA::fmadd(ISA::loadu_ps(src + j + 8), w8, accum0);
-        if (N >= 10) accum1 = ISA::fmadd(ISA::loadu_ps(src + j + 9), w9, accum1);
+        if (N >= 1) accum0 = ISA::fmadd(loadu_fp<ISA>(src + j + 0), w0, accum0);
+        if (N >= 2) accum1 = ISA::fmadd(loadu_fp<ISA>(src + j + 1), w1, accum1);
+        if (N >= 3) accum0 = ISA::fmadd(loadu_fp<ISA>(src + j + 2), w2, accum0);
+        if (N >= 4) accum1 = ISA::fmadd(loadu_fp<ISA>(src + j + 3), w3, accum1);
+        if (N >= 5) accum0 = ISA::fmadd(loadu_fp<ISA>(src + j + 4), w4, accum0);
+        if (N >= 6) accum1 = ISA::fmadd(loadu_fp<ISA>(src + j + 5), w5, accum1);
+        if (N >= 7) accum0 = ISA::fmadd(loadu_fp<ISA>(src + j + 6), w6, accum0);
+        if (N >= 8) accum1 = ISA::fmadd(loadu_fp<ISA>(src + j + 7), w7, accum1);
+        if (N >= 9) accum0 = ISA::fmadd(loadu_fp<ISA>(src + j + 8), w8, accum0);
+        if (N >= 10) accum1 = ISA::fmadd(loadu_fp<ISA>(src + j + 9), w9, accum1);
 
         accum0 = ISA::add_ps(accum0, accum1);
-        if (Last) accum0 = ISA::scale_bias_sat(accum0, scale, bias, satmask);
-        ISA::store_ps(dst + j, accum0);
+        if (Last)
+            store_fp<ISA>(dst + j, ISA::scale_bias_sat(accum0, scale, bias, satmask));
+        else
+            ISA::store_ps(acc + j, accum0);
     }
 }
 
@@ -412,22 +434,22 @@ void conv_scanline_v_word_pass(const void * const src[], uint16_t *dst, int32_t
     }
 }
 
-template <class ISA, unsigned N, unsigned K, bool First, bool Last>
-void conv_scanline_v_float_pass(const void * const src[], float *dst, const vs_generic_params &params, unsigned n)
+template <class ISA, unsigned N, unsigned K, bool First, bool Last, class T>
+void conv_scanline_v_float_pass(const void * const src[], float *acc, T *dst, const vs_generic_params &params, unsigned n)
 {
     typedef typename ISA::fvec fvec;
     auto weight = [=](unsigned k) -> float { return k < N ? params.matrixf[K + k] : 0; };
 
-    const float *srcp0 = static_cast<const float *>(src[K + 0]);
-    const float *srcp1 = N >= 2 ? static_cast<const float *>(src[K + 1]) : srcp0;
-    const float *srcp2 = N >= 3 ? static_cast<const float *>(src[K + 2]) : srcp1;
-    const float *srcp3 = N >= 4 ? static_cast<const float *>(src[K + 3]) : srcp2;
-    const float *srcp4 = N >= 5 ? static_cast<const float *>(src[K + 4]) : srcp3;
-    const float *srcp5 = N >= 6 ? static_cast<const float *>(src[K + 5]) : srcp4;
-    const float *srcp6 = N >= 7 ? static_cast<const float *>(src[K + 6]) : srcp5;
-    const float *srcp7 = N >= 8 ? static_cast<const float *>(src[K + 7]) : srcp6;
-    const float *srcp8 = N >= 9 ? static_cast<const float *>(src[K + 8]) : srcp7;
-    const float *srcp9 = N >= 10 ? static_cast<const float *>(src[K + 9]) : srcp8;
+    const T *srcp0 = static_cast<const T *>(src[K + 0]);
+    const T *srcp1 = N >= 2 ? static_cast<const T *>(src[K + 1]) : srcp0;
+    const T *srcp2 = N >= 3 ? static_cast<const T *>(src[K + 2]) : srcp1;
+    const T *srcp3 = N >= 4 ? static_cast<const T *>(src[K + 3]) : srcp2;
+    const T *srcp4 = N >= 5 ? static_cast<const T *>(src[K + 4]) : srcp3;
+    const T *srcp5 = N >= 6 ? static_cast<const T *>(src[K + 5]) : srcp4;
+    const T *srcp6 = N >= 7 ? static_cast<const T *>(src[K + 6]) : srcp5;
+    const T *srcp7 = N >= 8 ? static_cast<const T *>(src[K + 7]) : srcp6;
+    const T *srcp8 = N >= 9 ? static_cast<const T *>(src[K + 8]) : srcp7;
+    const T *srcp9 = N >= 10 ? static_cast<const T *>(src[K + 9]) : srcp8;
 
     fvec w0 = ISA::set1_ps(weight(0)), w1 = ISA::set1_ps(weight(1)), w2 = ISA::set1_ps(weight(2));
     fvec w3 = ISA::set1_ps(weight(3)), w4 = ISA::set1_ps(weight(4)), w5 = ISA::set1_ps(weight(5));
@@ -439,23 +461,25 @@ void conv_scanline_v_float_pass(const void * const src[], float *dst, const vs_g
     fvec satmask = ISA::satmask(params.saturate);
 
     for (ptrdiff_t j = 0; j < static_cast<ptrdiff_t>(n); j += ISA::FLANES) {
-        fvec accum0 = First ? ISA::fzero() : ISA::load_ps(dst + j);
+        fvec accum0 = First ? ISA::fzero() : ISA::load_ps(acc + j);
         fvec accum1 = ISA::fzero();
 
-        if (N >= 1) accum0 = ISA::fmadd(ISA::load_ps(srcp0 + j), w0, accum0);
-        if (N >= 2) accum1 = ISA::fmadd(ISA::load_ps(srcp1 + j), w1, accum1);
-        if (N >= 3) accum0 = ISA::fmadd(ISA::load_ps(srcp2 + j), w2, accum0);
-        if (N >= 4) accum1 = ISA::fmadd(ISA::load_ps(srcp3 + j), w3, accum1);
-        if (N >= 5) accum0 = ISA::fmadd(ISA::load_ps(srcp4 + j), w4, accum0);
-        if (N >= 6) accum1 = ISA::fmadd(ISA::load_ps(srcp5 + j), w5, accum1);
-        if (N >= 7) accum0 = ISA::fmadd(ISA::load_ps(srcp6 + j), w6, accum0);
-        if (N >= 8) accum1 = ISA::fmadd(ISA::load_ps(srcp7 + j), w7, accum1);
-        if (N >= 9) accum0 = ISA::fmadd(ISA::load_ps(srcp8 + j), w8, accum0);
-        if (N >= 10) accum1 = ISA::fmadd(ISA::load_ps(srcp9 + j), w9, accum1);
+        if (N >= 1) accum0 = ISA::fmadd(load_fp<ISA>(srcp0 + j), w0, accum0);
+        if (N >= 2) accum1 = ISA::fmadd(load_fp<ISA>(srcp1 + j), w1, accum1);
+        if (N >= 3) accum0 = ISA::fmadd(load_fp<ISA>(srcp2 + j), w2, accum0);
+        if (N >= 4) accum1 = ISA::fmadd(load_fp<ISA>(srcp3 + j), w3, accum1);
+        if (N >= 5) accum0 = ISA::fmadd(load_fp<ISA>(srcp4 + j), w4, accum0);
+        if (N >= 6) accum1 = ISA::fmadd(load_fp<ISA>(srcp5 + j), w5, accum1);
+        if (N >= 7) accum0 = ISA::fmadd(load_fp<ISA>(srcp6 + j), w6, accum0);
+        if (N >= 8) accum1 = ISA::fmadd(load_fp<ISA>(srcp7 + j), w7, accum1);
+        if (N >= 9) accum0 = ISA::fmadd(load_fp<ISA>(srcp8 + j), w8, accum0);
+        if (N >= 10) accum1 = ISA::fmadd(load_fp<ISA>(srcp9 + j), w9, accum1);
 
         accum0 = ISA::add_ps(accum0, accum1);
-        if (Last) accum0 = ISA::scale_bias_sat(accum0, scale, bias, satmask);
-        ISA::store_ps(dst + j, accum0);
+        if (Last)
+            store_fp<ISA>(dst + j, ISA::scale_bias_sat(accum0, scale, bias, satmask));
+        else
+            ISA::store_ps(acc + j, accum0);
     }
 }
 
@@ -496,24 +520,38 @@ void conv_scanline_h_word(const void *src, void *dst, void *tmp, const vs_generi
     }
 }
 
-template <class ISA, unsigned N>
-void conv_scanline_h_float(const void *src, void *dst, void *, const vs_generic_params &params, unsigned n)
+// Float sums the passes in dst, half in the float line tmp.
+template <class ISA, unsigned N, class T>
+void conv_scanline_h_fp(const void *src, void *dst, void *tmp, const vs_generic_params &params, unsigned n)
 {
-    const float *srcp = static_cast<const float *>(src);
-    float *dstp = static_cast<float *>(dst);
+    const T *srcp = static_cast<const T *>(src);
+    T *dstp = static_cast<T *>(dst);
+    float *accp = std::is_same<T, float>::value ? static_cast<float *>(dst) : static_cast<float *>(tmp);
 
     if (N > 19) {
-        conv_scanline_h_float_pass<ISA, 10, 0, true, false>(srcp, dstp, params, n);
-        conv_scanline_h_float_pass<ISA, 10, 10, false, false>(srcp, dstp, params, n);
-        conv_scanline_h_float_pass<ISA, N - 20, 20, false, true>(srcp, dstp, params, n);
+        conv_scanline_h_float_pass<ISA, 10, 0, true, false>(srcp, accp, dstp, params, n);
+        conv_scanline_h_float_pass<ISA, 10, 10, false, false>(srcp, accp, dstp, params, n);
+        conv_scanline_h_float_pass<ISA, N - 20, 20, false, true>(srcp, accp, dstp, params, n);
     } else if (N > 9) {
-        conv_scanline_h_float_pass<ISA, 10, 0, true, false>(srcp, dstp, params, n);
-        conv_scanline_h_float_pass<ISA, N - 10, 10, false, true>(srcp, dstp, params, n);
+        conv_scanline_h_float_pass<ISA, 10, 0, true, false>(srcp, accp, dstp, params, n);
+        conv_scanline_h_float_pass<ISA, N - 10, 10, false, true>(srcp, accp, dstp, params, n);
     } else {
-        conv_scanline_h_float_pass<ISA, N, 0, true, true>(srcp, dstp, params, n);
+        conv_scanline_h_float_pass<ISA, N, 0, true, true>(srcp, accp, dstp, params, n);
     }
 }
 
+template <class ISA, unsigned N>
+void conv_scanline_h_float(const void *src, void *dst, void *tmp, const vs_generic_params &params, unsigned n)
+{
+    conv_scanline_h_fp<ISA, N, float>(src, dst, tmp, params, n);
+}
+
+template <class ISA, unsigned N>
+void conv_scanline_h_half(const void *src, void *dst, void *tmp, const vs_generic_params &params, unsigned n)
+{
+    conv_scanline_h_fp<ISA, N, half_t>(src, dst, tmp, params, n);
+}
+
 template <class ISA, unsigned N>
 void conv_scanline_v_byte(const void * const src[], void *dst, void *tmp, const vs_generic_params &params, unsigned n)
 {
@@ -554,23 +592,36 @@ void conv_scanline_v_word(const void * const src[], void *dst, void *tmp, const
     }
 }
 
-template <class ISA, unsigned N>
-void conv_scanline_v_float(const void * const src[], void *dst, void *, const vs_generic_params &params, unsigned n)
+template <class ISA, unsigned N, class T>
+void conv_scanline_v_fp(const void * const src[], void *dst, void *tmp, const vs_generic_params &params, unsigned n)
 {
-    float *dstp = static_cast<float *>(dst);
+    T *dstp = static_cast<T *>(dst);
+    float *accp = std::is_same<T, float>::value ? static_cast<float *>(dst) : static_cast<float *>(tmp);
 
     if (N > 19) {
-        conv_scanline_v_float_pass<ISA, 10, 0, true, false>(src, dstp, params, n);
-        conv_scanline_v_float_pass<ISA, 10, 10, false, false>(src, dstp, params, n);
-        conv_scanline_v_float_pass<ISA, N - 20, 20, false, true>(src, dstp, params, n);
+        conv_scanline_v_float_pass<ISA, 10, 0, true, false>(src, accp, dstp, params, n);
+        conv_scanline_v_float_pass<ISA, 10, 10, false, false>(src, accp, dstp, params, n);
+        conv_scanline_v_float_pass<ISA, N - 20, 20, false, true>(src, accp, dstp, params, n);
     } else if (N > 9) {
-        conv_scanline_v_float_pass<ISA, 10, 0, true, false>(src, dstp, params, n);
-        conv_scanline_v_float_pass<ISA, N - 10, 10, false, true>(src, dstp, params, n);
+        conv_scanline_v_float_pass<ISA, 10, 0, true, false>(src, accp, dstp, params, n);
+        conv_scanline_v_float_pass<ISA, N - 10, 10, false, true>(src, accp, dstp, params, n);
     } else {
-        conv_scanline_v_float_pass<ISA, N, 0, true, true>(src, dstp, params, n);
+        conv_scanline_v_float_pass<ISA, N, 0, true, true>(src, accp, dstp, params, n);
     }
 }
 
+template <class ISA, unsigned N>
+void conv_scanline_v_float(const void * const src[], void *dst, void *tmp, const vs_generic_params &params, unsigned n)
+{
+    conv_scanline_v_fp<ISA, N, float>(src, dst, tmp, params, n);
+}
+
+template <class ISA, unsigned N>
+void conv_scanline_v_half(const void * const src[], void *dst, void *tmp, const vs_generic_params &params, unsigned n)
+{
+    conv_scanline_v_fp<ISA, N, half_t>(src, dst, tmp, params, n);
+}
+
 
 /* ---- fwidth -> kernel selection ---------------------------------------- */
 
@@ -598,18 +649,22 @@ decltype(&conv_scanline_##dir##_##type<ISA, 0>) select_conv_scanline_##dir##_##t
 VS_CONV_SELECT(h, byte, uint8_t)
 VS_CONV_SELECT(h, word, uint16_t)
 VS_CONV_SELECT(h, float, float)
+VS_CONV_SELECT(h, half, half_t)
 VS_CONV_SELECT(v, byte, uint8_t)
 VS_CONV_SELECT(v, word, uint16_t)
 VS_CONV_SELECT(v, float, float)
+VS_CONV_SELECT(v, half, half_t)
 
 #undef VS_CONV_SELECT
 
 template <class ISA> auto select_conv_scanline_h_for(uint8_t)  { return select_conv_scanline_h_byte_impl<ISA>; }
 template <class ISA> auto select_conv_scanline_h_for(uint16_t) { return select_conv_scanline_h_word_impl<ISA>; }
 template <class ISA> auto select_conv_scanline_h_for(float)    { return select_conv_scanline_h_float_impl<ISA>; }
+template <class ISA> auto select_conv_scanline_h_for(half_t)   { return select_conv_scanline_h_half_impl<ISA>; }
 template <class ISA> auto select_conv_scanline_v_for(uint8_t)  { return select_conv_scanline_v_byte_impl<ISA>; }
 template <class ISA> auto select_conv_scanline_v_for(uint16_t) { return select_conv_scanline_v_word_impl<ISA>; }
 template <class ISA> auto select_conv_scanline_v_for(float)    { return select_conv_scanline_v_float_impl<ISA>; }
+template <class ISA> auto select_conv_scanline_v_for(half_t)   { return select_conv_scanline_v_half_impl<ISA>; }
 
 
 /* ---- plane drivers ----------------------------------------------------- */
@@ -630,9 +685,9 @@ void conv_plane_h(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t ds
     // Max support = 12. Buffering: 12 before + (HBLK window) + lookahead + 12 after.
     alignas(ISA::ALIGN) T padded[ISA::PADDED];
 
-    // Multi-pass threshold = 13.
+    // Multi-pass threshold = 13 (integer), 9 (half).
     auto kernel = select_conv_scanline_h_for<ISA>(T{})(params.matrixsize);
-    void *tmp = (params.matrixsize > 13 && std::is_integral<T>::value) ? vsh::vsh_aligned_malloc((width + ISA::TMP_PAD) * sizeof(int32_t), ISA::ALIGN) : nullptr;
+    void *tmp = ((params.matrixsize > 13 && std::is_integral<T>::value) || (params.matrixsize > 9 && std::is_same<T, half_t>::value)) ? params.scratch : nullptr;
 
     for (unsigned i = 0; i < height; ++i) {
         const T *srcp = static_cast<const T *>(line_ptr(src, i, src_stride));
@@ -670,8 +725,6 @@ void conv_plane_h(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t ds
             kernel(padded + 16, dstp + vec_end, tmp, params, width - vec_end);
         }
     }
-
-    vsh::vsh_aligned_free(tmp);
 }
 
 template <class ISA, class T>
@@ -681,7 +734,7 @@ void conv_plane_v(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t ds
 
     // Multi-pass threshold = 9.
     auto kernel = select_conv_scanline_v_for<ISA>(T{})(params.matrixsize);
-    void *tmp = (params.matrixsize > 9 && std::is_integral<T>::value) ? vsh::vsh_aligned_malloc((width + ISA::TMP_PAD) * sizeof(int32_t), ISA::ALIGN) : nullptr;
+    void *tmp = (params.matrixsize > 9 && !std::is_same<T, float>::value) ? params.scratch : nullptr;
 
     for (unsigned i = 0; i < height; ++i) {
         const void *srcp[25];
@@ -690,8 +743,6 @@ void conv_plane_v(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t ds
         gather_v_rows(src, src_stride, i, height, fwidth, srcp);
         kernel(srcp, dstp, tmp, params, width);
     }
-
-    vsh::vsh_aligned_free(tmp);
 }
 
 template <class ISA, class T>
@@ -699,11 +750,11 @@ void conv_plane_x(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t ds
 {
     unsigned fwidth = params.matrixsize;
 
-    // Multi-pass threshold = 9 (v), 13 (h).
+    // Multi-pass threshold = 9 (v), 13 (h, 9 for half).
     auto kernel_v = select_conv_scanline_v_for<ISA>(T{})(params.matrixsize);
     auto kernel_h = select_conv_scanline_h_for<ISA>(T{})(params.matrixsize);
-    T *tmp1 = vsh::vsh_aligned_malloc<T>((width + 64) * sizeof(T), ISA::ALIGN);
-    void *tmp2 = (params.matrixsize > 9 && std::is_integral<T>::value) ? vsh::vsh_aligned_malloc((width + ISA::TMP_PAD) * sizeof(int32_t), ISA::ALIGN) : nullptr;
+    T *tmp1 = static_cast<T *>(params.scratch);
+    void *tmp2 = (params.matrixsize > 9 && !std::is_same<T, float>::value) ? static_cast<uint8_t *>(params.scratch) + VS_GENERIC_SCRATCH_LINE(width) : nullptr;
 
     for (unsigned i = 0; i < height; ++i) {
         const void *srcp[25];
@@ -716,9 +767,6 @@ void conv_plane_x(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t ds
         flip_right(tmp1 + 32 + width, 12);
         kernel_h(tmp1 + 32, dstp, tmp2, params, width);
     }
-
-    vsh::vsh_aligned_free(tmp2);
-    vsh::vsh_aligned_free(tmp1);
 }
 
 } // namespace
@@ -744,4 +792,13 @@ void conv_plane_x(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t ds
     void vs_generic_2d_conv_sep_float_##SUFFIX(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height) \
     { conv_plane_x<ISA, float>(src, src_stride, dst, dst_stride, *params, width, height); }
 
+/* The 3 half entry points, F16C tiers (avx2/avx512) only. */
+#define VS_CONV_ENTRYPOINTS_HALF(ISA, SUFFIX) \
+    void vs_generic_1d_conv_h_half_##SUFFIX(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height) \
+    { conv_plane_h<ISA, half_t>(src, src_stride, dst, dst_stride, *params, width, height); } \
+    void vs_generic_1d_conv_v_half_##SUFFIX(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height) \
+    { conv_plane_v<ISA, half_t>(src, src_stride, dst, dst_stride, *params, width, height); } \
+    void vs_generic_2d_conv_sep_half_##SUFFIX(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height) \
+    { conv_plane_x<ISA, half_t>(src, src_stride, dst, dst_stride, *params, width, height); }
+
 #endif // CONVOLUTION_IMPL_H
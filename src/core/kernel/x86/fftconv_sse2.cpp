@@ -0,0 +1,60 @@
+/*
+* Copyright (c) 2012-2019 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <emmintrin.h>
+#include "../fftconv_impl.h"
+#include "../transpose.h"
+
+namespace {
+
+struct Prims_SSE2 {
+    typedef float scalar;
+    typedef __m128 vec;
+    static constexpr unsigned SIZE = 4;
+
+    static vec load(const float *p) { return _mm_load_ps(p); }
+    static void store(float *p, vec v) { _mm_store_ps(p, v); }
+    static vec add(vec a, vec b) { return _mm_add_ps(a, b); }
+    static vec sub(vec a, vec b) { return _mm_sub_ps(a, b); }
+    static vec mul(vec a, vec b) { return _mm_mul_ps(a, b); }
+    static vec set1(float x) { return _mm_set1_ps(x); }
+};
+
+} // namespace
+
+void vs_generic_fft_conv_byte_sse2(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height)
+{
+    fftconv::filter_plane<Prims_SSE2, fftconv::IntPixel<uint8_t>>(src, src_stride, dst, dst_stride, params, width, height, vs_transpose_plane_dword_sse2);
+}
+
+void vs_generic_fft_conv_word_sse2(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height)
+{
+    fftconv::filter_plane<Prims_SSE2, fftconv::IntPixel<uint16_t>>(src, src_stride, dst, dst_stride, params, width, height, vs_transpose_plane_dword_sse2);
+}
+
+void vs_generic_fft_conv_float_sse2(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height)
+{
+    fftconv::filter_plane<Prims_SSE2, fftconv::FloatPixel>(src, src_stride, dst, dst_stride, params, width, height, vs_transpose_plane_dword_sse2);
+}
+
+void vs_generic_fft_conv_half_sse2(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height)
+{
+    fftconv::filter_plane<Prims_SSE2, fftconv::HalfPixel>(src, src_stride, dst, dst_stride, params, width, height, vs_transpose_plane_dword_sse2);
+}
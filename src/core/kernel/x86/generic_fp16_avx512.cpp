@@ -0,0 +1,105 @@
+/*
+* Copyright (c) 2012-2026 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+/*
+* AVX-512-FP16 3x3 median for half clips. The F16C kernels convert 16 halves to float per
+* vector, here the compares run on 32 halves at once without any conversion. A median only
+* selects values, so the result is bit-exact with the F16C kernels except that they quiet
+* signalling NaNs when converting.
+*
+* FP16 is not part of the x86-64-v4 baseline the AVX-512 kernels are built for. The whole
+* translation unit after the includes is compiled for it, since generic_impl.h instantiates
+* its templates here, and the kernel is only called when the CPU reports AVX512-FP16.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <immintrin.h>
+#include "../generic.h"
+#include "../../float16_helper.h"
+
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("avx512fp16,avx512bw,avx512dq,avx512vl,avx512f"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC target("avx512fp16")
+#endif
+
+namespace {
+
+// Only what MedianFloat and the HalfNative adapter below use. fvec holds 32 halves.
+struct Backend_AVX512FP16 {
+    typedef __m512h fvec;
+    static constexpr unsigned FLOAT_LEN = 32;
+
+    static fvec fmin(fvec a, fvec b) { return _mm512_min_ph(a, b); }
+    static fvec fmax(fvec a, fvec b) { return _mm512_max_ph(a, b); }
+
+    static fvec half_load(const uint16_t *p) { return _mm512_load_ph(p); }
+    static fvec half_loadu(const uint16_t *p) { return _mm512_loadu_ph(p); }
+    static void half_store(uint16_t *p, fvec x) { _mm512_store_ph(p, x); }
+
+    // Edge inserts, one lane shift with the edge pixel in lane 0 or lane idx.
+    static fvec half_shl_insert_lo(fvec x, uint16_t y)
+    {
+        __m512i perm = _mm512_set_epi16(
+            30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17, 16, 15,
+            14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0, 0);
+        return _mm512_castsi512_ph(_mm512_mask_permutexvar_epi16(_mm512_set1_epi16(static_cast<short>(y)), 0xFFFFFFFE, perm, _mm512_castph_si512(x)));
+    }
+    static fvec half_shr_insert(fvec x, uint16_t y, unsigned idx)
+    {
+        __m512i perm = _mm512_set_epi16(
+            31, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17,
+            16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1);
+        __m512i shifted = _mm512_permutexvar_epi16(perm, _mm512_castph_si512(x));
+        return _mm512_castsi512_ph(_mm512_mask_blend_epi16(static_cast<__mmask32>(1U << idx), shifted, _mm512_set1_epi16(static_cast<short>(y))));
+    }
+};
+
+} // namespace
+
+#define BACKEND Backend_AVX512FP16
+#include "generic_impl.h"
+
+namespace {
+
+// Like HalfMem but the vectors stay half, so the edge pixels are inserted as raw bits.
+template <class FloatOp, class B>
+struct HalfNative : FloatOp {
+    using FloatOp::FloatOp;
+    typedef uint16_t T;
+    static typename B::fvec load(const uint16_t *p) { return B::half_load(p); }
+    static typename B::fvec loadu(const uint16_t *p) { return B::half_loadu(p); }
+    static void store(uint16_t *p, typename B::fvec x) { B::half_store(p, x); }
+    static typename B::fvec shl_insert_lo(typename B::fvec x, uint16_t y) { return B::half_shl_insert_lo(x, y); }
+    static typename B::fvec shr_insert(typename B::fvec x, uint16_t y, unsigned idx) { return B::half_shr_insert(x, y, idx); }
+};
+
+} // namespace
+
+void vs_generic_3x3_median_half_avx512fp16(const void *src, ptrdiff_t ss, void *dst, ptrdiff_t ds, const struct vs_generic_params *p, unsigned w, unsigned h)
+{
+    filter_plane_3x3<HalfNative<MedianFloat<BACKEND>, BACKEND>>(src, ss, dst, ds, *p, w, h);
+}
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#endif
@@ -19,8 +19,8 @@
 */
 
 /*
- * AVX-512 gather for Lut2, dispatched only when the LUT spills L2
- * (integer output, >= ~512 KB) on CPUs with AVX-512 (a safe fast-gather gate).
+ * AVX-512 gather for Lut2, 16 pixels per iteration, used for every table size and
+ * output type (lut_avx2.cpp is the 8 pixel version for AVX2-only CPUs).
  * Frames are 64-byte aligned with rows padded to a multiple of 64 bytes when this
  * runs (AVX-512 implies avx512_f), and the min-clamp keeps every gather index within
  * the range the in-range lanes already read, so the width tail runs in full vectors
@@ -54,7 +54,9 @@ inline __m512i load_widen(const T *p) {
 
 template<typename V>
 inline void gather_store(V *d, const V *lut, __m512i idx) {
-    if constexpr (sizeof(V) == 2) {
+    if constexpr (sizeof(V) == 4) {
+        _mm512_storeu_ps((float *)d, _mm512_i32gather_ps(idx, (const float *)lut, 4));
+    } else if constexpr (sizeof(V) == 2) {
         __m512i g = _mm512_i32gather_epi32(idx, (const int *)lut, 2);
         _mm256_storeu_si256((__m256i *)d, _mm512_cvtepi32_epi16(g));
     } else {
@@ -77,12 +79,18 @@ void lut2_gather(const T *sx, const U *sy, V *d, int w, const V *lut, int bitsx,
 
 } // namespace
 
-void vs_lut2_gather_ww_w_avx512(const uint16_t *sx, const uint16_t *sy, uint16_t *d, int w, const uint16_t *lut, int bitsx, unsigned mx, unsigned my) { lut2_gather<uint16_t, uint16_t, uint16_t>(sx, sy, d, w, lut, bitsx, mx, my); }
+void vs_lut2_gather_bb_b_avx512(const uint8_t *sx, const uint8_t *sy, uint8_t *d, int w, const uint8_t *lut, int bitsx, unsigned mx, unsigned my) { lut2_gather<uint8_t, uint8_t, uint8_t>(sx, sy, d, w, lut, bitsx, mx, my); }
+void vs_lut2_gather_bb_w_avx512(const uint8_t *sx, const uint8_t *sy, uint16_t *d, int w, const uint16_t *lut, int bitsx, unsigned mx, unsigned my) { lut2_gather<uint8_t, uint8_t, uint16_t>(sx, sy, d, w, lut, bitsx, mx, my); }
+void vs_lut2_gather_bb_f_avx512(const uint8_t *sx, const uint8_t *sy, float *d, int w, const float *lut, int bitsx, unsigned mx, unsigned my) { lut2_gather<uint8_t, uint8_t, float>(sx, sy, d, w, lut, bitsx, mx, my); }
 void vs_lut2_gather_ww_b_avx512(const uint16_t *sx, const uint16_t *sy, uint8_t *d, int w, const uint8_t *lut, int bitsx, unsigned mx, unsigned my) { lut2_gather<uint16_t, uint16_t, uint8_t>(sx, sy, d, w, lut, bitsx, mx, my); }
-void vs_lut2_gather_wb_w_avx512(const uint16_t *sx, const uint8_t *sy, uint16_t *d, int w, const uint16_t *lut, int bitsx, unsigned mx, unsigned my) { lut2_gather<uint16_t, uint8_t, uint16_t>(sx, sy, d, w, lut, bitsx, mx, my); }
+void vs_lut2_gather_ww_w_avx512(const uint16_t *sx, const uint16_t *sy, uint16_t *d, int w, const uint16_t *lut, int bitsx, unsigned mx, unsigned my) { lut2_gather<uint16_t, uint16_t, uint16_t>(sx, sy, d, w, lut, bitsx, mx, my); }
+void vs_lut2_gather_ww_f_avx512(const uint16_t *sx, const uint16_t *sy, float *d, int w, const float *lut, int bitsx, unsigned mx, unsigned my) { lut2_gather<uint16_t, uint16_t, float>(sx, sy, d, w, lut, bitsx, mx, my); }
 void vs_lut2_gather_wb_b_avx512(const uint16_t *sx, const uint8_t *sy, uint8_t *d, int w, const uint8_t *lut, int bitsx, unsigned mx, unsigned my) { lut2_gather<uint16_t, uint8_t, uint8_t>(sx, sy, d, w, lut, bitsx, mx, my); }
-void vs_lut2_gather_bw_w_avx512(const uint8_t *sx, const uint16_t *sy, uint16_t *d, int w, const uint16_t *lut, int bitsx, unsigned mx, unsigned my) { lut2_gather<uint8_t, uint16_t, uint16_t>(sx, sy, d, w, lut, bitsx, mx, my); }
+void vs_lut2_gather_wb_w_avx512(const uint16_t *sx, const uint8_t *sy, uint16_t *d, int w, const uint16_t *lut, int bitsx, unsigned mx, unsigned my) { lut2_gather<uint16_t, uint8_t, uint16_t>(sx, sy, d, w, lut, bitsx, mx, my); }
+void vs_lut2_gather_wb_f_avx512(const uint16_t *sx, const uint8_t *sy, float *d, int w, const float *lut, int bitsx, unsigned mx, unsigned my) { lut2_gather<uint16_t, uint8_t, float>(sx, sy, d, w, lut, bitsx, mx, my); }
 void vs_lut2_gather_bw_b_avx512(const uint8_t *sx, const uint16_t *sy, uint8_t *d, int w, const uint8_t *lut, int bitsx, unsigned mx, unsigned my) { lut2_gather<uint8_t, uint16_t, uint8_t>(sx, sy, d, w, lut, bitsx, mx, my); }
+void vs_lut2_gather_bw_w_avx512(const uint8_t *sx, const uint16_t *sy, uint16_t *d, int w, const uint16_t *lut, int bitsx, unsigned mx, unsigned my) { lut2_gather<uint8_t, uint16_t, uint16_t>(sx, sy, d, w, lut, bitsx, mx, my); }
+void vs_lut2_gather_bw_f_avx512(const uint8_t *sx, const uint16_t *sy, float *d, int w, const float *lut, int bitsx, unsigned mx, unsigned my) { lut2_gather<uint8_t, uint16_t, float>(sx, sy, d, w, lut, bitsx, mx, my); }
 
 VS_TARGET_AVX512VBMI
 void vs_lut1_b_b_avx512vbmi(const uint8_t *src, uint8_t *dst, int w, const uint8_t *lut) {
@@ -0,0 +1,150 @@
+/*
+* Copyright (c) 2012-2019 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+
+#include <cstdint>
+#include <immintrin.h>
+#include "../median_impl.h"
+
+namespace {
+
+struct NetPrimsBase_AVX2 {
+    typedef __m256i vec;
+    static constexpr unsigned SIZE = 32;
+
+    static vec loadu(const uint8_t *p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p)); }
+    static void store(uint8_t *p, vec v) { _mm256_store_si256(reinterpret_cast<__m256i *>(p), v); }
+    static void to_key(uint8_t *, unsigned) {}
+    static vec from_key(vec v) { return v; }
+};
+
+struct ByteNetPrims_AVX2 : NetPrimsBase_AVX2 {
+    static vec min(vec a, vec b) { return _mm256_min_epu8(a, b); }
+    static vec max(vec a, vec b) { return _mm256_max_epu8(a, b); }
+};
+
+struct WordNetPrims_AVX2 : NetPrimsBase_AVX2 {
+    static vec min(vec a, vec b) { return _mm256_min_epu16(a, b); }
+    static vec max(vec a, vec b) { return _mm256_max_epu16(a, b); }
+};
+
+// Half samples are sorted as median::half_key keys: negative values are inverted, positive
+// ones get the sign bit set.
+struct HalfNetPrims_AVX2 : WordNetPrims_AVX2 {
+    static void to_key(uint8_t *p, unsigned n)
+    {
+        for (unsigned i = 0; i < n; i += SIZE) {
+            __m256i x = _mm256_load_si256(reinterpret_cast<const __m256i *>(p + i));
+            __m256i neg = _mm256_srai_epi16(x, 15);
+            x = _mm256_xor_si256(x, _mm256_or_si256(neg, _mm256_set1_epi16(INT16_MIN)));
+            _mm256_store_si256(reinterpret_cast<__m256i *>(p + i), x);
+        }
+    }
+
+    static vec from_key(vec v)
+    {
+        __m256i neg = _mm256_srai_epi16(_mm256_xor_si256(v, _mm256_set1_epi16(-1)), 15);
+        return _mm256_xor_si256(v, _mm256_or_si256(neg, _mm256_set1_epi16(INT16_MIN)));
+    }
+};
+
+struct FloatNetPrims_AVX2 {
+    typedef __m256 vec;
+    static constexpr unsigned SIZE = 32;
+
+    static vec loadu(const uint8_t *p) { return _mm256_loadu_ps(reinterpret_cast<const float *>(p)); }
+    static void store(uint8_t *p, vec v) { _mm256_store_ps(reinterpret_cast<float *>(p), v); }
+    static vec min(vec a, vec b) { return _mm256_min_ps(a, b); }
+    static vec max(vec a, vec b) { return _mm256_max_ps(a, b); }
+    static void to_key(uint8_t *, unsigned) {}
+    static vec from_key(vec v) { return v; }
+};
+
+struct HistPrims_AVX2 {
+    typedef __m256i hist;
+
+    static hist zero() { return _mm256_setzero_si256(); }
+    static hist load(const uint16_t *p) { return _mm256_load_si256(reinterpret_cast<const __m256i *>(p)); }
+    static void store(uint16_t *p, hist h) { _mm256_store_si256(reinterpret_cast<__m256i *>(p), h); }
+    static hist add(hist h, const uint16_t *a) { return _mm256_add_epi16(h, load(a)); }
+    static hist add_sub(hist h, const uint16_t *a, const uint16_t *b) { return _mm256_sub_epi16(_mm256_add_epi16(h, load(a)), load(b)); }
+
+    static unsigned find(hist v, unsigned &sum, unsigned half)
+    {
+        alignas(32) uint16_t prefix[16];
+
+        v = _mm256_add_epi16(v, _mm256_slli_si256(v, 2));
+        v = _mm256_add_epi16(v, _mm256_slli_si256(v, 4));
+        v = _mm256_add_epi16(v, _mm256_slli_si256(v, 8));
+
+        // Carry the total of the low lane into the high lane.
+        __m256i total = _mm256_permute2x128_si256(v, v, 0x08);
+        v = _mm256_add_epi16(v, _mm256_shuffle_epi8(total, _mm256_set1_epi16(0x0F0E)));
+
+        __m256i target = _mm256_set1_epi16(static_cast<short>(half - sum + 1));
+        __m256i ge = _mm256_cmpeq_epi16(_mm256_max_epu16(v, target), v);
+        unsigned i = median::ctz(_mm256_movemask_epi8(ge)) / 2;
+
+        if (i) {
+            _mm256_store_si256(reinterpret_cast<__m256i *>(prefix), v);
+            sum += prefix[i - 1];
+        }
+        return i;
+    }
+};
+
+} // namespace
+
+void vs_generic_median_radius_byte_avx2(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height)
+{
+    uint8_t *scratch = static_cast<uint8_t *>(params->scratch);
+
+    if (params->hradius == 2)
+        median::network_5x5<ByteNetPrims_AVX2>(src, src_stride, dst, dst_stride, width, height, 1, scratch);
+    else
+        median::ctmf_byte<HistPrims_AVX2>(src, src_stride, dst, dst_stride, width, height, params->hradius, scratch);
+}
+
+void vs_generic_median_radius_word_avx2(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height)
+{
+    if (params->hradius == 2)
+        median::network_5x5<WordNetPrims_AVX2>(src, src_stride, dst, dst_stride, width, height, 2, static_cast<uint8_t *>(params->scratch));
+    else
+        median::hist_word<HistPrims_AVX2>(src, src_stride, dst, dst_stride, width, height, params->hradius, median::sample_bits(params->maxval), static_cast<uint8_t *>(params->scratch),
+            [=](uint16_t x) { return std::min<unsigned>(x, params->maxval); }, [](unsigned x) { return static_cast<uint16_t>(x); });
+}
+
+// Only the network has a vector version for float.
+void vs_generic_median_radius_float_avx2(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height)
+{
+    if (params->hradius == 2)
+        median::network_5x5<FloatNetPrims_AVX2>(src, src_stride, dst, dst_stride, width, height, 4, static_cast<uint8_t *>(params->scratch));
+    else
+        vs_generic_median_radius_float_c(src, src_stride, dst, dst_stride, params, width, height);
+}
+
+void vs_generic_median_radius_half_avx2(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height)
+{
+    if (params->hradius == 2)
+        median::network_5x5<HalfNetPrims_AVX2>(src, src_stride, dst, dst_stride, width, height, 2, static_cast<uint8_t *>(params->scratch));
+    else
+        median::hist_word<HistPrims_AVX2>(src, src_stride, dst, dst_stride, width, height, params->hradius, 16, static_cast<uint8_t *>(params->scratch),
+            median::half_key, [](unsigned x) { return median::half_unkey(static_cast<uint16_t>(x)); });
+}
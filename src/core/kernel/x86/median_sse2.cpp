@@ -0,0 +1,152 @@
+/*
+* Copyright (c) 2012-2019 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+
+#include <cstdint>
+#include <emmintrin.h>
+#include "../median_impl.h"
+
+namespace {
+
+struct NetPrimsBase_SSE2 {
+    typedef __m128i vec;
+    static constexpr unsigned SIZE = 16;
+
+    static vec loadu(const uint8_t *p) { return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p)); }
+    static void store(uint8_t *p, vec v) { _mm_store_si128(reinterpret_cast<__m128i *>(p), v); }
+    static void to_key(uint8_t *, unsigned) {}
+    static vec from_key(vec v) { return v; }
+};
+
+struct ByteNetPrims_SSE2 : NetPrimsBase_SSE2 {
+    static vec min(vec a, vec b) { return _mm_min_epu8(a, b); }
+    static vec max(vec a, vec b) { return _mm_max_epu8(a, b); }
+};
+
+// SSE2 only has signed 16-bit min/max, so the lines are biased when they're copied.
+struct WordNetPrims_SSE2 : NetPrimsBase_SSE2 {
+    static vec min(vec a, vec b) { return _mm_min_epi16(a, b); }
+    static vec max(vec a, vec b) { return _mm_max_epi16(a, b); }
+
+    static void to_key(uint8_t *p, unsigned n)
+    {
+        for (unsigned i = 0; i < n; i += SIZE)
+            _mm_store_si128(reinterpret_cast<__m128i *>(p + i), from_key(_mm_load_si128(reinterpret_cast<const __m128i *>(p + i))));
+    }
+
+    static vec from_key(vec v) { return _mm_xor_si128(v, _mm_set1_epi16(INT16_MIN)); }
+};
+
+struct FloatNetPrims_SSE2 {
+    typedef __m128 vec;
+    static constexpr unsigned SIZE = 16;
+
+    static vec loadu(const uint8_t *p) { return _mm_loadu_ps(reinterpret_cast<const float *>(p)); }
+    static void store(uint8_t *p, vec v) { _mm_store_ps(reinterpret_cast<float *>(p), v); }
+    static vec min(vec a, vec b) { return _mm_min_ps(a, b); }
+    static vec max(vec a, vec b) { return _mm_max_ps(a, b); }
+    static void to_key(uint8_t *, unsigned) {}
+    static vec from_key(vec v) { return v; }
+};
+
+struct HistPrims_SSE2 {
+    struct hist {
+        __m128i lo;
+        __m128i hi;
+    };
+
+    static __m128i load8(const uint16_t *p) { return _mm_load_si128(reinterpret_cast<const __m128i *>(p)); }
+
+    static hist zero() { return{ _mm_setzero_si128(), _mm_setzero_si128() }; }
+    static hist load(const uint16_t *p) { return{ load8(p), load8(p + 8) }; }
+
+    static void store(uint16_t *p, hist h)
+    {
+        _mm_store_si128(reinterpret_cast<__m128i *>(p), h.lo);
+        _mm_store_si128(reinterpret_cast<__m128i *>(p + 8), h.hi);
+    }
+
+    static hist add(hist h, const uint16_t *a) { return{ _mm_add_epi16(h.lo, load8(a)), _mm_add_epi16(h.hi, load8(a + 8)) }; }
+
+    static hist add_sub(hist h, const uint16_t *a, const uint16_t *b)
+    {
+        return{ _mm_sub_epi16(_mm_add_epi16(h.lo, load8(a)), load8(b)), _mm_sub_epi16(_mm_add_epi16(h.hi, load8(a + 8)), load8(b + 8)) };
+    }
+
+    // Running sums of both halves, compared with a bias since SSE2 has no unsigned compare.
+    static unsigned find(hist h, unsigned &sum, unsigned half)
+    {
+        alignas(16) uint16_t prefix[16];
+        __m128i lo = h.lo;
+        __m128i hi = h.hi;
+
+        lo = _mm_add_epi16(lo, _mm_slli_si128(lo, 2));
+        hi = _mm_add_epi16(hi, _mm_slli_si128(hi, 2));
+        lo = _mm_add_epi16(lo, _mm_slli_si128(lo, 4));
+        hi = _mm_add_epi16(hi, _mm_slli_si128(hi, 4));
+        lo = _mm_add_epi16(lo, _mm_slli_si128(lo, 8));
+        hi = _mm_add_epi16(hi, _mm_slli_si128(hi, 8));
+
+        __m128i total = _mm_shufflehi_epi16(lo, _MM_SHUFFLE(3, 3, 3, 3));
+        hi = _mm_add_epi16(hi, _mm_unpackhi_epi64(total, total));
+
+        __m128i bias = _mm_set1_epi16(INT16_MIN);
+        __m128i target = _mm_xor_si128(_mm_set1_epi16(static_cast<short>(half - sum)), bias);
+        __m128i gt = _mm_packs_epi16(_mm_cmpgt_epi16(_mm_xor_si128(lo, bias), target), _mm_cmpgt_epi16(_mm_xor_si128(hi, bias), target));
+        unsigned i = median::ctz(_mm_movemask_epi8(gt));
+
+        if (i) {
+            _mm_store_si128(reinterpret_cast<__m128i *>(prefix), lo);
+            _mm_store_si128(reinterpret_cast<__m128i *>(prefix + 8), hi);
+            sum += prefix[i - 1];
+        }
+        return i;
+    }
+};
+
+} // namespace
+
+void vs_generic_median_radius_byte_sse2(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height)
+{
+    uint8_t *scratch = static_cast<uint8_t *>(params->scratch);
+
+    if (params->hradius == 2)
+        median::network_5x5<ByteNetPrims_SSE2>(src, src_stride, dst, dst_stride, width, height, 1, scratch);
+    else
+        median::ctmf_byte<HistPrims_SSE2>(src, src_stride, dst, dst_stride, width, height, params->hradius, scratch);
+}
+
+void vs_generic_median_radius_word_sse2(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height)
+{
+    if (params->hradius == 2)
+        median::network_5x5<WordNetPrims_SSE2>(src, src_stride, dst, dst_stride, width, height, 2, static_cast<uint8_t *>(params->scratch));
+    else
+        median::hist_word<HistPrims_SSE2>(src, src_stride, dst, dst_stride, width, height, params->hradius, median::sample_bits(params->maxval), static_cast<uint8_t *>(params->scratch),
+            [=](uint16_t x) { return std::min<unsigned>(x, params->maxval); }, [](unsigned x) { return static_cast<uint16_t>(x); });
+}
+
+// Only the network has a vector version for float.
+void vs_generic_median_radius_float_sse2(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height)
+{
+    if (params->hradius == 2)
+        median::network_5x5<FloatNetPrims_SSE2>(src, src_stride, dst, dst_stride, width, height, 4, static_cast<uint8_t *>(params->scratch));
+    else
+        vs_generic_median_radius_float_c(src, src_stride, dst, dst_stride, params, width, height);
+}
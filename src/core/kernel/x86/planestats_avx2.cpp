@@ -480,3 +480,67 @@ void vs_plane_stats_2_half_avx2(union vs_plane_stats *stats, const void *src1, p
     stats->f.acc = hadd_pd(fmacc);
     stats->f.diffacc = hadd_pd(fmdiffacc);
 }
+
+// Four independent sums so the double adds don't serialize on their latency.
+void vs_plane_stats_count_float_avx2(union vs_plane_stats *stats, const void *src, ptrdiff_t stride, unsigned width, unsigned height)
+{
+    const uint8_t *srcp = (const uint8_t *)src;
+    unsigned tail = width & ~7;
+    unsigned tail16 = width & ~15;
+    unsigned x, y;
+
+    __m256 fmmin = _mm256_set1_ps(INFINITY);
+    __m256 fmmax = _mm256_set1_ps(-INFINITY);
+    __m256d fmacc0 = _mm256_setzero_pd();
+    __m256d fmacc1 = _mm256_setzero_pd();
+    __m256d fmacc2 = _mm256_setzero_pd();
+    __m256d fmacc3 = _mm256_setzero_pd();
+    __m256i mcount = _mm256_setzero_si256();
+    __m256 zero = _mm256_setzero_ps();
+    __m256 mask = _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(width % 8), _mm256_loadu_si256((const __m256i *)ascend32)));
+    __m256 posmask = _mm256_andnot_ps(mask, _mm256_set1_ps(INFINITY));
+    __m256 negmask = _mm256_andnot_ps(mask, _mm256_set1_ps(-INFINITY));
+
+    for (y = 0; y < height; y++) {
+        // Counts per row in 32 bits, the comparison masks are -1.
+        __m256i rowcount = _mm256_setzero_si256();
+
+        for (x = 0; x < tail16; x += 16) {
+            __m256 v1 = _mm256_load_ps((const float *)srcp + x);
+            __m256 v2 = _mm256_load_ps((const float *)srcp + x + 8);
+            fmmin = _mm256_min_ps(fmmin, _mm256_min_ps(v1, v2));
+            fmmax = _mm256_max_ps(fmmax, _mm256_max_ps(v1, v2));
+            fmacc0 = _mm256_add_pd(fmacc0, _mm256_cvtps_pd(_mm256_castps256_ps128(v1)));
+            fmacc1 = _mm256_add_pd(fmacc1, _mm256_cvtps_pd(_mm256_extractf128_ps(v1, 1)));
+            fmacc2 = _mm256_add_pd(fmacc2, _mm256_cvtps_pd(_mm256_castps256_ps128(v2)));
+            fmacc3 = _mm256_add_pd(fmacc3, _mm256_cvtps_pd(_mm256_extractf128_ps(v2, 1)));
+            rowcount = _mm256_sub_epi32(rowcount, _mm256_castps_si256(_mm256_cmp_ps(v1, zero, _CMP_GT_OQ)));
+            rowcount = _mm256_sub_epi32(rowcount, _mm256_castps_si256(_mm256_cmp_ps(v2, zero, _CMP_GT_OQ)));
+        }
+        for (; x < tail; x += 8) {
+            __m256 v = _mm256_load_ps((const float *)srcp + x);
+            fmmin = _mm256_min_ps(fmmin, v);
+            fmmax = _mm256_max_ps(fmmax, v);
+            fmacc0 = _mm256_add_pd(fmacc0, _mm256_cvtps_pd(_mm256_castps256_ps128(v)));
+            fmacc1 = _mm256_add_pd(fmacc1, _mm256_cvtps_pd(_mm256_extractf128_ps(v, 1)));
+            rowcount = _mm256_sub_epi32(rowcount, _mm256_castps_si256(_mm256_cmp_ps(v, zero, _CMP_GT_OQ)));
+        }
+        if (width != tail) {
+            __m256 v = _mm256_and_ps(_mm256_load_ps((const float *)srcp + tail), mask);
+            fmmin = _mm256_min_ps(fmmin, _mm256_or_ps(v, posmask));
+            fmmax = _mm256_max_ps(fmmax, _mm256_or_ps(v, negmask));
+            fmacc0 = _mm256_add_pd(fmacc0, _mm256_cvtps_pd(_mm256_castps256_ps128(v)));
+            fmacc1 = _mm256_add_pd(fmacc1, _mm256_cvtps_pd(_mm256_extractf128_ps(v, 1)));
+            rowcount = _mm256_sub_epi32(rowcount, _mm256_castps_si256(_mm256_cmp_ps(v, zero, _CMP_GT_OQ)));
+        }
+
+        mcount = _mm256_add_epi64(mcount, _mm256_cvtepu32_epi64(_mm256_castsi256_si128(rowcount)));
+        mcount = _mm256_add_epi64(mcount, _mm256_cvtepu32_epi64(_mm256_extracti128_si256(rowcount, 1)));
+        srcp += stride;
+    }
+
+    stats->f.min = hmin_ps(fmmin);
+    stats->f.max = hmax_ps(fmmax);
+    stats->f.acc = hadd_pd(_mm256_add_pd(_mm256_add_pd(fmacc0, fmacc1), _mm256_add_pd(fmacc2, fmacc3)));
+    _mm_storel_epi64((__m128i *)&stats->f.count, hadd_epi64(mcount));
+}
@@ -370,3 +370,51 @@ void vs_plane_stats_2_float_sse2(union vs_plane_stats *stats, const void *src1,
     stats->f.acc = hadd_pd(fmacc);
     stats->f.diffacc = hadd_pd(fmdiffacc);
 }
+
+void vs_plane_stats_count_float_sse2(union vs_plane_stats *stats, const void *src, ptrdiff_t stride, unsigned width, unsigned height)
+{
+    const uint8_t *srcp = (const uint8_t *)src;
+    unsigned tail = width & ~3;
+    unsigned x, y;
+
+    __m128 fmmin = _mm_set_ps1(INFINITY);
+    __m128 fmmax = _mm_set_ps1(-INFINITY);
+    __m128d fmacc0 = _mm_setzero_pd();
+    __m128d fmacc1 = _mm_setzero_pd();
+    __m128i mcount = _mm_setzero_si128();
+    __m128 zero = _mm_setzero_ps();
+    __m128 mask = _mm_castsi128_ps(_mm_cmplt_epi32(_mm_loadu_si128((const __m128i *)ascend32), _mm_set1_epi32(width % 4)));
+    __m128 posmask = _mm_andnot_ps(mask, _mm_set_ps1(INFINITY));
+    __m128 negmask = _mm_andnot_ps(mask, _mm_set_ps1(-INFINITY));
+
+    for (y = 0; y < height; y++) {
+        // Counts per row in 32 bits, the comparison masks are -1.
+        __m128i rowcount = _mm_setzero_si128();
+
+        for (x = 0; x < tail; x += 4) {
+            __m128 v = _mm_load_ps((const float *)srcp + x);
+            fmmin = _mm_min_ps(fmmin, v);
+            fmmax = _mm_max_ps(fmmax, v);
+            fmacc0 = _mm_add_pd(fmacc0, _mm_cvtps_pd(v));
+            fmacc1 = _mm_add_pd(fmacc1, _mm_cvtps_pd(_mm_movehl_ps(v, v)));
+            rowcount = _mm_sub_epi32(rowcount, _mm_castps_si128(_mm_cmpgt_ps(v, zero)));
+        }
+        if (width != tail) {
+            __m128 v = _mm_and_ps(_mm_load_ps((const float *)srcp + tail), mask);
+            fmmin = _mm_min_ps(fmmin, _mm_or_ps(v, posmask));
+            fmmax = _mm_max_ps(fmmax, _mm_or_ps(v, negmask));
+            fmacc0 = _mm_add_pd(fmacc0, _mm_cvtps_pd(v));
+            fmacc1 = _mm_add_pd(fmacc1, _mm_cvtps_pd(_mm_movehl_ps(v, v)));
+            rowcount = _mm_sub_epi32(rowcount, _mm_castps_si128(_mm_cmpgt_ps(v, zero)));
+        }
+
+        mcount = _mm_add_epi64(mcount, _mm_unpacklo_epi32(rowcount, _mm_setzero_si128()));
+        mcount = _mm_add_epi64(mcount, _mm_unpackhi_epi32(rowcount, _mm_setzero_si128()));
+        srcp += stride;
+    }
+
+    stats->f.min = hmin_ps(fmmin);
+    stats->f.max = hmax_ps(fmmax);
+    stats->f.acc = hadd_pd(_mm_add_pd(fmacc0, fmacc1));
+    _mm_storel_epi64((__m128i *)&stats->f.count, _mm_add_epi64(mcount, _mm_srli_si128(mcount, 8)));
+}
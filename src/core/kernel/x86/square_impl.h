@@ -34,7 +34,9 @@
 * INT32_MAX at 7x7); word at N>=9 sums each row in int32 (a single row is always safe) and
 * spills into int64 accumulators, converting int64 -> float exactly at the end -- all
 * bit-exact with the C reference. Float uses FMA -> not bit-exact with the scalar/SSE2
-* tiers, matching convolution_impl.h's float behaviour.
+* tiers, matching convolution_impl.h's float behaviour. Half runs the float interior on
+* F16C loads and stores (half_t and the *_fp helpers of convolution_impl.h, which has to be
+* included first).
 */
 
 #ifndef SQUARE_IMPL_H
@@ -78,6 +80,8 @@ static T sq_scalar_px(const T *const *rows, unsigned j, unsigned S, unsigned W,
         float c = std::min(std::max(tmp, 0.0f), static_cast<float>(sizeof(T) == 1 ? 255 : 65535));
         long v = std::lrint(c);
         return static_cast<T>(std::min<long>(v, p.maxval));
+    } else if constexpr (std::is_same<T, half_t>::value) {
+        return half_t{ floatToHalf(tmp) };
     } else {
         return static_cast<T>(tmp);
     }
@@ -245,8 +249,8 @@ static unsigned sq_interior_word_i64(const uint16_t *const *rows, uint16_t *dst,
     return j;
 }
 
-template <class ISA, unsigned N>
-static unsigned sq_interior_float(const float *const *rows, float *dst, unsigned S, unsigned W,
+template <class ISA, unsigned N, class T>
+static unsigned sq_interior_float(const T *const *rows, T *dst, unsigned S, unsigned W,
                                   const float *m, typename ISA::fvec sc, typename ISA::fvec bi, typename ISA::fvec sm)
 {
     typedef typename ISA::fvec fvec;
@@ -254,15 +258,15 @@ static unsigned sq_interior_float(const float *const *rows, float *dst, unsigned
     auto block = [&](unsigned jj) {
         fvec a0 = ISA::fzero(), a1 = ISA::fzero();
         for (unsigned r = 0; r < N; ++r) {
-            const float *row = rows[r] + (jj - S);
+            const T *row = rows[r] + (jj - S);
             for (unsigned k = 0; k < N; ++k) {
                 fvec w = ISA::set1_ps(m[r * N + k]);
-                a0 = ISA::fmadd(ISA::loadu_ps(row + k), w, a0);
-                a1 = ISA::fmadd(ISA::loadu_ps(row + k + ISA::FLANES), w, a1);
+                a0 = ISA::fmadd(loadu_fp<ISA>(row + k), w, a0);
+                a1 = ISA::fmadd(loadu_fp<ISA>(row + k + ISA::FLANES), w, a1);
             }
         }
-        ISA::storeu_ps(dst + jj, ISA::scale_bias_sat(a0, sc, bi, sm));
-        ISA::storeu_ps(dst + jj + ISA::FLANES, ISA::scale_bias_sat(a1, sc, bi, sm));
+        storeu_fp<ISA>(dst + jj, ISA::scale_bias_sat(a0, sc, bi, sm));
+        storeu_fp<ISA>(dst + jj + ISA::FLANES, ISA::scale_bias_sat(a1, sc, bi, sm));
     };
     unsigned end = W > S ? W - S : 0, j = S;
     for (; j + STEP <= end; j += STEP) block(j);
@@ -293,7 +297,7 @@ static void sq_plane(const void *src, ptrdiff_t ss, void *dst, ptrdiff_t ds, con
             else
                 aend = sq_interior_word<ISA, N>(rows, d, S, W, p.matrix, sc, bi, sm, mv);
         } else
-            aend = sq_interior_float<ISA, N>(rows, d, S, W, p.matrixf, sc, bi, sm);
+            aend = sq_interior_float<ISA, N, T>(rows, d, S, W, p.matrixf, sc, bi, sm);
         for (unsigned j = 0; j < S && j < W; ++j)
             d[j] = sq_scalar_px<T, N>(rows, j, S, W, p);
         for (unsigned j = (aend > S ? aend : S); j < W; ++j)
@@ -322,4 +326,11 @@ static void sq_plane(const void *src, ptrdiff_t ss, void *dst, ptrdiff_t ds, con
     VS_SQUARE_ENTRY(ISA, SUF, 9x9,   9,  uint16_t, word) \
     VS_SQUARE_ENTRY(ISA, SUF, 11x11, 11, uint16_t, word)
 
+/* Half 5..11, F16C tiers (avx2/avx512) only. */
+#define VS_SQUARE_ENTRYPOINTS_HALF(ISA, SUF) \
+    VS_SQUARE_ENTRY(ISA, SUF, 5x5,   5,  half_t,   half) \
+    VS_SQUARE_ENTRY(ISA, SUF, 7x7,   7,  half_t,   half) \
+    VS_SQUARE_ENTRY(ISA, SUF, 9x9,   9,  half_t,   half) \
+    VS_SQUARE_ENTRY(ISA, SUF, 11x11, 11, half_t,   half)
+
 #endif // SQUARE_IMPL_H
@@ -0,0 +1,162 @@
+/*
+* Copyright (c) 2012-2019 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <cstdint>
+#include <limits>
+#include <immintrin.h>
+#include "../transpose.h"
+#include "../vhgw_impl.h"
+
+namespace {
+
+struct PrimsBase_AVX2 {
+    typedef __m256i vec;
+    static constexpr unsigned SIZE = 32;
+
+    static vec load(const uint8_t *p) { return _mm256_load_si256(reinterpret_cast<const __m256i *>(p)); }
+    static void store(uint8_t *p, vec v) { _mm256_store_si256(reinterpret_cast<__m256i *>(p), v); }
+};
+
+template <bool Max>
+struct BytePrims_AVX2 : PrimsBase_AVX2 {
+    __m256i threshold;
+    bool limited;
+
+    explicit BytePrims_AVX2(const vs_generic_params &params) :
+        threshold{ _mm256_set1_epi8(static_cast<char>(params.threshold)) },
+        limited{ params.threshold < params.maxval }
+    {}
+
+    vec reduce(vec a, vec b) const { return Max ? _mm256_max_epu8(a, b) : _mm256_min_epu8(a, b); }
+    bool thresholded() const { return limited; }
+    vec limit(vec val, vec src) const { return Max ? _mm256_min_epu8(val, _mm256_adds_epu8(src, threshold)) : _mm256_max_epu8(val, _mm256_subs_epu8(src, threshold)); }
+};
+
+template <bool Max>
+struct WordPrims_AVX2 : PrimsBase_AVX2 {
+    __m256i threshold;
+    bool limited;
+
+    explicit WordPrims_AVX2(const vs_generic_params &params) :
+        threshold{ _mm256_set1_epi16(static_cast<short>(params.threshold)) },
+        limited{ params.threshold < params.maxval }
+    {}
+
+    vec reduce(vec a, vec b) const { return Max ? _mm256_max_epu16(a, b) : _mm256_min_epu16(a, b); }
+    bool thresholded() const { return limited; }
+    vec limit(vec val, vec src) const { return Max ? _mm256_min_epu16(val, _mm256_adds_epu16(src, threshold)) : _mm256_max_epu16(val, _mm256_subs_epu16(src, threshold)); }
+};
+
+template <bool Max>
+struct FloatPrims_AVX2 {
+    typedef __m256 vec;
+    static constexpr unsigned SIZE = 32;
+
+    __m256 threshold;
+    bool limited;
+
+    explicit FloatPrims_AVX2(const vs_generic_params &params) :
+        threshold{ _mm256_set1_ps(params.thresholdf) },
+        limited{ params.thresholdf < std::numeric_limits<float>::max() }
+    {}
+
+    static vec load(const uint8_t *p) { return _mm256_load_ps(reinterpret_cast<const float *>(p)); }
+    static void store(uint8_t *p, vec v) { _mm256_store_ps(reinterpret_cast<float *>(p), v); }
+
+    vec reduce(vec a, vec b) const { return Max ? _mm256_max_ps(a, b) : _mm256_min_ps(a, b); }
+    bool thresholded() const { return limited; }
+    vec limit(vec val, vec src) const { return Max ? _mm256_min_ps(val, _mm256_add_ps(src, threshold)) : _mm256_max_ps(val, _mm256_sub_ps(src, threshold)); }
+};
+
+// Half samples are compared as signed integers after flipping the magnitude of negative
+// values, the same order as the C kernel. The flip is its own inverse. The threshold is
+// applied in float with F16C.
+template <bool Max>
+struct HalfPrims_AVX2 : PrimsBase_AVX2 {
+    __m256 threshold;
+    bool limited;
+
+    explicit HalfPrims_AVX2(const vs_generic_params &params) :
+        threshold{ _mm256_set1_ps(params.thresholdf) },
+        limited{ params.thresholdf < std::numeric_limits<float>::max() }
+    {}
+
+    static vec key(vec x) { return _mm256_xor_si256(x, _mm256_and_si256(_mm256_srai_epi16(x, 15), _mm256_set1_epi16(0x7FFF))); }
+
+    vec reduce(vec a, vec b) const { return key(Max ? _mm256_max_epi16(key(a), key(b)) : _mm256_min_epi16(key(a), key(b))); }
+    bool thresholded() const { return limited; }
+
+    __m128i limit8(__m128i val, __m128i src) const
+    {
+        __m256 v = _mm256_cvtph_ps(val);
+        __m256 s = _mm256_cvtph_ps(src);
+        v = Max ? _mm256_min_ps(v, _mm256_add_ps(s, threshold)) : _mm256_max_ps(v, _mm256_sub_ps(s, threshold));
+        return _mm256_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    }
+
+    vec limit(vec val, vec src) const
+    {
+        __m128i lo = limit8(_mm256_castsi256_si128(val), _mm256_castsi256_si128(src));
+        __m128i hi = limit8(_mm256_extracti128_si256(val, 1), _mm256_extracti128_si256(src, 1));
+        return _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+    }
+};
+
+} // namespace
+
+void vs_generic_vhgw_min_byte_avx2(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height)
+{
+    vhgw::filter_plane<BytePrims_AVX2<false>>(src, src_stride, dst, dst_stride, params, width, height, 1, vs_transpose_plane_byte_sse2);
+}
+
+void vs_generic_vhgw_min_word_avx2(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height)
+{
+    vhgw::filter_plane<WordPrims_AVX2<false>>(src, src_stride, dst, dst_stride, params, width, height, 2, vs_transpose_plane_word_sse2);
+}
+
+void vs_generic_vhgw_min_float_avx2(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height)
+{
+    vhgw::filter_plane<FloatPrims_AVX2<false>>(src, src_stride, dst, dst_stride, params, width, height, 4, vs_transpose_plane_dword_sse2);
+}
+
+void vs_generic_vhgw_min_half_avx2(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height)
+{
+    vhgw::filter_plane<HalfPrims_AVX2<false>>(src, src_stride, dst, dst_stride, params, width, height, 2, vs_transpose_plane_word_sse2);
+}
+
+void vs_generic_vhgw_max_byte_avx2(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height)
+{
+    vhgw::filter_plane<BytePrims_AVX2<true>>(src, src_stride, dst, dst_stride, params, width, height, 1, vs_transpose_plane_byte_sse2);
+}
+
+void vs_generic_vhgw_max_word_avx2(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height)
+{
+    vhgw::filter_plane<WordPrims_AVX2<true>>(src, src_stride, dst, dst_stride, params, width, height, 2, vs_transpose_plane_word_sse2);
+}
+
+void vs_generic_vhgw_max_float_avx2(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height)
+{
+    vhgw::filter_plane<FloatPrims_AVX2<true>>(src, src_stride, dst, dst_stride, params, width, height, 4, vs_transpose_plane_dword_sse2);
+}
+
+void vs_generic_vhgw_max_half_avx2(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height)
+{
+    vhgw::filter_plane<HalfPrims_AVX2<true>>(src, src_stride, dst, dst_stride, params, width, height, 2, vs_transpose_plane_word_sse2);
+}
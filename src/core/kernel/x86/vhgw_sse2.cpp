@@ -0,0 +1,122 @@
+/*
+* Copyright (c) 2012-2019 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <cstdint>
+#include <limits>
+#include <emmintrin.h>
+#include "../transpose.h"
+#include "../vhgw_impl.h"
+
+namespace {
+
+struct PrimsBase_SSE2 {
+    typedef __m128i vec;
+    static constexpr unsigned SIZE = 16;
+
+    static vec load(const uint8_t *p) { return _mm_load_si128(reinterpret_cast<const __m128i *>(p)); }
+    static void store(uint8_t *p, vec v) { _mm_store_si128(reinterpret_cast<__m128i *>(p), v); }
+};
+
+template <bool Max>
+struct BytePrims_SSE2 : PrimsBase_SSE2 {
+    __m128i threshold;
+    bool limited;
+
+    explicit BytePrims_SSE2(const vs_generic_params &params) :
+        threshold{ _mm_set1_epi8(static_cast<char>(params.threshold)) },
+        limited{ params.threshold < params.maxval }
+    {}
+
+    vec reduce(vec a, vec b) const { return Max ? _mm_max_epu8(a, b) : _mm_min_epu8(a, b); }
+    bool thresholded() const { return limited; }
+    vec limit(vec val, vec src) const { return Max ? _mm_min_epu8(val, _mm_adds_epu8(src, threshold)) : _mm_max_epu8(val, _mm_subs_epu8(src, threshold)); }
+};
+
+// SSE2 has no unsigned 16-bit min/max: min(a, b) = a - sat(a - b), max(a, b) = b + sat(a - b).
+template <bool Max>
+struct WordPrims_SSE2 : PrimsBase_SSE2 {
+    __m128i threshold;
+    bool limited;
+
+    explicit WordPrims_SSE2(const vs_generic_params &params) :
+        threshold{ _mm_set1_epi16(static_cast<short>(params.threshold)) },
+        limited{ params.threshold < params.maxval }
+    {}
+
+    static vec min_u16(vec a, vec b) { return _mm_sub_epi16(a, _mm_subs_epu16(a, b)); }
+    static vec max_u16(vec a, vec b) { return _mm_add_epi16(b, _mm_subs_epu16(a, b)); }
+
+    vec reduce(vec a, vec b) const { return Max ? max_u16(a, b) : min_u16(a, b); }
+    bool thresholded() const { return limited; }
+    vec limit(vec val, vec src) const { return Max ? min_u16(val, _mm_adds_epu16(src, threshold)) : max_u16(val, _mm_subs_epu16(src, threshold)); }
+};
+
+template <bool Max>
+struct FloatPrims_SSE2 {
+    typedef __m128 vec;
+    static constexpr unsigned SIZE = 16;
+
+    __m128 threshold;
+    bool limited;
+
+    explicit FloatPrims_SSE2(const vs_generic_params &params) :
+        threshold{ _mm_set1_ps(params.thresholdf) },
+        limited{ params.thresholdf < std::numeric_limits<float>::max() }
+    {}
+
+    static vec load(const uint8_t *p) { return _mm_load_ps(reinterpret_cast<const float *>(p)); }
+    static void store(uint8_t *p, vec v) { _mm_store_ps(reinterpret_cast<float *>(p), v); }
+
+    vec reduce(vec a, vec b) const { return Max ? _mm_max_ps(a, b) : _mm_min_ps(a, b); }
+    bool thresholded() const { return limited; }
+    vec limit(vec val, vec src) const { return Max ? _mm_min_ps(val, _mm_add_ps(src, threshold)) : _mm_max_ps(val, _mm_sub_ps(src, threshold)); }
+};
+
+} // namespace
+
+void vs_generic_vhgw_min_byte_sse2(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height)
+{
+    vhgw::filter_plane<BytePrims_SSE2<false>>(src, src_stride, dst, dst_stride, params, width, height, 1, vs_transpose_plane_byte_sse2);
+}
+
+void vs_generic_vhgw_min_word_sse2(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height)
+{
+    vhgw::filter_plane<WordPrims_SSE2<false>>(src, src_stride, dst, dst_stride, params, width, height, 2, vs_transpose_plane_word_sse2);
+}
+
+void vs_generic_vhgw_min_float_sse2(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height)
+{
+    vhgw::filter_plane<FloatPrims_SSE2<false>>(src, src_stride, dst, dst_stride, params, width, height, 4, vs_transpose_plane_dword_sse2);
+}
+
+void vs_generic_vhgw_max_byte_sse2(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height)
+{
+    vhgw::filter_plane<BytePrims_SSE2<true>>(src, src_stride, dst, dst_stride, params, width, height, 1, vs_transpose_plane_byte_sse2);
+}
+
+void vs_generic_vhgw_max_word_sse2(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height)
+{
+    vhgw::filter_plane<WordPrims_SSE2<true>>(src, src_stride, dst, dst_stride, params, width, height, 2, vs_transpose_plane_word_sse2);
+}
+
+void vs_generic_vhgw_max_float_sse2(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height)
+{
+    vhgw::filter_plane<FloatPrims_SSE2<true>>(src, src_stride, dst, dst_stride, params, width, height, 4, vs_transpose_plane_dword_sse2);
+}
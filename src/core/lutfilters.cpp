@@ -33,6 +33,7 @@
 #include "filtershared.h"
 #include "cpufeatures.h"
 #include "kernel/cpulevel.h"
+#include "expr/expr.h"
 
 using namespace vsh;
 
@@ -199,7 +200,7 @@ static bool funcToLut(int nin, int nout, void *vlut, VSFunction *func, const VSA
 }
 
 template<typename T, typename U>
-static void lutCreateHelper(const VSMap *in, VSMap *out, VSFunction *func, std::unique_ptr<LutData> &d, VSCore *core, const VSAPI *vsapi) {
+static void lutCreateHelper(const VSMap *in, VSMap *out, VSFunction *func, const char *expr, std::unique_ptr<LutData> &d, VSCore *core, const VSAPI *vsapi) {
     int inrange = 1 << d->vi->format.bitsPerSample;
     int maxval = (d->vi_out.format.sampleType == stInteger) ? (1 << d->vi_out.format.bitsPerSample) : 0;
     /* Allocate the LUT for the full input container (256 or 65536 entries) rather
@@ -216,6 +217,12 @@ static void lutCreateHelper(const VSMap *in, VSMap *out, VSFunction *func, std::
 
         if (!errstr.empty())
             RETERROR(errstr.c_str());
+    } else if (expr) {
+        try {
+            expr::evaluateTable(expr, &d->vi, 1, d->vi_out, d->lut, vs_get_cpulevel(core));
+        } catch (std::runtime_error &e) {
+            RETERROR(("Lut: " + std::string(e.what())).c_str());
+        }
     } else {
 
         U *lut = reinterpret_cast<U *>(d->lut);
@@ -285,16 +292,18 @@ static void VS_CC lutCreate(const VSMap *in, VSMap *out, void *userData, VSCore
         int lut_elem = vsapi->mapNumElements(in, "lut");
         int lutf_elem = vsapi->mapNumElements(in, "lutf");
 
-        int num_set = (lut_elem >= 0) + (lutf_elem >= 0) + !!func;
+        const char *expr = vsapi->mapGetData(in, "expr", 0, &err);
+
+        int num_set = (lut_elem >= 0) + (lutf_elem >= 0) + !!func + !!expr;
 
         if (!num_set) {
             vsapi->freeFunction(func);
-            RETERROR("Lut: none of lut, lutf and function are set");
+            RETERROR("Lut: none of lut, lutf, function and expr are set");
         }
 
         if (num_set > 1) {
             vsapi->freeFunction(func);
-            RETERROR("Lut: more than one of lut, lutf and function are set");
+            RETERROR("Lut: more than one of lut, lutf, function and expr are set");
         }
 
         if (lut_elem >= 0 && floatout) {
@@ -329,17 +338,17 @@ static void VS_CC lutCreate(const VSMap *in, VSMap *out, void *userData, VSCore
 #endif
 
         if (d->vi->format.bytesPerSample == 1 && bitsout == 8)
-            lutCreateHelper<uint8_t, uint8_t>(in, out, func, d, core, vsapi);
+            lutCreateHelper<uint8_t, uint8_t>(in, out, func, expr, d, core, vsapi);
         else if (d->vi->format.bytesPerSample == 1 && bitsout > 8 && bitsout <= 16)
-            lutCreateHelper<uint8_t, uint16_t>(in, out, func, d, core, vsapi);
+            lutCreateHelper<uint8_t, uint16_t>(in, out, func, expr, d, core, vsapi);
         else if (d->vi->format.bytesPerSample == 1 && floatout)
-            lutCreateHelper<uint8_t, float>(in, out, func, d, core, vsapi);
+            lutCreateHelper<uint8_t, float>(in, out, func, expr, d, core, vsapi);
         else if (d->vi->format.bytesPerSample == 2 && bitsout == 8)
-            lutCreateHelper<uint16_t, uint8_t>(in, out, func, d, core, vsapi);
+            lutCreateHelper<uint16_t, uint8_t>(in, out, func, expr, d, core, vsapi);
         else if (d->vi->format.bytesPerSample == 2 && bitsout > 8 && bitsout <= 16)
-            lutCreateHelper<uint16_t, uint16_t>(in, out, func, d, core, vsapi);
+            lutCreateHelper<uint16_t, uint16_t>(in, out, func, expr, d, core, vsapi);
         else if (d->vi->format.bytesPerSample == 2 && floatout)
-            lutCreateHelper<uint16_t, float>(in, out, func, d, core, vsapi);
+            lutCreateHelper<uint16_t, float>(in, out, func, expr, d, core, vsapi);
 
     } catch (std::runtime_error &e) {
         RETERROR(("Lut " + std::string(e.what())).c_str());
@@ -349,51 +358,74 @@ static void VS_CC lutCreate(const VSMap *in, VSMap *out, void *userData, VSCore
 //////////////////////////////////////////
 // Lut2
 
+template<typename T, typename U, typename V>
+using Lut2GatherFunc = void (*)(const T *sx, const U *sy, V *d, int w, const V *lut, int bitsx, unsigned mx, unsigned my);
+
 struct Lut2DataExtra {
     VSVideoInfo vi_out;
     const VSVideoInfo *vi[2];
     void *lut;
     bool process[3];
     int cpulevel;
-    bool use_gather;
+    /* Row kernel for the current type combo, a Lut2GatherFunc<T, U, V>. Null for the scalar path. */
+    void (*gather)();
     ~Lut2DataExtra() { free(lut); };
 };
 
 typedef DualNodeData<Lut2DataExtra> Lut2Data;
 
 #ifdef VS_TARGET_CPU_X86
-void vs_lut2_gather_ww_w_avx512(const uint16_t *, const uint16_t *, uint16_t *, int, const uint16_t *, int, unsigned, unsigned);
-void vs_lut2_gather_ww_b_avx512(const uint16_t *, const uint16_t *, uint8_t *, int, const uint8_t *, int, unsigned, unsigned);
-void vs_lut2_gather_wb_w_avx512(const uint16_t *, const uint8_t *, uint16_t *, int, const uint16_t *, int, unsigned, unsigned);
-void vs_lut2_gather_wb_b_avx512(const uint16_t *, const uint8_t *, uint8_t *, int, const uint8_t *, int, unsigned, unsigned);
-void vs_lut2_gather_bw_w_avx512(const uint8_t *, const uint16_t *, uint16_t *, int, const uint16_t *, int, unsigned, unsigned);
-void vs_lut2_gather_bw_b_avx512(const uint8_t *, const uint16_t *, uint8_t *, int, const uint8_t *, int, unsigned, unsigned);
+#define LUT2_GATHER_DECL(xy, o, T, U, V) \
+    void vs_lut2_gather_##xy##_##o##_avx2(const T *, const U *, V *, int, const V *, int, unsigned, unsigned); \
+    void vs_lut2_gather_##xy##_##o##_avx512(const T *, const U *, V *, int, const V *, int, unsigned, unsigned);
+
+LUT2_GATHER_DECL(bb, b, uint8_t, uint8_t, uint8_t)
+LUT2_GATHER_DECL(bb, w, uint8_t, uint8_t, uint16_t)
+LUT2_GATHER_DECL(bb, f, uint8_t, uint8_t, float)
+LUT2_GATHER_DECL(ww, b, uint16_t, uint16_t, uint8_t)
+LUT2_GATHER_DECL(ww, w, uint16_t, uint16_t, uint16_t)
+LUT2_GATHER_DECL(ww, f, uint16_t, uint16_t, float)
+LUT2_GATHER_DECL(wb, b, uint16_t, uint8_t, uint8_t)
+LUT2_GATHER_DECL(wb, w, uint16_t, uint8_t, uint16_t)
+LUT2_GATHER_DECL(wb, f, uint16_t, uint8_t, float)
+LUT2_GATHER_DECL(bw, b, uint8_t, uint16_t, uint8_t)
+LUT2_GATHER_DECL(bw, w, uint8_t, uint16_t, uint16_t)
+LUT2_GATHER_DECL(bw, f, uint8_t, uint16_t, float)
+
+#undef LUT2_GATHER_DECL
 #endif
 
-/* Dispatch one row to the gather kernel for the current type combo.
-   Returns false (compile-time) for combos without a kernel so the caller falls
-   back to the scalar path; only ever called when d->use_gather is set. */
+/* Picks the gather kernel for the type combo. Gathers beat the scalar loop at every table
+   size, the table stays in its natural y-major order so neighbouring pixels, which mostly
+   differ in a few low bits, gather from the same cache lines. */
 template<typename T, typename U, typename V>
-static inline bool lut2GatherRow(const T *sx, const U *sy, V *d, int w, const V *lut, int bitsx, unsigned mx, unsigned my) {
+static Lut2GatherFunc<T, U, V> lut2SelectGather(int cpulevel) {
 #ifdef VS_TARGET_CPU_X86
-    if constexpr (std::is_integral_v<V>) {
-        if constexpr (std::is_same_v<T, uint16_t> && std::is_same_v<U, uint16_t>) {
-            if constexpr (sizeof(V) == 2) vs_lut2_gather_ww_w_avx512(sx, sy, d, w, lut, bitsx, mx, my);
-            else vs_lut2_gather_ww_b_avx512(sx, sy, d, w, lut, bitsx, mx, my);
-            return true;
-        } else if constexpr (std::is_same_v<T, uint16_t> && std::is_same_v<U, uint8_t>) {
-            if constexpr (sizeof(V) == 2) vs_lut2_gather_wb_w_avx512(sx, sy, d, w, lut, bitsx, mx, my);
-            else vs_lut2_gather_wb_b_avx512(sx, sy, d, w, lut, bitsx, mx, my);
-            return true;
-        } else if constexpr (std::is_same_v<T, uint8_t> && std::is_same_v<U, uint16_t>) {
-            if constexpr (sizeof(V) == 2) vs_lut2_gather_bw_w_avx512(sx, sy, d, w, lut, bitsx, mx, my);
-            else vs_lut2_gather_bw_b_avx512(sx, sy, d, w, lut, bitsx, mx, my);
-            return true;
-        }
-    }
+    bool avx512 = getCPUFeatures()->avx512 && cpulevel >= VS_CPU_LEVEL_AVX512;
+    if (!avx512 && !(getCPUFeatures()->avx2 && cpulevel >= VS_CPU_LEVEL_AVX2))
+        return nullptr;
+
+#define LUT2_GATHER_SELECT(xy, o, TT, UU, VV) \
+    if constexpr (std::is_same_v<T, TT> && std::is_same_v<U, UU> && std::is_same_v<V, VV>) \
+        return avx512 ? vs_lut2_gather_##xy##_##o##_avx512 : vs_lut2_gather_##xy##_##o##_avx2;
+
+    LUT2_GATHER_SELECT(bb, b, uint8_t, uint8_t, uint8_t)
+    LUT2_GATHER_SELECT(bb, w, uint8_t, uint8_t, uint16_t)
+    LUT2_GATHER_SELECT(bb, f, uint8_t, uint8_t, float)
+    LUT2_GATHER_SELECT(ww, b, uint16_t, uint16_t, uint8_t)
+    LUT2_GATHER_SELECT(ww, w, uint16_t, uint16_t, uint16_t)
+    LUT2_GATHER_SELECT(ww, f, uint16_t, uint16_t, float)
+    LUT2_GATHER_SELECT(wb, b, uint16_t, uint8_t, uint8_t)
+    LUT2_GATHER_SELECT(wb, w, uint16_t, uint8_t, uint16_t)
+    LUT2_GATHER_SELECT(wb, f, uint16_t, uint8_t, float)
+    LUT2_GATHER_SELECT(bw, b, uint8_t, uint16_t, uint8_t)
+    LUT2_GATHER_SELECT(bw, w, uint8_t, uint16_t, uint16_t)
+    LUT2_GATHER_SELECT(bw, f, uint8_t, uint16_t, float)
+
+#undef LUT2_GATHER_SELECT
 #endif
-    (void)sx; (void)sy; (void)d; (void)w; (void)lut; (void)bitsx; (void)mx; (void)my;
-    return false;
+    (void)cpulevel;
+    return nullptr;
 }
 
 template<typename T, typename U, typename V>
@@ -428,8 +460,12 @@ static const VSFrame *VS_CC lut2Getframe(int n, int activationReason, void *inst
                 int h = vsapi->getFrameHeight(srcx, plane);
                 int w = vsapi->getFrameWidth(srcx, plane);
 
+                Lut2GatherFunc<T, U, V> gather = reinterpret_cast<Lut2GatherFunc<T, U, V>>(d->gather);
+
                 for (int hl = 0; hl < h; hl++) {
-                    if (!(d->use_gather && lut2GatherRow<T, U, V>(srcpx, srcpy, dstp, w, lut, shift, maxvalx, maxvaly))) {
+                    if (gather) {
+                        gather(srcpx, srcpy, dstp, w, lut, shift, maxvalx, maxvaly);
+                    } else {
                         for (int x = 0; x < w; x++)
                             dstp[x] =  lut[(std::min(srcpy[x], maxvaly) << shift) + std::min(srcpx[x], maxvalx)];
                     }
@@ -505,12 +541,12 @@ static bool funcToLut2(int nxin, int nyin, int nout, void *vlut, VSFunction *fun
 }
 
 template<typename T, typename U, typename V>
-static void lut2CreateHelper(const VSMap *in, VSMap *out, VSFunction *func, std::unique_ptr<Lut2Data> &d, VSCore *core, const VSAPI *vsapi) {
+static void lut2CreateHelper(const VSMap *in, VSMap *out, VSFunction *func, const char *expr, std::unique_ptr<Lut2Data> &d, VSCore *core, const VSAPI *vsapi) {
     int inrange = (1 << d->vi[0]->format.bitsPerSample) * (1 << d->vi[1]->format.bitsPerSample);
     int maxval = (d->vi_out.format.sampleType == stInteger) ? (1 << d->vi_out.format.bitsPerSample) : 0;
 
-    /* +64 bytes so the AVX-512 gather's dword-granularity overread past the last
-       entry stays in bounds (see lut2GatherRow). */
+    /* +64 bytes so the dword-granularity overread of the gather kernels past the last
+       entry stays in bounds (see lut_avx2.cpp). */
     d->lut = malloc((size_t)inrange * sizeof(V) + 64);
 
     if (func) {
@@ -520,6 +556,12 @@ static void lut2CreateHelper(const VSMap *in, VSMap *out, VSFunction *func, std:
 
         if (!errstr.empty())
             RETERROR(errstr.c_str());
+    } else if (expr) {
+        try {
+            expr::evaluateTable(expr, d->vi, 2, d->vi_out, d->lut, d->cpulevel);
+        } catch (std::runtime_error &e) {
+            RETERROR(("Lut2: " + std::string(e.what())).c_str());
+        }
     } else {
 
         V *lut = reinterpret_cast<V *>(d->lut);
@@ -543,16 +585,7 @@ static void lut2CreateHelper(const VSMap *in, VSMap *out, VSFunction *func, std:
         }
     }
 
-    /* Use the AVX-512 gather only where it wins: integer output and a LUT large
-       enough to spill L2 (>= ~512 KB), on CPUs with AVX-512 (a safe fast-gather
-       gate). Smaller tables and float output stay on the scalar path. */
-    d->use_gather = false;
-#ifdef VS_TARGET_CPU_X86
-    if constexpr (std::is_integral_v<V>) {
-        if (getCPUFeatures()->avx512 && d->cpulevel >= VS_CPU_LEVEL_AVX512 && (size_t)inrange * sizeof(V) >= (512u << 10))
-            d->use_gather = true;
-    }
-#endif
+    d->gather = reinterpret_cast<void (*)()>(lut2SelectGather<T, U, V>(d->cpulevel));
 
     VSFilterDependency deps[] = {{ d->node1, rpStrictSpatial }, { d->node2, (d->vi[0]->numFrames <= d->vi[1]->numFrames) ? rpStrictSpatial : rpFrameReuseLastOnly }};
     vsapi->createVideoFilter(out, "Lut2", &d->vi_out, lut2Getframe<T, U, V>, filterFree<Lut2Data>, fmParallel, deps, 2, d.get(), core);
@@ -596,16 +629,18 @@ static void VS_CC lut2Create(const VSMap *in, VSMap *out, void *userData, VSCore
         int lut_elem = vsapi->mapNumElements(in, "lut");
         int lutf_elem = vsapi->mapNumElements(in, "lutf");
 
-        int num_set = (lut_elem >= 0) + (lutf_elem >= 0) + !!func;
+        const char *expr = vsapi->mapGetData(in, "expr", 0, &err);
+
+        int num_set = (lut_elem >= 0) + (lutf_elem >= 0) + !!func + !!expr;
 
         if (!num_set) {
             vsapi->freeFunction(func);
-            RETERROR("Lut2: none of lut, lutf and function are set");
+            RETERROR("Lut2: none of lut, lutf, function and expr are set");
         }
 
         if (num_set > 1) {
             vsapi->freeFunction(func);
-            RETERROR("Lut2: more than one of lut, lutf and function are set");
+            RETERROR("Lut2: more than one of lut, lutf, function and expr are set");
         }
 
         if (lut_elem >= 0 && floatout) {
@@ -630,34 +665,34 @@ static void VS_CC lut2Create(const VSMap *in, VSMap *out, void *userData, VSCore
         if (d->vi[0]->format.bytesPerSample == 1) {
             if (d->vi[1]->format.bytesPerSample == 1) {
                 if (d->vi_out.format.bytesPerSample == 1 && d->vi_out.format.sampleType == stInteger)
-                    lut2CreateHelper<uint8_t, uint8_t, uint8_t>(in, out, func, d, core, vsapi);
+                    lut2CreateHelper<uint8_t, uint8_t, uint8_t>(in, out, func, expr, d, core, vsapi);
                 else if (d->vi_out.format.bytesPerSample == 2 && d->vi_out.format.sampleType == stInteger)
-                    lut2CreateHelper<uint8_t, uint8_t, uint16_t>(in, out, func, d, core, vsapi);
+                    lut2CreateHelper<uint8_t, uint8_t, uint16_t>(in, out, func, expr, d, core, vsapi);
                 else if (d->vi_out.format.bitsPerSample == 32 && d->vi_out.format.sampleType == stFloat)
-                    lut2CreateHelper<uint8_t, uint8_t, float>(in, out, func, d, core, vsapi);
+                    lut2CreateHelper<uint8_t, uint8_t, float>(in, out, func, expr, d, core, vsapi);
             } else if (d->vi[1]->format.bytesPerSample == 2) {
                 if (d->vi_out.format.bytesPerSample == 1 && d->vi_out.format.sampleType == stInteger)
-                    lut2CreateHelper<uint8_t, uint16_t, uint8_t>(in, out, func, d, core, vsapi);
+                    lut2CreateHelper<uint8_t, uint16_t, uint8_t>(in, out, func, expr, d, core, vsapi);
                 else if (d->vi_out.format.bytesPerSample == 2 && d->vi_out.format.sampleType == stInteger)
-                    lut2CreateHelper<uint8_t, uint16_t, uint16_t>(in, out, func, d, core, vsapi);
+                    lut2CreateHelper<uint8_t, uint16_t, uint16_t>(in, out, func, expr, d, core, vsapi);
                 else if (d->vi_out.format.bitsPerSample == 32 && d->vi_out.format.sampleType == stFloat)
-                    lut2CreateHelper<uint8_t, uint16_t, float>(in, out, func, d, core, vsapi);
+                    lut2CreateHelper<uint8_t, uint16_t, float>(in, out, func, expr, d, core, vsapi);
             }
         } else if (d->vi[0]->format.bytesPerSample == 2) {
             if (d->vi[1]->format.bytesPerSample == 1) {
                 if (d->vi_out.format.bytesPerSample == 1 && d->vi_out.format.sampleType == stInteger)
-                    lut2CreateHelper<uint16_t, uint8_t, uint8_t>(in, out, func, d, core, vsapi);
+                    lut2CreateHelper<uint16_t, uint8_t, uint8_t>(in, out, func, expr, d, core, vsapi);
                 else if (d->vi_out.format.bytesPerSample == 2 && d->vi_out.format.sampleType == stInteger)
-                    lut2CreateHelper<uint16_t, uint8_t, uint16_t>(in, out, func, d, core, vsapi);
+                    lut2CreateHelper<uint16_t, uint8_t, uint16_t>(in, out, func, expr, d, core, vsapi);
                 else if (d->vi_out.format.bitsPerSample == 32 && d->vi_out.format.sampleType == stFloat)
-                    lut2CreateHelper<uint16_t, uint8_t, float>(in, out, func, d, core, vsapi);
+                    lut2CreateHelper<uint16_t, uint8_t, float>(in, out, func, expr, d, core, vsapi);
             } else if (d->vi[1]->format.bytesPerSample == 2) {
                 if (d->vi_out.format.bytesPerSample == 1 && d->vi_out.format.sampleType == stInteger)
-                    lut2CreateHelper<uint16_t, uint16_t, uint8_t>(in, out, func, d, core, vsapi);
+                    lut2CreateHelper<uint16_t, uint16_t, uint8_t>(in, out, func, expr, d, core, vsapi);
                 else if (d->vi_out.format.bytesPerSample == 2 && d->vi_out.format.sampleType == stInteger)
-                    lut2CreateHelper<uint16_t, uint16_t, uint16_t>(in, out, func, d, core, vsapi);
+                    lut2CreateHelper<uint16_t, uint16_t, uint16_t>(in, out, func, expr, d, core, vsapi);
                 else if (d->vi_out.format.bitsPerSample == 32 && d->vi_out.format.sampleType == stFloat)
-                    lut2CreateHelper<uint16_t, uint16_t, float>(in, out, func, d, core, vsapi);
+                    lut2CreateHelper<uint16_t, uint16_t, float>(in, out, func, expr, d, core, vsapi);
             }
         }
 
@@ -670,6 +705,6 @@ static void VS_CC lut2Create(const VSMap *in, VSMap *out, void *userData, VSCore
 // Init
 
 void lutInitialize(VSPlugin *plugin, const VSPLUGINAPI *vspapi) {
-    vspapi->registerFunction("Lut", "clip:vnode;planes:int[]:opt;lut:int[]:opt;lutf:float[]:opt;function:func:opt;bits:int:opt;floatout:int:opt;", "clip:vnode;", lutCreate, 0, plugin);
-    vspapi->registerFunction("Lut2", "clipa:vnode;clipb:vnode;planes:int[]:opt;lut:int[]:opt;lutf:float[]:opt;function:func:opt;bits:int:opt;floatout:int:opt;", "clip:vnode;", lut2Create, 0, plugin);
+    vspapi->registerFunction("Lut", "clip:vnode;planes:int[]:opt;lut:int[]:opt;lutf:float[]:opt;function:func:opt;expr:data:opt;bits:int:opt;floatout:int:opt;", "clip:vnode;", lutCreate, 0, plugin);
+    vspapi->registerFunction("Lut2", "clipa:vnode;clipb:vnode;planes:int[]:opt;lut:int[]:opt;lutf:float[]:opt;function:func:opt;expr:data:opt;bits:int:opt;floatout:int:opt;", "clip:vnode;", lut2Create, 0, plugin);
 }
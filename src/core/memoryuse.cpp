@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <bit>
 #include <cassert>
 #include <climits>
 #include <cstdint>
@@ -6,12 +8,19 @@
 #include "memoryuse.h"
 #include "VSHelper4.h"
 
+#include <chrono>
+#include <vector>
+
 #ifdef VS_TARGET_OS_WINDOWS
 #include <windows.h>
 #elif defined(VS_TARGET_OS_DARWIN)
+#include <sys/mman.h>
 #include <sys/sysctl.h>
+#include <unistd.h>
 #else
+#include <sys/mman.h>
 #include <sys/sysinfo.h>
+#include <unistd.h>
 #endif
 
 // Confirmed needed on Windows and Linux, primarily due to the impact
@@ -19,11 +28,6 @@
 // https://github.com/vapoursynth/vapoursynth/issues/1167
 #define USE_FRAME_POOL
 
-// Print pool hit/miss stats on exit.
-#if 0
-#define DEBUG_STATS
-#endif
-
 namespace vs {
 
 namespace {
@@ -36,6 +40,57 @@ constexpr size_t SYSTEM_ALLOCATOR_THRESHOLD = SIZE_MAX;
 constexpr size_t ALIGNMENT = 64;
 constexpr size_t GOOD_FIT_NUMERATOR = 1;
 constexpr size_t GOOD_FIT_DENOMINATOR = 8;
+constexpr size_t MIN_SCRATCH_BLOCK = 1UL << 16;
+constexpr unsigned FIRST_SIZE_CLASS_BITS = 16;
+
+// blocks that sit on the freelist for this long aren't part of the working set anymore
+constexpr std::chrono::seconds FREELIST_DECAY_TIME{ 15 };
+constexpr std::chrono::seconds FREELIST_DECAY_INTERVAL{ 1 };
+
+int64_t steady_now()
+{
+    return std::chrono::steady_clock::now().time_since_epoch().count();
+}
+
+constexpr int64_t to_ticks(std::chrono::seconds s)
+{
+    return std::chrono::duration_cast<std::chrono::steady_clock::duration>(s).count();
+}
+
+size_t page_size()
+{
+#ifdef VS_TARGET_OS_WINDOWS
+    SYSTEM_INFO info{};
+    GetSystemInfo(&info);
+    return info.dwPageSize;
+#else
+    long size = sysconf(_SC_PAGESIZE);
+    return size > 0 ? static_cast<size_t>(size) : 4096;
+#endif
+}
+
+size_t size_class(size_t size)
+{
+    unsigned bits = size ? static_cast<unsigned>(std::bit_width(size - 1)) : 0;
+    return std::min<size_t>(bits > FIRST_SIZE_CLASS_BITS ? bits - FIRST_SIZE_CLASS_BITS : 0, MemoryStats::NUM_SIZE_CLASSES - 1);
+}
+
+size_t counter_slot()
+{
+    static std::atomic_size_t next_slot{ 0 };
+    thread_local size_t slot = next_slot++;
+    return slot;
+}
+
+size_t block_size(size_t size)
+{
+    return (size + ALIGNMENT + (ALIGNMENT - 1)) & ~static_cast<size_t>(ALIGNMENT - 1);
+}
+
+size_t pool_block_size(size_t size)
+{
+    return (block_size(size) + 4095) & ~static_cast<size_t>(4095);
+}
 
 bool is_good_fit(size_t request, size_t allocated)
 {
@@ -68,16 +123,6 @@ std::size_t get_total_ram()
 
 } // namespace
 
-#ifdef DEBUG_STATS
-struct MemoryUse::DebugStats {
-    std::atomic_size_t gc_count{ 0 };
-    std::atomic_size_t small_malloc_count{ 0 };
-    std::atomic_size_t small_free_count{ 0 };
-    std::atomic_size_t large_malloc_count{ 0 };
-    std::atomic_size_t large_free_count{ 0 };
-};
-#endif
-
 thread_local int64_t MemoryUse::s_call_delta = 0;
 thread_local int64_t MemoryUse::s_call_peak = 0;
 
@@ -89,42 +134,14 @@ MemoryUse::MemoryUse()
 #else
     m_limit = 1 * (1ULL << 30);
 #endif
-
-#ifdef DEBUG_STATS
-    m_debug_stats = new DebugStats{};
-#endif
 }
 
 MemoryUse::~MemoryUse()
 {
     assert(!m_allocated);
 
-#ifdef DEBUG_STATS
-    size_t num_keys = 0;
-    size_t size_class = 0;
-#endif
-
-    for (auto &entry : m_freelist) {
-#ifdef DEBUG_STATS
-        if (entry.first != size_class) {
-            size_class = entry.first;
-            ++num_keys;
-        }
-#endif
-
+    for (auto &entry : m_freelist)
         do_deallocate(entry.second);
-    }
-
-#ifdef DEBUG_STATS
-    fprintf(stderr, "Small Allocations: %zu\n", m_debug_stats->small_malloc_count.load());
-    fprintf(stderr, "Large Allocations: %zu\n", m_debug_stats->large_malloc_count.load());
-    fprintf(stderr, "Small Deallocations: %zu\n", m_debug_stats->small_free_count.load());
-    fprintf(stderr, "Large Deallocations: %zu\n", m_debug_stats->large_free_count.load());
-    fprintf(stderr, "GC Deallocations: %zu\n", m_debug_stats->gc_count.load());
-    fprintf(stderr, "Freelist Length: %zu\n", m_freelist.size());
-    fprintf(stderr, "Freelist Size Classes: %zu\n", num_keys);
-    delete m_debug_stats;
-#endif
 }
 
 uint8_t *MemoryUse::init_block(uint8_t *raw_ptr, size_t allocation_size)
@@ -134,6 +151,20 @@ uint8_t *MemoryUse::init_block(uint8_t *raw_ptr, size_t allocation_size)
     return raw_ptr + ALIGNMENT;
 }
 
+void MemoryUse::count(Counter counter, uint64_t value)
+{
+    m_counter_slots[counter_slot() % NUM_COUNTER_SLOTS].counters[counter].fetch_add(value, std::memory_order_relaxed);
+}
+
+void MemoryUse::add_allocated(size_t size)
+{
+    size_t allocated = (m_allocated += size);
+    size_t peak = m_peak_allocated.load(std::memory_order_relaxed);
+    while (allocated > peak && !m_peak_allocated.compare_exchange_weak(peak, allocated, std::memory_order_relaxed)) {
+    }
+    track_allocated(size);
+}
+
 void *MemoryUse::do_allocate(size_t size)
 {
     return vsh::vsh_aligned_malloc(size, ALIGNMENT);
@@ -146,20 +177,12 @@ void MemoryUse::do_deallocate(void *ptr)
 
 uint8_t *MemoryUse::allocate_from_system(size_t size)
 {
-#ifdef DEBUG_STATS
-    if (size > SYSTEM_ALLOCATOR_THRESHOLD)
-        ++m_debug_stats->large_malloc_count;
-    else
-        ++m_debug_stats->small_malloc_count;
-#endif
-
     uint8_t *raw_ptr = static_cast<uint8_t *>(do_allocate(size));
     if (!raw_ptr)
         return nullptr;
 
     uint8_t *user_ptr = init_block(raw_ptr, size);
-    m_allocated += size;
-    track_allocated(size);
+    add_allocated(size);
     return user_ptr;
 }
 
@@ -176,8 +199,9 @@ uint8_t *MemoryUse::allocate_from_freelist(size_t size)
 
         m_freelist.erase(iter);
         m_freelist_size -= block_size;
-        m_allocated += block_size;
-        track_allocated(block_size);
+        add_allocated(block_size);
+        reinterpret_cast<BlockHeader *>(raw_ptr)->pages_released = false;
+        reinterpret_cast<BlockHeader *>(raw_ptr)->prewarmed = false;
 
         return raw_ptr + ALIGNMENT;
     }
@@ -186,13 +210,6 @@ uint8_t *MemoryUse::allocate_from_freelist(size_t size)
 
 void MemoryUse::deallocate_to_system(uint8_t *ptr, size_t size)
 {
-#ifdef DEBUG_STATS
-    if (size > SYSTEM_ALLOCATOR_THRESHOLD)
-        ++m_debug_stats->large_free_count;
-    else
-        ++m_debug_stats->small_free_count;
-#endif
-
     do_deallocate(ptr);
     m_allocated -= size;
     track_deallocated(size);
@@ -200,6 +217,8 @@ void MemoryUse::deallocate_to_system(uint8_t *ptr, size_t size)
 
 void MemoryUse::deallocate_to_freelist(uint8_t *ptr, size_t size)
 {
+    reinterpret_cast<BlockHeader *>(ptr)->released_at = steady_now();
+
     std::lock_guard<std::mutex> lock{ m_mutex };
     m_freelist.emplace(size, ptr);
     m_freelist_size += size;
@@ -247,9 +266,8 @@ void MemoryUse::gc_freelist()
         do_deallocate(ptr);
         total -= size;
 
-#ifdef DEBUG_STATS
-        ++m_debug_stats->gc_count;
-#endif
+        count(GC_EVICTION);
+        count(GC_EVICTED_BYTES, size);
     }
 }
 
@@ -257,15 +275,21 @@ uint8_t *MemoryUse::allocate(size_t size)
 {
     assert(size < SIZE_MAX - 4095 - 64);
 
-    size_t aligned_size = (size + ALIGNMENT + (ALIGNMENT - 1)) & ~static_cast<size_t>(ALIGNMENT - 1);
-    size_t page_aligned_size = (aligned_size + 4095) & ~static_cast<size_t>(4095);
+    size_t aligned_size = block_size(size);
+    size_t page_aligned_size = pool_block_size(size);
+
+    count(static_cast<Counter>(SIZE_CLASS + size_class(size)));
 
-    if (page_aligned_size <= SYSTEM_ALLOCATOR_THRESHOLD)
+    if (page_aligned_size <= SYSTEM_ALLOCATOR_THRESHOLD) {
+        count(SMALL_ALLOCATION);
         return allocate_from_system(aligned_size); // Don't align small buffers to 4k.
-    else if (uint8_t *cached = allocate_from_freelist(page_aligned_size))
+    } else if (uint8_t *cached = allocate_from_freelist(page_aligned_size)) {
+        count(POOL_HIT);
         return cached;
-    else
+    } else {
+        count(POOL_MISS);
         return allocate_from_system(page_aligned_size);
+    }
 }
 
 void MemoryUse::deallocate(uint8_t *buf)
@@ -291,6 +315,250 @@ void MemoryUse::deallocate(uint8_t *buf)
         delete this;
 }
 
+uint8_t *MemoryUse::allocate_untracked(size_t size)
+{
+    int64_t delta = s_call_delta;
+    int64_t peak = s_call_peak;
+    uint8_t *buf = allocate(size);
+    s_call_delta = delta;
+    s_call_peak = peak;
+    return buf;
+}
+
+void MemoryUse::deallocate_untracked(uint8_t *buf)
+{
+    int64_t delta = s_call_delta;
+    int64_t peak = s_call_peak;
+    deallocate(buf);
+    s_call_delta = delta;
+    s_call_peak = peak;
+}
+
+void MemoryUse::get_stats(MemoryStats &stats, bool reset)
+{
+    uint64_t totals[NUM_COUNTERS] = {};
+    for (auto &slot : m_counter_slots) {
+        for (size_t i = 0; i < NUM_COUNTERS; i++)
+            totals[i] += reset ? slot.counters[i].exchange(0, std::memory_order_relaxed) : slot.counters[i].load(std::memory_order_relaxed);
+    }
+
+    stats.allocated = m_allocated;
+    stats.peak_allocated = std::max<size_t>(m_peak_allocated, stats.allocated);
+    if (reset)
+        m_peak_allocated = stats.allocated;
+
+    {
+        std::lock_guard<std::mutex> lock{ m_mutex };
+        stats.freelist_bytes = m_freelist_size;
+        stats.freelist_blocks = m_freelist.size();
+    }
+
+    stats.pool_hits = totals[POOL_HIT];
+    stats.pool_misses = totals[POOL_MISS];
+    stats.small_allocations = totals[SMALL_ALLOCATION];
+    stats.gc_evictions = totals[GC_EVICTION];
+    stats.gc_evicted_bytes = totals[GC_EVICTED_BYTES];
+    stats.trimmed_bytes = totals[TRIMMED_BYTES];
+    for (size_t i = 0; i < MemoryStats::NUM_SIZE_CLASSES; i++)
+        stats.size_classes[i] = totals[SIZE_CLASS + i];
+}
+
+template<typename T>
+size_t MemoryUse::release_freelist_blocks(T predicate)
+{
+    std::vector<uint8_t *> blocks;
+    size_t released = 0;
+    size_t trimmed = 0;
+
+    {
+        std::lock_guard<std::mutex> lock{ m_mutex };
+        for (auto iter = m_freelist.begin(); iter != m_freelist.end();) {
+            BlockHeader *header = reinterpret_cast<BlockHeader *>(iter->second);
+            if (predicate(header)) {
+                blocks.push_back(iter->second);
+                released += iter->first;
+                // the pages were already counted when they were released
+                if (!header->pages_released)
+                    trimmed += iter->first;
+                m_freelist_size -= iter->first;
+                iter = m_freelist.erase(iter);
+            } else {
+                ++iter;
+            }
+        }
+    }
+
+    // freeing large blocks can be slow so do it without holding the lock
+    for (uint8_t *ptr : blocks)
+        do_deallocate(ptr);
+
+    count(TRIMMED_BYTES, trimmed);
+    return released;
+}
+
+size_t MemoryUse::trim(size_t retain)
+{
+    int64_t cutoff;
+
+    {
+        std::lock_guard<std::mutex> lock{ m_mutex };
+        if (m_freelist_size <= retain)
+            return 0;
+
+        std::vector<std::pair<int64_t, size_t>> blocks;
+        blocks.reserve(m_freelist.size());
+        for (auto &entry : m_freelist)
+            blocks.push_back({ reinterpret_cast<BlockHeader *>(entry.second)->released_at, entry.first });
+
+        // keep the most recently released blocks since they're the most likely to be reused
+        std::sort(blocks.begin(), blocks.end());
+        size_t remaining = m_freelist_size;
+        cutoff = INT64_MIN;
+        for (auto &block : blocks) {
+            if (remaining <= retain)
+                break;
+            remaining -= block.second;
+            cutoff = block.first;
+        }
+    }
+
+    // blocks released after the scan above are newer than the cutoff and stay
+    return release_freelist_blocks([cutoff](const BlockHeader *header) { return header->released_at <= cutoff; });
+}
+
+void MemoryUse::decay()
+{
+    int64_t now = steady_now();
+    int64_t next = m_next_decay.load(std::memory_order_relaxed);
+    if (now < next || !m_next_decay.compare_exchange_strong(next, now + to_ticks(FREELIST_DECAY_INTERVAL), std::memory_order_relaxed))
+        return;
+
+    // prewarmed blocks haven't been in the working set yet, freeing them before the
+    // processing they were made for starts would defeat the point
+    int64_t cutoff = now - to_ticks(FREELIST_DECAY_TIME);
+    release_freelist_blocks([cutoff](const BlockHeader *header) { return header->released_at < cutoff && !header->prewarmed; });
+}
+
+size_t MemoryUse::release_pages(uint8_t *raw_ptr, size_t size)
+{
+    // the header lives at the start of the block so that page has to stay
+    size_t psize = page_size();
+    uintptr_t start = (reinterpret_cast<uintptr_t>(raw_ptr) + ALIGNMENT + psize - 1) & ~static_cast<uintptr_t>(psize - 1);
+    uintptr_t end = (reinterpret_cast<uintptr_t>(raw_ptr) + size) & ~static_cast<uintptr_t>(psize - 1);
+    if (end <= start)
+        return 0;
+
+#ifdef VS_TARGET_OS_WINDOWS
+    if (!VirtualAlloc(reinterpret_cast<void *>(start), end - start, MEM_RESET, PAGE_READWRITE))
+        return 0;
+#elif defined(VS_TARGET_OS_DARWIN)
+    if (madvise(reinterpret_cast<void *>(start), end - start, MADV_FREE))
+        return 0;
+#else
+    if (madvise(reinterpret_cast<void *>(start), end - start, MADV_DONTNEED))
+        return 0;
+#endif
+    return end - start;
+}
+
+void MemoryUse::release_idle_pages()
+{
+    // The blocks are taken off the freelist while the kernel is advised so nothing can reuse
+    // them in the meantime, madvise on a large pool is too slow to do while holding the lock
+    // that every frame allocation needs.
+    std::vector<std::pair<size_t, uint8_t *>> blocks;
+
+    {
+        std::lock_guard<std::mutex> lock{ m_mutex };
+        for (auto iter = m_freelist.begin(); iter != m_freelist.end();) {
+            const BlockHeader *header = reinterpret_cast<const BlockHeader *>(iter->second);
+            if (!header->pages_released && !header->prewarmed) {
+                blocks.push_back(*iter);
+                m_freelist_size -= iter->first;
+                iter = m_freelist.erase(iter);
+            } else {
+                ++iter;
+            }
+        }
+    }
+
+    if (blocks.empty())
+        return;
+
+    size_t released = 0;
+    for (auto &block : blocks) {
+        released += release_pages(block.second, block.first);
+        reinterpret_cast<BlockHeader *>(block.second)->pages_released = true;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock{ m_mutex };
+        for (auto &block : blocks) {
+            m_freelist.emplace(block.first, block.second);
+            m_freelist_size += block.first;
+        }
+    }
+
+    count(TRIMMED_BYTES, released);
+}
+
+size_t MemoryUse::prewarm(const std::map<size_t, size_t> &buffers, size_t budget, const std::atomic_bool &cancel)
+{
+    // only buffers that go through the pool can be prepared ahead of time
+    std::map<size_t, size_t> blocks;
+    for (auto &entry : buffers) {
+        size_t size = pool_block_size(entry.first);
+        if (size > SYSTEM_ALLOCATOR_THRESHOLD)
+            blocks[size] += entry.second;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock{ m_mutex };
+        for (auto &entry : blocks)
+            entry.second -= std::min(entry.second, m_freelist.count(entry.first));
+    }
+
+    size_t psize = page_size();
+    size_t prewarmed = 0;
+    bool pending = true;
+
+    // go through the sizes round robin so processing that starts right away benefits
+    // for all of them early on
+    while (pending && !cancel) {
+        pending = false;
+        for (auto &entry : blocks) {
+            if (!entry.second || cancel)
+                continue;
+
+            if (m_allocated + m_freelist_size + entry.first > std::min<size_t>(budget, m_limit))
+                return prewarmed;
+
+            uint8_t *raw_ptr = static_cast<uint8_t *>(do_allocate(entry.first));
+            if (!raw_ptr)
+                return prewarmed;
+
+            for (size_t offset = 0; offset < entry.first; offset += psize)
+                raw_ptr[offset] = 0;
+
+            init_block(raw_ptr, entry.first);
+            reinterpret_cast<BlockHeader *>(raw_ptr)->released_at = steady_now();
+            reinterpret_cast<BlockHeader *>(raw_ptr)->prewarmed = true;
+
+            {
+                std::lock_guard<std::mutex> lock{ m_mutex };
+                m_freelist.emplace(entry.first, raw_ptr);
+                m_freelist_size += entry.first;
+            }
+
+            prewarmed += entry.first;
+            if (--entry.second)
+                pending = true;
+        }
+    }
+
+    return prewarmed;
+}
+
 size_t MemoryUse::set_limit(size_t bytes)
 {
     m_limit = bytes;
@@ -308,4 +576,60 @@ void MemoryUse::on_core_freed()
         delete this;
 }
 
+ScratchArena::~ScratchArena()
+{
+    reset();
+    for (auto &block : m_blocks)
+        m_mem.deallocate_untracked(block.data);
+}
+
+void *ScratchArena::allocate(size_t size)
+{
+    size = (std::max<size_t>(size, 1) + (ALIGNMENT - 1)) & ~static_cast<size_t>(ALIGNMENT - 1);
+
+    while (m_block < m_blocks.size() && m_blocks[m_block].size - m_offset < size) {
+        ++m_block;
+        m_offset = 0;
+    }
+
+    if (m_block == m_blocks.size()) {
+        // grow geometrically so a filter with many small buffers needs few blocks, the earlier
+        // blocks stay allocated and are used again from the start by the next call
+        size_t block_size = std::max(size, m_blocks.empty() ? MIN_SCRATCH_BLOCK : m_blocks.back().size * 2);
+        uint8_t *data = m_mem.allocate_untracked(block_size);
+        if (!data)
+            return nullptr;
+        m_blocks.push_back({ data, block_size });
+        m_offset = 0;
+    }
+
+    m_last = m_blocks[m_block].data + m_offset;
+    m_last_offset = m_offset;
+    m_offset += size;
+    m_used += size;
+    MemoryUse::track_allocated(size);
+    return m_last;
+}
+
+void ScratchArena::deallocate(void *ptr)
+{
+    if (!ptr || ptr != m_last)
+        return;
+
+    size_t size = m_offset - m_last_offset;
+    m_offset = m_last_offset;
+    m_used -= size;
+    m_last = nullptr;
+    MemoryUse::track_deallocated(size);
+}
+
+void ScratchArena::reset()
+{
+    MemoryUse::track_deallocated(m_used);
+    m_block = 0;
+    m_offset = 0;
+    m_used = 0;
+    m_last = nullptr;
+}
+
 } // namespace vs
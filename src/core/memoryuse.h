@@ -27,28 +27,71 @@
 #include <map>
 #include <mutex>
 #include <random>
+#include <vector>
 
 namespace vs {
 
+struct MemoryStats {
+    static constexpr size_t NUM_SIZE_CLASSES = 16;
+
+    size_t allocated;
+    size_t peak_allocated;
+    size_t freelist_bytes;
+    size_t freelist_blocks;
+    uint64_t pool_hits;
+    uint64_t pool_misses;
+    uint64_t small_allocations;
+    uint64_t gc_evictions;
+    uint64_t gc_evicted_bytes;
+    uint64_t trimmed_bytes;
+    // allocations of up to 64kB in the first class, each following class doubles the upper
+    // bound and the last one holds everything above 1GB
+    uint64_t size_classes[NUM_SIZE_CLASSES];
+};
+
 // Memory allocation policy. Tracks all framebuffer allocations within a Core.
 class MemoryUse {
-    typedef std::multimap<size_t, uint8_t *> freelist_type;
+    friend class ScratchArena;
 
-    struct DebugStats;
+    typedef std::multimap<size_t, uint8_t *> freelist_type;
 
     struct BlockHeader {
         size_t size;
+        int64_t released_at; // when the block was put on the freelist
+        bool pages_released; // the memory has been handed back to the os but the block is still reserved
+        bool prewarmed; // added by prewarm and not handed out yet, idle trimming and decay skip it
+    };
+    static_assert(sizeof(BlockHeader) <= 64, "block header too large");
+
+    enum Counter {
+        POOL_HIT,
+        POOL_MISS,
+        SMALL_ALLOCATION,
+        GC_EVICTION,
+        GC_EVICTED_BYTES,
+        TRIMMED_BYTES,
+        SIZE_CLASS,
+        NUM_COUNTERS = SIZE_CLASS + MemoryStats::NUM_SIZE_CLASSES
+    };
+
+    // The statistics counters are always enabled so every thread gets its own cache line to
+    // increment them in, reading them sums all slots.
+    static constexpr size_t NUM_COUNTER_SLOTS = 16;
+
+    struct alignas(64) CounterSlot {
+        std::atomic<uint64_t> counters[NUM_COUNTERS];
     };
-    static_assert(sizeof(BlockHeader) <= 16, "block header too large");
 
     std::mutex m_mutex;
     freelist_type m_freelist;
     std::minstd_rand m_prng;
-    DebugStats *m_debug_stats = nullptr;
+    CounterSlot m_counter_slots[NUM_COUNTER_SLOTS] = {};
 
     std::atomic_size_t m_allocated{ 0 };
+    std::atomic_size_t m_peak_allocated{ 0 };
     std::atomic_size_t m_freelist_size{ 0 };
     std::atomic_size_t m_limit{ 0 };
+    std::atomic<int64_t> m_next_decay{ 0 };
 
     std::atomic_bool m_core_freed{ false };
 
@@ -65,8 +108,17 @@ class MemoryUse {
         s_call_delta -= static_cast<int64_t>(size);
     }
 
+    // used for scratch arena blocks, the arenas report the bytes they hand out to filters instead
+    uint8_t *allocate_untracked(size_t size);
+
+    void deallocate_untracked(uint8_t *buf);
+
     static uint8_t *init_block(uint8_t *raw_ptr, size_t allocation_size);
 
+    void count(Counter counter, uint64_t value = 1);
+
+    void add_allocated(size_t size);
+
     ~MemoryUse();
 
     void *do_allocate(size_t size);
@@ -82,6 +134,12 @@ class MemoryUse {
     void deallocate_to_freelist(uint8_t *ptr, size_t size);
 
     void gc_freelist();
+
+    // Frees the freelist blocks that match the predicate, returns the number of bytes released
+    template<typename T>
+    size_t release_freelist_blocks(T predicate);
+
+    static size_t release_pages(uint8_t *raw_ptr, size_t size);
 public:
     MemoryUse();
 
@@ -103,6 +161,27 @@ public:
 
     bool is_under_limit() const { return m_allocated < (m_limit >> 1); }
 
+    // Reset clears all counters and restarts the peak from the currently allocated bytes
+    void get_stats(MemoryStats &stats, bool reset);
+
+    // Frees the least recently released freelist blocks until at most retain bytes are left,
+    // returns the number of bytes freed
+    size_t trim(size_t retain);
+
+    // Frees freelist blocks that haven't been reused for a long time, rate limited internally
+    // so it can be called often. Prewarmed blocks are kept until they've been handed out once.
+    void decay();
+
+    // Hands the memory of all freelist blocks except prewarmed ones back to the os while
+    // keeping the blocks themselves, used when no processing has happened for a while
+    void release_idle_pages();
+
+    // Puts already faulted in blocks on the freelist so the first frames don't have to wait
+    // for the os, buffers maps requested allocation sizes to the number of buffers wanted.
+    // Blocks already on the freelist are taken into account and nothing is added once the
+    // pool and working memory together would exceed budget. Returns the number of bytes added.
+    size_t prewarm(const std::map<size_t, size_t> &buffers, size_t budget, const std::atomic_bool &cancel);
+
     struct CallTracking {
         int64_t delta;
         int64_t peak;
@@ -129,6 +208,49 @@ public:
     void on_core_freed();
 };
 
+// Bump allocator for the temporary buffers a filter needs during a single getframe call. Every
+// worker thread owns one and everything handed out is released at once when the call returns
+// while the blocks themselves are kept around for the next call. The blocks count towards the
+// allocated framebuffer bytes and the bytes handed out count towards the call tracking.
+//
+// The blocks are never merged and only freed when the thread exits, so a worker permanently
+// retains the largest amount of scratch memory a single call on it has needed. Blocks that a
+// request doesn't fit into are skipped and every new block is at least twice the size of the
+// previous one, which in the worst case makes the retained memory about four times that peak.
+// The blocks come from the framebuffer pool and count towards the cache limit, but the thread
+// holds on to them until it exits so trimming can't return them. Only line and band sized
+// buffers belong here.
+class ScratchArena {
+    struct Block {
+        uint8_t *data;
+        size_t size;
+    };
+
+    MemoryUse &m_mem;
+    std::vector<Block> m_blocks;
+    size_t m_block = 0;
+    size_t m_offset = 0;
+    size_t m_used = 0;
+
+    // only the most recent allocation can be returned before the reset
+    uint8_t *m_last = nullptr;
+    size_t m_last_offset = 0;
+public:
+    explicit ScratchArena(MemoryUse &mem) : m_mem(mem) {}
+
+    ScratchArena(const ScratchArena &) = delete;
+
+    ScratchArena &operator=(const ScratchArena &) = delete;
+
+    ~ScratchArena();
+
+    void *allocate(size_t size);
+
+    void deallocate(void *ptr);
+
+    void reset();
+};
+
 } // namespace vs
 
 #endif // MEMORYUSE_H
@@ -1673,7 +1673,19 @@ static const VSFrame *VS_CC transposeGetFrame(int n, int activationReason, void
         void (*func)(const void *, ptrdiff_t, void *, ptrdiff_t, unsigned, unsigned) = nullptr;
 
 #ifdef VS_TARGET_CPU_X86
-        if (d->cpulevel >= VS_CPU_LEVEL_SSE2) {
+        if (getCPUFeatures()->avx512 && d->cpulevel >= VS_CPU_LEVEL_AVX512) {
+            switch (d->vi.format.bytesPerSample) {
+            case 1: func = vs_transpose_plane_byte_avx512; break;
+            case 2: func = vs_transpose_plane_word_avx512; break;
+            case 4: func = vs_transpose_plane_dword_avx512; break;
+            }
+        } else if (getCPUFeatures()->avx2 && d->cpulevel >= VS_CPU_LEVEL_AVX2) {
+            switch (d->vi.format.bytesPerSample) {
+            case 1: func = vs_transpose_plane_byte_avx2; break;
+            case 2: func = vs_transpose_plane_word_avx2; break;
+            case 4: func = vs_transpose_plane_dword_avx2; break;
+            }
+        } else if (d->cpulevel >= VS_CPU_LEVEL_SSE2) {
             switch (d->vi.format.bytesPerSample) {
             case 1: func = vs_transpose_plane_byte_sse2; break;
             case 2: func = vs_transpose_plane_word_sse2; break;
@@ -0,0 +1,150 @@
+/*
+* Copyright (c) 2012-2020 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef SLABALLOCATOR_H
+#define SLABALLOCATOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include "VSHelper4.h"
+
+namespace vs {
+
+// Fixed size allocator for the small objects created for every single frame request.
+// Objects are carved out of 64kb slabs in cache line sized slots so the refcounts of
+// neighbouring objects never share a line. Each thread keeps a short free list of its
+// own and only touches the shared list in batches, frames are usually freed by a
+// different thread than the one that created them so slots move between threads in
+// batches. Slabs are never returned to the system, the number of live objects is
+// bounded by the number of frames in flight and cached.
+template<typename T>
+class SlabAllocator {
+private:
+    static constexpr size_t SLOT_ALIGNMENT = 64;
+    static constexpr size_t SLOT_SIZE = (sizeof(T) + SLOT_ALIGNMENT - 1) & ~(SLOT_ALIGNMENT - 1);
+    static constexpr size_t SLAB_SIZE = (SLOT_SIZE * 16 > 65536) ? SLOT_SIZE * 16 : 65536;
+    static constexpr size_t SLOTS_PER_SLAB = SLAB_SIZE / SLOT_SIZE;
+    static constexpr size_t MAX_CACHED_SLOTS = 64;
+    static constexpr size_t TRANSFER_BATCH = 32;
+
+    struct FreeSlot {
+        FreeSlot *next;
+    };
+
+    struct SharedList {
+        std::mutex lock;
+        FreeSlot *head = nullptr;
+    };
+
+    struct ThreadCache {
+        FreeSlot *head = nullptr;
+        size_t count = 0;
+
+        ~ThreadCache() {
+            if (!head)
+                return;
+            FreeSlot *tail = head;
+            while (tail->next)
+                tail = tail->next;
+            SharedList &list = shared();
+            std::lock_guard<std::mutex> lock(list.lock);
+            tail->next = list.head;
+            list.head = head;
+        }
+    };
+
+    // intentionally leaked, thread caches can be destroyed after static destructors have run
+    static SharedList &shared() {
+        static SharedList *list = new SharedList();
+        return *list;
+    }
+
+    static ThreadCache &cache() {
+        thread_local ThreadCache tc;
+        return tc;
+    }
+
+    static void refill(ThreadCache &tc) {
+        SharedList &list = shared();
+        {
+            std::lock_guard<std::mutex> lock(list.lock);
+            while (list.head && tc.count < TRANSFER_BATCH) {
+                FreeSlot *slot = list.head;
+                list.head = slot->next;
+                slot->next = tc.head;
+                tc.head = slot;
+                tc.count++;
+            }
+        }
+
+        if (tc.head)
+            return;
+
+        uint8_t *slab = vsh::vsh_aligned_malloc<uint8_t>(SLAB_SIZE, SLOT_ALIGNMENT);
+        if (!slab)
+            throw std::bad_alloc();
+
+        for (size_t i = SLOTS_PER_SLAB; i > 0; i--) {
+            FreeSlot *slot = reinterpret_cast<FreeSlot *>(slab + (i - 1) * SLOT_SIZE);
+            slot->next = tc.head;
+            tc.head = slot;
+        }
+        tc.count = SLOTS_PER_SLAB;
+    }
+public:
+    static void *allocate() {
+        ThreadCache &tc = cache();
+        if (!tc.head)
+            refill(tc);
+        FreeSlot *slot = tc.head;
+        tc.head = slot->next;
+        tc.count--;
+        return slot;
+    }
+
+    static void deallocate(void *ptr) noexcept {
+        if (!ptr)
+            return;
+        ThreadCache &tc = cache();
+        FreeSlot *slot = static_cast<FreeSlot *>(ptr);
+        slot->next = tc.head;
+        tc.head = slot;
+
+        if (++tc.count > MAX_CACHED_SLOTS) {
+            FreeSlot *first = tc.head;
+            FreeSlot *last = first;
+            for (size_t i = 1; i < TRANSFER_BATCH; i++)
+                last = last->next;
+            tc.head = last->next;
+            tc.count -= TRANSFER_BATCH;
+
+            SharedList &list = shared();
+            std::lock_guard<std::mutex> lock(list.lock);
+            last->next = list.head;
+            list.head = first;
+        }
+    }
+};
+
+}
+
+#endif
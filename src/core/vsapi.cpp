@@ -963,6 +963,35 @@ static void VS_CC getCoreInfo2(VSCore *core, VSCoreInfo2 *info) VS_NOEXCEPT {
     core->getCoreInfo2(*info);
 }
 
+static void *VS_CC allocScratch(size_t size, VSFrameContext *frameCtx) VS_NOEXCEPT {
+    assert(frameCtx);
+    vs::ScratchArena *arena = VSCore::scratchArena;
+    if (!arena)
+        VS_FATAL_ERROR("allocScratch() may only be called from a filter's getframe function");
+    return arena->allocate(size);
+}
+
+static void VS_CC freeScratch(void *ptr, VSFrameContext *frameCtx) VS_NOEXCEPT {
+    assert(frameCtx);
+    if (ptr && VSCore::scratchArena)
+        VSCore::scratchArena->deallocate(ptr);
+}
+
+static void VS_CC getCoreMemoryStats(VSCore *core, VSCoreMemoryStats *stats, int reset) VS_NOEXCEPT {
+    assert(core && stats);
+    core->getMemoryStats(*stats, !!reset);
+}
+
+static int64_t VS_CC trimCoreMemory(VSCore *core, int64_t retainBytes) VS_NOEXCEPT {
+    assert(core);
+    return core->trimMemory(retainBytes);
+}
+
+static void VS_CC prewarmCoreMemory(VSNode *node, VSCore *core) VS_NOEXCEPT {
+    assert(node && core);
+    core->prewarmMemory(node);
+}
+
 static void VS_CC createVideoFilter(VSMap *out, const char *name, const VSVideoInfo *vi, VSFilterGetFrame getFrame, VSFilterFree free, int filterMode, const VSFilterDependency *dependencies, int numDeps, void *instanceData, VSCore *core) VS_NOEXCEPT {
     assert(out && name && vi && getFrame && core);
     core->createVideoFilter(out, name, vi, getFrame, free, static_cast<VSFilterMode>(filterMode), dependencies, numDeps, instanceData, VAPOURSYNTH_API_MAJOR);
@@ -1285,7 +1314,14 @@ const VSAPI vs_internal_vsapi = {
     &getNodeCreationFunctionName,
     &getNodeCreationPluginID,
     &getNodeCreationPluginNS,
-    &getNodeCreationFunctionArguments
+    &getNodeCreationFunctionArguments,
+
+    &allocScratch,
+    &freeScratch,
+
+    &getCoreMemoryStats,
+    &trimCoreMemory,
+    &prewarmCoreMemory
 };
 
 const vs3::VSAPI3 vs_internal_vsapi3 = {
@@ -79,7 +79,7 @@ bool VSFrameContext::setError(const std::string &errorMsg) {
     bool prevState = error;
     error = true;
     if (!prevState)
-        errorMessage = errorMsg;
+        errorMessage = std::make_unique<std::string>(errorMsg);
     return prevState;
 }
 
@@ -156,29 +156,29 @@ void VSPlaneData::release() noexcept {
 
 void VSFrame::setAllocationInfo() noexcept {
     VSNode *currentNode = core->currentProcessingNode;
+    std::string info;
 
     if (contentType == mtVideo) {
         char fmtname[32];
         core->getVideoFormatName(format.vf, fmtname);
         if (currentNode)
-            debugAllocationInfo = "Video frame #" + std::to_string(allocationSeq++) + " (" + std::string(fmtname) + " " + std::to_string(width) + "x" + std::to_string(height) + ") allocated by " + currentNode->getName();
+            info = "Video frame #" + std::to_string(allocationSeq++) + " (" + std::string(fmtname) + " " + std::to_string(width) + "x" + std::to_string(height) + ") allocated by " + currentNode->getName();
         else
-            debugAllocationInfo = "Video frame #" + std::to_string(allocationSeq++) + " (" + std::string(fmtname) + " " + std::to_string(width) + "x" + std::to_string(height) + ") allocated by <unknown>";
+            info = "Video frame #" + std::to_string(allocationSeq++) + " (" + std::string(fmtname) + " " + std::to_string(width) + "x" + std::to_string(height) + ") allocated by <unknown>";
     } else {
         if (currentNode)
-            debugAllocationInfo = "Audio frame #" + std::to_string(allocationSeq++) + " (" + std::to_string(width) + ") allocated by " + currentNode->getName();
+            info = "Audio frame #" + std::to_string(allocationSeq++) + " (" + std::to_string(width) + ") allocated by " + currentNode->getName();
         else
-            debugAllocationInfo = "Audio frame #" + std::to_string(allocationSeq++) + " (" + std::to_string(width) + ") allocated by <unknown>";
+            info = "Audio frame #" + std::to_string(allocationSeq++) + " (" + std::to_string(width) + ") allocated by <unknown>";
     }
+    debugAllocationInfo = std::make_unique<std::string>(std::move(info));
+
+    // only add the frame once the description is set since it may be read at any time after that
+    std::lock_guard<std::mutex> lock(core->frameRefMutex);
+    core->frameRefs.insert(this);
 }
 
 VSFrame::VSFrame(const VSVideoFormat &f, int width, int height, const VSFrame *propSrc, VSCore *core) noexcept : refcount(1), contentType(mtVideo), v3format(nullptr), width(width), height(height), properties(propSrc ? &propSrc->properties : nullptr), core(core) {
-    frameRefDebug = core->enableFrameRefDebug;
-    if (frameRefDebug) {
-        std::lock_guard<std::mutex> lock(core->frameRefMutex);
-        core->frameRefs.insert(this);
-    }
-
     if (width <= 0 || height <= 0)
         core->logFatal("Error in frame creation: dimensions are negative (" + std::to_string(width) + "x" + std::to_string(height) + ")");
 
@@ -190,10 +190,8 @@ VSFrame::VSFrame(const VSVideoFormat &f, int width, int height, const VSFrame *p
     if (numPlanes == 3) {
         ptrdiff_t plane23 = (static_cast<ptrdiff_t>(width >> format.vf.subSamplingW) * format.vf.bytesPerSample + (alignment - 1)) & ~(alignment - 1);
         stride[1] = plane23;
-        stride[2] = plane23;
     } else {
         stride[1] = 0;
-        stride[2] = 0;
     }
 
     data[0] = new VSPlaneData(stride[0] * height, *core->memory);
@@ -203,17 +201,11 @@ VSFrame::VSFrame(const VSVideoFormat &f, int width, int height, const VSFrame *p
         data[2] = new VSPlaneData(size23, *core->memory);
     }
 
-    if (frameRefDebug)
+    if (core->enableFrameRefDebug)
         setAllocationInfo();
 }
 
 VSFrame::VSFrame(const VSVideoFormat &f, int width, int height, const VSFrame * const *planeSrc, const int *plane, const VSFrame *propSrc, VSCore *core) noexcept : refcount(1), contentType(mtVideo), v3format(nullptr), width(width), height(height), properties(propSrc ? &propSrc->properties : nullptr), core(core) {
-    frameRefDebug = core->enableFrameRefDebug;
-    if (frameRefDebug) {
-        std::lock_guard<std::mutex> lock(core->frameRefMutex);
-        core->frameRefs.insert(this);
-    }
-
     if (width <= 0 || height <= 0)
         core->logFatal("Error in frame creation: dimensions are negative " + std::to_string(width) + "x" + std::to_string(height));
 
@@ -225,10 +217,8 @@ VSFrame::VSFrame(const VSVideoFormat &f, int width, int height, const VSFrame *
     if (numPlanes == 3) {
         ptrdiff_t plane23 = (static_cast<ptrdiff_t>(width >> format.vf.subSamplingW) * format.vf.bytesPerSample + (alignment - 1)) & ~(alignment - 1);
         stride[1] = plane23;
-        stride[2] = plane23;
     } else {
         stride[1] = 0;
-        stride[2] = 0;
     }
 
     for (int i = 0; i < numPlanes; i++) {
@@ -241,25 +231,19 @@ VSFrame::VSFrame(const VSVideoFormat &f, int width, int height, const VSFrame *
             data[i]->add_ref();
         } else {
             if (i == 0) {
-                data[i] = new VSPlaneData(stride[i] * height, *core->memory);
+                data[i] = new VSPlaneData(stride[0] * height, *core->memory);
             } else {
-                data[i] = new VSPlaneData(stride[i] * (height >> format.vf.subSamplingH), *core->memory);
+                data[i] = new VSPlaneData(stride[1] * (height >> format.vf.subSamplingH), *core->memory);
             }
         }
     }
 
-    if (frameRefDebug)
+    if (core->enableFrameRefDebug)
         setAllocationInfo();
 }
 
 VSFrame::VSFrame(const VSAudioFormat &f, int numSamples, const VSFrame *propSrc, VSCore *core) noexcept
     : refcount(1), contentType(mtAudio), v3format(nullptr), properties(propSrc ? &propSrc->properties : nullptr), core(core) {
-    frameRefDebug = core->enableFrameRefDebug;
-    if (frameRefDebug) {
-        std::lock_guard<std::mutex> lock(core->frameRefMutex);
-        core->frameRefs.insert(this);
-    }
-
     if (numSamples <= 0)
         core->logFatal("Error in frame creation: bad number of samples (" + std::to_string(numSamples) + ")");
 
@@ -272,18 +256,12 @@ VSFrame::VSFrame(const VSAudioFormat &f, int numSamples, const VSFrame *propSrc,
 
     data[0] = new VSPlaneData(stride[0] * format.af.numChannels, *core->memory);
 
-    if (frameRefDebug)
+    if (core->enableFrameRefDebug)
         setAllocationInfo();
 }
 
 VSFrame::VSFrame(const VSAudioFormat &f, int numSamples, const VSFrame * const *channelSrc, const int *channel, const VSFrame *propSrc, VSCore *core) noexcept
     : refcount(1), contentType(mtAudio), v3format(nullptr), properties(propSrc ? &propSrc->properties : nullptr), core(core) {
-    frameRefDebug = core->enableFrameRefDebug;
-    if (frameRefDebug) {
-        std::lock_guard<std::mutex> lock(core->frameRefMutex);
-        core->frameRefs.insert(this);
-    }
-
     if (numSamples <= 0)
         core->logFatal("Error in frame creation: bad number of samples (" + std::to_string(numSamples) + ")");
 
@@ -306,16 +284,11 @@ VSFrame::VSFrame(const VSAudioFormat &f, int numSamples, const VSFrame * const *
         }
     }
 
-    if (frameRefDebug)
+    if (core->enableFrameRefDebug)
         setAllocationInfo();
 }
 
 VSFrame::VSFrame(const VSFrame &f) noexcept : refcount(1), v3format(nullptr), core(f.core) {
-    frameRefDebug = core->enableFrameRefDebug;
-    if (frameRefDebug) {
-        std::lock_guard<std::mutex> lock(core->frameRefMutex);
-        core->frameRefs.insert(this);
-    }
     contentType = f.contentType;
     data[0] = f.data[0];
     data[1] = f.data[1];
@@ -331,10 +304,9 @@ VSFrame::VSFrame(const VSFrame &f) noexcept : refcount(1), v3format(nullptr), co
     height = f.height;
     stride[0] = f.stride[0];
     stride[1] = f.stride[1];
-    stride[2] = f.stride[2];
     properties = f.properties;
 
-    if (frameRefDebug)
+    if (core->enableFrameRefDebug)
         setAllocationInfo();
 }
 
@@ -345,12 +317,21 @@ VSFrame::~VSFrame() {
         data[2]->release();
     }
 
-    if (frameRefDebug) {
+    if (debugAllocationInfo) {
         std::lock_guard<std::mutex> lock(core->frameRefMutex);
         core->frameRefs.erase(this);
     }
 }
 
+size_t VSFrame::getPlaneAllocationSize(const VSVideoFormat &f, int width, int height, int plane) noexcept {
+    if (plane > 0) {
+        width >>= f.subSamplingW;
+        height >>= f.subSamplingH;
+    }
+    ptrdiff_t planeStride = (static_cast<ptrdiff_t>(width) * f.bytesPerSample + (alignment - 1)) & ~(alignment - 1);
+    return planeStride * height + 2 * guardSpace;
+}
+
 const vs3::VSVideoFormat *VSFrame::getVideoFormatV3() const noexcept {
     assert(contentType == mtVideo);
     if (!v3format)
@@ -363,7 +344,7 @@ ptrdiff_t VSFrame::getStride(int plane) const {
     // numPlanes is the channel count for audio frames and can exceed the array size
     if (plane < 0 || plane >= numPlanes || plane >= 3)
         return 0;
-    return stride[plane];
+    return stride[plane ? 1 : 0];
 }
 
 const uint8_t *VSFrame::getReadPtr(int plane) const {
@@ -1065,6 +1046,10 @@ PVSFrame VSNode::getFrameInternal(int n, int activationReason, VSFrameContext *f
     const VSFrame *r = (apiMajor == VAPOURSYNTH_API_MAJOR) ? filterGetFrame(n, activationReason, instanceData, frameCtx->frameContext, frameCtx, core, &vs_internal_vsapi) : reinterpret_cast<vs3::VSFilterGetFrame>(filterGetFrame)(n, activationReason, &instanceData, frameCtx->frameContext, frameCtx, core, &vs_internal_vsapi3);
     core->currentProcessingNode = nullptr;
 
+    // scratch memory only lives for the duration of a single call
+    if (core->scratchArena)
+        core->scratchArena->reset();
+
     updateTransientAllocEstimate(vs::MemoryUse::end_call_tracking(savedTracking));
 
     if (enableFilterTiming) {
@@ -1707,6 +1692,76 @@ void VSCore::getCoreInfo2(VSCoreInfo2 &info) const {
     info.usedFramebufferSize = memory->allocated_bytes();
 }
 
+void VSCore::getMemoryStats(VSCoreMemoryStats &stats, bool reset) {
+    vs::MemoryStats mstats;
+    memory->get_stats(mstats, reset);
+    stats.allocatedBytes = mstats.allocated;
+    stats.peakAllocatedBytes = mstats.peak_allocated;
+    stats.freelistBytes = mstats.freelist_bytes;
+    stats.freelistBlocks = mstats.freelist_blocks;
+    stats.poolHits = mstats.pool_hits;
+    stats.poolMisses = mstats.pool_misses;
+    stats.smallAllocations = mstats.small_allocations;
+    stats.gcEvictions = mstats.gc_evictions;
+    stats.gcEvictedBytes = mstats.gc_evicted_bytes;
+    stats.trimmedBytes = mstats.trimmed_bytes;
+    static_assert(sizeof(stats.sizeClasses) / sizeof(stats.sizeClasses[0]) == vs::MemoryStats::NUM_SIZE_CLASSES);
+    for (size_t i = 0; i < vs::MemoryStats::NUM_SIZE_CLASSES; i++)
+        stats.sizeClasses[i] = mstats.size_classes[i];
+}
+
+int64_t VSCore::trimMemory(int64_t retainBytes) {
+    return memory->trim(static_cast<size_t>(std::max<int64_t>(retainBytes, 0)));
+}
+
+void VSCore::prewarmMemory(VSNode *node) {
+    // every node can have one frame in flight per thread and nodes with an enabled cache
+    // additionally keep up to its current size around, nodes with variable format or
+    // dimensions and audio nodes, whose frames are too small to be pooled, are skipped
+    std::map<size_t, size_t> buffers;
+    size_t numThreads = threadPool->threadCount();
+    std::set<VSNode *> visited;
+    std::vector<VSNode *> pending = { node };
+
+    while (!pending.empty()) {
+        VSNode *current = pending.back();
+        pending.pop_back();
+        if (!visited.insert(current).second)
+            continue;
+
+        for (const auto &dep : current->dependencies)
+            pending.push_back(dep.source);
+
+        const VSVideoInfo &vi = current->vi;
+        if (current->nodeType != mtVideo || !vsh::isConstantVideoFormat(&vi))
+            continue;
+
+        size_t numFrames = numThreads;
+        if (current->cacheEnabled) {
+            std::lock_guard<std::mutex> lock(current->cacheMutex);
+            numFrames += current->cache.getMaxFrames();
+        }
+
+        for (int plane = 0; plane < vi.format.numPlanes; plane++)
+            buffers[VSFrame::getPlaneAllocationSize(vi.format, vi.width, vi.height, plane)] += numFrames;
+    }
+
+    std::lock_guard<std::mutex> lock(prewarmLock);
+    stopPrewarm();
+    // never let prewarming take up more than a quarter of the allowed memory
+    prewarmThread = std::thread([this, buffers = std::move(buffers)]() {
+        memory->prewarm(buffers, memory->limit() / 4, prewarmCancel);
+    });
+}
+
+void VSCore::stopPrewarm() {
+    if (prewarmThread.joinable()) {
+        prewarmCancel = true;
+        prewarmThread.join();
+        prewarmCancel = false;
+    }
+}
+
 bool VSCore::getAudioFormatName(const VSAudioFormat &format, char *buffer) noexcept {
     if (!isValidAudioFormat(format.sampleType, format.bitsPerSample, format.channelLayout))
         return false;
@@ -2094,6 +2149,10 @@ void VSCore::freeCore() {
     if (coreFreed)
         logFatal("Double free of core");
     coreFreed = true;
+    {
+        std::lock_guard<std::mutex> lock(prewarmLock);
+        stopPrewarm();
+    }
     threadPool->waitForDone();
     if (numFilterInstances > 1)
         logMessage(mtWarning, "Core freed but " + safe_to_string(numFilterInstances.load() - 1) + " filter instance(s) still exist");
@@ -2609,7 +2668,7 @@ std::string VSCore::getFrameRefInfo() {
     info.reserve(65000);
     info += "FrameData START (num frames: " + std::to_string(frameRefs.size()) + ")\n";
     for (const auto &frame : frameRefs)
-        info += frame->debugAllocationInfo + "\n";
+        info += *frame->debugAllocationInfo + "\n";
     info += "FrameData END (num frames: " + std::to_string(frameRefs.size()) + ")\n";
     return info;
 }
@@ -2625,5 +2684,6 @@ ptrdiff_t VSFrame::alignment = 32;
 #endif
 
 thread_local VSNode *VSCore::currentProcessingNode = nullptr;
+thread_local vs::ScratchArena *VSCore::scratchArena = nullptr;
 thread_local PVSFunctionFrame VSCore::functionFrame;
 std::atomic<uint64_t> VSFrame::allocationSeq = 0;
\ No newline at end of file
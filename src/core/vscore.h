@@ -26,6 +26,7 @@
 #include "vslog.h"
 #include "intrusive_ptr.h"
 #include "memoryuse.h"
+#include "slaballocator.h"
 #include <cstdlib>
 #include <stdexcept>
 #include <string>
@@ -399,6 +400,8 @@ public:
     const size_t size;
     VSPlaneData(size_t dataSize, vs::MemoryUse &mem) noexcept;
     VSPlaneData(const VSPlaneData &d) noexcept;
+    static void *operator new(size_t) { return vs::SlabAllocator<VSPlaneData>::allocate(); }
+    static void operator delete(void *ptr) noexcept { vs::SlabAllocator<VSPlaneData>::deallocate(ptr); }
     bool unique() noexcept;
     void add_ref() noexcept;
     void release() noexcept;
@@ -409,21 +412,20 @@ struct VSFrame {
 private:
     std::atomic<long> refcount;
     VSMediaType contentType;
+    int numPlanes;
     union {
         VSVideoFormat vf;
         VSAudioFormat af;
     } format;
     mutable std::atomic<const vs3::VSVideoFormat *> v3format; /* API 3 compatibility */
     VSPlaneData *data[3] = {}; /* only the first data pointer is ever used for audio and is subdivided using the internal offset in height */
+    ptrdiff_t stride[2] = {}; /* the second and third plane always share a stride, stride[0] stores internal offset between audio channels */
     int width; /* stores number of samples for audio */
     int height;
-    ptrdiff_t stride[3] = {}; /* stride[0] stores internal offset between audio channels */
-    int numPlanes;
     VSMap properties;
     VSCore *core;
-    bool frameRefDebug = false;
 
-    std::string debugAllocationInfo;
+    std::unique_ptr<std::string> debugAllocationInfo; /* only set when frame reference debugging is enabled */
     static std::atomic<uint64_t> allocationSeq;
 
     void setAllocationInfo() noexcept;
@@ -443,6 +445,12 @@ public:
     VSFrame(const VSFrame &f) noexcept;
     ~VSFrame();
 
+    // the size of the buffer a newly created frame allocates for the given plane
+    static size_t getPlaneAllocationSize(const VSVideoFormat &f, int width, int height, int plane) noexcept;
+
+    static void *operator new(size_t) { return vs::SlabAllocator<VSFrame>::allocate(); }
+    static void operator delete(void *ptr) noexcept { vs::SlabAllocator<VSFrame>::deallocate(ptr); }
+
     void add_ref() noexcept {
         ++refcount;
     }
@@ -604,7 +612,7 @@ private:
     /// external return only
     VSFrameDoneCallback frameDone;
     void *userData;
-    std::string errorMessage;
+    std::unique_ptr<std::string> errorMessage;
 public:
     SemiStaticVector<NodeOutputKey, NUM_FRAMECONTEXT_FAST_REQS> reqList;
     SemiStaticVector<std::pair<NodeOutputKey, PVSFrame>, NUM_FRAMECONTEXT_FAST_REQS> availableFrames;
@@ -627,12 +635,16 @@ public:
     }
 
     const std::string &getErrorMessage() {
-        return errorMessage;
+        assert(errorMessage);
+        return *errorMessage;
     }
 
     bool setError(const std::string &errorMsg);
     VSFrameContext(NodeOutputKey key, const PVSFrameContext &notify);
     VSFrameContext(int n, VSNode *node, VSFrameDoneCallback frameDone, void *userData, bool lockOnOutput, bool reserveThread);
+
+    static void *operator new(size_t) { return vs::SlabAllocator<VSFrameContext>::allocate(); }
+    static void operator delete(void *ptr) noexcept { vs::SlabAllocator<VSFrameContext>::deallocate(ptr); }
 };
 
 struct VSFunctionFrame;
@@ -1152,6 +1164,12 @@ private:
 
     std::atomic<int> cpuLevel;
 
+    std::mutex prewarmLock;
+    std::thread prewarmThread;
+    std::atomic_bool prewarmCancel{false};
+
+    void stopPrewarm();
+
     static std::filesystem::path getLibraryPath();
 
     virtual ~VSCore();
@@ -1184,6 +1202,9 @@ public:
     std::string getFrameRefInfo();
     //
 
+    // The scratch arena owned by the current worker thread, null in all other threads
+    static thread_local vs::ScratchArena *scratchArena;
+
     void notifyCaches(bool needMemory);
     const vs3::VSVideoFormat *getV3VideoFormat(int id);
     const vs3::VSVideoFormat *getVideoFormat3(int id);
@@ -1238,6 +1259,9 @@ public:
     const VSCoreInfo &getCoreInfo3();
     void getCoreInfo(VSCoreInfo &info) const;
     void getCoreInfo2(VSCoreInfo2 &info) const;
+    void getMemoryStats(VSCoreMemoryStats &stats, bool reset);
+    int64_t trimMemory(int64_t retainBytes);
+    void prewarmMemory(VSNode *node);
 
     static bool getAudioFormatName(const VSAudioFormat &format, char *buffer) noexcept;
     static bool getVideoFormatName(const VSVideoFormat &format, char *buffer) noexcept;
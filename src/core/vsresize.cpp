@@ -675,7 +675,7 @@ class vszimg {
         set_frame_params(m_frame_params, dst_format);
     }
 
-    const VSFrame *real_get_frame(const VSFrame *src_frame, VSCore *core, const VSAPI *vsapi) {
+    const VSFrame *real_get_frame(const VSFrame *src_frame, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi) {
         VSFrame *dst_frame = nullptr;
         vszimgxx::zimage_format src_format, dst_format;
 
@@ -736,10 +736,7 @@ class vszimg {
                 dst_format_b.field_parity = ZIMG_FIELD_BOTTOM;
                 std::shared_ptr<graph_data> graph_b = get_graph_data(src_format_b, dst_format_b);
 
-                std::unique_ptr<void, decltype(&vsh_aligned_free)> tmp{
-                    vsh_aligned_malloc(std::max(graph_t->graph.get_tmp_size(), graph_b->graph.get_tmp_size()), 64),
-                    vsh_aligned_free
-                };
+                void *tmp = vsapi->allocScratch(std::max(graph_t->graph.get_tmp_size(), graph_b->graph.get_tmp_size()), frameCtx);
                 if (!tmp)
                     throw std::bad_alloc{};
 
@@ -748,24 +745,21 @@ class vszimg {
 
                 auto src_buffer_b = get_field_buffer(src_buffer, src_vsformat->numPlanes, ZIMG_FIELD_BOTTOM);
                 auto dst_buffer_b = get_field_buffer(dst_buffer, dst_vsformat->numPlanes, ZIMG_FIELD_BOTTOM);
-                graph_b->graph.process(src_buffer_b, dst_buffer_b, tmp.get());
+                graph_b->graph.process(src_buffer_b, dst_buffer_b, tmp);
 
                 auto src_buffer_t = get_field_buffer(src_buffer, src_vsformat->numPlanes, ZIMG_FIELD_TOP);
                 auto dst_buffer_t = get_field_buffer(dst_buffer, dst_vsformat->numPlanes, ZIMG_FIELD_TOP);
-                graph_t->graph.process(src_buffer_t, dst_buffer_t, tmp.get());
+                graph_t->graph.process(src_buffer_t, dst_buffer_t, tmp);
             } else {
                 std::shared_ptr<graph_data> graph = get_graph_data(src_format, dst_format);
 
-                std::unique_ptr<void, decltype(&vsh_aligned_free)> tmp{
-                    vsh_aligned_malloc(graph->graph.get_tmp_size(), 64),
-                    vsh_aligned_free
-                };
+                void *tmp = vsapi->allocScratch(graph->graph.get_tmp_size(), frameCtx);
                 if (!tmp)
                     throw std::bad_alloc{};
 
                 auto src_buffer = import_frame_as_buffer_const(src_frame, vsapi);
                 auto dst_buffer = import_frame_as_buffer(dst_frame, vsapi);
-                graph->graph.process(src_buffer, dst_buffer, tmp.get());
+                graph->graph.process(src_buffer, dst_buffer, tmp);
             }
 
             VSMap *dst_props = vsapi->getFramePropertiesRW(dst_frame);
@@ -810,7 +804,7 @@ public:
                 vsapi->requestFrameFilter(n, m_node, frameCtx);
             } else if (activationReason == arAllFramesReady) {
                 src_frame = vsapi->getFrameFilter(n, m_node, frameCtx);
-                ret = real_get_frame(src_frame, core, vsapi);
+                ret = real_get_frame(src_frame, frameCtx, core, vsapi);
             }
         } catch (const vszimgxx::zerror &e) {
             std::string errmsg = "Resize error " + std::to_string(e.code) + ": " + e.msg;
@@ -44,6 +44,10 @@ static constexpr int64_t pressureCacheSweepInterval = std::chrono::duration_cast
 // memory held by something only a full pipeline flush can reach, flush as a last resort
 static constexpr int64_t flushAfterOverInterval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::milliseconds(2000)).count();
 
+// once nothing has been processed for this long the memory of the pooled frame buffers is handed
+// back to the os so hosts that keep a core around between renders don't hold on to it
+static constexpr std::chrono::seconds idlePoolTrimDelay(3);
+
 static int64_t steadyClockNow() {
     return std::chrono::steady_clock::now().time_since_epoch().count();
 }
@@ -87,6 +91,10 @@ void VSThreadPool::runTasks(bool &stop) {
         core->logFatal("Bad SSE state detected after creating new thread");
 #endif
 
+    // backs allocScratch for all filter calls made by this thread
+    vs::ScratchArena scratch(*core->memory);
+    core->scratchArena = &scratch;
+
     std::unique_lock<std::mutex> lock(taskLock);
 
     std::string deferredLog;
@@ -269,6 +277,7 @@ void VSThreadPool::runTasks(bool &stop) {
                 if (!cacheSweepActive.exchange(true)) {
                     lastCacheSweep = timeNow;
                     core->notifyCaches(overLimit);
+                    core->memory->decay();
                     cacheSweepActive = false;
                 }
             }
@@ -352,8 +361,9 @@ void VSThreadPool::runTasks(bool &stop) {
             }
             
             bool shouldWait = true;
+            bool lastIdle = (++idleThreads == allThreads.size());
 
-            if (++idleThreads == allThreads.size()) {
+            if (lastIdle) {
                 if (flushCaches) {
                     core->clearCaches(true);
                     flushCaches = false;
@@ -375,13 +385,28 @@ void VSThreadPool::runTasks(bool &stop) {
                 // We always need to wait here to unlock the taskLock mutex, if we don't no new work can be added to the queue and the thread will never wake up again
                 // Wait predicates don't work since they're the equivalent of a wrapping while loop
                 do {
-                    newWork.wait(lock);
+                    // the last thread to go idle is responsible for trimming the frame buffer pool
+                    if (lastIdle) {
+                        lastIdle = false;
+                        if (newWork.wait_for(lock, idlePoolTrimDelay) == std::cv_status::timeout && idleThreads == allThreads.size() && !stop) {
+                            lock.unlock();
+                            core->memory->release_idle_pages();
+                            lock.lock();
+                            // work queued while the lock was released has already sent its notification
+                            if (tasks.empty() && !stop)
+                                newWork.wait(lock);
+                        }
+                    } else {
+                        newWork.wait(lock);
+                    }
                 } while (activeThreads >= maxThreads && !stop);
                 --idleThreads;
                 ++activeThreads;
             }
         }
     }
+
+    core->scratchArena = nullptr;
 }
 
 VSThreadPool::VSThreadPool(VSCore *core) : core(core), activeThreads(0), idleThreads(0), reqCounter(0), overLimitSince(0), lastCacheSweep(0), completedExternalFrames(0), inflightAllocation(0), processingThreads(0), cacheSweepActive(false), stopThreads(false), flushCaches(false) {
@@ -473,7 +498,7 @@ void VSThreadPool::returnFrame(VSFrameContext *rCtx, const PVSFrame &f, std::uni
     if (rCtx->hasError()) {
         if (outputLock)
             callbackLock.lock();
-        rCtx->frameDone(rCtx->userData, nullptr, rCtx->key.second, rCtx->key.first, rCtx->errorMessage.c_str());
+        rCtx->frameDone(rCtx->userData, nullptr, rCtx->key.second, rCtx->key.first, rCtx->getErrorMessage().c_str());
         if (outputLock)
             callbackLock.unlock();
     } else {
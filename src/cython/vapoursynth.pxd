@@ -223,6 +223,19 @@ cdef extern from "include/VapourSynth4.h" nogil:
         int64_t maxFramebufferSize
         int64_t usedFramebufferSize
 
+    struct VSCoreMemoryStats:
+        int64_t allocatedBytes
+        int64_t peakAllocatedBytes
+        int64_t freelistBytes
+        int64_t freelistBlocks
+        int64_t poolHits
+        int64_t poolMisses
+        int64_t smallAllocations
+        int64_t gcEvictions
+        int64_t gcEvictedBytes
+        int64_t trimmedBytes
+        int64_t sizeClasses[16]
+
     struct VSVideoInfo:
         VSVideoFormat format
         int64_t fpsNum
@@ -444,4 +457,11 @@ cdef extern from "include/VapourSynth4.h" nogil:
         const char *getNodeCreationPluginNS(VSNode *node, int level) nogil
         const VSMap *getNodeCreationFunctionArguments(VSNode *node, int level) nogil
 
+        # Added in API 4.3
+        void *allocScratch(size_t size, VSFrameContext *frameCtx) nogil
+        void freeScratch(void *ptr, VSFrameContext *frameCtx) nogil
+        void getCoreMemoryStats(VSCore *core, VSCoreMemoryStats *stats, int reset) nogil
+        int64_t trimCoreMemory(VSCore *core, int64_t retainBytes) nogil
+        void prewarmCoreMemory(VSNode *node, VSCore *core) nogil
+
     const VSAPI *getVapourSynthAPI(int version) nogil
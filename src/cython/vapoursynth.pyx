@@ -3108,6 +3108,38 @@ cdef class Core(object):
         self.funcs.getCoreInfo2(self.core, &v)
         return v.usedFramebufferSize
 
+    def get_memory_stats(self, bint reset=False):
+        self.ensure_valid()
+        cdef VSCoreMemoryStats s
+        self.funcs.getCoreMemoryStats(self.core, &s, reset)
+        large_allocations = s.poolHits + s.poolMisses
+        return {
+            'allocated': s.allocatedBytes,
+            'peak_allocated': s.peakAllocatedBytes,
+            'freelist': s.freelistBytes,
+            'freelist_blocks': s.freelistBlocks,
+            'pool_hits': s.poolHits,
+            'pool_misses': s.poolMisses,
+            'pool_hit_rate': s.poolHits / large_allocations if large_allocations else 0.0,
+            'small_allocations': s.smallAllocations,
+            'gc_evictions': s.gcEvictions,
+            'gc_evicted': s.gcEvictedBytes,
+            'trimmed': s.trimmedBytes,
+            'size_classes': [s.sizeClasses[i] for i in range(16)]
+        }
+
+    def trim_memory(self, int64_t retain=0):
+        self.ensure_valid()
+        cdef int64_t freed
+        with nogil:
+            freed = self.funcs.trimCoreMemory(self.core, retain)
+        return freed
+
+    def prewarm_memory(self, RawNode clip not None):
+        self.ensure_valid()
+        with nogil:
+            self.funcs.prewarmCoreMemory(clip.node, self.core)
+
     @property
     def flags(self):
         self.ensure_valid()
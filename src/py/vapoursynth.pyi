@@ -1211,6 +1211,12 @@ class Core:
     @property
     def used_cache_size(self) -> int: ...
 
+    def get_memory_stats(self, reset: bool = False) -> Dict[str, Any]: ...
+
+    def trim_memory(self, retain: int = 0) -> int: ...
+
+    def prewarm_memory(self, clip: RawNode) -> None: ...
+
     @property
     def flags(self) -> int: ...
 
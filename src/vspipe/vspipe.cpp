@@ -106,6 +106,8 @@ struct VSPipeOptions {
     bool printProgress = false;
     bool frameRefDebug = false;
     bool printFilterTime = false;
+    bool printMemoryStats = false;
+    bool prewarmMemory = false;
     std::filesystem::path scriptFilename;
     std::filesystem::path outputFilename;
     std::filesystem::path timecodesFilename;
@@ -617,6 +619,34 @@ static bool outputNode(const VSPipeOptions &opts, VSPipeOutputData *data, VSCore
     return data->outputError;
 }
 
+static std::string formatMemoryStats(const VSCoreMemoryStats &stats) {
+    auto twoDecimals = [](double v) {
+        char buffer[64];
+        snprintf(buffer, sizeof(buffer), "%.2f", v);
+        return std::string(buffer);
+    };
+    auto toMB = [&](int64_t bytes) { return twoDecimals(bytes / (1024. * 1024.)) + " MB"; };
+    int64_t largeAllocations = stats.poolHits + stats.poolMisses;
+
+    std::string s = "Memory statistics:\n";
+    s += "  Allocated: " + toMB(stats.allocatedBytes) + "\n";
+    s += "  Peak allocated: " + toMB(stats.peakAllocatedBytes) + "\n";
+    s += "  Freelist: " + toMB(stats.freelistBytes) + " in " + std::to_string(stats.freelistBlocks) + " blocks\n";
+    s += "  Pool hits: " + std::to_string(stats.poolHits) + ", misses: " + std::to_string(stats.poolMisses) + " (" + twoDecimals(largeAllocations ? 100. * stats.poolHits / largeAllocations : 0.) + "% hit rate)\n";
+    s += "  Small allocations: " + std::to_string(stats.smallAllocations) + "\n";
+    s += "  GC evictions: " + std::to_string(stats.gcEvictions) + " (" + toMB(stats.gcEvictedBytes) + ")\n";
+    s += "  Trimmed: " + toMB(stats.trimmedBytes) + "\n";
+    s += "  Allocation sizes:\n";
+    for (int i = 0; i < 16; i++) {
+        if (!stats.sizeClasses[i])
+            continue;
+        int64_t bound = INT64_C(64) << i;
+        std::string label = (i == 15) ? "> 1GB" : ("<= " + (bound >= 1024 ? std::to_string(bound / 1024) + "MB" : std::to_string(bound) + "kB"));
+        s += "    " + label + ": " + std::to_string(stats.sizeClasses[i]) + "\n";
+    }
+    return s;
+}
+
 static const char *colorFamilyToString(int colorFamily) {
     switch (colorFamily) {
     case cfGray: return "Gray";
@@ -667,6 +697,8 @@ static void printHelp() {
         "  -p, --progress                   Print progress to stderr\n"
         "      --filter-time                Print time spent in individual filters to stderr after processing\n"
         "      --filter-time-graph FILE     Write output node's filter graph in dot format with time information after processing\n"
+        "      --stats                      Print frame buffer allocator statistics to stderr after processing\n"
+        "      --prewarm                    Allocate the frame buffers the output is expected to need before processing starts\n"
         "  -i, --info                       Print all set output node info to <outfile> and exit\n"
         "  -g  --graph <simple/full>        Print output node's filter graph in dot format to <outfile> and exit\n"
         "      --frame-ref-debug            Print frame allocation debug information\n"
@@ -731,6 +763,10 @@ static int parseOptions(VSPipeOptions &opts, int argc, char **argv) {
             opts.frameRefDebug = true;
         } else if (argString == "--filter-time") {
             opts.printFilterTime = true;
+        } else if (argString == "--stats") {
+            opts.printMemoryStats = true;
+        } else if (argString == "--prewarm") {
+            opts.prewarmMemory = true;
         } else if (argString == "--filter-time-graph") {
             if (argc <= arg + 1) {
                 fprintf(stderr, "No filter time graph file specified\n");
@@ -1226,6 +1262,10 @@ int main(int argc, char **argv) {
         data->outFile = outFile;
         data->timecodesFile = timecodesFile;
         data->jsonFile = jsonFile;
+
+        // Only the main node, a second call would cancel it. The alpha clip usually shares most of its graph.
+        if (opts.prewarmMemory)
+            vsapi->prewarmCoreMemory(node, vssapi->getCore(se));
         
         if (nodeType == mtVideo) {
 
@@ -1282,6 +1322,11 @@ int main(int argc, char **argv) {
             std::string graph = printNodeGraph(NodePrintMode::FullWithTimes, node, elapsedSeconds.count(), vsapi);
             fprintf(filterTimeGraphFile, "%s", graph.c_str());
         }
+        if (opts.printMemoryStats) {
+            VSCoreMemoryStats stats;
+            vsapi->getCoreMemoryStats(core, &stats, 0);
+            fprintf(stderr, "%s", formatMemoryStats(stats).c_str());
+        }
     }
 
     if (outFile && closeOutFile)
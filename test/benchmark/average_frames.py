@@ -0,0 +1,59 @@
+# Measures the AverageFrames kernels at every CPU level. A single clip of distinct frames is
+# averaged over temporal windows of the sizes typically used for denoising, so every output
+# frame reads a full window of different source frames. Integer formats are also measured in
+# running sum mode, which should cost about the same for every window size. Frames are requested
+# in parallel like an encode would so the running sum is measured at the given number of threads.
+#
+# Usage: python average_frames.py [--threads N] [--frames N] [--width N] [--height N] [--windows N ...]
+
+import argparse
+import time
+
+import vapoursynth as vs
+
+
+def measure(name, clip, num_frames):
+    start = time.perf_counter()
+    for _ in clip[:num_frames].frames():
+        pass
+    elapsed = time.perf_counter() - start
+    print(f'{name:<40} {num_frames / elapsed:10.1f} fps {elapsed * 1e3 / num_frames:10.2f} ms/frame')
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('--threads', type=int, default=1)
+    parser.add_argument('--frames', type=int, default=100)
+    parser.add_argument('--width', type=int, default=1920)
+    parser.add_argument('--height', type=int, default=1080)
+    parser.add_argument('--windows', type=int, nargs='+', default=[7, 11, 15])
+    args = parser.parse_args()
+
+    core = vs.core
+    core.num_threads = args.threads
+
+    formats = [vs.YUV420P8, vs.YUV420P16, vs.YUV420PH, vs.YUV420PS]
+    levels = ['none', 'sse2', 'avx2', 'avx512']
+
+    print(f'{core.num_threads} threads, {args.frames} frames, {args.width}x{args.height}')
+    for fmt in formats:
+        fi = core.get_video_format(fmt)
+        peak = (1 << fi.bits_per_sample) - 1 if fi.sample_type == vs.INTEGER else 1.0
+        # BlankClip with keep=True returns the same frame every time, so building and
+        # caching the sources costs nothing next to the averaging itself
+        sources = [core.std.BlankClip(format=fmt, width=args.width, height=args.height, length=1, keep=True,
+                                      color=[peak * k / 32, peak / 2, peak / 2]) for k in range(32)]
+        clip = core.std.Splice(sources).std.Loop(args.frames // 32 + 2)
+        for window in args.windows:
+            for level in levels:
+                core.std.SetMaxCPU(level)
+                averaged = core.std.AverageFrames(clip, [1] * window)
+                measure(f'{fi.name} window {window} {level}', averaged, args.frames)
+            if fi.sample_type == vs.INTEGER:
+                averaged = core.std.AverageFrames(clip, [1] * window, running=True)
+                measure(f'{fi.name} window {window} running', averaged, args.frames)
+    core.std.SetMaxCPU('avx512')
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,70 @@
+# Measures the filters that have half precision kernels at every CPU level, next to the same
+# filters on 32-bit float and 16-bit integer clips. Half clips use half the memory of float
+# clips so they should be at least as fast wherever a kernel converts with F16C instead of
+# going through the scalar conversion helpers.
+#
+# Usage: python half.py [--threads N] [--frames N] [--width N] [--height N] [--filter NAME]
+
+import argparse
+import time
+
+import vapoursynth as vs
+
+
+def measure(name, clip, num_frames):
+    start = time.perf_counter()
+    for n in range(num_frames):
+        clip.get_frame(n)
+    elapsed = time.perf_counter() - start
+    print(f'{name:<50} {num_frames / elapsed:10.1f} fps {elapsed * 1e3 / num_frames:10.2f} ms/frame')
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('--threads', type=int, default=1)
+    parser.add_argument('--frames', type=int, default=100)
+    parser.add_argument('--width', type=int, default=1920)
+    parser.add_argument('--height', type=int, default=1080)
+    parser.add_argument('--filter', default=None)
+    args = parser.parse_args()
+
+    core = vs.core
+    core.num_threads = args.threads
+
+    filters = {
+        'Merge': lambda a, b: core.std.Merge(a, b, 0.3),
+        'MaskedMerge': lambda a, b: core.std.MaskedMerge(a, b, b),
+        'MakeDiff': lambda a, b: core.std.MakeDiff(a, b),
+        'MergeDiff': lambda a, b: core.std.MergeDiff(a, b),
+        'PreMultiply': lambda a, b: core.std.PreMultiply(a, b),
+        'PlaneStats': lambda a, b: core.std.PlaneStats(a, b),
+        'BoxBlur': lambda a, b: core.std.BoxBlur(a, hradius=3, vradius=3),
+        'AverageFrames': lambda a, b: core.std.AverageFrames(core.std.Interleave([a, b] * 4), [1] * 7),
+        'Convolution 3x3': lambda a, b: core.std.Convolution(a, [1, 2, 1, 2, 4, 2, 1, 2, 1]),
+        'Convolution 5x5': lambda a, b: core.std.Convolution(a, [1] * 25),
+        'Convolution hv 9': lambda a, b: core.std.Convolution(a, [1, 2, 3, 4, 5, 4, 3, 2, 1], mode='hv'),
+        'Convolution hv 15': lambda a, b: core.std.Convolution(a, [1] * 15, mode='hv'),
+        'Minimum': lambda a, b: core.std.Minimum(a),
+        'Median': lambda a, b: core.std.Median(a),
+        'Expr': lambda a, b: core.std.Expr([a, b], 'x y * 0.5 +'),
+    }
+    formats = [vs.GRAY16, vs.GRAYS, vs.GRAYH]
+    levels = ['none', 'sse2', 'avx2', 'avx512']
+
+    print(f'{core.num_threads} threads, {args.frames} frames, {args.width}x{args.height}')
+    for name, func in filters.items():
+        if args.filter and args.filter != name:
+            continue
+        for fmt in formats:
+            fi = core.get_video_format(fmt)
+            peak = (1 << fi.bits_per_sample) - 1 if fi.sample_type == vs.INTEGER else 1.0
+            a = core.std.BlankClip(format=fmt, width=args.width, height=args.height, length=args.frames, keep=True, color=peak / 3)
+            b = core.std.BlankClip(format=fmt, width=args.width, height=args.height, length=args.frames, keep=True, color=peak / 5)
+            for level in levels:
+                core.std.SetMaxCPU(level)
+                measure(f'{name} {fi.name} {level}', func(a, b), args.frames)
+    core.std.SetMaxCPU('auto')
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,59 @@
+# Measures the core overhead of requesting, processing and returning frames. Tiny clips are pushed
+# through long chains of trivial filters so the actual pixel processing is negligible and the
+# results are dominated by frame context, frame and plane allocation and scheduling.
+#
+# Usage: python request_overhead.py [--threads N] [--frames N] [--depth N]
+
+import argparse
+import collections
+import time
+
+import vapoursynth as vs
+
+
+def chain(clip, depth, func):
+    for _ in range(depth):
+        clip = func(clip)
+    return clip
+
+
+def measure(name, clip, num_frames, prefetch):
+    # requests are kept in flight manually instead of going through clip.frames() so the
+    # python side bookkeeping stays as small as possible
+    pending = collections.deque()
+    start = time.perf_counter()
+    for n in range(num_frames):
+        if len(pending) >= prefetch:
+            pending.popleft().result()
+        pending.append(clip.get_frame_async(n))
+    while pending:
+        pending.popleft().result()
+    elapsed = time.perf_counter() - start
+    print(f'{name:<40} {num_frames / elapsed:10.0f} fps {elapsed * 1e6 / num_frames:10.2f} us/frame')
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('--threads', type=int, default=0)
+    parser.add_argument('--frames', type=int, default=20000)
+    parser.add_argument('--depth', type=int, default=20)
+    args = parser.parse_args()
+
+    core = vs.core
+    if args.threads > 0:
+        core.num_threads = args.threads
+
+    video = core.std.BlankClip(format=vs.GRAY8, width=16, height=16, length=args.frames)
+    audio = core.std.BlankAudio(length=args.frames * 3072)
+
+    prefetch = core.num_threads * 2
+
+    print(f'{core.num_threads} threads, {args.frames} frames, chain depth {args.depth}')
+    measure('video new frame per filter', chain(video, args.depth, lambda c: c.std.Invert()), args.frames, prefetch)
+    measure('video shared planes per filter', chain(video, args.depth, lambda c: c.std.SetFrameProp('bench', intval=1)), args.frames, prefetch)
+    measure('video 3 requests per filter', chain(video, args.depth, lambda c: c.std.AverageFrames([1, 1, 1])), args.frames, prefetch)
+    measure('audio new frame per filter', chain(audio, args.depth, lambda c: c.std.AudioGain(0.5)), audio.num_frames, prefetch)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,46 @@
+# Measures std.Transpose at every CPU level. Large planes are included because the destination
+# rows of one source row are a whole plane height apart, which is what the column tiling of
+# the plane kernels is for.
+#
+# Usage: python transpose.py [--threads N] [--frames N]
+
+import argparse
+import time
+
+import vapoursynth as vs
+
+
+def measure(name, clip, num_frames):
+    start = time.perf_counter()
+    for n in range(num_frames):
+        clip.get_frame(n)
+    elapsed = time.perf_counter() - start
+    print(f'{name:<40} {num_frames / elapsed:10.1f} fps {elapsed * 1e3 / num_frames:10.2f} ms/frame')
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('--threads', type=int, default=1)
+    parser.add_argument('--frames', type=int, default=50)
+    args = parser.parse_args()
+
+    core = vs.core
+    core.num_threads = args.threads
+
+    formats = [vs.GRAY8, vs.GRAY16, vs.GRAYS]
+    sizes = [(1920, 1080), (3840, 2160), (7680, 4320)]
+    levels = ['none', 'sse2', 'avx2', 'avx512']
+
+    print(f'{core.num_threads} threads, {args.frames} frames')
+    for fmt in formats:
+        fi = core.get_video_format(fmt)
+        for width, height in sizes:
+            clip = core.std.BlankClip(format=fmt, width=width, height=height, length=args.frames, keep=True)
+            for level in levels:
+                core.std.SetMaxCPU(level)
+                measure(f'{fi.name} {width}x{height} {level}', core.std.Transpose(clip), args.frames)
+    core.std.SetMaxCPU('avx512')
+
+
+if __name__ == '__main__':
+    main()
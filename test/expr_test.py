@@ -1,4 +1,6 @@
 import math
+import os
+import tempfile
 import unittest
 
 import vapoursynth as vs
@@ -392,6 +394,202 @@ class CoreTestSequence(unittest.TestCase):
     def test_expr_cos65(self):
         self.helper_sincos("cos", lambda x: math.cos(x))
 
+    def helper_neighbour(self, fmt, expr, ref, cpu="auto"):
+        clip = self.core.std.BlankClip(format=fmt, width=37, height=9, length=1)
+
+        def init_frame(n, f):
+            fout = f.copy()
+            arr = fout[0]
+            M, N = arr.shape
+            for i in range(M):
+                for j in range(N):
+                    arr[i, j] = (i * 7 + j * 13) % 200
+            return fout
+
+        clip = self.core.std.ModifyFrame(clip, clip, init_frame)
+        self.core.std.SetMaxCPU(cpu)
+        try:
+            clip2 = self.core.std.Expr(clip, expr)
+        finally:
+            self.core.std.SetMaxCPU("auto")
+        arr1, arr2 = clip.get_frame(0)[0], clip2.get_frame(0)[0]
+        for i in range(clip.height):
+            for j in range(clip.width):
+                self.assertEqual(arr2[i, j], ref(arr1, i, j, clip.width, clip.height), "at %d,%d" % (j, i))
+
+    def test_expr_neighbour66(self):
+        def clamp(a, i, j, w, h):
+            return a[min(max(i + 1, 0), h - 1), min(max(j - 2, 0), w - 1)]
+
+        for fmt in (vs.GRAY8, vs.GRAY16, vs.GRAYS):
+            for cpu in ("none", "sse2", "avx2", "auto"):
+                self.helper_neighbour(fmt, "x[-2,1]", clamp, cpu)
+
+    def test_expr_neighbour67(self):
+        def mirror(p, n):
+            return -p - 1 if p < 0 else (2 * n - 1 - p if p >= n else p)
+
+        def sobel(a, i, j, w, h):
+            def px(dx, dy):
+                return a[mirror(i + dy, h), mirror(j + dx, w)]
+            gx = px(1, -1) + 2 * px(1, 0) + px(1, 1) - px(-1, -1) - 2 * px(-1, 0) - px(-1, 1)
+            return min(abs(gx), 255)
+
+        expr = "x[1,-1]:m x[1,0]:m 2 * + x[1,1]:m + x[-1,-1]:m - x[-1,0]:m 2 * - x[-1,1]:m - abs"
+        for cpu in ("none", "sse2", "avx2", "auto"):
+            self.helper_neighbour(vs.GRAY8, expr, sobel, cpu)
+
+    def test_expr_neighbour68(self):
+        clip = self.core.std.BlankClip(format=vs.GRAY8)
+        for expr in ("x[1]", "x[1,1", "x[1,1]:q", "x[200,0]", "q[0,1]"):
+            with self.assertRaises(vs.Error):
+                self.core.std.Expr(clip, expr)
+
+    def test_expr_coordinates69(self):
+        clip = self.core.std.BlankClip(format=vs.GRAYS, width=37, height=5, length=3)
+        for cpu in ("none", "sse2", "avx2", "auto"):
+            self.core.std.SetMaxCPU(cpu)
+            try:
+                clip2 = self.core.std.Expr(clip, "X Y 100 * + N 1000 * +")
+            finally:
+                self.core.std.SetMaxCPU("auto")
+            for n in range(clip.num_frames):
+                arr = clip2.get_frame(n)[0]
+                for i in range(clip.height):
+                    for j in range(clip.width):
+                        self.assertEqual(arr[i, j], j + i * 100 + n * 1000)
+
+    def test_expr_dimensions70(self):
+        clip = self.core.std.BlankClip(format=vs.YUV420P8, width=40, height=20)
+        clip = self.core.std.Expr(clip, "width height +")
+        frame = clip.get_frame(0)
+        self.assertEqual(frame[0][0, 0], 60)
+        self.assertEqual(frame[1][0, 0], 30)
+
+    def test_expr_props71(self):
+        clip1 = self.core.std.BlankClip(format=vs.GRAY8, length=2)
+        clip1 = self.core.std.SetFrameProps(clip1, Foo=7, Bar=2.0)
+        clip2 = self.core.std.BlankClip(format=vs.GRAY8, length=2)
+        clip2 = self.core.std.SetFrameProps(clip2, Foo=3)
+        for cpu in ("none", "auto"):
+            self.core.std.SetMaxCPU(cpu)
+            try:
+                clip = self.core.std.Expr((clip1, clip2), "x.Foo x.Bar * y.Foo + y.Missing +")
+            finally:
+                self.core.std.SetMaxCPU("auto")
+            self.assertEqual(get_pixel_value(clip), 17)
+
+        with self.assertRaises(vs.Error):
+            self.core.std.Expr(clip1, "y.Foo")
+
+    def test_expr_variables72(self):
+        clip1 = self.core.std.BlankClip(format=vs.GRAY8, color=10)
+        clip2 = self.core.std.BlankClip(format=vs.GRAY8, color=2)
+        clip = self.core.std.Expr((clip1, clip2), "x y - d! d@ d@ * x 2 * d@ - +")
+        self.assertEqual(get_pixel_value(clip), 76)
+
+    def test_expr_variables73(self):
+        clip = self.core.std.BlankClip(format=vs.GRAY8, color=10)
+        clip = self.core.std.Expr(clip, "x 1 + x! x@ x@ * x +")
+        self.assertEqual(get_pixel_value(clip), 131)
+
+        for expr in ("a@ 1 +", "a!", "1 a! a@ b@ +"):
+            with self.assertRaises(vs.Error):
+                self.core.std.Expr(clip, expr)
+
+    def test_expr_shared_code74(self):
+        clip = self.core.std.BlankClip(format=vs.GRAY16, color=1000)
+        first = self.core.std.Expr(clip, "x 3 * 7 +")
+        second = self.core.std.Expr(clip, "x 3 * 7 +")
+        self.assertEqual(get_pixel_value(first), 3007)
+        del first
+        self.assertEqual(get_pixel_value(second), 3007)
+
+    def test_expr_shared_code_single_compile75(self):
+        # Code is only written to the cache directory when it's compiled, so once the file of
+        # the first filter is removed a second filter sharing its code must not recreate it.
+        clip = self.core.std.BlankClip(format=vs.GRAY16, color=1000)
+        with tempfile.TemporaryDirectory() as cache_dir:
+            os.environ['VAPOURSYNTH_EXPR_CACHE_DIR'] = cache_dir
+            try:
+                first = self.core.std.Expr(clip, "x 5 * 11 +")
+                self.assertEqual(get_pixel_value(first), 5011)
+                files = os.listdir(cache_dir)
+                if not files:
+                    self.skipTest("no JIT code to share on this CPU")
+                self.assertEqual(len(files), 1)
+                os.remove(os.path.join(cache_dir, files[0]))
+                second = self.core.std.Expr(clip, "x 5 * 11 +")
+                self.assertEqual(get_pixel_value(second), 5011)
+                self.assertEqual(os.listdir(cache_dir), [])
+            finally:
+                del os.environ['VAPOURSYNTH_EXPR_CACHE_DIR']
+
+    def test_expr_integer76(self):
+        # These fit in int16 lanes, which uses integer code on AVX2. The results have
+        # to match the float code and the interpreter exactly, rounding included.
+        exprs = ["x y + 2 /", "x y - abs 2 * 128 +", "x y max 1 + 2 /", "x 128 > x y ?",
+                 "x 3 * y + 4 /", "x 0.75 * y 0.25 * +", "x y < x y = not and 9 *",
+                 "x[-1,0] x 2 * + x[1,0] + 4 /", "x 64 - 3 * 0 max", "x 100 - y 100 - * 64 /"]
+
+        def init_frame(n, f):
+            fout = f.copy()
+            arr = fout[0]
+            for i in range(fout.height):
+                for j in range(fout.width):
+                    arr[i, j] = (i * 97 + j * 61 + n * 13) % (1 << fout.format.bits_per_sample)
+            return fout
+
+        for fmt in (vs.GRAY8, vs.GRAY10):
+            clip = self.core.std.BlankClip(format=fmt, width=45, height=7, length=2)
+            clip = self.core.std.ModifyFrame(clip, clip, init_frame)
+            clips = (clip, clip[1] + clip[0])
+            for expr in exprs:
+                results = []
+                for cpu in ("none", "sse2", "avx2", "auto"):
+                    self.core.std.SetMaxCPU(cpu)
+                    try:
+                        out = self.core.std.Expr(clips, expr)
+                    finally:
+                        self.core.std.SetMaxCPU("auto")
+                    arr = out.get_frame(0)[0]
+                    results.append([arr[i, j] for i in range(out.height) for j in range(out.width)])
+                for r in results[1:]:
+                    self.assertEqual(results[0], r, expr)
+
+    def test_expr_multi77(self):
+        clipa = self.core.std.BlankClip(format=vs.YUV420P8, width=40, height=6, color=[90, 20, 200])
+        clipb = self.core.std.BlankClip(format=vs.YUV420P8, width=40, height=6, color=[60, 30, 100])
+        exprs = ["x y - abs", "x y + 2 /", "x y - abs 10 > 255 0 ?", "x[1,0] y max"]
+        outs = self.core.std.MultiExpr([clipa, clipb], exprs, format=[vs.YUV420P8, vs.YUV420P16])
+        self.assertEqual(len(outs), len(exprs))
+        for i, expr in enumerate(exprs):
+            ref = self.core.std.Expr([clipa, clipb], expr, format=vs.YUV420P8 if i == 0 else vs.YUV420P16)
+            self.assertEqual(outs[i].format.id, ref.format.id)
+            fout = outs[i].get_frame(0)
+            fref = ref.get_frame(0)
+            self.assertNotIn("MultiExprOutputs", fout.props)
+            for p in range(3):
+                self.assertEqual(bytes(fout[p]), bytes(fref[p]), expr)
+
+    def test_expr_stats78(self):
+        clipa = self.core.std.BlankClip(format=vs.YUV420P8, width=40, height=6, color=[90, 20, 200])
+        clipb = self.core.std.BlankClip(format=vs.YUV420P8, width=40, height=6, color=[60, 30, 100])
+        clipb = self.core.std.Expr([clipb], "X 8 < x x 20 + ?")
+        for expr in ("x y - abs", "x y -", "y x - 10 >"):
+            stats = self.core.std.ExprStats([clipa, clipb], expr, prop="ES")
+            ref = self.core.std.Expr([clipa, clipb], expr, format=vs.YUV420PS)
+            ref = self.core.std.PlaneStats(ref)
+            count = self.core.std.PlaneStats(self.core.std.Expr([clipa, clipb], expr + " 0 >", format=vs.YUV420PS))
+            props = stats.get_frame(0).props
+            rprops = ref.get_frame(0).props
+            self.assertEqual(props["ESMin"], rprops["PlaneStatsMin"], expr)
+            self.assertEqual(props["ESMax"], rprops["PlaneStatsMax"], expr)
+            self.assertAlmostEqual(props["ESAverage"], rprops["PlaneStatsAverage"], msg=expr)
+            self.assertAlmostEqual(props["ESSum"], rprops["PlaneStatsAverage"] * 40 * 6, msg=expr)
+            self.assertEqual(props["ESCount"], round(count.get_frame(0).props["PlaneStatsAverage"] * 40 * 6), expr)
+        self.assertEqual(bytes(stats.get_frame(0)[0]), bytes(clipa.get_frame(0)[0]))
+
 
 if __name__ == "__main__":
     unittest.main()
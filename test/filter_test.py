@@ -1,3 +1,4 @@
+import struct
 import unittest
 
 import vapoursynth as vs
@@ -29,6 +30,22 @@ class FilterTestSequence(unittest.TestCase):
         clip = self.BlankClip(format=vs.YUV444PS, color=[0, 0, 0], width=1156, height=752)
         self.Transpose(clip).get_frame(0)
 
+    def test_transpose_cpu(self):
+        # every block size has to give the same output, the sizes leave partial blocks and tiles
+        for fmt in (vs.GRAY8, vs.GRAY16, vs.GRAYS):
+            for width, height in ((1, 1), (67, 131), (1025, 77)):
+                clip = self.BlankClip(format=fmt, width=width, height=height)
+                clip = self.core.std.Expr(clip, 'X 37 * Y 11 * + sin 100 * 120 +')
+                results = []
+                for cpu in ('none', 'sse2', 'avx2', 'avx512'):
+                    self.core.std.SetMaxCPU(cpu)
+                    try:
+                        results.append(bytes(self.Transpose(clip).get_frame(0)[0]))
+                    finally:
+                        self.core.std.SetMaxCPU('auto')
+                for other in results[1:]:
+                    self.assertEqual(results[0], other)
+
     def test_makefulldiff1(self):
         clipa = self.BlankClip(format=vs.YUV420P8, color=[0, 255, 0], width=1156, height=752)
         clipb = self.BlankClip(format=vs.YUV420P8, color=[255, 0, 0], width=1156, height=752)
@@ -37,6 +54,259 @@ class FilterTestSequence(unittest.TestCase):
         self.assertEqual(get_pixel_value(newclipb, 0), get_pixel_value(clipa, 0))
         self.assertEqual(get_pixel_value(newclipb, 1), get_pixel_value(clipa, 1))
 
+    def test_separable_convolution(self):
+        # the separable kernels keep the intermediate line in scratch memory so the result
+        # has to match doing the two passes separately
+        matrix = [1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1]
+        for fmt in (vs.YUV420P8, vs.YUV420P16, vs.YUV420PS):
+            color = [0, 0.1, -0.1] if fmt == vs.YUV420PS else [0, 50, 100]
+            stripes = [self.BlankClip(format=fmt, width=24, height=384, length=4, color=[color[0] + i * (0.05 if fmt == vs.YUV420PS else 13), color[1], color[2]]) for i in range(16)]
+            clip = self.core.std.StackHorizontal(stripes)
+            clip = self.core.std.Expr([clip, self.Transpose(clip)], 'x 2 * y -' if fmt == vs.YUV420PS else 'x 2 * y - abs')
+            sep = self.core.std.Convolution(clip, matrix, mode='hv')
+            twopass = self.core.std.Convolution(self.core.std.Convolution(clip, matrix, mode='v'), matrix, mode='h')
+            for frame in self.core.std.PlaneStats(sep, twopass).frames():
+                self.assertEqual(frame.props['PlaneStatsDiff'], 0)
+
+    def test_fft_convolution(self):
+        # squares above 11x11 go through the FFT, compare with summing every window with mirrored
+        # edges. The FFT is computed in float so integer results may be off by one.
+        def mirror(pos, size):
+            pos = -pos - 1 if pos < 0 else 2 * size - 1 - pos if pos >= size else pos
+            return min(max(pos, 0), size - 1)
+
+        size = 13
+        matrix = [(i * 7) % 11 - 2 for i in range(size * size)]
+        for fmt, sample in ((vs.GRAY8, 'B'), (vs.GRAY16, 'H'), (vs.GRAYS, 'f'), (vs.GRAYH, 'e')):
+            peak = 1 if sample in 'fe' else (1 << self.core.get_video_format(fmt).bits_per_sample) - 1
+            clip = self.BlankClip(format=fmt, width=120, height=60)
+            clip = self.core.std.Expr(clip, f'X 0.37 * Y 1.7 * + sin X Y * 0.05 * cos * 0.5 * 0.5 + {peak} *')
+            frame = clip.get_frame(0)
+            width, height = frame.width, frame.height
+            src = struct.unpack(f'{width * height}{sample}', bytes(frame[0]))
+            ref = []
+            for y in range(height):
+                rows = [mirror(y + i, height) * width for i in range(-(size // 2), size // 2 + 1)]
+                for x in range(width):
+                    cols = [mirror(x + j, width) for j in range(-(size // 2), size // 2 + 1)]
+                    window = [src[row + col] for row in rows for col in cols]
+                    ref.append(sum(c * v for c, v in zip(matrix, window)) / sum(matrix))
+            for cpu in ('none', 'sse2', 'avx2'):
+                self.core.std.SetMaxCPU(cpu)
+                try:
+                    filtered = self.core.std.Convolution(clip, matrix)
+                finally:
+                    self.core.std.SetMaxCPU('auto')
+                result = struct.unpack(f'{width * height}{sample}', bytes(filtered.get_frame(0)[0]))
+                for value, expected in zip(result, ref):
+                    self.assertAlmostEqual(value, expected, delta=1 if sample in 'BH' else 1e-3)
+        with self.assertRaises(vs.Error):
+            self.core.std.Convolution(clip, [1] * 144)
+        with self.assertRaises(vs.Error):
+            self.core.std.Convolution(clip, [1] * 129 * 129)
+        # the mirrored borders only reach one plane size out, smaller planes have to be rejected
+        with self.assertRaises(vs.Error):
+            self.core.std.Convolution(self.BlankClip(format=vs.GRAY8, width=6, height=60), matrix)
+        with self.assertRaises(vs.Error):
+            self.core.std.Convolution(self.BlankClip(format=vs.YUV420P8, width=60, height=12), matrix)
+        clip = self.core.std.Expr(self.BlankClip(format=vs.GRAYS, width=7, height=8), 'X 0.37 * Y 1.7 * + sin')
+        src = struct.unpack('56f', bytes(clip.get_frame(0)[0]))
+        result = struct.unpack('56f', bytes(self.core.std.Convolution(clip, matrix).get_frame(0)[0]))
+        for y in range(8):
+            for x in range(7):
+                window = [src[mirror(y + i, 8) * 7 + mirror(x + j, 7)] for i in range(-(size // 2), size // 2 + 1) for j in range(-(size // 2), size // 2 + 1)]
+                self.assertAlmostEqual(result[y * 7 + x], sum(c * v for c, v in zip(matrix, window)) / sum(matrix), delta=1e-3)
+
+
+    def test_average_frames_cpu(self):
+        # the integer kernels have to be bit-exact with the C version at every cpu level
+        for fmt in (vs.YUV444P8, vs.YUV420P10, vs.YUV444P16):
+            peak = (1 << self.core.get_video_format(fmt).bits_per_sample) - 1
+            frames = [self.BlankClip(format=fmt, width=70, height=8, length=1, color=[peak * i // 16, peak * (16 - i) // 16, peak // 2]) for i in range(17)]
+            clip = self.core.std.Splice(frames)
+            clip = self.core.std.Expr([clip, self.Transpose(self.Transpose(clip))], f'x X 5 * Y 3 * + + {peak} min')
+            for weights in ([1] * 7, [3, -2, 5, 1023, 5, -2, 3], [1023, -1023] * 7 + [17]):
+                results = []
+                for cpu in ('none', 'sse2', 'avx2', 'avx512'):
+                    self.core.std.SetMaxCPU(cpu)
+                    try:
+                        results.append(self.core.std.AverageFrames(clip, weights))
+                    finally:
+                        self.core.std.SetMaxCPU('auto')
+                for other in results[1:]:
+                    for n in range(clip.num_frames):
+                        a, b = results[0].get_frame(n), other.get_frame(n)
+                        for plane in range(a.format.num_planes):
+                            self.assertEqual(bytes(a[plane]), bytes(b[plane]))
+
+    def test_average_frames_running(self):
+        # the running sum has to give the same output for linear access, skipped frames, seeks,
+        # scene changes and parallel requests, up to the most threads a window of 7 allows and one past it
+        clip = self.BlankClip(format=vs.YUV420P10, width=70, height=8, length=40)
+        clip = self.core.std.Expr(clip, 'X 0.37 * Y 1.7 * + N 7.919 * + sin 0.5 * 0.5 + 1023 *')
+        clip = self.core.std.Splice([clip[:20], clip[20].std.SetFrameProp('_SceneChangePrev', intval=1), clip[21:]])
+        num_threads = self.core.num_threads
+        try:
+            for threads in (1, 2, 3, 4):
+                self.core.num_threads = threads
+                for cpu in ('none', 'sse2', 'avx2'):
+                    self.core.std.SetMaxCPU(cpu)
+                    try:
+                        ref = self.core.std.AverageFrames(clip, [3] * 7, scenechange=True)
+                        running = self.core.std.AverageFrames(clip, [3] * 7, scenechange=True, running=True)
+                    finally:
+                        self.core.std.SetMaxCPU('auto')
+                    for n in list(range(clip.num_frames)) + [7, 8, 30, 31, 0, 1, 3, 6, 8, 9, 11, 12, 15]:
+                        a, b = ref.get_frame(n), running.get_frame(n)
+                        for plane in range(a.format.num_planes):
+                            self.assertEqual(bytes(a[plane]), bytes(b[plane]))
+                    running = self.core.std.AverageFrames(clip, [3] * 7, scenechange=True, running=True)
+                    for a, b in zip(ref.frames(), running.frames()):
+                        for plane in range(a.format.num_planes):
+                            self.assertEqual(bytes(a[plane]), bytes(b[plane]))
+        finally:
+            self.core.num_threads = num_threads
+        with self.assertRaises(vs.Error):
+            self.core.std.AverageFrames(clip, [1, 2, 1], running=True)
+
+    def test_box_blur_direct_vertical(self):
+        # the vertical pass runs over all columns at once, it has to match a horizontal blur
+        # of the transposed clip at every cpu level
+        for fmt in (vs.GRAY8, vs.GRAY16, vs.GRAYS):
+            peak = 1 if fmt == vs.GRAYS else (1 << self.core.get_video_format(fmt).bits_per_sample) - 1
+            clip = self.BlankClip(format=fmt, width=77, height=45)
+            clip = self.core.std.Expr(clip, f'X 0.37 * Y 1.7 * + sin X Y * 0.05 * cos * 0.5 * 0.5 + {peak} *')
+            for hradius, hpasses, vradius, vpasses in ((1, 1, 1, 1), (0, 0, 3, 2), (5, 2, 7, 3), (60, 1, 60, 1)):
+                ref = self.core.std.BoxBlur(clip, hradius=hradius, hpasses=hpasses, vradius=0) if hpasses else clip
+                ref = self.Transpose(self.core.std.BoxBlur(self.Transpose(ref), hradius=vradius, hpasses=vpasses, vradius=0))
+                for cpu in ('none', 'sse2', 'avx2'):
+                    self.core.std.SetMaxCPU(cpu)
+                    try:
+                        blurred = self.core.std.BoxBlur(clip, hradius=hradius, hpasses=hpasses, vradius=vradius, vpasses=vpasses)
+                    finally:
+                        self.core.std.SetMaxCPU('auto')
+                    self.assertEqual(bytes(blurred.get_frame(0)[0]), bytes(ref.get_frame(0)[0]))
+
+    def test_minimum_maximum_radius(self):
+        # a rectangle of radius r is r 3x3 passes over its horizontal and vertical neighbours
+        for fmt in (vs.GRAY8, vs.GRAY16, vs.GRAYS, vs.GRAYH):
+            peak = 1 if fmt in (vs.GRAYS, vs.GRAYH) else (1 << self.core.get_video_format(fmt).bits_per_sample) - 1
+            clip = self.BlankClip(format=fmt, width=77, height=45)
+            clip = self.core.std.Expr(clip, f'X 0.37 * Y 1.7 * + sin X Y * 0.05 * cos * 0.5 * 0.5 + {peak} *')
+            for func in (self.core.std.Minimum, self.core.std.Maximum):
+                for hradius, vradius in ((1, 1), (4, 0), (0, 3), (6, 9), (100, 100)):
+                    ref = clip
+                    for _ in range(min(hradius, 76)):
+                        ref = func(ref, coordinates=[0, 0, 0, 1, 1, 0, 0, 0])
+                    for _ in range(min(vradius, 44)):
+                        ref = func(ref, coordinates=[0, 1, 0, 0, 0, 0, 1, 0])
+                    for cpu in ('none', 'sse2', 'avx2'):
+                        self.core.std.SetMaxCPU(cpu)
+                        try:
+                            filtered = func(clip, radius=[hradius, vradius])
+                        finally:
+                            self.core.std.SetMaxCPU('auto')
+                        self.assertEqual(bytes(filtered.get_frame(0)[0]), bytes(ref.get_frame(0)[0]))
+        with self.assertRaises(vs.Error):
+            self.core.std.Minimum(clip, radius=[0, 0])
+        with self.assertRaises(vs.Error):
+            self.core.std.Minimum(clip, radius=3, coordinates=[1] * 8)
+
+    def test_minimum_maximum_radius_thin(self):
+        # on single row or column planes one of the radii is clamped to nothing, with both
+        # clamped the plane is only copied
+        for fmt, sample in ((vs.GRAY8, 'B'), (vs.GRAY16, 'H'), (vs.GRAYS, 'f')):
+            peak = 1 if sample == 'f' else (1 << self.core.get_video_format(fmt).bits_per_sample) - 1
+            for width, height in ((17, 1), (1, 13)):
+                clip = self.BlankClip(format=fmt, width=width, height=height)
+                clip = self.core.std.Expr(clip, f'X 0.37 * Y 1.7 * + sin 0.5 * 0.5 + {peak} *')
+                src = struct.unpack(f'{width * height}{sample}', bytes(clip.get_frame(0)[0]))
+                for func, reduce in ((self.core.std.Minimum, min), (self.core.std.Maximum, max)):
+                    for hradius, vradius in ((0, 5), (5, 0), (3, 3)):
+                        ref = [reduce(src[yy * width + xx] for yy in range(max(y - vradius, 0), min(y + vradius + 1, height))
+                                      for xx in range(max(x - hradius, 0), min(x + hradius + 1, width)))
+                               for y in range(height) for x in range(width)]
+                        for cpu in ('none', 'sse2', 'avx2'):
+                            self.core.std.SetMaxCPU(cpu)
+                            try:
+                                filtered = func(clip, radius=[hradius, vradius])
+                            finally:
+                                self.core.std.SetMaxCPU('auto')
+                            self.assertEqual(list(struct.unpack(f'{width * height}{sample}', bytes(filtered.get_frame(0)[0]))), ref)
+
+    def test_median_radius(self):
+        # compare with sorting every window, the edges are clamped
+        for fmt, sample in ((vs.GRAY8, 'B'), (vs.GRAY10, 'H'), (vs.GRAY16, 'H'), (vs.GRAYS, 'f'), (vs.GRAYH, 'e')):
+            peak = 1 if sample in 'fe' else (1 << self.core.get_video_format(fmt).bits_per_sample) - 1
+            clip = self.BlankClip(format=fmt, width=29, height=19)
+            clip = self.core.std.Expr(clip, f'X 0.37 * Y 1.7 * + sin X Y * 0.05 * cos * 0.5 * 0.5 + {peak} *')
+            frame = clip.get_frame(0)
+            width, height = frame.width, frame.height
+            src = struct.unpack(f'{width * height}{sample}', bytes(frame[0]))
+            for radius in (2, 3, 12):
+                ref = []
+                for y in range(height):
+                    for x in range(width):
+                        window = sorted(src[min(max(y + i, 0), height - 1) * width + min(max(x + j, 0), width - 1)] for i in range(-radius, radius + 1) for j in range(-radius, radius + 1))
+                        ref.append(window[len(window) // 2])
+                for cpu in ('none', 'sse2', 'avx2'):
+                    self.core.std.SetMaxCPU(cpu)
+                    try:
+                        filtered = self.core.std.Median(clip, radius=radius)
+                    finally:
+                        self.core.std.SetMaxCPU('auto')
+                    self.assertEqual(list(struct.unpack(f'{width * height}{sample}', bytes(filtered.get_frame(0)[0]))), ref)
+        with self.assertRaises(vs.Error):
+            self.core.std.Median(clip, radius=0)
+        with self.assertRaises(vs.Error):
+            self.core.std.Median(clip, radius=128)
+
+    def test_median_radius_float_ties(self):
+        # float medians step from the previous one, flat areas, repeated values and negative
+        # values have to give the same result as sorting every window
+        clip = self.BlankClip(format=vs.GRAYS, width=41, height=23)
+        clip = self.core.std.Expr(clip, 'X 13 > Y 9 > + X Y * 0.3 * sin 0.9 > - X 30 > X Y * 0.7 * sin 0 ? + 0.5 -')
+        frame = clip.get_frame(0)
+        width, height = frame.width, frame.height
+        src = struct.unpack(f'{width * height}f', bytes(frame[0]))
+        for radius in (3, 7, 30):
+            ref = []
+            for y in range(height):
+                for x in range(width):
+                    window = sorted(src[min(max(y + i, 0), height - 1) * width + min(max(x + j, 0), width - 1)] for i in range(-radius, radius + 1) for j in range(-radius, radius + 1))
+                    ref.append(window[len(window) // 2])
+            filtered = self.core.std.Median(clip, radius=radius)
+            self.assertEqual(list(struct.unpack(f'{width * height}f', bytes(filtered.get_frame(0)[0]))), ref)
+
+    def test_half_convolution_median(self):
+        # the half kernels convert with F16C and accumulate in float, they have to stay within
+        # rounding of the scalar path, the median only selects values so it has to match exactly
+        clip = self.BlankClip(format=vs.GRAYH, width=77, height=45)
+        clip = self.core.std.Expr(clip, 'X 0.37 * Y 1.7 * + sin X Y * 0.05 * cos * 0.5 * 0.5 +')
+        size = 77 * 45
+        cases = [([1] * 25, 's'), ([(i * 7) % 5 + 1 for i in range(49)], 's'), ([1] * 121, 's'),
+                 ([1, 2, 3, 4, 5, 4, 3, 2, 1], 'h'), ([1] * 15, 'v'), ([1, 2, 3, 4, 5, 4, 3, 2, 1], 'hv'), (list(range(1, 26)), 'hv')]
+        for matrix, mode in cases:
+            results = []
+            for cpu in ('none', 'avx2', 'avx512'):
+                self.core.std.SetMaxCPU(cpu)
+                try:
+                    results.append(struct.unpack(f'{size}e', bytes(self.core.std.Convolution(clip, matrix, mode=mode).get_frame(0)[0])))
+                finally:
+                    self.core.std.SetMaxCPU('auto')
+            for other in results[1:]:
+                for a, b in zip(results[0], other):
+                    self.assertAlmostEqual(a, b, delta=1e-3)
+        results = []
+        for cpu in ('none', 'avx2', 'avx512'):
+            self.core.std.SetMaxCPU(cpu)
+            try:
+                results.append(bytes(self.core.std.Median(clip).get_frame(0)[0]))
+            finally:
+                self.core.std.SetMaxCPU('auto')
+        for other in results[1:]:
+            self.assertEqual(results[0], other)
+
 
 if __name__ == "__main__":
     unittest.main()
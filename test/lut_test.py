@@ -67,6 +67,62 @@ class FilterTestSequence(unittest.TestCase):
         ret = self.Lut2(clipa=clipx, clipb=clipy, planes=[0, 1, 2], function=lambda x, y: x, bits=10)
         self.checkDifference(clipx, ret)
 
+    def testLUT2_cpu(self):
+        # The gather kernels have to match the scalar path for every input and output type,
+        # the width leaves a partial vector.
+        def pattern(fmt, peak):
+            clip = self.BlankClip(format=fmt, width=77, height=9)
+            return self.core.std.Expr(clip, f'X 0.37 * Y 1.7 * + sin 0.5 * 0.5 + {peak} *')
+
+        for fmtx, fmty in ((vs.GRAY8, vs.GRAY8), (vs.GRAY10, vs.GRAY10), (vs.GRAY10, vs.GRAY8), (vs.GRAY8, vs.GRAY10)):
+            bitsx = self.core.get_video_format(fmtx).bits_per_sample
+            bitsy = self.core.get_video_format(fmty).bits_per_sample
+            clipx, clipy = pattern(fmtx, (1 << bitsx) - 1), pattern(fmty, (1 << bitsy) - 1)
+            size = 1 << (bitsx + bitsy)
+            for args in ({'lut': [i * 2654435761 % 251 for i in range(size)], 'bits': 8},
+                         {'lut': [i * 2654435761 % 65521 for i in range(size)], 'bits': 16},
+                         {'lutf': [i * 0.25 - 7 for i in range(size)], 'floatout': True}):
+                results = []
+                for cpu in ('none', 'avx2', 'avx512'):
+                    self.core.std.SetMaxCPU(cpu)
+                    try:
+                        results.append(bytes(self.Lut2(clipx, clipy, **args).get_frame(0)[0]))
+                    finally:
+                        self.core.std.SetMaxCPU('auto')
+                for other in results[1:]:
+                    self.assertEqual(results[0], other)
+
+    def testLUT_expr(self):
+        # Tables built from an expression have to match the ones built by calling a function.
+        clip8 = self.core.std.Expr(self.BlankClip(format=vs.GRAY8, width=256, height=4), 'X')
+        clip10 = self.core.std.Expr(self.BlankClip(format=vs.GRAY10, width=256, height=4), 'X Y 256 * +')
+
+        def check(a, b):
+            self.assertEqual(bytes(a.get_frame(0)[0]), bytes(b.get_frame(0)[0]))
+
+        for cpu in ('none', 'avx2'):
+            self.core.std.SetMaxCPU(cpu)
+            try:
+                ret = self.Lut(clip10, expr='1023 x -')
+                check(ret, self.Lut(clip10, function=lambda x: 1023 - x))
+                ret = self.Lut(clip8, expr='x 2 *', bits=16)
+                check(ret, self.Lut(clip8, function=lambda x: x * 2, bits=16))
+                ret = self.Lut(clip8, expr='x 0.25 *', floatout=True)
+                check(ret, self.Lut(clip8, function=lambda x: x * 0.25, floatout=True))
+                ret = self.Lut2(clip8, clip10, expr='x y - abs', bits=10)
+                check(ret, self.Lut2(clip8, clip10, function=lambda x, y: abs(x - y), bits=10))
+                ret = self.Lut2(clip10, clip8, expr='x y max')
+                check(ret, self.Lut2(clip10, clip8, function=lambda x, y: max(x, y)))
+            finally:
+                self.core.std.SetMaxCPU('auto')
+
+        with self.assertRaises(vs.Error):
+            self.Lut(clip8, expr='X')
+        with self.assertRaises(vs.Error):
+            self.Lut(clip8, expr='x[1,0]')
+        with self.assertRaises(vs.Error):
+            self.Lut(clip8, expr='x', function=lambda x: x)
+
 
 if __name__ == "__main__":
     unittest.main()
@@ -1,3 +1,4 @@
+import time
 import unittest
 
 import vapoursynth as vs
@@ -28,6 +29,66 @@ class CoreTestSequence(unittest.TestCase):
         self.assertEqual(frame.height, 100)
         self.assertFalse(frame.readonly)
 
+    def test_memory_stats(self):
+        self.core.get_memory_stats(reset=True)
+        clip = self.core.std.BlankClip(format=vs.YUV420P8, width=1920, height=1080, length=20)
+        for frame in self.core.std.Invert(clip).frames():
+            pass
+        stats = self.core.get_memory_stats()
+        self.assertGreaterEqual(stats['peak_allocated'], stats['allocated'])
+        self.assertGreater(stats['pool_hits'] + stats['pool_misses'], 0)
+        self.assertEqual(sum(stats['size_classes']), stats['pool_hits'] + stats['pool_misses'] + stats['small_allocations'])
+        self.core.get_memory_stats(reset=True)
+        self.assertEqual(self.core.get_memory_stats()['pool_hits'], 0)
+
+    def test_trim_memory(self):
+        clip = self.core.std.BlankClip(format=vs.YUV420P8, width=1920, height=1080, length=20)
+        for frame in self.core.std.Invert(clip).frames():
+            pass
+        del frame
+        # idle trimming, decay and the worker threads releasing their last frames run in the
+        # background, so the freed amount isn't exact and the freelist can refill for a moment
+        deadline = time.monotonic() + 10
+        while True:
+            self.assertGreaterEqual(self.core.trim_memory(), 0)
+            freelist = self.core.get_memory_stats()['freelist']
+            if freelist == 0 or time.monotonic() > deadline:
+                break
+            time.sleep(0.01)
+        self.assertEqual(freelist, 0)
+
+    def test_prewarm_memory(self):
+        clip = self.core.std.Invert(self.core.std.BlankClip(format=vs.YUV420P8, width=1920, height=1080, length=20))
+        self.core.trim_memory()
+        self.core.prewarm_memory(clip)
+        # one luma buffer per thread for each of the two nodes
+        deadline = time.monotonic() + 10
+        while self.core.get_memory_stats()['freelist_blocks'] < 20 and time.monotonic() < deadline:
+            time.sleep(0.01)
+        self.assertGreaterEqual(self.core.get_memory_stats()['freelist_blocks'], 20)
+        self.core.get_memory_stats(reset=True)
+        clip.get_frame(0)
+        stats = self.core.get_memory_stats()
+        self.assertGreater(stats['pool_hits'], 0)
+        self.assertEqual(stats['pool_misses'], 0)
+
+    def test_prewarm_memory_idle(self):
+        # prewarmed buffers have to survive the idle trim until they have been used
+        clip = self.core.std.Invert(self.core.std.BlankClip(format=vs.YUV420P8, width=1920, height=1080, length=20))
+        self.core.trim_memory()
+        self.core.prewarm_memory(clip)
+        deadline = time.monotonic() + 10
+        while self.core.get_memory_stats()['freelist_blocks'] < 20 and time.monotonic() < deadline:
+            time.sleep(0.01)
+        # small frames don't go through the pool, the request only makes the threads go idle
+        self.core.std.BlankClip(width=16, height=16, length=1).get_frame(0)
+        self.core.get_memory_stats(reset=True)
+        time.sleep(4)
+        # buffers released by earlier tests may still be trimmed, the prewarmed ones must not be
+        stats = self.core.get_memory_stats()
+        self.assertGreaterEqual(stats['freelist_blocks'], 20)
+        self.assertGreaterEqual(stats['freelist'] - stats['trimmed'], 20 * 1920 * 1080)
+
     ### Clip-Attr tests
 
     def test_frames_generator(self):